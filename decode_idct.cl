@@ -29,10 +29,28 @@ struct ComponentInfo
 struct DecodeInfo
 {
    unsigned int componets_mcu_width;
+   unsigned int MCUs_per_row;
    JSAMPLE  sample_range_limit[(5 * (MAXJSAMPLE+1) + CENTERJSAMPLE)]; 
    struct ComponentInfo component_infos[MAX_COMPONENT_INFO_COUNT]; 
 };
 
+// Per-image descriptors of a batched decode (see jdbatch.c).  All images of
+// a batch share one geometry; only the sample offsets and the dequantization
+// tables differ between them.
+struct BatchComponentInfo
+{
+    unsigned int block_offset;
+    unsigned int width_in_blocks;
+    unsigned int height_in_blocks;
+    unsigned int plane_offset;
+    FLOAT_MULT_TYPE dct_table[DCTSIZE2];
+};
+
+struct BatchImageInfo
+{
+    struct BatchComponentInfo component_infos[MAX_COMPONENT_INFO_COUNT];
+};
+
 #define IDCT_range_limit(cinfo)  ((cinfo)->sample_range_limit + CENTERJSAMPLE + (MAXJSAMPLE+1))
 #define DEQUANTIZE(coef,quantval)  (((FAST_FLOAT) (coef)) * (quantval))
 #define CONST_BITS  13
@@ -186,7 +204,7 @@ struct DecodeInfo
 // 
 //   wsptr = workspace;
 //   for (ctr = 0; ctr < DCTSIZE; ctr++) {
-//     outptr = output_buf + ctr * compptr->row_buffer_size + output_col;
+//     outptr = output_buf + ctr * row_pitch + output_col;
 //     /* Rows of zeroes can be exploited in the same way as we did with columns.
 //      * However, the column calculation has created many nonzero AC terms, so
 //      * the simplification applies less often (typically 5% to 10% of the time).
@@ -299,8 +317,9 @@ struct DecodeInfo
 
 
 
-void inverse_DCT(__global struct DecodeInfo * cinfo,
-                __global struct ComponentInfo * compptr,
+void inverse_DCT_block(__global JSAMPLE * range_limit,
+                __global FLOAT_MULT_TYPE * dct_table,
+                unsigned int row_pitch,
                 __global JCOEF * coef_block,
                 __global JSAMPLE * output_buf,
                 JDIMENSION output_col)
@@ -312,14 +331,13 @@ void inverse_DCT(__global struct DecodeInfo * cinfo,
   __global FLOAT_MULT_TYPE * quantptr;
   __local FAST_FLOAT * wsptr;
   __global JSAMPLE * outptr;
-  __global JSAMPLE *range_limit = IDCT_range_limit(cinfo);
   int ctr;
   __local FAST_FLOAT workspace[DCTSIZE2]; /* buffers data between passes */
 
   /* Pass 1: process columns from input, store into work array. */
 
   inptr = coef_block;
-  quantptr = (__global FLOAT_MULT_TYPE *) compptr->dct_table;
+  quantptr = dct_table;
   wsptr = workspace;
   ctr = get_local_id(2);
   inptr += ctr;
@@ -412,7 +430,7 @@ void inverse_DCT(__global struct DecodeInfo * cinfo,
   wsptr = workspace;
   wsptr +=  DCTSIZE * ctr;
    {
-    outptr = output_buf + ctr * compptr->row_buffer_size + output_col;
+    outptr = output_buf + ctr * row_pitch + output_col;
     /* Rows of zeroes can be exploited in the same way as we did with columns.
      * However, the column calculation has created many nonzero AC terms, so
      * the simplification applies less often (typically 5% to 10% of the time).
@@ -472,6 +490,18 @@ void inverse_DCT(__global struct DecodeInfo * cinfo,
   }
 }
 
+void inverse_DCT(__global struct DecodeInfo * cinfo,
+                __global struct ComponentInfo * compptr,
+                __global JCOEF * coef_block,
+                __global JSAMPLE * output_buf,
+                JDIMENSION output_col)
+{
+    inverse_DCT_block(IDCT_range_limit(cinfo),
+            compptr->dct_table,
+            compptr->row_buffer_size,
+            coef_block,output_buf,output_col);
+}
+
 __kernel void idct(__global struct DecodeInfo * cinfo,
                __global JBLOCK * decoded_mcu_base,
                __global JSAMPLE *  output)
@@ -488,7 +518,8 @@ __kernel void idct(__global struct DecodeInfo * cinfo,
    yheightoffset = get_global_id(0);
    MCU_col_num = get_global_id(1);
    ci = get_group_id(2);
-   MCUs_per_row = get_global_size(1);
+   // not get_global_size(1): a region of interest runs a sub-range
+   MCUs_per_row = cinfo->MCUs_per_row;
    last_MCU_col = MCUs_per_row - 1;
 
    cur_row = output;
@@ -513,3 +544,40 @@ __kernel void idct(__global struct DecodeInfo * cinfo,
    }
 }
 
+// One launch for every block of every image in a batch.
+// global: (block rows, block columns, planes * DCTSIZE), local: (1,1,DCTSIZE)
+// where plane = image * num_components + component.  Offsets in the
+// descriptors are relative to their image; images are block_stride blocks
+// and sample_stride samples apart.
+__kernel void idct_batch(__global JSAMPLE * sample_range_limit,
+               __global struct BatchImageInfo * images,
+               __global JBLOCK * blocks,
+               __global JSAMPLE * output,
+               unsigned int num_components,
+               unsigned int block_stride,
+               unsigned int sample_stride)
+{
+   __global struct BatchComponentInfo * compptr;
+   unsigned int block_row = get_global_id(0);
+   unsigned int block_col = get_global_id(1);
+   unsigned int plane = get_group_id(2);
+   unsigned int image = plane / num_components;
+   unsigned int row_pitch;
+
+   compptr = &images[image].component_infos[plane % num_components];
+   // subsampled planes have fewer blocks than the launch grid; the whole
+   // work-group takes this exit together, so the barrier below stays uniform
+   if(block_row >= compptr->height_in_blocks || block_col >= compptr->width_in_blocks)
+   {
+       return;
+   }
+   row_pitch = compptr->width_in_blocks * DCTSIZE;
+   inverse_DCT_block(sample_range_limit + CENTERJSAMPLE + (MAXJSAMPLE+1),
+           compptr->dct_table,
+           row_pitch,
+           (__global JCOEF *) (blocks + image * block_stride + compptr->block_offset
+               + block_row * compptr->width_in_blocks + block_col),
+           output + image * sample_stride + compptr->plane_offset
+               + block_row * DCTSIZE * row_pitch,
+           block_col * DCTSIZE);
+}
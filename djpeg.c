@@ -27,6 +27,8 @@
 #include "jversion.h"		/* for version message */
 #include "ReadFile.h"
 #include <ctype.h>		/* to declare isprint() */
+#include <fcntl.h>		/* to declare open() */
+#include <unistd.h>		/* to declare close() */
 
 #ifdef USE_CCOMMAND		/* command-line reader for Macintosh */
 #ifdef __MWERKS__
@@ -84,6 +86,7 @@ static IMAGE_FORMATS requested_fmt;
 
 static const char * progname;	/* program name for error messages */
 static char * outfilename;	/* for -outfile switch */
+static boolean print_stats;	/* for -stats switch */
 
 
     LOCAL(void)
@@ -151,8 +154,10 @@ usage (void)
 #ifdef QUANT_1PASS_SUPPORTED
     fprintf(stderr, "  -onepass       Use 1-pass quantization (fast, low quality)\n");
 #endif
+    fprintf(stderr, "  -cpu           Decode on the CPU even if an OpenCL device exists\n");
     fprintf(stderr, "  -maxmemory N   Maximum memory to use (in kbytes)\n");
     fprintf(stderr, "  -outfile name  Specify name for output file\n");
+    fprintf(stderr, "  -stats         Print time spent in each decoding stage\n");
     fprintf(stderr, "  -verbose  or  -debug   Emit debug output\n");
     exit(EXIT_FAILURE);
 }
@@ -176,6 +181,7 @@ parse_switches (j_decompress_ptr cinfo, int argc, char **argv,
     /* Set up default JPEG parameters. */
     requested_fmt = DEFAULT_FMT;	/* set default output file format */
     outfilename = NULL;
+    print_stats = FALSE;
     cinfo->err->trace_level = 0;
 
     /* Scan command line options, adjust parameters */
@@ -208,6 +214,10 @@ parse_switches (j_decompress_ptr cinfo, int argc, char **argv,
             cinfo->desired_number_of_colors = val;
             cinfo->quantize_colors = TRUE;
 
+        } else if (keymatch(arg, "cpu", 2)) {
+            /* Use the CPU pipeline, as when no OpenCL device is found. */
+            cinfo->cl_disable = TRUE;
+
         } else if (keymatch(arg, "dct", 2)) {
             /* Select IDCT algorithm. */
             if (++argn >= argc)	/* advance to next argument */
@@ -330,6 +340,11 @@ parse_switches (j_decompress_ptr cinfo, int argc, char **argv,
                         &cinfo->scale_num, &cinfo->scale_denom) != 2)
                 usage();
 
+        } else if (keymatch(arg, "stats", 2)) {
+            /* Time the decoding stages, using OpenCL event profiling. */
+            print_stats = TRUE;
+            cinfo->cl_profiling = TRUE;
+
         } else if (keymatch(arg, "targa", 1)) {
             /* Targa output format. */
             requested_fmt = FMT_TARGA;
@@ -416,6 +431,35 @@ print_text_marker (j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Print the per-stage breakdown collected by the library for -stats.
+ * Device columns stay zero for stages that run on the host only.
+ */
+
+    LOCAL(void)
+print_stage_stats (j_decompress_ptr cinfo)
+{
+    static const char * const stage_names[JSTAGE_COUNT] = {
+        "entropy", "upload", "idct", "upsample", "color", "readback"
+    };
+    jpeg_stage_stats * stats;
+    double host_total = 0.0;
+    int stage;
+
+    fprintf(stderr, "%-10s %10s %10s %10s %10s %6s\n", "stage",
+            "host ms", "queued ms", "submit ms", "device ms", "cmds");
+    for (stage = 0; stage < JSTAGE_COUNT; stage++) {
+        stats = &cinfo->cl_stats.stage[stage];
+        host_total += stats->host_seconds;
+        fprintf(stderr, "%-10s %10.3f %10.3f %10.3f %10.3f %6ld\n",
+                stage_names[stage], stats->host_seconds * 1000.0,
+                stats->queued_seconds * 1000.0, stats->submit_seconds * 1000.0,
+                stats->device_seconds * 1000.0, stats->commands);
+    }
+    fprintf(stderr, "%-10s %10.3f\n", "total", host_total * 1000.0);
+}
+
+
 /*
  * The main program.
  */
@@ -433,8 +477,13 @@ main (int argc, char **argv)
     FILE * input_file;
     FILE * output_file;
     JDIMENSION num_scanlines;
-    void * sMem;
+    JDIMENSION row, row_stride;
+    JSAMPARRAY image_rows;
+    int i;
+    void * sMem = NULL;
     int sSize;
+    int input_fd;
+    boolean mapped = FALSE;
 
     /* On Mac, fetch a command line. */
 #ifdef USE_CCOMMAND
@@ -508,10 +557,18 @@ main (int argc, char **argv)
         //   exit(EXIT_FAILURE);
         // }
 
-        sSize = read_all_bytes (argv[file_index] ,&sMem);
-        if(!sSize)
-        {
-            exit(EXIT_FAILURE);
+        // Map the file where we can, so the decoder reads the compressed
+        // bytes in place; otherwise read it all into memory.
+        if ((input_fd = open(argv[file_index], O_RDONLY)) >= 0) {
+            mapped = jpeg_mmap_src(&cinfo, input_fd);
+            close(input_fd);
+        }
+        if (!mapped) {
+            sSize = read_all_bytes (argv[file_index] ,&sMem);
+            if(!sSize)
+            {
+                exit(EXIT_FAILURE);
+            }
         }
     } else {
         /* default input file is stdin */
@@ -536,7 +593,8 @@ main (int argc, char **argv)
 
     /* Specify data source for decompression */
     //jpeg_stdio_src(&cinfo, input_file);
-    jpeg_mem_src(&cinfo,sMem,sSize);
+    if (!mapped)
+        jpeg_mem_src(&cinfo,sMem,sSize);
     /* Read file header, set default decompression parameters */
     (void) jpeg_read_header(&cinfo, TRUE);
 
@@ -588,10 +646,34 @@ main (int argc, char **argv)
     /* Write output file header */
     (*dest_mgr->start_output) (&cinfo, dest_mgr);
 
-    /* Process data */
+    /* Process data.  The decoder emits the whole image in one
+     * jpeg_read_scanlines call, so it is read into a whole-image buffer
+     * (as jpegbench.c does) and then handed to the output module
+     * buffer_height rows at a time.
+     */
+    row_stride = cinfo.output_width * cinfo.output_components;
+    image_rows = (JSAMPARRAY) (*cinfo.mem->alloc_small)
+        ((j_common_ptr) &cinfo, JPOOL_IMAGE,
+         cinfo.output_height * SIZEOF(JSAMPROW));
+    image_rows[0] = (JSAMPROW) (*cinfo.mem->alloc_large)
+        ((j_common_ptr) &cinfo, JPOOL_IMAGE,
+         (size_t) row_stride * cinfo.output_height * SIZEOF(JSAMPLE));
+    for (row = 1; row < cinfo.output_height; row++)
+        image_rows[row] = image_rows[row - 1] + row_stride;
     while (cinfo.output_scanline < cinfo.output_height) {
-        num_scanlines = jpeg_read_scanlines(&cinfo, dest_mgr->buffer,
-                dest_mgr->buffer_height);
+        if (jpeg_read_scanlines(&cinfo, image_rows + cinfo.output_scanline,
+                cinfo.output_height - cinfo.output_scanline) == 0) {
+            fprintf(stderr, "%s: premature end of data\n", progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (row = 0; row < cinfo.output_height; row += num_scanlines) {
+        num_scanlines = cinfo.output_height - row;
+        if (num_scanlines > dest_mgr->buffer_height)
+            num_scanlines = dest_mgr->buffer_height;
+        for (i = 0; i < (int) num_scanlines; i++)
+            MEMCOPY(dest_mgr->buffer[i], image_rows[row + i],
+                    row_stride * SIZEOF(JSAMPLE));
         (*dest_mgr->put_pixel_rows) (&cinfo, dest_mgr, num_scanlines);
     }
 
@@ -608,12 +690,16 @@ main (int argc, char **argv)
      */
     (*dest_mgr->finish_output) (&cinfo, dest_mgr);
     (void) jpeg_finish_decompress(&cinfo);
+    if (print_stats)
+        print_stage_stats(&cinfo);
+    jpeg_mmap_src_close(&cinfo);
     jpeg_destroy_decompress(&cinfo);
 
     /* Close files, if we opened them */
 //    if (input_file != stdin)
 //        fclose(input_file);
-    free_all_bytes(sMem);
+    if (!mapped)
+        free_all_bytes(sMem);
     if (output_file != stdout)
         fclose(output_file);
 
@@ -0,0 +1,44 @@
+typedef unsigned char JSAMPLE;
+#define GETJSAMPLE(value)  ((int) (value) & 0xFF)
+
+// Downsampling of one component plane for the compressor.  Global
+// (rows, cols) is the component's size in whole DCT blocks.  Every output
+// sample averages an h_expand x v_expand box of the input plane, with the
+// rounding of jcsample.c: alternating biases 0,1 for h2v1 and 1,2 for
+// h2v2, and half the box size (int_downsample) otherwise.  Output rows
+// from last_row on repeat last_row, as the preprocessor pads the bottom
+// of the last iMCU row after downsampling.
+__kernel
+void downsample(
+                __global JSAMPLE * input_buf,
+                unsigned int in_offset,
+                unsigned int in_pitch,
+                unsigned int h_expand,
+                unsigned int v_expand,
+                unsigned int last_row,
+                __global JSAMPLE * output_buf,
+                unsigned int out_offset)
+{
+  __global JSAMPLE * inptr;
+  int yoffset = get_global_id(0);
+  int col = get_global_id(1);
+  int width = get_global_size(1);
+  int row = min(yoffset,(int) last_row);
+  int outvalue, bias, h, v;
+
+  inptr = input_buf + in_offset + row * v_expand * in_pitch + col * h_expand;
+  outvalue = 0;
+  for (v = 0; v < v_expand; v++) {
+    for (h = 0; h < h_expand; h++)
+      outvalue += GETJSAMPLE(inptr[h]);
+    inptr += in_pitch;
+  }
+  if (h_expand == 2 && v_expand == 1)
+    bias = col & 1;
+  else if (h_expand == 2 && v_expand == 2)
+    bias = 1 + (col & 1);
+  else
+    bias = (h_expand * v_expand) / 2;
+  output_buf[out_offset + yoffset * width + col] =
+    (JSAMPLE) ((outvalue + bias) / (h_expand * v_expand));
+}
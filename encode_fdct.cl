@@ -0,0 +1,139 @@
+#define DCTSIZE2 64
+#define DCTSIZE 8
+#define CENTERJSAMPLE	128
+typedef unsigned char JSAMPLE;
+typedef short JCOEF;
+typedef int INT32;
+typedef int DCTELEM;
+#define GETJSAMPLE(value)  ((int) (value) & 0xFF)
+#define CONST_BITS  13
+#define PASS1_BITS  2
+#define FIX_0_298631336  ((INT32)  2446)	/* FIX(0.298631336) */
+#define FIX_0_390180644  ((INT32)  3196)	/* FIX(0.390180644) */
+#define FIX_0_541196100  ((INT32)  4433)	/* FIX(0.541196100) */
+#define FIX_0_765366865  ((INT32)  6270)	/* FIX(0.765366865) */
+#define FIX_0_899976223  ((INT32)  7373)	/* FIX(0.899976223) */
+#define FIX_1_175875602  ((INT32)  9633)	/* FIX(1.175875602) */
+#define FIX_1_501321110  ((INT32)  12299)	/* FIX(1.501321110) */
+#define FIX_1_847759065  ((INT32)  15137)	/* FIX(1.847759065) */
+#define FIX_1_961570560  ((INT32)  16069)	/* FIX(1.961570560) */
+#define FIX_2_053119869  ((INT32)  16819)	/* FIX(2.053119869) */
+#define FIX_2_562915447  ((INT32)  20995)	/* FIX(2.562915447) */
+#define FIX_3_072711026  ((INT32)  25172)	/* FIX(3.072711026) */
+#define MULTIPLY(var,const)  ((var) * (const))
+#define ONE	((INT32) 1)
+#define RIGHT_SHIFT(x,shft)	((x) >> (shft))
+#define DESCALE(x,n)  RIGHT_SHIFT((x) + (ONE << ((n)-1)), n)
+
+// One 1-D pass of jpeg_fdct_islow (jfdctint.c) over the eight elements
+// dataptr[0], dataptr[STRIDE], ... ; pass 1 keeps PASS1_BITS of extra
+// precision, pass 2 removes it again.
+#define FDCT_1D(dataptr,STRIDE,EVEN_SHIFT,EVEN_ROUND,ODD_SHIFT) \
+  { \
+    INT32 tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7; \
+    INT32 tmp10, tmp11, tmp12, tmp13; \
+    INT32 z1, z2, z3, z4, z5; \
+    tmp0 = dataptr[STRIDE*0] + dataptr[STRIDE*7]; \
+    tmp7 = dataptr[STRIDE*0] - dataptr[STRIDE*7]; \
+    tmp1 = dataptr[STRIDE*1] + dataptr[STRIDE*6]; \
+    tmp6 = dataptr[STRIDE*1] - dataptr[STRIDE*6]; \
+    tmp2 = dataptr[STRIDE*2] + dataptr[STRIDE*5]; \
+    tmp5 = dataptr[STRIDE*2] - dataptr[STRIDE*5]; \
+    tmp3 = dataptr[STRIDE*3] + dataptr[STRIDE*4]; \
+    tmp4 = dataptr[STRIDE*3] - dataptr[STRIDE*4]; \
+    tmp10 = tmp0 + tmp3; \
+    tmp13 = tmp0 - tmp3; \
+    tmp11 = tmp1 + tmp2; \
+    tmp12 = tmp1 - tmp2; \
+    dataptr[STRIDE*0] = EVEN_ROUND(tmp10 + tmp11, EVEN_SHIFT); \
+    dataptr[STRIDE*4] = EVEN_ROUND(tmp10 - tmp11, EVEN_SHIFT); \
+    z1 = MULTIPLY(tmp12 + tmp13, FIX_0_541196100); \
+    dataptr[STRIDE*2] = DESCALE(z1 + MULTIPLY(tmp13, FIX_0_765366865), \
+                                ODD_SHIFT); \
+    dataptr[STRIDE*6] = DESCALE(z1 + MULTIPLY(tmp12, - FIX_1_847759065), \
+                                ODD_SHIFT); \
+    z1 = tmp4 + tmp7; \
+    z2 = tmp5 + tmp6; \
+    z3 = tmp4 + tmp6; \
+    z4 = tmp5 + tmp7; \
+    z5 = MULTIPLY(z3 + z4, FIX_1_175875602); \
+    tmp4 = MULTIPLY(tmp4, FIX_0_298631336); \
+    tmp5 = MULTIPLY(tmp5, FIX_2_053119869); \
+    tmp6 = MULTIPLY(tmp6, FIX_3_072711026); \
+    tmp7 = MULTIPLY(tmp7, FIX_1_501321110); \
+    z1 = MULTIPLY(z1, - FIX_0_899976223); \
+    z2 = MULTIPLY(z2, - FIX_2_562915447); \
+    z3 = MULTIPLY(z3, - FIX_1_961570560); \
+    z4 = MULTIPLY(z4, - FIX_0_390180644); \
+    z3 += z5; \
+    z4 += z5; \
+    dataptr[STRIDE*7] = DESCALE(tmp4 + z1 + z3, ODD_SHIFT); \
+    dataptr[STRIDE*5] = DESCALE(tmp5 + z2 + z4, ODD_SHIFT); \
+    dataptr[STRIDE*3] = DESCALE(tmp6 + z2 + z3, ODD_SHIFT); \
+    dataptr[STRIDE*1] = DESCALE(tmp7 + z1 + z4, ODD_SHIFT); \
+  }
+
+#define LEFT_SHIFT(x,n)  ((x) << (n))
+
+// Forward DCT and quantization of one component plane, one block per
+// work-item.  Global (height_in_blocks, width_in_blocks); the coefficients
+// go out in natural order, block rows one after the other, starting at
+// block out_offset.  divisors holds one table per component, the
+// quantization table times 8 as jcdctmgr.c builds it for the ISLOW method.
+__kernel
+void fdct(
+                __global JSAMPLE * input_buf,
+                unsigned int in_offset,
+                unsigned int in_pitch,
+                __global int * divisors,
+                unsigned int table,
+                __global JCOEF * output_buf,
+                unsigned int out_offset)
+{
+  DCTELEM workspace[DCTSIZE2];
+  DCTELEM * dataptr;
+  __global JSAMPLE * inptr;
+  __global JCOEF * outptr;
+  int block_row = get_global_id(0);
+  int block_col = get_global_id(1);
+  int blocks_across = get_global_size(1);
+  DCTELEM temp, qval;
+  int i, j;
+
+  inptr = input_buf + in_offset + block_row * DCTSIZE * in_pitch
+    + block_col * DCTSIZE;
+  for (i = 0; i < DCTSIZE; i++) {
+    for (j = 0; j < DCTSIZE; j++)
+      workspace[i * DCTSIZE + j] = GETJSAMPLE(inptr[j]) - CENTERJSAMPLE;
+    inptr += in_pitch;
+  }
+
+  // Pass 1: process rows.
+  dataptr = workspace;
+  for (i = 0; i < DCTSIZE; i++) {
+    FDCT_1D(dataptr, 1, PASS1_BITS, LEFT_SHIFT, CONST_BITS-PASS1_BITS);
+    dataptr += DCTSIZE;
+  }
+  // Pass 2: process columns.
+  dataptr = workspace;
+  for (i = 0; i < DCTSIZE; i++) {
+    FDCT_1D(dataptr, DCTSIZE, PASS1_BITS, DESCALE, CONST_BITS+PASS1_BITS);
+    dataptr++;
+  }
+
+  // Quantize as forward_DCT does, rounding the magnitude to nearest
+  outptr = output_buf
+    + ((out_offset + block_row * blocks_across + block_col) * DCTSIZE2);
+  for (i = 0; i < DCTSIZE2; i++) {
+    qval = divisors[table * DCTSIZE2 + i];
+    temp = workspace[i];
+    if (temp < 0) {
+      temp = -temp;
+      temp = (temp + (qval >> 1)) / qval;
+      temp = -temp;
+    } else {
+      temp = (temp + (qval >> 1)) / qval;
+    }
+    outptr[i] = (JCOEF) temp;
+  }
+}
@@ -38,3 +38,53 @@ void my_upsample( __global JSAMPLE * input_buf,
        output_ptr[1] = (JSAMPLE) ((invalue * 3 + othervalue + 2) >> 2);
    }
 }
+
+// Batched variant: global (rows, in_width, images * planes_per_image).
+// Plane p of image i starts at in_offset + i * in_image_stride + p * in_plane_size
+// in the input and at i * out_image_stride + p * out_plane_size in the output.
+__kernel
+void my_upsample_batch( __global JSAMPLE * input_buf,
+            unsigned int in_offset,
+            unsigned int in_pitch,
+            unsigned int in_plane_size,
+            unsigned int in_image_stride,
+            __global JSAMPLE * output_buf,
+            unsigned int out_pitch,
+            unsigned int out_plane_size,
+            unsigned int out_image_stride,
+            unsigned int planes_per_image)
+{
+   __global JSAMPLE * input_ptr;
+   __global JSAMPLE * output_ptr;
+   int invalue,othervalue;
+   int yoffset = get_global_id(0);
+   int col = get_global_id(1);
+   int width = get_global_size(1);
+   int image = get_global_id(2) / planes_per_image;
+   int plane = get_global_id(2) % planes_per_image;
+
+   input_ptr = input_buf + in_offset + image * in_image_stride + plane * in_plane_size
+       + yoffset * in_pitch + col;
+   output_ptr = output_buf + image * out_image_stride + plane * out_plane_size
+       + yoffset * out_pitch + (col << 1);
+   invalue = GETJSAMPLE(input_ptr[0]);
+   if(col == 0)
+   {
+       othervalue = GETJSAMPLE(input_ptr[1]);
+       output_ptr[0] = invalue;
+       output_ptr[1] = (JSAMPLE) ((invalue * 3 + othervalue  + 2) >> 2);
+   }
+   else if (col == (width - 1) )
+   {
+       othervalue = GETJSAMPLE(input_ptr[-1]) ;
+       output_ptr[0] = (JSAMPLE) ((invalue * 3 + othervalue + 1) >> 2);
+       output_ptr[1] = (JSAMPLE) invalue;
+   }
+   else
+   {
+       othervalue = GETJSAMPLE(input_ptr[-1]);
+       output_ptr[0] = (JSAMPLE) ((invalue * 3 + othervalue + 1) >> 2);
+       othervalue = GETJSAMPLE(input_ptr[1]);
+       output_ptr[1] = (JSAMPLE) ((invalue * 3 + othervalue + 2) >> 2);
+   }
+}
@@ -64,3 +64,69 @@ void my_upsample( __global JSAMPLE * input_buf,
        outptr[1] = (JSAMPLE) ((thiscolsum * 3 + nextcolsum + 7) >> 4);
    }
 }
+
+// Batched variant: global (2 * in_rows, in_width, images * planes_per_image).
+// Same plane addressing as the h2v1 batch kernel; rows above the first and
+// below the last input row replicate the edge row like jdmainct.c does.
+__kernel
+void my_upsample_batch( __global JSAMPLE * input_buf,
+            unsigned int in_offset,
+            unsigned int in_pitch,
+            unsigned int in_plane_size,
+            unsigned int in_image_stride,
+            __global JSAMPLE * output_buf,
+            unsigned int out_pitch,
+            unsigned int out_plane_size,
+            unsigned int out_image_stride,
+            unsigned int planes_per_image)
+{
+   __global JSAMPLE * inptr0;
+   __global JSAMPLE * inptr1;
+   __global JSAMPLE * outptr;
+   int yoffset = get_global_id(0);
+   int height = get_global_size(0);
+   int col = get_global_id(1);
+   int width = get_global_size(1);
+   int image = get_global_id(2) / planes_per_image;
+   int plane = get_global_id(2) % planes_per_image;
+   unsigned int thiscolsum;
+   unsigned int othercolsum;
+
+   inptr0 = input_buf + in_offset + image * in_image_stride + plane * in_plane_size
+       + (yoffset >> 1) * in_pitch + col;
+   if(yoffset == 0 || yoffset == (height - 1))
+   {
+       inptr1 = inptr0;
+   }
+   else if( !(yoffset & 1 ))
+   {
+       inptr1 = inptr0 - in_pitch;
+   }
+   else
+   {
+       inptr1 = inptr0 + in_pitch;
+   }
+   outptr = output_buf + image * out_image_stride + plane * out_plane_size
+       + yoffset * out_pitch + (col << 1);
+
+   thiscolsum = GETJSAMPLE(inptr0[0]) * 3 + GETJSAMPLE(inptr1[0]);
+   if(col == 0)
+   {
+       othercolsum = GETJSAMPLE(inptr0[1]) * 3 + GETJSAMPLE(inptr1[1]);
+       outptr[0] = (JSAMPLE) ((thiscolsum * 4 + 8) >> 4);
+       outptr[1] = (JSAMPLE) ((thiscolsum * 3 + othercolsum + 7) >> 4);
+   }
+   else if (col == (width - 1) )
+   {
+       othercolsum = GETJSAMPLE(inptr0[-1]) * 3 + GETJSAMPLE(inptr1[-1]);
+       outptr[0] = (JSAMPLE) ((thiscolsum * 3 + othercolsum + 8) >> 4);
+       outptr[1] = (JSAMPLE) ((thiscolsum * 4 + 7) >> 4);
+   }
+   else
+   {
+       othercolsum = GETJSAMPLE(inptr0[-1]) * 3 + GETJSAMPLE(inptr1[-1]);
+       outptr[0] = (JSAMPLE) ((thiscolsum * 3 + othercolsum + 8) >> 4);
+       othercolsum = GETJSAMPLE(inptr0[1]) * 3 + GETJSAMPLE(inptr1[1]);
+       outptr[1] = (JSAMPLE) ((thiscolsum * 3 + othercolsum + 7) >> 4);
+   }
+}
@@ -19,6 +19,8 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jopenclenv.h"
+#include "jthreadpool.h"
 
 
 /*
@@ -77,9 +79,6 @@ jpeg_CreateCompress (j_compress_ptr cinfo, int version, size_t structsize)
 
   /* OK, I'm ready */
   cinfo->global_state = CSTATE_START;
-
-  cinfo->decoded_mcus_base = NULL;
-  cinfo->decoded_mcus_current = NULL;
 }
 
 
@@ -90,6 +89,11 @@ jpeg_CreateCompress (j_compress_ptr cinfo, int version, size_t structsize)
 GLOBAL(void)
 jpeg_destroy_compress (j_compress_ptr cinfo)
 {
+  j_opencl_env_release_compress(cinfo);
+  if (cinfo->cpu_pool) {
+    j_threadpool_destroy(cinfo->cpu_pool);
+    cinfo->cpu_pool = NULL;
+  }
   jpeg_destroy((j_common_ptr) cinfo); /* use common routine */
 }
 
@@ -114,7 +114,11 @@ start_pass_coef (j_compress_ptr cinfo, J_BUF_MODE pass_mode)
   case JBUF_SAVE_AND_PASS:
     if (coef->whole_image[0] == NULL)
       ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
-    coef->pub.compress_data = compress_first_pass;
+    /* The OpenCL pipeline fills the virtual arrays itself (jcopencl.c) */
+    if (cinfo->cl_pipeline)
+      coef->pub.compress_data = compress_output;
+    else
+      coef->pub.compress_data = compress_first_pass;
     break;
   case JBUF_CRANK_DEST:
     if (coef->whole_image[0] == NULL)
@@ -428,8 +432,13 @@ jinit_c_coef_controller (j_compress_ptr cinfo, boolean need_full_buffer)
 				(long) compptr->h_samp_factor),
 	 (JDIMENSION) jround_up((long) compptr->height_in_blocks,
 				(long) compptr->v_samp_factor),
-	 (JDIMENSION) compptr->v_samp_factor);
+	 /* parallel entropy coding reads whole arrays at once */
+	 (JDIMENSION) (cinfo->parallel_entropy ?
+		       jround_up((long) compptr->height_in_blocks,
+				 (long) compptr->v_samp_factor) :
+		       compptr->v_samp_factor));
     }
+    coef->pub.coef_arrays = coef->whole_image;
 #else
     ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
 #endif
@@ -445,5 +454,6 @@ jinit_c_coef_controller (j_compress_ptr cinfo, boolean need_full_buffer)
       coef->MCU_buffer[i] = buffer + i;
     }
     coef->whole_image[0] = NULL; /* flag for no virtual arrays */
+    coef->pub.coef_arrays = NULL;
   }
 }
@@ -11,6 +11,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /* Private subobject */
@@ -20,6 +21,8 @@ typedef struct {
 
   /* Private state for RGB->YCC conversion */
   INT32 * rgb_ycc_tab;		/* => table for RGB to YCbCr conversion */
+  /* SSE2/AVX2 version of the RGB->YCbCr row loop, or NULL */
+  jsimd_rgb_ycc_row_ptr rgb_ycc_row;
 } my_color_converter;
 
 typedef my_color_converter * my_cconvert_ptr;
@@ -145,7 +148,14 @@ rgb_ycc_convert (j_compress_ptr cinfo,
     outptr1 = output_buf[1][output_row];
     outptr2 = output_buf[2][output_row];
     output_row++;
-    for (col = 0; col < num_cols; col++) {
+    col = 0;
+    if (cconvert->rgb_ycc_row != NULL) {
+      /* vector code does all but the last few pixels */
+      col = (*cconvert->rgb_ycc_row) (inptr, outptr0, outptr1, outptr2,
+				      num_cols);
+      inptr += col * RGB_PIXELSIZE;
+    }
+    for (; col < num_cols; col++) {
       r = GETJSAMPLE(inptr[RGB_RED]);
       g = GETJSAMPLE(inptr[RGB_GREEN]);
       b = GETJSAMPLE(inptr[RGB_BLUE]);
@@ -359,6 +369,7 @@ jinit_color_converter (j_compress_ptr cinfo)
   cinfo->cconvert = (struct jpeg_color_converter *) cconvert;
   /* set start_pass to null method until we find out differently */
   cconvert->pub.start_pass = null_method;
+  cconvert->rgb_ycc_row = NULL;
 
   /* Make sure input_components agrees with in_color_space */
   switch (cinfo->in_color_space) {
@@ -422,6 +433,12 @@ jinit_color_converter (j_compress_ptr cinfo)
     if (cinfo->in_color_space == JCS_RGB) {
       cconvert->pub.start_pass = rgb_ycc_start;
       cconvert->pub.color_convert = rgb_ycc_convert;
+#ifdef JSIMD_X86_RGB
+      if (jsimd_cpu_features() & JSIMD_AVX2)
+	cconvert->rgb_ycc_row = jsimd_rgb_ycc_row_avx2;
+      else if (jsimd_cpu_features() & JSIMD_SSE2)
+	cconvert->rgb_ycc_row = jsimd_rgb_ycc_row_sse2;
+#endif
     } else if (cinfo->in_color_space == JCS_YCbCr)
       cconvert->pub.color_convert = null_convert;
     else
@@ -0,0 +1,224 @@
+/*
+ * jccolsimd.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains SSE2 and AVX2 row helpers for RGB->YCbCr conversion
+ * in the compressor (jccolor.c).
+ *
+ * The scalar code sums table entries built as
+ *	Y  = ( FIX(0.29900) * R + FIX(0.58700) * G + FIX(0.11400) * B
+ *	      + ONE_HALF) >> SCALEBITS
+ *	Cb = (-FIX(0.16874) * R - FIX(0.33126) * G + FIX(0.50000) * B
+ *	      + CBCR_OFFSET + ONE_HALF-1) >> SCALEBITS
+ *	Cr = ( FIX(0.50000) * R - FIX(0.41869) * G - FIX(0.08131) * B
+ *	      + CBCR_OFFSET + ONE_HALF-1) >> SCALEBITS
+ * Here the same products are formed with pmaddwd, which multiplies 16-bit
+ * pairs and adds them into 32 bits.  FIX(0.58700) does not fit 16 bits,
+ * so G goes in two halves of 19235; FIX(0.50000) is a shift by 15.  The
+ * sums are exact, so the results equal the scalar ones.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86_RGB
+
+#include <immintrin.h>
+
+#define SSE2_TARGET  __attribute__((target("sse2")))
+#define AVX2_TARGET  __attribute__((target("avx2")))
+
+#define SCALEBITS	16
+#define CBCR_OFFSET	((INT32) CENTERJSAMPLE << SCALEBITS)
+#define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
+
+/* FIX() of the jccolor.c constants, for SCALEBITS = 16 */
+#define FIX_0_29900	19595
+#define FIX_0_58700	38470
+#define FIX_0_11400	7471
+#define FIX_0_16874	11059
+#define FIX_0_33126	21709
+#define FIX_0_41869	27439
+#define FIX_0_08131	5329
+
+/* A pmaddwd multiplier pair, first element in the low half */
+#define PAIR(lo,hi)  \
+  ((int) (((unsigned int) (hi) << 16) | ((unsigned int) (lo) & 0xFFFF)))
+
+/* Y from (R, G) and (B, G); Cb from (R, G); Cr from (G, B) */
+#define Y_RG	PAIR(FIX_0_29900, FIX_0_58700/2)
+#define Y_BG	PAIR(FIX_0_11400, FIX_0_58700/2)
+#define CB_RG	PAIR(-FIX_0_16874, -FIX_0_33126)
+#define CR_GB	PAIR(-FIX_0_41869, -FIX_0_08131)
+
+
+/*
+ * SSE2 versions: 16 pixels per step, taken four at a time.
+ */
+
+/* Pixels 0-3 of v, one per 32-bit lane as R | G<<8 | B<<16 | junk<<24 */
+SSE2_TARGET static __inline__ __m128i
+gather4_sse2 (__m128i v)
+{
+  return _mm_unpacklo_epi64(
+	   _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3)),
+	   _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9)));
+}
+
+/* Y, Cb and Cr of four gathered pixels, still scaled up by SCALEBITS */
+SSE2_TARGET static __inline__ void
+rgb_ycc4_sse2 (__m128i pix, __m128i * y, __m128i * cb, __m128i * cr)
+{
+  __m128i mask = _mm_set1_epi32(0xFF);
+  __m128i r = _mm_and_si128(pix, mask);
+  __m128i g = _mm_and_si128(_mm_srli_epi32(pix, 8), mask);
+  __m128i b = _mm_and_si128(_mm_srli_epi32(pix, 16), mask);
+  __m128i g_hi = _mm_slli_epi32(g, 16);
+  __m128i offset = _mm_set1_epi32(CBCR_OFFSET + ONE_HALF-1);
+
+  *y = _mm_add_epi32(_mm_add_epi32(
+	 _mm_madd_epi16(_mm_or_si128(r, g_hi), _mm_set1_epi32(Y_RG)),
+	 _mm_madd_epi16(_mm_or_si128(b, g_hi), _mm_set1_epi32(Y_BG))),
+	 _mm_set1_epi32(ONE_HALF));
+  *cb = _mm_add_epi32(_mm_add_epi32(
+	  _mm_madd_epi16(_mm_or_si128(r, g_hi), _mm_set1_epi32(CB_RG)),
+	  _mm_slli_epi32(b, SCALEBITS-1)), offset);
+  *cr = _mm_add_epi32(_mm_add_epi32(
+	  _mm_madd_epi16(_mm_or_si128(g, _mm_slli_epi32(b, 16)),
+			 _mm_set1_epi32(CR_GB)),
+	  _mm_slli_epi32(r, SCALEBITS-1)), offset);
+}
+
+/* Descale four vectors of four results and store them as 16 samples */
+SSE2_TARGET static __inline__ void
+store16_sse2 (JSAMPROW outptr, __m128i * v)
+{
+  _mm_storeu_si128((__m128i *) outptr,
+    _mm_packus_epi16(
+      _mm_packs_epi32(_mm_srli_epi32(v[0], SCALEBITS),
+		      _mm_srli_epi32(v[1], SCALEBITS)),
+      _mm_packs_epi32(_mm_srli_epi32(v[2], SCALEBITS),
+		      _mm_srli_epi32(v[3], SCALEBITS))));
+}
+
+SSE2_TARGET GLOBAL(JDIMENSION)
+jsimd_rgb_ycc_row_sse2 (JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+			JSAMPROW outptr2, JDIMENSION num_cols)
+{
+  __m128i y[4], cb[4], cr[4], pix[4];
+  JSAMPROW ptr;
+  JDIMENSION col;
+  int i;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    /* Pixel 4*i starts at byte 12*i; the last load is moved back to end
+     * at the last byte of the 16 pixels.
+     */
+    ptr = inptr + col * RGB_PIXELSIZE;
+    pix[0] = gather4_sse2(_mm_loadu_si128((const __m128i *) ptr));
+    pix[1] = gather4_sse2(_mm_loadu_si128((const __m128i *) (ptr + 12)));
+    pix[2] = gather4_sse2(_mm_loadu_si128((const __m128i *) (ptr + 24)));
+    pix[3] = gather4_sse2(_mm_srli_si128(
+	       _mm_loadu_si128((const __m128i *) (ptr + 32)), 4));
+    for (i = 0; i < 4; i++)
+      rgb_ycc4_sse2(pix[i], &y[i], &cb[i], &cr[i]);
+    store16_sse2(outptr0 + col, y);
+    store16_sse2(outptr1 + col, cb);
+    store16_sse2(outptr2 + col, cr);
+  }
+  return col;
+}
+
+
+/*
+ * AVX2 versions: 16 pixels per step, eight at a time.  Each 128-bit half
+ * gathers its four pixels with a byte shuffle.
+ */
+
+AVX2_TARGET static __inline__ __m256i
+gather8_avx2 (JSAMPROW lo, JSAMPROW hi, __m256i shuffle)
+{
+  __m256i v = _mm256_inserti128_si256(
+		_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) lo)),
+		_mm_loadu_si128((const __m128i *) hi), 1);
+
+  return _mm256_shuffle_epi8(v, shuffle);
+}
+
+AVX2_TARGET static __inline__ void
+rgb_ycc8_avx2 (__m256i pix, __m256i * y, __m256i * cb, __m256i * cr)
+{
+  __m256i mask = _mm256_set1_epi32(0xFF);
+  __m256i r = _mm256_and_si256(pix, mask);
+  __m256i g = _mm256_and_si256(_mm256_srli_epi32(pix, 8), mask);
+  __m256i b = _mm256_srli_epi32(pix, 16);
+  __m256i g_hi = _mm256_slli_epi32(g, 16);
+  __m256i offset = _mm256_set1_epi32(CBCR_OFFSET + ONE_HALF-1);
+
+  *y = _mm256_add_epi32(_mm256_add_epi32(
+	 _mm256_madd_epi16(_mm256_or_si256(r, g_hi), _mm256_set1_epi32(Y_RG)),
+	 _mm256_madd_epi16(_mm256_or_si256(b, g_hi), _mm256_set1_epi32(Y_BG))),
+	 _mm256_set1_epi32(ONE_HALF));
+  *cb = _mm256_add_epi32(_mm256_add_epi32(
+	  _mm256_madd_epi16(_mm256_or_si256(r, g_hi),
+			    _mm256_set1_epi32(CB_RG)),
+	  _mm256_slli_epi32(b, SCALEBITS-1)), offset);
+  *cr = _mm256_add_epi32(_mm256_add_epi32(
+	  _mm256_madd_epi16(_mm256_or_si256(g, _mm256_slli_epi32(b, 16)),
+			    _mm256_set1_epi32(CR_GB)),
+	  _mm256_slli_epi32(r, SCALEBITS-1)), offset);
+}
+
+/* Descale pixels 0-7 (first) and 8-15 (second) and store them in order.
+ * The packs work within 128-bit halves, leaving pixels 0-3, 8-11, 4-7,
+ * 12-15 in the dwords 0, 1, 4, 5.
+ */
+AVX2_TARGET static __inline__ void
+store16_avx2 (JSAMPROW outptr, __m256i first, __m256i second)
+{
+  __m256i words = _mm256_packs_epi32(_mm256_srli_epi32(first, SCALEBITS),
+				     _mm256_srli_epi32(second, SCALEBITS));
+  __m256i bytes = _mm256_permutevar8x32_epi32(
+		    _mm256_packus_epi16(words, words),
+		    _mm256_setr_epi32(0, 4, 1, 5, 0, 0, 0, 0));
+
+  _mm_storeu_si128((__m128i *) outptr, _mm256_castsi256_si128(bytes));
+}
+
+AVX2_TARGET GLOBAL(JDIMENSION)
+jsimd_rgb_ycc_row_avx2 (JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+			JSAMPROW outptr2, JDIMENSION num_cols)
+{
+  /* Shuffle picking R,G,B of four pixels from bytes 0-11, or from 4-15
+   * for a load moved back by four bytes
+   */
+#define PIX3(i,o)  (3*(i)+(o)), (3*(i)+(o)+1), (3*(i)+(o)+2), -1
+  __m256i shuffle = _mm256_setr_epi8(PIX3(0,0), PIX3(1,0), PIX3(2,0),
+				     PIX3(3,0), PIX3(0,0), PIX3(1,0),
+				     PIX3(2,0), PIX3(3,0));
+  __m256i shuffle_end = _mm256_setr_epi8(PIX3(0,0), PIX3(1,0), PIX3(2,0),
+					 PIX3(3,0), PIX3(0,4), PIX3(1,4),
+					 PIX3(2,4), PIX3(3,4));
+#undef PIX3
+  __m256i y0, cb0, cr0, y1, cb1, cr1;
+  JSAMPROW ptr;
+  JDIMENSION col;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    ptr = inptr + col * RGB_PIXELSIZE;
+    rgb_ycc8_avx2(gather8_avx2(ptr, ptr + 12, shuffle), &y0, &cb0, &cr0);
+    rgb_ycc8_avx2(gather8_avx2(ptr + 24, ptr + 32, shuffle_end),
+		  &y1, &cb1, &cr1);
+    store16_avx2(outptr0 + col, y0, y1);
+    store16_avx2(outptr1 + col, cb0, cb1);
+    store16_avx2(outptr2 + col, cr0, cr1);
+  }
+  return col;
+}
+
+#endif /* JSIMD_X86_RGB */
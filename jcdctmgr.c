@@ -15,6 +15,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
 
 
 /* Private subobject for this module */
@@ -36,11 +37,64 @@ typedef struct {
   float_DCT_method_ptr do_float_dct;
   FAST_FLOAT * float_divisors[NUM_QUANT_TBLS];
 #endif
+
+  int simd;			/* JSIMD_xxx features of this CPU */
+#ifdef JSIMD_X86
+  /* SIMD quantizers, or NULL to quantize with the scalar loops */
+  quantize_method_ptr quantize;
+#ifdef DCT_FLOAT_SUPPORTED
+  float_quantize_method_ptr quantize_float;
+#endif
+  /* Reciprocal tables for quantize (see jdct.h), and whether each is
+   * usable, i.e. its quant table has no divisors out of range.
+   */
+  DCTELEM * reciprocals[NUM_QUANT_TBLS];
+  boolean use_reciprocals[NUM_QUANT_TBLS];
+#endif
 } my_fdct_controller;
 
 typedef my_fdct_controller * my_fdct_ptr;
 
 
+#ifdef JSIMD_X86
+#if defined(DCT_ISLOW_SUPPORTED) || defined(DCT_IFAST_SUPPORTED)
+
+/*
+ * Set up the reciprocal table matching a freshly computed divisor table.
+ */
+
+LOCAL(void)
+compute_reciprocals (j_compress_ptr cinfo, int qtblno)
+{
+  my_fdct_ptr fdct = (my_fdct_ptr) cinfo->fdct;
+  DCTELEM * dtbl = fdct->divisors[qtblno];
+  DCTELEM * rtbl;
+  int i;
+
+  fdct->use_reciprocals[qtblno] = FALSE;
+  for (i = 0; i < DCTSIZE2; i++) {
+    if (dtbl[i] < 2 || dtbl[i] > MAX_RECIP_DIVISOR)
+      return;			/* leave this table to forward_DCT's loop */
+  }
+
+  if (fdct->reciprocals[qtblno] == NULL) {
+    fdct->reciprocals[qtblno] = (DCTELEM *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				  2 * DCTSIZE2 * SIZEOF(DCTELEM));
+  }
+  rtbl = fdct->reciprocals[qtblno];
+  for (i = 0; i < DCTSIZE2; i++) {
+    /* ceil(2^RECIP_BITS / d) for 2 <= d; RECIP_BITS is 31 */
+    rtbl[i] = (DCTELEM) ((INT32) 0x7FFFFFFFL / dtbl[i] + 1);
+    rtbl[DCTSIZE2 + i] = dtbl[i] >> 1;
+  }
+  fdct->use_reciprocals[qtblno] = TRUE;
+}
+
+#endif /* DCT_ISLOW_SUPPORTED || DCT_IFAST_SUPPORTED */
+#endif /* JSIMD_X86 */
+
+
 /*
  * Initialize for a processing pass.
  * Verify that all referenced Q-tables are present, and set up
@@ -84,6 +138,10 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
       for (i = 0; i < DCTSIZE2; i++) {
 	dtbl[i] = ((DCTELEM) qtbl->quantval[i]) << 3;
       }
+#ifdef JSIMD_X86
+      if (fdct->quantize != NULL)
+	compute_reciprocals(cinfo, qtblno);
+#endif
       break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
@@ -121,6 +179,10 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
 				  (INT32) aanscales[i]),
 		    CONST_BITS-3);
 	}
+#ifdef JSIMD_X86
+	if (fdct->quantize != NULL)
+	  compute_reciprocals(cinfo, qtblno);
+#endif
       }
       break;
 #endif
@@ -187,6 +249,12 @@ forward_DCT (j_compress_ptr cinfo, jpeg_component_info * compptr,
   my_fdct_ptr fdct = (my_fdct_ptr) cinfo->fdct;
   forward_DCT_method_ptr do_dct = fdct->do_dct;
   DCTELEM * divisors = fdct->divisors[compptr->quant_tbl_no];
+#ifdef JSIMD_X86
+  quantize_method_ptr quantize = fdct->quantize;
+  DCTELEM * reciprocals = (quantize != NULL &&
+			   fdct->use_reciprocals[compptr->quant_tbl_no]) ?
+			  fdct->reciprocals[compptr->quant_tbl_no] : NULL;
+#endif
   DCTELEM workspace[DCTSIZE2];	/* work area for FDCT subroutine */
   JDIMENSION bi;
 
@@ -224,6 +292,11 @@ forward_DCT (j_compress_ptr cinfo, jpeg_component_info * compptr,
     (*do_dct) (workspace);
 
     /* Quantize/descale the coefficients, and store into coef_blocks[] */
+#ifdef JSIMD_X86
+    if (reciprocals != NULL)
+      (*quantize) (coef_blocks[bi], reciprocals, workspace);
+    else
+#endif
     { register DCTELEM temp, qval;
       register int i;
       register JCOEFPTR output_ptr = coef_blocks[bi];
@@ -277,6 +350,9 @@ forward_DCT_float (j_compress_ptr cinfo, jpeg_component_info * compptr,
   my_fdct_ptr fdct = (my_fdct_ptr) cinfo->fdct;
   float_DCT_method_ptr do_dct = fdct->do_float_dct;
   FAST_FLOAT * divisors = fdct->float_divisors[compptr->quant_tbl_no];
+#ifdef JSIMD_X86
+  float_quantize_method_ptr quantize = fdct->quantize_float;
+#endif
   FAST_FLOAT workspace[DCTSIZE2]; /* work area for FDCT subroutine */
   JDIMENSION bi;
 
@@ -315,6 +391,11 @@ forward_DCT_float (j_compress_ptr cinfo, jpeg_component_info * compptr,
     (*do_dct) (workspace);
 
     /* Quantize/descale the coefficients, and store into coef_blocks[] */
+#ifdef JSIMD_X86
+    if (quantize != NULL)
+      (*quantize) (coef_blocks[bi], divisors, workspace);
+    else
+#endif
     { register FAST_FLOAT temp;
       register int i;
       register JCOEFPTR output_ptr = coef_blocks[bi];
@@ -352,24 +433,44 @@ jinit_forward_dct (j_compress_ptr cinfo)
 				SIZEOF(my_fdct_controller));
   cinfo->fdct = (struct jpeg_forward_dct *) fdct;
   fdct->pub.start_pass = start_pass_fdctmgr;
+  fdct->simd = jsimd_cpu_features();
 
   switch (cinfo->dct_method) {
 #ifdef DCT_ISLOW_SUPPORTED
   case JDCT_ISLOW:
     fdct->pub.forward_DCT = forward_DCT;
     fdct->do_dct = jpeg_fdct_islow;
+#ifdef JSIMD_X86
+    /* Same results, several rows or columns at a time */
+    if (fdct->simd & JSIMD_AVX2)
+      fdct->do_dct = jpeg_fdct_islow_avx2;
+    else if (fdct->simd & JSIMD_SSE2)
+      fdct->do_dct = jpeg_fdct_islow_sse2;
+#endif
     break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
   case JDCT_IFAST:
     fdct->pub.forward_DCT = forward_DCT;
     fdct->do_dct = jpeg_fdct_ifast;
+#ifdef JSIMD_X86
+    if (fdct->simd & JSIMD_AVX2)
+      fdct->do_dct = jpeg_fdct_ifast_avx2;
+    else if (fdct->simd & JSIMD_SSE2)
+      fdct->do_dct = jpeg_fdct_ifast_sse2;
+#endif
     break;
 #endif
 #ifdef DCT_FLOAT_SUPPORTED
   case JDCT_FLOAT:
     fdct->pub.forward_DCT = forward_DCT_float;
     fdct->do_float_dct = jpeg_fdct_float;
+#ifdef JSIMD_X86
+    if (fdct->simd & JSIMD_AVX2)
+      fdct->do_float_dct = jpeg_fdct_float_avx2;
+    else if (fdct->simd & JSIMD_SSE2)
+      fdct->do_float_dct = jpeg_fdct_float_sse2;
+#endif
     break;
 #endif
   default:
@@ -377,11 +478,33 @@ jinit_forward_dct (j_compress_ptr cinfo)
     break;
   }
 
+#ifdef JSIMD_X86
+  fdct->quantize = NULL;
+#ifdef DCT_FLOAT_SUPPORTED
+  fdct->quantize_float = NULL;
+#endif
+  if (fdct->simd & JSIMD_AVX2) {
+    fdct->quantize = jsimd_quantize_avx2;
+#ifdef DCT_FLOAT_SUPPORTED
+    fdct->quantize_float = jsimd_quantize_float_avx2;
+#endif
+  } else if (fdct->simd & JSIMD_SSE2) {
+    fdct->quantize = jsimd_quantize_sse2;
+#ifdef DCT_FLOAT_SUPPORTED
+    fdct->quantize_float = jsimd_quantize_float_sse2;
+#endif
+  }
+#endif
+
   /* Mark divisor tables unallocated */
   for (i = 0; i < NUM_QUANT_TBLS; i++) {
     fdct->divisors[i] = NULL;
 #ifdef DCT_FLOAT_SUPPORTED
     fdct->float_divisors[i] = NULL;
+#endif
+#ifdef JSIMD_X86
+    fdct->reciprocals[i] = NULL;
+    fdct->use_reciprocals[i] = FALSE;
 #endif
   }
 }
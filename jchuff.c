@@ -18,6 +18,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jchuff.h"		/* Declarations shared with jcphuff.c */
+#include "jthreadpool.h"
 
 
 /* Expanded entropy encoder object for Huffman encoding.
@@ -32,6 +33,13 @@ typedef struct {
   int last_dc_val[MAX_COMPS_IN_SCAN]; /* last DC coef for each component */
 } savable_state;
 
+/* The fast block encoder needs a 64-bit integer type */
+
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define HUFF_FAST_ENCODER
+typedef unsigned long long huff_bitbuf;
+#endif
+
 /* This macro is to work around compilers with missing or broken
  * structure assignment.  You'll need to fix this code if you have
  * such a compiler and you change MAX_COMPS_IN_SCAN.
@@ -68,6 +76,8 @@ typedef struct {
 #ifdef ENTROPY_OPT_SUPPORTED	/* Statistics tables for optimization */
   long * dc_count_ptrs[NUM_HUFF_TBLS];
   long * ac_count_ptrs[NUM_HUFF_TBLS];
+  JDIMENSION MCU_count;		/* MCUs counted so far in this pass */
+  long * worker_counts;		/* per-thread tables for parallel gathering */
 #endif
 } huff_entropy_encoder;
 
@@ -89,10 +99,16 @@ typedef struct {
 METHODDEF(boolean) encode_mcu_huff JPP((j_compress_ptr cinfo,
 					JBLOCKROW *MCU_data));
 METHODDEF(void) finish_pass_huff JPP((j_compress_ptr cinfo));
+METHODDEF(boolean) encode_mcu_deferred JPP((j_compress_ptr cinfo,
+					    JBLOCKROW *MCU_data));
+#ifdef HUFF_FAST_ENCODER
+METHODDEF(void) finish_pass_parallel JPP((j_compress_ptr cinfo));
+#endif
 #ifdef ENTROPY_OPT_SUPPORTED
 METHODDEF(boolean) encode_mcu_gather JPP((j_compress_ptr cinfo,
 					  JBLOCKROW *MCU_data));
 METHODDEF(void) finish_pass_gather JPP((j_compress_ptr cinfo));
+METHODDEF(void) finish_pass_gather_parallel JPP((j_compress_ptr cinfo));
 #endif
 
 
@@ -113,12 +129,30 @@ start_pass_huff (j_compress_ptr cinfo, boolean gather_statistics)
 #ifdef ENTROPY_OPT_SUPPORTED
     entropy->pub.encode_mcu = encode_mcu_gather;
     entropy->pub.finish_pass = finish_pass_gather;
+    /* With the whole image's coefficients kept, count the symbols of all
+     * MCU rows in parallel at the end of the pass instead.
+     */
+    if (cinfo->parallel_entropy && cinfo->coef->coef_arrays != NULL) {
+      entropy->pub.encode_mcu = encode_mcu_deferred;
+      entropy->pub.finish_pass = finish_pass_gather_parallel;
+    }
+    entropy->MCU_count = 0;
 #else
     ERREXIT(cinfo, JERR_NOT_COMPILED);
 #endif
   } else {
     entropy->pub.encode_mcu = encode_mcu_huff;
     entropy->pub.finish_pass = finish_pass_huff;
+#ifdef HUFF_FAST_ENCODER
+    /* With the whole image's coefficients kept (see jcinit.c), the
+     * restart intervals are encoded in parallel at the end of the pass.
+     */
+    if (cinfo->parallel_entropy && cinfo->restart_interval > 0 &&
+	cinfo->coef->coef_arrays != NULL) {
+      entropy->pub.encode_mcu = encode_mcu_deferred;
+      entropy->pub.finish_pass = finish_pass_parallel;
+    }
+#endif
   }
 
   for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
@@ -347,6 +381,167 @@ flush_bits (working_state * state)
 }
 
 
+#ifdef HUFF_FAST_ENCODER
+
+/* High-throughput block encoder.
+ *
+ * encode_mcu_huff uses this in place of encode_one_block whenever the
+ * output buffer has room for the worst-case block, which is at most 4
+ * bytes per coefficient and twice that with every byte stuffed.  Nothing
+ * can then suspend, so the bytes go straight into the buffer without any
+ * per-byte checks.  The bits accumulate right-justified in a 64-bit
+ * buffer and are flushed 32 at a time; a word containing no 0xFF byte,
+ * the usual case, goes out without looking at its bytes one by one.
+ * Between blocks the state is kept in the format emit_bits uses, so the
+ * two encoders can alternate freely and the output is the same.
+ * Errors are returned as a message code rather than raised, since the
+ * parallel scan encoder below calls this from worker threads.
+ */
+
+#define FAST_BLOCK_BYTES  (DCTSIZE2 * 4 * 2 + 64)
+
+/* Number of bits in the magnitude x, which must be nonzero */
+#ifdef __GNUC__
+#define NBITS_NONZERO(x)  \
+	((int) (SIZEOF(unsigned int) * 8) - __builtin_clz((unsigned int) (x)))
+#else
+#define NBITS_NONZERO(x)  nbits_nonzero((unsigned int) (x))
+
+LOCAL(int)
+nbits_nonzero (unsigned int x)
+{
+  int nbits = 1;
+
+  while ((x >>= 1))
+    nbits++;
+  return nbits;
+}
+#endif
+
+/* Append size bits of code, which must have no bits above those */
+#define PUT_BITS(code,size)  \
+	{ put_bits += (size);  \
+	  put_buffer = (put_buffer << (size)) | (huff_bitbuf) (code); }
+
+/* Write out one byte of the buffer, stuffing a zero after 0xFF */
+#define PUT_BYTE()  \
+	{ int c = (int) (put_buffer >> (put_bits -= 8)) & 0xFF;  \
+	  *outptr++ = (JOCTET) c;  \
+	  if (c == 0xFF) *outptr++ = 0; }
+
+/* Keep fewer than 32 bits in the buffer, so that the next symbol and its
+ * value bits (16 + MAX_COEF_BITS+1 at most) fit.
+ */
+#define FLUSH_BITS()  \
+	if (put_bits >= 32) {  \
+	  unsigned int w = (unsigned int) (put_buffer >> (put_bits - 32));  \
+	  if (((~w - 0x01010101U) & w & 0x80808080U) == 0) {  \
+	    /* no 0xFF byte in w */  \
+	    outptr[0] = (JOCTET) (w >> 24);  \
+	    outptr[1] = (JOCTET) (w >> 16);  \
+	    outptr[2] = (JOCTET) (w >> 8);  \
+	    outptr[3] = (JOCTET) w;  \
+	    outptr += 4;  \
+	    put_bits -= 32;  \
+	  } else {  \
+	    PUT_BYTE(); PUT_BYTE(); PUT_BYTE(); PUT_BYTE();  \
+	  }  \
+	}
+
+LOCAL(int)
+encode_one_block_fast (working_state * state, JCOEFPTR block,
+		       int last_dc_val,
+		       c_derived_tbl *dctbl, c_derived_tbl *actbl)
+{
+  register huff_bitbuf put_buffer;
+  register int put_bits;
+  register int temp, temp2, sign;
+  register int nbits, size;
+  register int k, r, i;
+  JOCTET * outptr = state->next_output_byte;
+
+  /* Pick up the bits left over by emit_bits, left-justified in 24 bits */
+  put_bits = state->cur.put_bits;
+  put_buffer = (huff_bitbuf) ((state->cur.put_buffer >> (24 - put_bits)) &
+			      ((((INT32) 1) << put_bits) - 1));
+
+  /* Encode the DC coefficient difference per section F.1.2.1 */
+
+  temp = block[0] - last_dc_val;
+  sign = - (temp < 0);		/* all ones for a negative input */
+  temp2 = temp + sign;		/* complement of abs value if negative */
+  temp = (temp ^ sign) - sign;	/* abs value */
+  nbits = temp ? NBITS_NONZERO(temp) : 0;
+  if (nbits > MAX_COEF_BITS+1)
+    return JERR_BAD_DCT_COEF;
+
+  size = dctbl->ehufsi[nbits];
+  if (size == 0)
+    return JERR_HUFF_MISSING_CODE;
+  PUT_BITS(dctbl->ehufco[nbits], size);
+  PUT_BITS(temp2 & ((1 << nbits) - 1), nbits);
+  FLUSH_BITS();
+
+  /* Encode the AC coefficients per section F.1.2.2 */
+
+  r = 0;			/* r = run length of zeros */
+
+  for (k = 1; k < DCTSIZE2; k++) {
+    if ((temp = block[jpeg_natural_order[k]]) == 0) {
+      r++;
+      continue;
+    }
+    /* if run length > 15, must emit special run-length-16 codes (0xF0) */
+    while (r > 15) {
+      size = actbl->ehufsi[0xF0];
+      if (size == 0)
+	return JERR_HUFF_MISSING_CODE;
+      PUT_BITS(actbl->ehufco[0xF0], size);
+      FLUSH_BITS();
+      r -= 16;
+    }
+
+    sign = - (temp < 0);
+    temp2 = temp + sign;
+    temp = (temp ^ sign) - sign;
+    nbits = NBITS_NONZERO(temp);
+    if (nbits > MAX_COEF_BITS)
+      return JERR_BAD_DCT_COEF;
+
+    /* Huffman symbol for run length / number of bits, then the value */
+    i = (r << 4) + nbits;
+    size = actbl->ehufsi[i];
+    if (size == 0)
+      return JERR_HUFF_MISSING_CODE;
+    PUT_BITS(actbl->ehufco[i], size);
+    PUT_BITS(temp2 & ((1 << nbits) - 1), nbits);
+    FLUSH_BITS();
+
+    r = 0;
+  }
+
+  /* If the last coef(s) were zero, emit an end-of-block code */
+  if (r > 0) {
+    size = actbl->ehufsi[0];
+    if (size == 0)
+      return JERR_HUFF_MISSING_CODE;
+    PUT_BITS(actbl->ehufco[0], size);
+  }
+
+  /* Write out all whole bytes and hand the rest back to emit_bits */
+  while (put_bits >= 8)
+    PUT_BYTE();
+  state->cur.put_buffer = (INT32) (put_buffer & ((1 << put_bits) - 1))
+			  << (24 - put_bits);
+  state->cur.put_bits = put_bits;
+  state->free_in_buffer -= (size_t) (outptr - state->next_output_byte);
+  state->next_output_byte = outptr;
+  return 0;
+}
+
+#endif /* HUFF_FAST_ENCODER */
+
+
 /* Encode a single block's worth of coefficients */
 
 LOCAL(boolean)
@@ -497,6 +692,16 @@ encode_mcu_huff (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     ci = cinfo->MCU_membership[blkn];
     compptr = cinfo->cur_comp_info[ci];
+#ifdef HUFF_FAST_ENCODER
+    if (state.free_in_buffer >= FAST_BLOCK_BYTES) {
+      int err = encode_one_block_fast(&state,
+			MCU_data[blkn][0], state.cur.last_dc_val[ci],
+			entropy->dc_derived_tbls[compptr->dc_tbl_no],
+			entropy->ac_derived_tbls[compptr->ac_tbl_no]);
+      if (err)
+	ERREXIT(cinfo, err);
+    } else
+#endif
     if (! encode_one_block(&state,
 			   MCU_data[blkn][0], state.cur.last_dc_val[ci],
 			   entropy->dc_derived_tbls[compptr->dc_tbl_no],
@@ -552,6 +757,250 @@ finish_pass_huff (j_compress_ptr cinfo)
 }
 
 
+/*
+ * In the parallel modes MCUs are not looked at as they come; the
+ * finish_pass routine does the whole scan from the coefficient arrays.
+ */
+
+METHODDEF(boolean)
+encode_mcu_deferred (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  return TRUE;
+}
+
+
+/*
+ * Get the block rows of every component in the scan from the
+ * coefficient controller's full-image arrays.  These are requested with
+ * whole-array access when parallel_entropy is set (see jccoefct.c), so
+ * the row pointers stay valid while worker threads read them.
+ *
+ * Note this is also used by jcphuff.c.
+ */
+
+GLOBAL(void)
+jpeg_access_scan_coefs (j_compress_ptr cinfo, JBLOCKARRAY buffer[])
+{
+  jpeg_component_info * compptr;
+  int ci;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    buffer[ci] = (*cinfo->mem->access_virt_barray)
+      ((j_common_ptr) cinfo, cinfo->coef->coef_arrays[compptr->component_index],
+       (JDIMENSION) 0,
+       (JDIMENSION) jround_up((long) compptr->height_in_blocks,
+			      (long) compptr->v_samp_factor),
+       FALSE);
+  }
+}
+
+
+#ifdef HUFF_FAST_ENCODER
+
+/*
+ * Parallel encoding of a scan.
+ *
+ * Restart markers make the intervals of a scan independent: each one
+ * starts on a byte boundary with the DC predictions at zero.  So once the
+ * coefficient controller has filled the whole-image buffer, every
+ * interval is encoded on the thread pool into its own growing memory
+ * buffer with the fast block encoder, and the buffers are then written
+ * out in order with RSTn markers between them.  The result is the same
+ * as encoding serially with the same restart interval.  Worker threads
+ * must not longjmp, so they only record an error and finish_pass_parallel
+ * raises it.
+ */
+
+typedef struct {
+  JOCTET * data;		/* output of this interval (malloc'd) */
+  size_t size;			/* allocated size of data */
+  size_t used;			/* bytes of data filled in */
+  int error;			/* message code of a failure, or 0 */
+} huff_interval;
+
+typedef struct {
+  j_compress_ptr cinfo;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN]; /* whole arrays of the scan */
+  c_derived_tbl * dctbl[MAX_COMPS_IN_SCAN];
+  c_derived_tbl * actbl[MAX_COMPS_IN_SCAN];
+  JDIMENSION total_MCUs;	/* MCUs in the scan */
+  huff_interval * intervals;
+} huff_scan_job;
+
+
+/* Make room for one more block in an interval's buffer */
+
+LOCAL(boolean)
+reserve_block (huff_interval * interval, working_state * state,
+	       size_t estimate)
+{
+  size_t used, size;
+  JOCTET * data;
+
+  if (state->free_in_buffer >= FAST_BLOCK_BYTES)
+    return TRUE;
+  used = interval->size - state->free_in_buffer;
+  size = MAX(interval->size * 2, estimate + FAST_BLOCK_BYTES);
+  data = (JOCTET *) realloc(interval->data, size);
+  if (data == NULL)
+    return FALSE;
+  interval->data = data;
+  interval->size = size;
+  state->next_output_byte = data + used;
+  state->free_in_buffer = size - used;
+  return TRUE;
+}
+
+
+/* Encode restart interval number index of the scan (a thread pool task) */
+
+static void encode_interval (void * arg, int index, int worker)
+{
+  huff_scan_job * job = (huff_scan_job *) arg;
+  j_compress_ptr cinfo = job->cinfo;
+  huff_interval * interval = &job->intervals[index];
+  working_state state;
+  JDIMENSION MCU_num, last_MCU, MCU_row, MCU_col;
+  JBLOCKROW buffer_ptr;
+  jpeg_component_info * compptr;
+  size_t estimate;
+  int ci, xindex, yindex, c;
+
+  MCU_num = (JDIMENSION) index * cinfo->restart_interval;
+  last_MCU = MIN(MCU_num + cinfo->restart_interval, job->total_MCUs);
+  /* a guess at the compressed size, to save most of the reallocations */
+  estimate = (size_t) (last_MCU - MCU_num) * cinfo->blocks_in_MCU * 32;
+
+  state.next_output_byte = NULL;
+  state.free_in_buffer = 0;
+  state.cur.put_buffer = 0;
+  state.cur.put_bits = 0;
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++)
+    state.cur.last_dc_val[ci] = 0;
+  state.cinfo = cinfo;
+
+  /* Walk the MCUs the way compress_output in jccoefct.c does */
+  for (; MCU_num < last_MCU; MCU_num++) {
+    MCU_row = MCU_num / cinfo->MCUs_per_row;
+    MCU_col = MCU_num % cinfo->MCUs_per_row;
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+      compptr = cinfo->cur_comp_info[ci];
+      for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+	buffer_ptr = job->buffer[ci][MCU_row * compptr->MCU_height + yindex]
+		     + MCU_col * compptr->MCU_width;
+	for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+	  if (! reserve_block(interval, &state, estimate)) {
+	    interval->error = JERR_OUT_OF_MEMORY;
+	    return;
+	  }
+	  interval->error = encode_one_block_fast(&state,
+				buffer_ptr[xindex], state.cur.last_dc_val[ci],
+				job->dctbl[ci], job->actbl[ci]);
+	  if (interval->error)
+	    return;
+	  state.cur.last_dc_val[ci] = buffer_ptr[xindex][0];
+	}
+      }
+    }
+  }
+
+  /* Fill any partial byte with ones, as flush_bits does */
+  if (! reserve_block(interval, &state, estimate)) {
+    interval->error = JERR_OUT_OF_MEMORY;
+    return;
+  }
+  if (state.cur.put_bits > 0) {
+    c = (int) ((state.cur.put_buffer >> 16) & 0xFF) |
+	(0xFF >> state.cur.put_bits);
+    *state.next_output_byte++ = (JOCTET) c;
+    state.free_in_buffer--;
+    if (c == 0xFF) {
+      *state.next_output_byte++ = 0;
+      state.free_in_buffer--;
+    }
+  }
+  interval->used = interval->size - state.free_in_buffer;
+}
+
+
+/* Copy bytes to the destination; return FALSE if it wants to suspend */
+
+LOCAL(boolean)
+write_output (j_compress_ptr cinfo, const JOCTET * data, size_t count)
+{
+  struct jpeg_destination_mgr * dest = cinfo->dest;
+  size_t n;
+
+  while (count > 0) {
+    n = MIN(count, dest->free_in_buffer);
+    MEMCOPY(dest->next_output_byte, data, n);
+    dest->next_output_byte += n;
+    dest->free_in_buffer -= n;
+    data += n;
+    count -= n;
+    if (dest->free_in_buffer == 0)
+      if (! (*dest->empty_output_buffer) (cinfo))
+	return FALSE;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Encode and output the whole scan at the end of the pass.
+ */
+
+METHODDEF(void)
+finish_pass_parallel (j_compress_ptr cinfo)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  huff_scan_job job;
+  jpeg_component_info * compptr;
+  JOCTET marker[2];
+  int ci, i, num_intervals, error;
+
+  jpeg_access_scan_coefs(cinfo, job.buffer);
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    job.dctbl[ci] = entropy->dc_derived_tbls[compptr->dc_tbl_no];
+    job.actbl[ci] = entropy->ac_derived_tbls[compptr->ac_tbl_no];
+  }
+  job.cinfo = cinfo;
+  job.total_MCUs = cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan;
+  num_intervals = (int) ((job.total_MCUs + cinfo->restart_interval - 1) /
+			 cinfo->restart_interval);
+  job.intervals = (huff_interval *)
+    (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				num_intervals * SIZEOF(huff_interval));
+  jzero_far((void FAR *) job.intervals,
+	    num_intervals * SIZEOF(huff_interval));
+
+  j_threadpool_run(cinfo->cpu_pool, num_intervals, encode_interval, &job);
+
+  error = 0;
+  for (i = 0; i < num_intervals && ! error; i++)
+    error = job.intervals[i].error;
+  for (i = 0; i < num_intervals && ! error; i++) {
+    if (! write_output(cinfo, job.intervals[i].data, job.intervals[i].used))
+      error = JERR_CANT_SUSPEND;
+    else if (i < num_intervals - 1) {
+      marker[0] = 0xFF;
+      marker[1] = (JOCTET) (JPEG_RST0 + (i & 7));
+      if (! write_output(cinfo, marker, 2))
+	error = JERR_CANT_SUSPEND;
+    }
+  }
+  for (i = 0; i < num_intervals; i++)
+    if (job.intervals[i].data != NULL)
+      free(job.intervals[i].data);
+  if (error)
+    ERREXIT(cinfo, error);
+}
+
+#endif /* HUFF_FAST_ENCODER */
+
+
 /*
  * Huffman coding optimization.
  *
@@ -566,10 +1015,31 @@ finish_pass_huff (j_compress_ptr cinfo)
 #ifdef ENTROPY_OPT_SUPPORTED
 
 
-/* Process a single block's worth of coefficients */
+/* Fast optimize: AC statistics come from one MCU row in this many */
 
-LOCAL(void)
-htest_one_block (j_compress_ptr cinfo, JCOEFPTR block, int last_dc_val,
+#define FAST_OPTIMIZE_STRIDE  4
+
+/* Sampling makes every possible AC symbol need a code, which costs a few
+ * hundred bytes of table and data whatever the image size: 5-8% of a
+ * 227x149 image.  Shorter scans than this are counted in full, as they
+ * take little time to count anyway.
+ */
+
+#define FAST_OPTIMIZE_MIN_ROWS  32
+
+#define SAMPLE_AC_STATS(cinfo)  ((cinfo)->fast_optimize && \
+				 (cinfo)->MCU_rows_in_scan >= \
+				 FAST_OPTIMIZE_MIN_ROWS)
+
+
+/* Process a single block's worth of coefficients.
+ * ac_counts may be NULL to count the DC symbol only.
+ * Returns 0 or the message code of an error, as this also runs on
+ * worker threads, which must not longjmp.
+ */
+
+LOCAL(int)
+htest_one_block (JCOEFPTR block, int last_dc_val,
 		 long dc_counts[], long ac_counts[])
 {
   register int temp;
@@ -592,10 +1062,12 @@ htest_one_block (j_compress_ptr cinfo, JCOEFPTR block, int last_dc_val,
    * Since we're encoding a difference, the range limit is twice as much.
    */
   if (nbits > MAX_COEF_BITS+1)
-    ERREXIT(cinfo, JERR_BAD_DCT_COEF);
+    return JERR_BAD_DCT_COEF;
 
   /* Count the Huffman symbol for the number of bits */
   dc_counts[nbits]++;
+  if (ac_counts == NULL)
+    return 0;
   
   /* Encode the AC coefficients per section F.1.2.2 */
   
@@ -621,7 +1093,7 @@ htest_one_block (j_compress_ptr cinfo, JCOEFPTR block, int last_dc_val,
 	nbits++;
       /* Check for out-of-range coefficient values */
       if (nbits > MAX_COEF_BITS)
-	ERREXIT(cinfo, JERR_BAD_DCT_COEF);
+	return JERR_BAD_DCT_COEF;
       
       /* Count Huffman symbol for run length / number of bits */
       ac_counts[(r << 4) + nbits]++;
@@ -633,6 +1105,7 @@ htest_one_block (j_compress_ptr cinfo, JCOEFPTR block, int last_dc_val,
   /* If the last coef(s) were zero, emit an end-of-block code */
   if (r > 0)
     ac_counts[0]++;
+  return 0;
 }
 
 
@@ -645,7 +1118,8 @@ METHODDEF(boolean)
 encode_mcu_gather (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 {
   huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
-  int blkn, ci;
+  int blkn, ci, err;
+  boolean sampled;
   jpeg_component_info * compptr;
 
   /* Take care of restart intervals if needed */
@@ -660,12 +1134,21 @@ encode_mcu_gather (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
+  /* In fast mode only some MCU rows count their AC symbols */
+  sampled = (! SAMPLE_AC_STATS(cinfo) ||
+	     (entropy->MCU_count / cinfo->MCUs_per_row) %
+	     FAST_OPTIMIZE_STRIDE == 0);
+  entropy->MCU_count++;
+
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     ci = cinfo->MCU_membership[blkn];
     compptr = cinfo->cur_comp_info[ci];
-    htest_one_block(cinfo, MCU_data[blkn][0], entropy->saved.last_dc_val[ci],
-		    entropy->dc_count_ptrs[compptr->dc_tbl_no],
-		    entropy->ac_count_ptrs[compptr->ac_tbl_no]);
+    err = htest_one_block(MCU_data[blkn][0], entropy->saved.last_dc_val[ci],
+			  entropy->dc_count_ptrs[compptr->dc_tbl_no],
+			  sampled ? entropy->ac_count_ptrs[compptr->ac_tbl_no]
+				  : (long *) NULL);
+    if (err)
+      ERREXIT(cinfo, err);
     entropy->saved.last_dc_val[ci] = MCU_data[blkn][0][0];
   }
 
@@ -838,6 +1321,31 @@ jpeg_gen_optimal_table (j_compress_ptr cinfo, JHUFF_TBL * htbl, long freq[])
 }
 
 
+/*
+ * In fast mode the AC counts only cover a sample of the blocks, so a
+ * symbol may turn up in the output pass that was never counted.  Scale
+ * the counts back up and give every possible AC symbol at least a count
+ * of one, so that each gets a (long) code.
+ */
+
+LOCAL(void)
+complete_sampled_counts (long ac_counts[])
+{
+  int i, r, nbits;
+
+  for (i = 0; i < 256; i++)
+    ac_counts[i] *= FAST_OPTIMIZE_STRIDE;
+  if (ac_counts[0] == 0)	/* EOB */
+    ac_counts[0] = 1;
+  if (ac_counts[0xF0] == 0)	/* ZRL */
+    ac_counts[0xF0] = 1;
+  for (r = 0; r < 16; r++)
+    for (nbits = 1; nbits <= MAX_COEF_BITS; nbits++)
+      if (ac_counts[(r << 4) + nbits] == 0)
+	ac_counts[(r << 4) + nbits] = 1;
+}
+
+
 /*
  * Finish up a statistics-gathering pass and create the new Huffman tables.
  */
@@ -873,6 +1381,8 @@ finish_pass_gather (j_compress_ptr cinfo)
       htblptr = & cinfo->ac_huff_tbl_ptrs[actbl];
       if (*htblptr == NULL)
 	*htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+      if (SAMPLE_AC_STATS(cinfo))
+	complete_sampled_counts(entropy->ac_count_ptrs[actbl]);
       jpeg_gen_optimal_table(cinfo, *htblptr, entropy->ac_count_ptrs[actbl]);
       did_ac[actbl] = TRUE;
     }
@@ -880,6 +1390,138 @@ finish_pass_gather (j_compress_ptr cinfo)
 }
 
 
+/*
+ * Parallel statistics gathering.
+ *
+ * Counting symbols needs no output, so no restart markers either: every
+ * MCU row of the scan is one task, counted into tables private to the
+ * thread running it.  The DC predictions a row starts with are the DC
+ * values of the blocks just before it, read straight from the arrays (or
+ * zero where a restart interval begins), so the merged counts are exactly
+ * those of encode_mcu_gather.
+ */
+
+#define COUNT_TABLE_SIZE  257	/* what jpeg_gen_optimal_table expects */
+#define WORKER_COUNTS  (2 * NUM_HUFF_TBLS * COUNT_TABLE_SIZE)
+
+typedef struct {
+  j_compress_ptr cinfo;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN]; /* whole arrays of the scan */
+  long * counts;		/* WORKER_COUNTS per thread: DC tables, AC */
+  int * errors;			/* message code of a failure, per thread */
+} huff_gather_job;
+
+
+/* Count the symbols of MCU row number index (a thread pool task) */
+
+static void gather_MCU_row (void * arg, int index, int worker)
+{
+  huff_gather_job * job = (huff_gather_job *) arg;
+  j_compress_ptr cinfo = job->cinfo;
+  long * dc_counts = job->counts + (size_t) worker * WORKER_COUNTS;
+  long * ac_counts = dc_counts + NUM_HUFF_TBLS * COUNT_TABLE_SIZE;
+  int last_dc_val[MAX_COMPS_IN_SCAN];
+  JDIMENSION MCU_col, MCU_num, prev_row, prev_col;
+  JBLOCKROW buffer_ptr;
+  jpeg_component_info * compptr;
+  boolean sampled;
+  int ci, xindex, yindex, err;
+
+  sampled = (! SAMPLE_AC_STATS(cinfo) || index % FAST_OPTIMIZE_STRIDE == 0);
+
+  /* Pick up the DC predictions where the previous MCU left them */
+  MCU_num = (JDIMENSION) index * cinfo->MCUs_per_row;
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    if (MCU_num == 0) {
+      last_dc_val[ci] = 0;
+      continue;
+    }
+    prev_row = (MCU_num - 1) / cinfo->MCUs_per_row;
+    prev_col = (MCU_num - 1) % cinfo->MCUs_per_row;
+    last_dc_val[ci] = job->buffer[ci]
+      [prev_row * compptr->MCU_height + compptr->MCU_height - 1]
+      [prev_col * compptr->MCU_width + compptr->MCU_width - 1][0];
+  }
+
+  for (MCU_col = 0; MCU_col < cinfo->MCUs_per_row; MCU_col++, MCU_num++) {
+    if (cinfo->restart_interval && MCU_num % cinfo->restart_interval == 0)
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++)
+	last_dc_val[ci] = 0;
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+      compptr = cinfo->cur_comp_info[ci];
+      for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+	buffer_ptr = job->buffer[ci][index * compptr->MCU_height + yindex]
+		     + MCU_col * compptr->MCU_width;
+	for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+	  err = htest_one_block(buffer_ptr[xindex], last_dc_val[ci],
+		  dc_counts + compptr->dc_tbl_no * COUNT_TABLE_SIZE,
+		  sampled ? ac_counts + compptr->ac_tbl_no * COUNT_TABLE_SIZE
+			  : (long *) NULL);
+	  if (err) {
+	    job->errors[worker] = err;
+	    return;
+	  }
+	  last_dc_val[ci] = buffer_ptr[xindex][0];
+	}
+      }
+    }
+  }
+}
+
+
+/*
+ * Count the whole scan at the end of the pass, then make the tables.
+ */
+
+METHODDEF(void)
+finish_pass_gather_parallel (j_compress_ptr cinfo)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  huff_gather_job job;
+  int workers, w, tbl, i;
+  long * counts;
+
+  workers = j_threadpool_get_worker_count(cinfo->cpu_pool);
+  if (entropy->worker_counts == NULL)
+    entropy->worker_counts = (long *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+		(size_t) workers * (WORKER_COUNTS * SIZEOF(long) + SIZEOF(int)));
+  jzero_far((void FAR *) entropy->worker_counts,
+	    (size_t) workers * (WORKER_COUNTS * SIZEOF(long) + SIZEOF(int)));
+
+  job.cinfo = cinfo;
+  jpeg_access_scan_coefs(cinfo, job.buffer);
+  job.counts = entropy->worker_counts;
+  job.errors = (int *) (entropy->worker_counts + (size_t) workers * WORKER_COUNTS);
+  j_threadpool_run(cinfo->cpu_pool, (int) cinfo->MCU_rows_in_scan,
+		   gather_MCU_row, &job);
+
+  for (w = 0; w < workers; w++)
+    if (job.errors[w])
+      ERREXIT(cinfo, job.errors[w]);
+
+  /* Merge the threads' tables into the ones start_pass_huff set up */
+  for (w = 0; w < workers; w++) {
+    counts = job.counts + (size_t) w * WORKER_COUNTS;
+    for (tbl = 0; tbl < NUM_HUFF_TBLS; tbl++) {
+      if (entropy->dc_count_ptrs[tbl] != NULL)
+	for (i = 0; i < COUNT_TABLE_SIZE; i++)
+	  entropy->dc_count_ptrs[tbl][i] += counts[i];
+      counts += COUNT_TABLE_SIZE;
+    }
+    for (tbl = 0; tbl < NUM_HUFF_TBLS; tbl++) {
+      if (entropy->ac_count_ptrs[tbl] != NULL)
+	for (i = 0; i < COUNT_TABLE_SIZE; i++)
+	  entropy->ac_count_ptrs[tbl][i] += counts[i];
+      counts += COUNT_TABLE_SIZE;
+    }
+  }
+
+  finish_pass_gather(cinfo);
+}
+
+
 #endif /* ENTROPY_OPT_SUPPORTED */
 
 
@@ -906,4 +1548,7 @@ jinit_huff_encoder (j_compress_ptr cinfo)
     entropy->dc_count_ptrs[i] = entropy->ac_count_ptrs[i] = NULL;
 #endif
   }
+#ifdef ENTROPY_OPT_SUPPORTED
+  entropy->worker_counts = NULL;
+#endif
 }
@@ -35,6 +35,7 @@ typedef struct {
 #ifdef NEED_SHORT_EXTERNAL_NAMES
 #define jpeg_make_c_derived_tbl	jMkCDerived
 #define jpeg_gen_optimal_table	jGenOptTbl
+#define jpeg_access_scan_coefs	jAccScanCoefs
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 /* Expand a Huffman table definition into the derived format */
@@ -45,3 +46,7 @@ EXTERN(void) jpeg_make_c_derived_tbl
 /* Generate an optimal table definition given the specified counts */
 EXTERN(void) jpeg_gen_optimal_table
 	JPP((j_compress_ptr cinfo, JHUFF_TBL * htbl, long freq[]));
+
+/* Get whole-scan access to the coefficients (parallel_entropy mode) */
+EXTERN(void) jpeg_access_scan_coefs
+	JPP((j_compress_ptr cinfo, JBLOCKARRAY buffer[]));
@@ -18,6 +18,8 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jopenclenv.h"
+#include "jthreadpool.h"
 
 
 /*
@@ -29,9 +31,45 @@
 GLOBAL(void)
 jinit_compress_master (j_compress_ptr cinfo)
 {
+  int workers;
+
   /* Initialize master control (includes parameter checking/processing) */
   jinit_c_master_control(cinfo, FALSE /* full compression */);
 
+  /* Move preprocessing and the DCT to the OpenCL device if it can take
+   * this image; the CPU modules below stay set up as the fallback.
+   */
+  cinfo->cl_pipeline = FALSE;
+  if (! cinfo->cl_disable && jopencl_compress_supported(cinfo)) {
+    cl_int error_code = j_opencl_env_init_compress(cinfo);
+    if (error_code == CL_SUCCESS)
+      cinfo->cl_pipeline = TRUE;
+    else
+      TRACEMS1(cinfo, 1, JTRC_CPU_COMPRESS, (int) error_code);
+  }
+
+  /* Parallel Huffman encoding of sequential scans, and parallel gathering
+   * of statistics for optimized tables, progressive ones included.
+   * Restart intervals are what make the sequential output divisible; when
+   * the application asked for none, use whole MCU rows, about four
+   * intervals per thread.  Progressive output is always coded serially.
+   * A pool that fails to start just leaves us single-threaded.
+   */
+  cinfo->parallel_entropy = FALSE;
+  if (cinfo->entropy_threads != 1 && ! cinfo->arith_code &&
+      (! cinfo->progressive_mode || cinfo->optimize_coding)) {
+    if (cinfo->cpu_pool == NULL)
+      cinfo->cpu_pool = j_threadpool_create(cinfo->entropy_threads);
+    workers = j_threadpool_get_worker_count(cinfo->cpu_pool);
+    if (workers > 1) {
+      cinfo->parallel_entropy = TRUE;
+      if (! cinfo->progressive_mode &&
+	  cinfo->restart_interval == 0 && cinfo->restart_in_rows == 0)
+	cinfo->master->restart_in_rows = (int) MAX(1L,
+	  (long) cinfo->total_iMCU_rows / (4L * workers));
+    }
+  }
+
   /* Preprocessing */
   if (! cinfo->raw_data_in) {
     jinit_color_converter(cinfo);
@@ -56,7 +94,8 @@ jinit_compress_master (j_compress_ptr cinfo)
 
   /* Need a full-image coefficient buffer in any multi-pass mode. */
   jinit_c_coef_controller(cinfo,
-		(boolean) (cinfo->num_scans > 1 || cinfo->optimize_coding));
+		(boolean) (cinfo->num_scans > 1 || cinfo->optimize_coding ||
+			   cinfo->cl_pipeline || cinfo->parallel_entropy));
   jinit_c_main_controller(cinfo, FALSE /* never need full buffer here */);
 
   jinit_marker_writer(cinfo);
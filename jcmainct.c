@@ -45,6 +45,14 @@ typedef struct {
    */
   jvirt_sarray_ptr whole_image[MAX_COMPONENTS];
 #endif
+
+  /* With the OpenCL pipeline the whole input image is collected here
+   * before any of it is compressed (see jcopencl.c).
+   */
+  JSAMPARRAY image;		/* image_height contiguous input rows */
+  JDIMENSION rows_buffered;	/* rows of image filled so far */
+  JDIMENSION rows_fed;		/* rows given to the CPU stages on fallback */
+  boolean image_done;		/* image went to the device or the CPU */
 } my_main_controller;
 
 typedef my_main_controller * my_main_ptr;
@@ -54,6 +62,9 @@ typedef my_main_controller * my_main_ptr;
 METHODDEF(void) process_data_simple_main
 	JPP((j_compress_ptr cinfo, JSAMPARRAY input_buf,
 	     JDIMENSION *in_row_ctr, JDIMENSION in_rows_avail));
+METHODDEF(void) process_data_image_main
+	JPP((j_compress_ptr cinfo, JSAMPARRAY input_buf,
+	     JDIMENSION *in_row_ctr, JDIMENSION in_rows_avail));
 #ifdef FULL_MAIN_BUFFER_SUPPORTED
 METHODDEF(void) process_data_buffer_main
 	JPP((j_compress_ptr cinfo, JSAMPARRAY input_buf,
@@ -85,7 +96,13 @@ start_pass_main (j_compress_ptr cinfo, J_BUF_MODE pass_mode)
     if (main->whole_image[0] != NULL)
       ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
 #endif
-    main->pub.process_data = process_data_simple_main;
+    if (cinfo->cl_pipeline) {
+      main->rows_buffered = 0;
+      main->rows_fed = 0;
+      main->image_done = FALSE;
+      main->pub.process_data = process_data_image_main;
+    } else
+      main->pub.process_data = process_data_simple_main;
     break;
 #ifdef FULL_MAIN_BUFFER_SUPPORTED
   case JBUF_SAVE_SOURCE:
@@ -158,6 +175,66 @@ process_data_simple_main (j_compress_ptr cinfo,
 }
 
 
+/*
+ * Process some data.
+ * This routine handles the OpenCL pipeline, which needs the whole image
+ * at once.  Rows are only collected until the last one arrives; then the
+ * device fills the coefficient arrays and the coefficient controller emits
+ * them.  Should the device fail, the collected rows take the usual route
+ * through the preprocessor instead.
+ */
+
+METHODDEF(void)
+process_data_image_main (j_compress_ptr cinfo,
+			 JSAMPARRAY input_buf, JDIMENSION *in_row_ctr,
+			 JDIMENSION in_rows_avail)
+{
+  my_main_ptr main = (my_main_ptr) cinfo->main;
+  JDIMENSION num_rows;
+  cl_int error_code;
+
+  num_rows = MIN(in_rows_avail - *in_row_ctr,
+		 cinfo->image_height - main->rows_buffered);
+  jcopy_sample_rows(input_buf, (int) *in_row_ctr,
+		    main->image, (int) main->rows_buffered, (int) num_rows,
+		    cinfo->image_width * (JDIMENSION) cinfo->input_components);
+  *in_row_ctr += num_rows;
+  main->rows_buffered += num_rows;
+  if (main->rows_buffered < cinfo->image_height)
+    return;
+
+  if (! main->image_done) {
+    error_code = jopencl_compress_image(cinfo, main->image);
+    if (error_code != CL_SUCCESS) {
+      TRACEMS1(cinfo, 1, JTRC_CPU_COMPRESS, (int) error_code);
+      cinfo->cl_pipeline = FALSE;
+      /* nothing was emitted yet, so the pass can start over */
+      (*cinfo->coef->start_pass) (cinfo, JBUF_SAVE_AND_PASS);
+    }
+    main->image_done = TRUE;
+  }
+
+  if (cinfo->cl_pipeline) {
+    while (main->cur_iMCU_row < cinfo->total_iMCU_rows) {
+      if (! (*cinfo->coef->compress_data) (cinfo, (JSAMPIMAGE) NULL))
+	break;
+      main->cur_iMCU_row++;
+    }
+  } else
+    process_data_simple_main(cinfo, main->image, &main->rows_fed,
+			     cinfo->image_height);
+
+  /* If the output suspended, pretend we didn't yet consume the last
+   * input row, as process_data_simple_main does, so that the application
+   * calls us again.
+   */
+  if (main->cur_iMCU_row < cinfo->total_iMCU_rows) {
+    main->rows_buffered--;
+    (*in_row_ctr)--;
+  }
+}
+
+
 #ifdef FULL_MAIN_BUFFER_SUPPORTED
 
 /*
@@ -281,6 +358,22 @@ jinit_c_main_controller (j_compress_ptr cinfo, boolean need_full_buffer)
 #ifdef FULL_MAIN_BUFFER_SUPPORTED
     main->whole_image[0] = NULL; /* flag for no virtual arrays */
 #endif
+    if (cinfo->cl_pipeline) {
+      /* One block, so that the image goes to the device in one piece */
+      JDIMENSION row_size = cinfo->image_width *
+			    (JDIMENSION) cinfo->input_components;
+      JSAMPROW row;
+      JDIMENSION i;
+
+      row = (JSAMPROW) (*cinfo->mem->alloc_large)
+	((j_common_ptr) cinfo, JPOOL_IMAGE,
+	 (size_t) row_size * cinfo->image_height * SIZEOF(JSAMPLE));
+      main->image = (JSAMPARRAY) (*cinfo->mem->alloc_small)
+	((j_common_ptr) cinfo, JPOOL_IMAGE,
+	 cinfo->image_height * SIZEOF(JSAMPROW));
+      for (i = 0; i < cinfo->image_height; i++, row += row_size)
+	main->image[i] = row;
+    }
     /* Allocate a strip buffer for each component */
     for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
 	 ci++, compptr++) {
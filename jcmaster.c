@@ -382,8 +382,9 @@ per_scan_setup (j_compress_ptr cinfo)
 
   /* Convert restart specified in rows to actual MCU count. */
   /* Note that count must fit in 16 bits, so we provide limiting. */
-  if (cinfo->restart_in_rows > 0) {
-    long nominal = (long) cinfo->restart_in_rows * (long) cinfo->MCUs_per_row;
+  if (cinfo->master->restart_in_rows > 0) {
+    long nominal = (long) cinfo->master->restart_in_rows *
+		   (long) cinfo->MCUs_per_row;
     cinfo->restart_interval = (unsigned int) MIN(nominal, 65535L);
   }
 }
@@ -416,8 +417,12 @@ prepare_for_pass (j_compress_ptr cinfo)
     }
     (*cinfo->fdct->start_pass) (cinfo);
     (*cinfo->entropy->start_pass) (cinfo, cinfo->optimize_coding);
+    /* The OpenCL pipeline and parallel entropy coding always go through
+     * the full-image buffer
+     */
     (*cinfo->coef->start_pass) (cinfo,
-				(master->total_passes > 1 ?
+				(master->total_passes > 1 || cinfo->cl_pipeline ||
+				 cinfo->parallel_entropy ?
 				 JBUF_SAVE_AND_PASS : JBUF_PASS_THRU));
     (*cinfo->main->start_pass) (cinfo, JBUF_PASS_THRU);
     if (cinfo->optimize_coding) {
@@ -531,6 +536,13 @@ finish_pass_master (j_compress_ptr cinfo)
     break;
   }
 
+  /* A restart interval we chose ourselves must not carry over to the
+   * next image compressed with this object.
+   */
+  if (master->pub.is_last_pass &&
+      master->pub.restart_in_rows != cinfo->restart_in_rows)
+    cinfo->restart_interval = 0;
+
   master->pass_number++;
 }
 
@@ -552,6 +564,7 @@ jinit_c_master_control (j_compress_ptr cinfo, boolean transcode_only)
   master->pub.pass_startup = pass_startup;
   master->pub.finish_pass = finish_pass_master;
   master->pub.is_last_pass = FALSE;
+  master->pub.restart_in_rows = cinfo->restart_in_rows;
 
   /* Validate parameters, determine derived values */
   initial_setup(cinfo);
@@ -0,0 +1,365 @@
+/*
+ * jcopencl.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains the OpenCL pipeline of the compressor.  The main
+ * controller (jcmainct.c) collects the whole RGB image; here it goes to
+ * the device in one piece, where color conversion, downsampling, the
+ * forward DCT and quantization each run as one launch over the image.
+ * The quantized coefficients come back into the full-image virtual
+ * arrays of the coefficient controller, from which jccoefct.c and the
+ * entropy encoder emit the scans as in any multi-pass mode.
+ *
+ * The kernels reproduce jccolor.c, jcsample.c and the ISLOW path of
+ * jcdctmgr.c in integer arithmetic, edge padding included, so the output
+ * equals that of the CPU path.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jmemsys.h"		/* for MAX_ALLOC_CHUNK */
+#include "jopenclstore.h"
+#include "jopenclprogpool.h"
+
+
+/*
+ * Can the device pipeline take this image with these parameters?
+ * Called by jinit_compress_master once the master control has computed
+ * the sampling geometry.
+ */
+
+GLOBAL(boolean)
+jopencl_compress_supported (j_compress_ptr cinfo)
+{
+  jpeg_component_info * compptr;
+  int ci;
+
+#if BITS_IN_JSAMPLE != 8 || RGB_PIXELSIZE != 3
+  return FALSE;			/* the kernels assume 8-bit packed RGB */
+#endif
+#if RGB_RED != 0 || RGB_GREEN != 1 || RGB_BLUE != 2
+  return FALSE;
+#endif
+  if (cinfo->raw_data_in || cinfo->in_color_space != JCS_RGB ||
+      cinfo->input_components != 3 || cinfo->jpeg_color_space != JCS_YCbCr ||
+      cinfo->num_components != 3)
+    return FALSE;
+  if (cinfo->dct_method != JDCT_ISLOW || cinfo->smoothing_factor != 0 ||
+      cinfo->CCIR601_sampling)
+    return FALSE;
+  /* The image is buffered in one block */
+  if ((double) cinfo->image_width * cinfo->image_height * 3 >
+      (double) (MAX_ALLOC_CHUNK / 2))
+    return FALSE;
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    if (cinfo->max_h_samp_factor % compptr->h_samp_factor != 0 ||
+	cinfo->max_v_samp_factor % compptr->v_samp_factor != 0)
+      return FALSE;		/* jcsample.c would refuse it too */
+  }
+  return TRUE;
+}
+
+
+/*
+ * Copy the coefficients read back from the device into the virtual
+ * arrays, adding the dummy blocks at the right and bottom edges the way
+ * compress_first_pass in jccoefct.c does.
+ */
+
+LOCAL(void)
+store_coefficients (j_compress_ptr cinfo, JBLOCKROW blocks)
+{
+  jvirt_barray_ptr * coef_arrays = cinfo->coef->coef_arrays;
+  JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
+  JDIMENSION iMCU_row, blocks_across, MCUs_across, MCUindex;
+  int bi, ci, h_samp_factor, block_row, block_rows, ndummy;
+  JCOEF lastDC;
+  jpeg_component_info *compptr;
+  JBLOCKARRAY buffer;
+  JBLOCKROW thisblockrow, lastblockrow;
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    h_samp_factor = compptr->h_samp_factor;
+    ndummy = (int) (compptr->width_in_blocks % h_samp_factor);
+    if (ndummy > 0)
+      ndummy = h_samp_factor - ndummy;
+    for (iMCU_row = 0; iMCU_row <= last_iMCU_row; iMCU_row++) {
+      buffer = (*cinfo->mem->access_virt_barray)
+	((j_common_ptr) cinfo, coef_arrays[ci],
+	 iMCU_row * compptr->v_samp_factor,
+	 (JDIMENSION) compptr->v_samp_factor, TRUE);
+      if (iMCU_row < last_iMCU_row)
+	block_rows = compptr->v_samp_factor;
+      else {
+	block_rows = (int) (compptr->height_in_blocks % compptr->v_samp_factor);
+	if (block_rows == 0) block_rows = compptr->v_samp_factor;
+      }
+      blocks_across = compptr->width_in_blocks;
+      for (block_row = 0; block_row < block_rows; block_row++) {
+	thisblockrow = buffer[block_row];
+	jcopy_block_row(blocks, thisblockrow, blocks_across);
+	blocks += blocks_across;
+	if (ndummy > 0) {
+	  thisblockrow += blocks_across; /* => first dummy block */
+	  jzero_far((void FAR *) thisblockrow, ndummy * SIZEOF(JBLOCK));
+	  lastDC = thisblockrow[-1][0];
+	  for (bi = 0; bi < ndummy; bi++) {
+	    thisblockrow[bi][0] = lastDC;
+	  }
+	}
+      }
+      if (iMCU_row == last_iMCU_row) {
+	blocks_across += ndummy;	/* include lower right corner */
+	MCUs_across = blocks_across / h_samp_factor;
+	for (block_row = block_rows; block_row < compptr->v_samp_factor;
+	     block_row++) {
+	  thisblockrow = buffer[block_row];
+	  lastblockrow = buffer[block_row-1];
+	  jzero_far((void FAR *) thisblockrow,
+		    (size_t) (blocks_across * SIZEOF(JBLOCK)));
+	  for (MCUindex = 0; MCUindex < MCUs_across; MCUindex++) {
+	    lastDC = lastblockrow[h_samp_factor-1][0];
+	    for (bi = 0; bi < h_samp_factor; bi++) {
+	      thisblockrow[bi][0] = lastDC;
+	    }
+	    thisblockrow += h_samp_factor; /* advance to next MCU in row */
+	    lastblockrow += h_samp_factor;
+	  }
+	}
+      }
+    }
+  }
+}
+
+
+/*
+ * Compress the buffered image on the device and fill the coefficient
+ * arrays.  image must be one contiguous block of image_height rows of
+ * image_width RGB pixels.  All device buffers live in one session of the
+ * buffer store, so every exit path releases them with a single pop.
+ * Returns an OpenCL error code; on failure the arrays are left untouched
+ * and the caller can still run the CPU stages.
+ */
+
+GLOBAL(cl_int)
+jopencl_compress_image (j_compress_ptr cinfo, JSAMPARRAY image)
+{
+  cl_int error_code;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem rgb_buf, color_buf, down_buf, divisor_buf, coef_buf;
+  cl_mem fdct_input;
+  cl_int divisors[MAX_COMPONENTS][DCTSIZE2];
+  cl_uint image_width = (cl_uint) cinfo->image_width;
+  cl_uint image_height = (cl_uint) cinfo->image_height;
+  cl_uint in_offset, in_pitch, h_expand, v_expand, last_row, table, out_offset;
+  size_t plane_width, plane_height, plane_size;
+  size_t down_offset[MAX_COMPONENTS], down_size, coef_offset[MAX_COMPONENTS];
+  size_t total_blocks;
+  size_t work_dim[2];
+  JBLOCKROW blocks;
+  JQUANT_TBL * qtbl;
+  jpeg_component_info * compptr;
+  int ci, i;
+
+  /* Full-size planes cover every MCU; each component's own plane covers
+   * its non-dummy blocks.  A component at full resolution reads its
+   * samples straight from the color planes.
+   */
+  plane_width = (size_t) jdiv_round_up((long) cinfo->image_width,
+				       (long) (cinfo->max_h_samp_factor * DCTSIZE))
+		* cinfo->max_h_samp_factor * DCTSIZE;
+  plane_height = (size_t) cinfo->total_iMCU_rows *
+		 cinfo->max_v_samp_factor * DCTSIZE;
+  plane_size = plane_width * plane_height;
+  down_size = 0;
+  total_blocks = 0;
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    down_offset[ci] = down_size;
+    if (compptr->h_samp_factor != cinfo->max_h_samp_factor ||
+	compptr->v_samp_factor != cinfo->max_v_samp_factor)
+      down_size += (size_t) compptr->width_in_blocks *
+		   compptr->height_in_blocks * DCTSIZE2;
+    coef_offset[ci] = total_blocks;
+    total_blocks += (size_t) compptr->width_in_blocks *
+		    compptr->height_in_blocks;
+    qtbl = cinfo->quant_tbl_ptrs[compptr->quant_tbl_no];
+    for (i = 0; i < DCTSIZE2; i++)
+      divisors[ci][i] = ((cl_int) qtbl->quantval[i]) << 3;
+  }
+
+  if (j_opencl_store_new_session(cinfo->cl_store))
+    return CL_OUT_OF_HOST_MEMORY;
+  kernel = NULL;
+  blocks = NULL;
+
+  rgb_buf = clCreateBuffer(cinfo->current_cl_context,
+		CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+		(size_t) image_width * image_height * 3 * SIZEOF(JSAMPLE),
+		image[0], &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  j_opencl_store_append_buffer(cinfo->cl_store, rgb_buf);
+  color_buf = clCreateBuffer(cinfo->current_cl_context, CL_MEM_READ_WRITE,
+		plane_size * 3 * SIZEOF(JSAMPLE), NULL, &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  j_opencl_store_append_buffer(cinfo->cl_store, color_buf);
+  down_buf = NULL;
+  if (down_size > 0) {
+    down_buf = clCreateBuffer(cinfo->current_cl_context, CL_MEM_READ_WRITE,
+		  down_size * SIZEOF(JSAMPLE), NULL, &error_code);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    j_opencl_store_append_buffer(cinfo->cl_store, down_buf);
+  }
+  divisor_buf = clCreateBuffer(cinfo->current_cl_context,
+		CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+		SIZEOF(divisors), divisors, &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  j_opencl_store_append_buffer(cinfo->cl_store, divisor_buf);
+  coef_buf = clCreateBuffer(cinfo->current_cl_context, CL_MEM_WRITE_ONLY,
+		total_blocks * SIZEOF(JBLOCK), NULL, &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  j_opencl_store_append_buffer(cinfo->cl_store, coef_buf);
+
+  /* Color conversion of every pixel of the padded planes */
+  error_code = j_opencl_prog_pool_get_rgb_to_ycc(cinfo->cl_prog_pool, &program);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  kernel = clCreateKernel(program, "convert", &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  clSetKernelArg(kernel, 0, sizeof(cl_mem), &rgb_buf);
+  clSetKernelArg(kernel, 1, sizeof(cl_uint), &image_width);
+  clSetKernelArg(kernel, 2, sizeof(cl_uint), &image_height);
+  error_code = clSetKernelArg(kernel, 3, sizeof(cl_mem), &color_buf);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  work_dim[0] = plane_height;
+  work_dim[1] = plane_width;
+  error_code = clEnqueueNDRangeKernel(cinfo->current_cl_queue, kernel,
+		2, NULL, work_dim, NULL, 0, NULL, NULL);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  clReleaseKernel(kernel);
+  kernel = NULL;
+
+  /* Downsampling, one launch per subsampled component */
+  if (down_buf != NULL) {
+    error_code = j_opencl_prog_pool_get_downsample(cinfo->cl_prog_pool,
+						   &program);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    kernel = clCreateKernel(program, "downsample", &error_code);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+	 ci++, compptr++) {
+      if (compptr->h_samp_factor == cinfo->max_h_samp_factor &&
+	  compptr->v_samp_factor == cinfo->max_v_samp_factor)
+	continue;
+      in_offset = (cl_uint) (ci * plane_size);
+      in_pitch = (cl_uint) plane_width;
+      h_expand = (cl_uint) (cinfo->max_h_samp_factor / compptr->h_samp_factor);
+      v_expand = (cl_uint) (cinfo->max_v_samp_factor / compptr->v_samp_factor);
+      /* jcprep.c downsamples ceil(image_height / max_v_samp_factor) row
+       * groups and pads below them by repeating the last output row.
+       */
+      last_row = (cl_uint) (jdiv_round_up((long) cinfo->image_height,
+					  (long) cinfo->max_v_samp_factor)
+			    * compptr->v_samp_factor - 1);
+      out_offset = (cl_uint) down_offset[ci];
+      clSetKernelArg(kernel, 0, sizeof(cl_mem), &color_buf);
+      clSetKernelArg(kernel, 1, sizeof(cl_uint), &in_offset);
+      clSetKernelArg(kernel, 2, sizeof(cl_uint), &in_pitch);
+      clSetKernelArg(kernel, 3, sizeof(cl_uint), &h_expand);
+      clSetKernelArg(kernel, 4, sizeof(cl_uint), &v_expand);
+      clSetKernelArg(kernel, 5, sizeof(cl_uint), &last_row);
+      clSetKernelArg(kernel, 6, sizeof(cl_mem), &down_buf);
+      error_code = clSetKernelArg(kernel, 7, sizeof(cl_uint), &out_offset);
+      if (error_code != CL_SUCCESS)
+	goto EXIT;
+      work_dim[0] = (size_t) compptr->height_in_blocks * DCTSIZE;
+      work_dim[1] = (size_t) compptr->width_in_blocks * DCTSIZE;
+      error_code = clEnqueueNDRangeKernel(cinfo->current_cl_queue, kernel,
+		    2, NULL, work_dim, NULL, 0, NULL, NULL);
+      if (error_code != CL_SUCCESS)
+	goto EXIT;
+    }
+    clReleaseKernel(kernel);
+    kernel = NULL;
+  }
+
+  /* DCT and quantization, one launch per component */
+  error_code = j_opencl_prog_pool_get_fdct(cinfo->cl_prog_pool, &program);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  kernel = clCreateKernel(program, "fdct", &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    if (compptr->h_samp_factor == cinfo->max_h_samp_factor &&
+	compptr->v_samp_factor == cinfo->max_v_samp_factor) {
+      fdct_input = color_buf;
+      in_offset = (cl_uint) (ci * plane_size);
+      in_pitch = (cl_uint) plane_width;
+    } else {
+      fdct_input = down_buf;
+      in_offset = (cl_uint) down_offset[ci];
+      in_pitch = (cl_uint) (compptr->width_in_blocks * DCTSIZE);
+    }
+    table = (cl_uint) ci;
+    out_offset = (cl_uint) coef_offset[ci];
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), &fdct_input);
+    clSetKernelArg(kernel, 1, sizeof(cl_uint), &in_offset);
+    clSetKernelArg(kernel, 2, sizeof(cl_uint), &in_pitch);
+    clSetKernelArg(kernel, 3, sizeof(cl_mem), &divisor_buf);
+    clSetKernelArg(kernel, 4, sizeof(cl_uint), &table);
+    clSetKernelArg(kernel, 5, sizeof(cl_mem), &coef_buf);
+    error_code = clSetKernelArg(kernel, 6, sizeof(cl_uint), &out_offset);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    work_dim[0] = compptr->height_in_blocks;
+    work_dim[1] = compptr->width_in_blocks;
+    error_code = clEnqueueNDRangeKernel(cinfo->current_cl_queue, kernel,
+		  2, NULL, work_dim, NULL, 0, NULL, NULL);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+  }
+  clReleaseKernel(kernel);
+  kernel = NULL;
+
+  /* Read the coefficients back and spread them over the virtual arrays */
+  blocks = (JBLOCKROW) malloc(total_blocks * SIZEOF(JBLOCK));
+  if (blocks == NULL) {
+    error_code = CL_OUT_OF_HOST_MEMORY;
+    goto EXIT;
+  }
+  error_code = clEnqueueReadBuffer(cinfo->current_cl_queue, coef_buf,
+		CL_TRUE, 0, total_blocks * SIZEOF(JBLOCK), blocks,
+		0, NULL, NULL);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  store_coefficients(cinfo, blocks);
+
+EXIT:
+  if (kernel != NULL)
+    clReleaseKernel(kernel);
+  if (error_code != CL_SUCCESS)
+    clFinish(cinfo->current_cl_queue); /* before the buffers go away */
+  j_opencl_store_pop_session(cinfo->cl_store);
+  if (blocks != NULL)
+    free(blocks);
+  return error_code;
+}
@@ -330,6 +330,10 @@ jpeg_set_defaults (j_compress_ptr cinfo)
   cinfo->restart_interval = 0;
   cinfo->restart_in_rows = 0;
 
+  /* Entropy coding on the calling thread only */
+  cinfo->entropy_threads = 1;
+  cinfo->fast_optimize = FALSE;
+
   /* Fill in default JFIF marker parameters.  Note that whether the marker
    * will actually be written is determined by jpeg_set_colorspace.
    *
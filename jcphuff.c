@@ -16,6 +16,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jchuff.h"		/* Declarations shared with jchuff.c */
+#include "jthreadpool.h"
 
 #ifdef C_PROGRESSIVE_SUPPORTED
 
@@ -57,6 +58,7 @@ typedef struct {
 
   /* Statistics tables for optimization; again, one set is enough */
   long * count_ptrs[NUM_HUFF_TBLS];
+  long * worker_counts;		/* per-thread tables for parallel gathering */
 } phuff_entropy_encoder;
 
 typedef phuff_entropy_encoder * phuff_entropy_ptr;
@@ -96,6 +98,9 @@ METHODDEF(boolean) encode_mcu_AC_refine JPP((j_compress_ptr cinfo,
 					     JBLOCKROW *MCU_data));
 METHODDEF(void) finish_pass_phuff JPP((j_compress_ptr cinfo));
 METHODDEF(void) finish_pass_gather_phuff JPP((j_compress_ptr cinfo));
+METHODDEF(boolean) encode_mcu_deferred JPP((j_compress_ptr cinfo,
+					    JBLOCKROW *MCU_data));
+METHODDEF(void) finish_pass_gather_parallel JPP((j_compress_ptr cinfo));
 
 
 /*
@@ -139,6 +144,14 @@ start_pass_phuff (j_compress_ptr cinfo, boolean gather_statistics)
     entropy->pub.finish_pass = finish_pass_gather_phuff;
   else
     entropy->pub.finish_pass = finish_pass_phuff;
+  /* The first scan of a band can be counted in parallel from the whole
+   * image's coefficients (see below); refinement scans cannot.
+   */
+  if (gather_statistics && cinfo->Ah == 0 && cinfo->parallel_entropy &&
+      cinfo->coef->coef_arrays != NULL) {
+    entropy->pub.encode_mcu = encode_mcu_deferred;
+    entropy->pub.finish_pass = finish_pass_gather_parallel;
+  }
 
   /* Only DC coefficients may be interleaved, so cinfo->comps_in_scan = 1
    * for AC coefficients.
@@ -806,6 +819,299 @@ finish_pass_gather_phuff (j_compress_ptr cinfo)
 }
 
 
+/*
+ * Parallel statistics gathering for DC and AC first scans.
+ *
+ * Every MCU row is a task, counted into tables private to the thread
+ * running it.  DC predictions start from the point-transformed DC of the
+ * block just before the row, as in jchuff.c.  EOB runs are what tie an AC
+ * scan's rows together: a task cannot know the run it inherits, so it
+ * only counts the runs it sees completed after its first flush point (a
+ * newly coded coefficient or a restart) and reports the EOBs before that
+ * point and those still pending at its end.  finish_pass_gather_parallel
+ * then joins the runs across rows in order.  Runs reaching 0x7FFF are
+ * forced out by themselves, just as the serial code does, so the counts
+ * come out exactly the same.
+ *
+ * AC refinement scans also force runs out when the correction-bit buffer
+ * fills, which depends on everything before; they are counted serially.
+ */
+
+typedef struct {
+  unsigned long lead;		/* EOBs before the first flush point */
+  unsigned int trail;		/* EOBs pending at the end of the row */
+  boolean flushed;		/* did the row have a flush point? */
+  int error;			/* message code of a failure, or 0 */
+} phuff_row_state;
+
+typedef struct {
+  j_compress_ptr cinfo;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN]; /* whole arrays of the scan */
+  long * counts;		/* NUM_HUFF_TBLS tables per thread */
+  phuff_row_state * rows;	/* one per MCU row */
+} phuff_gather_job;
+
+#define COUNT_TABLE_SIZE  257	/* what jpeg_gen_optimal_table expects */
+
+
+/* Count the EOBRUN symbols for a run of EOBs, as emit_eobrun would */
+
+LOCAL(void)
+count_eobrun (long counts[], unsigned long run)
+{
+  int nbits;
+  unsigned long temp;
+
+  while (run >= 0x7FFF) {	/* forced out at the counter's limit */
+    counts[14 << 4]++;
+    run -= 0x7FFF;
+  }
+  if (run > 0) {
+    temp = run;
+    nbits = 0;
+    while ((temp >>= 1))
+      nbits++;
+    counts[nbits << 4]++;
+  }
+}
+
+
+/* Count the DC symbols of MCU row number index */
+
+LOCAL(void)
+gather_DC_row (phuff_gather_job * job, int index, long * counts)
+{
+  j_compress_ptr cinfo = job->cinfo;
+  int Al = cinfo->Al;
+  int last_dc_val[MAX_COMPS_IN_SCAN];
+  register int temp, temp2, nbits;
+  JDIMENSION MCU_col, MCU_num, prev_row, prev_col;
+  JBLOCKROW buffer_ptr;
+  jpeg_component_info * compptr;
+  int ci, xindex, yindex;
+  ISHIFT_TEMPS
+
+  /* Pick up the DC predictions where the previous MCU left them */
+  MCU_num = (JDIMENSION) index * cinfo->MCUs_per_row;
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    if (MCU_num == 0) {
+      last_dc_val[ci] = 0;
+      continue;
+    }
+    prev_row = (MCU_num - 1) / cinfo->MCUs_per_row;
+    prev_col = (MCU_num - 1) % cinfo->MCUs_per_row;
+    last_dc_val[ci] = IRIGHT_SHIFT((int) job->buffer[ci]
+      [prev_row * compptr->MCU_height + compptr->MCU_height - 1]
+      [prev_col * compptr->MCU_width + compptr->MCU_width - 1][0], Al);
+  }
+
+  for (MCU_col = 0; MCU_col < cinfo->MCUs_per_row; MCU_col++, MCU_num++) {
+    if (cinfo->restart_interval && MCU_num % cinfo->restart_interval == 0)
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++)
+	last_dc_val[ci] = 0;
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+      compptr = cinfo->cur_comp_info[ci];
+      for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+	buffer_ptr = job->buffer[ci][index * compptr->MCU_height + yindex]
+		     + MCU_col * compptr->MCU_width;
+	for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+	  /* as in encode_mcu_DC_first */
+	  temp2 = IRIGHT_SHIFT((int) buffer_ptr[xindex][0], Al);
+	  temp = temp2 - last_dc_val[ci];
+	  last_dc_val[ci] = temp2;
+	  if (temp < 0)
+	    temp = -temp;
+	  nbits = 0;
+	  while (temp) {
+	    nbits++;
+	    temp >>= 1;
+	  }
+	  if (nbits > MAX_COEF_BITS+1) {
+	    job->rows[index].error = JERR_BAD_DCT_COEF;
+	    return;
+	  }
+	  counts[compptr->dc_tbl_no * COUNT_TABLE_SIZE + nbits]++;
+	}
+      }
+    }
+  }
+}
+
+
+/* Count the AC symbols of MCU row number index (one component) */
+
+LOCAL(void)
+gather_AC_row (phuff_gather_job * job, int index, long * counts)
+{
+  j_compress_ptr cinfo = job->cinfo;
+  phuff_row_state * row = &job->rows[index];
+  int Se = cinfo->Se;
+  int Al = cinfo->Al;
+  register int temp, nbits;
+  register int r, k;
+  unsigned long EOBRUN;
+  JDIMENSION MCU_col, MCU_num;
+  JBLOCKROW buffer_ptr;
+
+  counts += cinfo->cur_comp_info[0]->ac_tbl_no * COUNT_TABLE_SIZE;
+  buffer_ptr = job->buffer[0][index];
+  MCU_num = (JDIMENSION) index * cinfo->MCUs_per_row;
+  EOBRUN = 0;
+
+#define FLUSH_POINT()  \
+  { if (! row->flushed) { row->lead = EOBRUN; row->flushed = TRUE; }  \
+    else count_eobrun(counts, EOBRUN);  \
+    EOBRUN = 0; }
+
+  for (MCU_col = 0; MCU_col < cinfo->MCUs_per_row; MCU_col++, MCU_num++) {
+    if (cinfo->restart_interval && MCU_num > 0 &&
+	MCU_num % cinfo->restart_interval == 0)
+      FLUSH_POINT();
+    /* as in encode_mcu_AC_first */
+    r = 0;
+    for (k = cinfo->Ss; k <= Se; k++) {
+      if ((temp = buffer_ptr[MCU_col][jpeg_natural_order[k]]) == 0) {
+	r++;
+	continue;
+      }
+      if (temp < 0)
+	temp = -temp;
+      temp >>= Al;
+      if (temp == 0) {
+	r++;
+	continue;
+      }
+      FLUSH_POINT();
+      while (r > 15) {
+	counts[0xF0]++;
+	r -= 16;
+      }
+      nbits = 1;
+      while ((temp >>= 1))
+	nbits++;
+      if (nbits > MAX_COEF_BITS) {
+	row->error = JERR_BAD_DCT_COEF;
+	return;
+      }
+      counts[(r << 4) + nbits]++;
+      r = 0;
+    }
+    if (r > 0) {
+      EOBRUN++;
+      /* the serial count only is known once a flush point has passed */
+      if (row->flushed && EOBRUN == 0x7FFF) {
+	count_eobrun(counts, EOBRUN);
+	EOBRUN = 0;
+      }
+    }
+  }
+
+#undef FLUSH_POINT
+
+  if (row->flushed)
+    row->trail = (unsigned int) EOBRUN;
+  else
+    row->lead = EOBRUN;
+}
+
+
+/* Thread pool task: count MCU row number index */
+
+static void gather_MCU_row (void * arg, int index, int worker)
+{
+  phuff_gather_job * job = (phuff_gather_job *) arg;
+  long * counts = job->counts +
+		  (size_t) worker * NUM_HUFF_TBLS * COUNT_TABLE_SIZE;
+
+  if (job->cinfo->Ss == 0)
+    gather_DC_row(job, index, counts);
+  else
+    gather_AC_row(job, index, counts);
+}
+
+
+/*
+ * MCUs are not looked at as they come; finish_pass_gather_parallel
+ * counts the whole scan.
+ */
+
+METHODDEF(boolean)
+encode_mcu_deferred (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  return TRUE;
+}
+
+
+/*
+ * Count the whole scan at the end of the pass, then make the tables.
+ */
+
+METHODDEF(void)
+finish_pass_gather_parallel (j_compress_ptr cinfo)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
+  phuff_gather_job job;
+  int workers, w, tbl, i, num_rows;
+  unsigned long EOBRUN;
+  long * counts;
+
+  workers = j_threadpool_get_worker_count(cinfo->cpu_pool);
+  if (entropy->worker_counts == NULL)
+    entropy->worker_counts = (long *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+		(size_t) workers * NUM_HUFF_TBLS * COUNT_TABLE_SIZE * SIZEOF(long));
+  jzero_far((void FAR *) entropy->worker_counts,
+	    (size_t) workers * NUM_HUFF_TBLS * COUNT_TABLE_SIZE * SIZEOF(long));
+  num_rows = (int) cinfo->MCU_rows_in_scan;
+
+  job.cinfo = cinfo;
+  jpeg_access_scan_coefs(cinfo, job.buffer);
+  job.counts = entropy->worker_counts;
+  job.rows = (phuff_row_state *)
+    (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				num_rows * SIZEOF(phuff_row_state));
+  jzero_far((void FAR *) job.rows, num_rows * SIZEOF(phuff_row_state));
+  j_threadpool_run(cinfo->cpu_pool, num_rows, gather_MCU_row, &job);
+
+  for (i = 0; i < num_rows; i++)
+    if (job.rows[i].error)
+      ERREXIT(cinfo, job.rows[i].error);
+
+  /* Merge the threads' tables into the ones start_pass_phuff set up */
+  for (w = 0; w < workers; w++) {
+    counts = job.counts + (size_t) w * NUM_HUFF_TBLS * COUNT_TABLE_SIZE;
+    for (tbl = 0; tbl < NUM_HUFF_TBLS; tbl++) {
+      if (entropy->count_ptrs[tbl] != NULL)
+	for (i = 0; i < COUNT_TABLE_SIZE; i++)
+	  entropy->count_ptrs[tbl][i] += counts[i];
+      counts += COUNT_TABLE_SIZE;
+    }
+  }
+
+  /* Join the EOB runs across the rows */
+  if (cinfo->Ss != 0) {
+    counts = entropy->count_ptrs[entropy->ac_tbl_no];
+    EOBRUN = 0;
+    for (i = 0; i < num_rows; i++) {
+      if (job.rows[i].flushed) {
+	count_eobrun(counts, EOBRUN + job.rows[i].lead);
+	EOBRUN = job.rows[i].trail;
+      } else {
+	EOBRUN += job.rows[i].lead;
+	while (EOBRUN >= 0x7FFF) {
+	  counts[14 << 4]++;
+	  EOBRUN -= 0x7FFF;
+	}
+      }
+    }
+    count_eobrun(counts, EOBRUN); /* what finish_pass would flush */
+  }
+
+  finish_pass_gather_phuff(cinfo);
+}
+
+
 /*
  * Module initialization routine for progressive Huffman entropy encoding.
  */
@@ -828,6 +1134,7 @@ jinit_phuff_encoder (j_compress_ptr cinfo)
     entropy->count_ptrs[i] = NULL;
   }
   entropy->bit_buffer = NULL;	/* needed only in AC refinement scan */
+  entropy->worker_counts = NULL; /* needed only for parallel gathering */
 }
 
 #endif /* C_PROGRESSIVE_SUPPORTED */
@@ -48,6 +48,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /* Pointer to routine to downsample a single component */
@@ -62,6 +63,11 @@ typedef struct {
 
   /* Downsampling method pointers, one per component */
   downsample1_ptr methods[MAX_COMPONENTS];
+
+  /* SSE2/AVX2 versions of the 2:1 row loops, or NULL */
+  jsimd_h2v1_downsample_ptr h2v1_row;
+  jsimd_h2v2_downsample_ptr h2v2_row;
+  jsimd_h2v2_smooth_ptr h2v2_smooth_row;
 } my_downsampler;
 
 typedef my_downsampler * my_downsample_ptr;
@@ -212,6 +218,7 @@ METHODDEF(void)
 h2v1_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
 		 JSAMPARRAY input_data, JSAMPARRAY output_data)
 {
+  my_downsample_ptr downsample = (my_downsample_ptr) cinfo->downsample;
   int outrow;
   JDIMENSION outcol;
   JDIMENSION output_cols = compptr->width_in_blocks * DCTSIZE;
@@ -228,8 +235,14 @@ h2v1_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
   for (outrow = 0; outrow < compptr->v_samp_factor; outrow++) {
     outptr = output_data[outrow];
     inptr = input_data[outrow];
+    outcol = 0;
+    if (downsample->h2v1_row != NULL) {
+      /* vector code does an even number of samples, so bias starts over */
+      outcol = (*downsample->h2v1_row) (inptr, outptr, output_cols);
+      inptr += outcol * 2; outptr += outcol;
+    }
     bias = 0;			/* bias = 0,1,0,1,... for successive samples */
-    for (outcol = 0; outcol < output_cols; outcol++) {
+    for (; outcol < output_cols; outcol++) {
       *outptr++ = (JSAMPLE) ((GETJSAMPLE(*inptr) + GETJSAMPLE(inptr[1])
 			      + bias) >> 1);
       bias ^= 1;		/* 0=>1, 1=>0 */
@@ -249,6 +262,7 @@ METHODDEF(void)
 h2v2_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
 		 JSAMPARRAY input_data, JSAMPARRAY output_data)
 {
+  my_downsample_ptr downsample = (my_downsample_ptr) cinfo->downsample;
   int inrow, outrow;
   JDIMENSION outcol;
   JDIMENSION output_cols = compptr->width_in_blocks * DCTSIZE;
@@ -267,8 +281,13 @@ h2v2_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
     outptr = output_data[outrow];
     inptr0 = input_data[inrow];
     inptr1 = input_data[inrow+1];
+    outcol = 0;
+    if (downsample->h2v2_row != NULL) {
+      outcol = (*downsample->h2v2_row) (inptr0, inptr1, outptr, output_cols);
+      inptr0 += outcol * 2; inptr1 += outcol * 2; outptr += outcol;
+    }
     bias = 1;			/* bias = 1,2,1,2,... for successive samples */
-    for (outcol = 0; outcol < output_cols; outcol++) {
+    for (; outcol < output_cols; outcol++) {
       *outptr++ = (JSAMPLE) ((GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[1]) +
 			      GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[1])
 			      + bias) >> 2);
@@ -292,8 +311,9 @@ METHODDEF(void)
 h2v2_smooth_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
 			JSAMPARRAY input_data, JSAMPARRAY output_data)
 {
+  my_downsample_ptr downsample = (my_downsample_ptr) cinfo->downsample;
   int inrow, outrow;
-  JDIMENSION colctr;
+  JDIMENSION colctr, simd_cols;
   JDIMENSION output_cols = compptr->width_in_blocks * DCTSIZE;
   register JSAMPROW inptr0, inptr1, above_ptr, below_ptr, outptr;
   INT32 membersum, neighsum, memberscale, neighscale;
@@ -343,7 +363,19 @@ h2v2_smooth_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
     *outptr++ = (JSAMPLE) ((membersum + 32768) >> 16);
     inptr0 += 2; inptr1 += 2; above_ptr += 2; below_ptr += 2;
 
-    for (colctr = output_cols - 2; colctr > 0; colctr--) {
+    simd_cols = 0;
+    if (downsample->h2v2_smooth_row != NULL) {
+      simd_cols = (*downsample->h2v2_smooth_row) (above_ptr, inptr0, inptr1,
+						  below_ptr, outptr,
+						  output_cols - 2,
+						  (int) memberscale,
+						  (int) neighscale);
+      inptr0 += simd_cols * 2; inptr1 += simd_cols * 2;
+      above_ptr += simd_cols * 2; below_ptr += simd_cols * 2;
+      outptr += simd_cols;
+    }
+
+    for (colctr = output_cols - 2 - simd_cols; colctr > 0; colctr--) {
       /* sum of pixels directly mapped to this output element */
       membersum = GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[1]) +
 		  GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[1]);
@@ -475,6 +507,20 @@ jinit_downsampler (j_compress_ptr cinfo)
   downsample->pub.start_pass = start_pass_downsample;
   downsample->pub.downsample = sep_downsample;
   downsample->pub.need_context_rows = FALSE;
+  downsample->h2v1_row = NULL;
+  downsample->h2v2_row = NULL;
+  downsample->h2v2_smooth_row = NULL;
+#ifdef JSIMD_X86
+  if (jsimd_cpu_features() & JSIMD_AVX2) {
+    downsample->h2v1_row = jsimd_h2v1_downsample_avx2;
+    downsample->h2v2_row = jsimd_h2v2_downsample_avx2;
+    downsample->h2v2_smooth_row = jsimd_h2v2_smooth_avx2;
+  } else if (jsimd_cpu_features() & JSIMD_SSE2) {
+    downsample->h2v1_row = jsimd_h2v1_downsample_sse2;
+    downsample->h2v2_row = jsimd_h2v2_downsample_sse2;
+    downsample->h2v2_smooth_row = jsimd_h2v2_smooth_sse2;
+  }
+#endif
 
   if (cinfo->CCIR601_sampling)
     ERREXIT(cinfo, JERR_CCIR601_NOTIMPL);
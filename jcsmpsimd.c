@@ -0,0 +1,253 @@
+/*
+ * jcsmpsimd.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains SSE2 and AVX2 row helpers for the 2:1 downsamplers
+ * of jcsample.c.
+ *
+ * Each output sample averages a pair of input columns.  Loaded as 16-bit
+ * words, a row holds such a pair in every word, so (w & 0xFF) + (w >> 8)
+ * is the pair sum; the sums then stay in 16-bit lanes, where they cannot
+ * overflow.  The alternating rounding bias of the scalar code repeats
+ * every two outputs, and the helpers always do an even number of them.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#include <immintrin.h>
+
+#define SSE2_TARGET  __attribute__((target("sse2")))
+#define AVX2_TARGET  __attribute__((target("avx2")))
+
+
+/*
+ * SSE2 versions: 16 output samples per step.
+ */
+
+/* Sums of the eight column pairs in 16 input samples */
+SSE2_TARGET static __inline__ __m128i
+pairsum_sse2 (JSAMPROW inptr)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *) inptr);
+
+  return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0xFF)),
+		       _mm_srli_epi16(v, 8));
+}
+
+SSE2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v1_downsample_sse2 (JSAMPROW inptr, JSAMPROW outptr,
+			    JDIMENSION output_cols)
+{
+  __m128i bias = _mm_set1_epi32(1 << 16);	/* 0,1,0,1,... */
+  JDIMENSION outcol;
+
+  for (outcol = 0; outcol + 16 <= output_cols; outcol += 16) {
+    _mm_storeu_si128((__m128i *) (outptr + outcol),
+      _mm_packus_epi16(
+	_mm_srli_epi16(_mm_add_epi16(pairsum_sse2(inptr + outcol * 2),
+				     bias), 1),
+	_mm_srli_epi16(_mm_add_epi16(pairsum_sse2(inptr + outcol * 2 + 16),
+				     bias), 1)));
+  }
+  return outcol;
+}
+
+SSE2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v2_downsample_sse2 (JSAMPROW inptr0, JSAMPROW inptr1,
+			    JSAMPROW outptr, JDIMENSION output_cols)
+{
+  __m128i bias = _mm_set1_epi32(1 + (2 << 16));	/* 1,2,1,2,... */
+  __m128i lo, hi;
+  JDIMENSION outcol;
+
+  for (outcol = 0; outcol + 16 <= output_cols; outcol += 16) {
+    lo = _mm_add_epi16(pairsum_sse2(inptr0 + outcol * 2),
+		       pairsum_sse2(inptr1 + outcol * 2));
+    hi = _mm_add_epi16(pairsum_sse2(inptr0 + outcol * 2 + 16),
+		       pairsum_sse2(inptr1 + outcol * 2 + 16));
+    _mm_storeu_si128((__m128i *) (outptr + outcol),
+      _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(lo, bias), 2),
+		       _mm_srli_epi16(_mm_add_epi16(hi, bias), 2)));
+  }
+  return outcol;
+}
+
+/* Sums of the outer neighbors (columns -1 and +2) of the eight column
+ * pairs starting at inptr
+ */
+SSE2_TARGET static __inline__ __m128i
+outersum_sse2 (JSAMPROW inptr)
+{
+  return _mm_add_epi16(
+	   _mm_and_si128(_mm_loadu_si128((const __m128i *) (inptr - 1)),
+			 _mm_set1_epi16(0xFF)),
+	   _mm_srli_epi16(_mm_loadu_si128((const __m128i *) (inptr + 1)), 8));
+}
+
+/* Eight smoothed outputs, as in the scalar loop, in 16-bit lanes */
+SSE2_TARGET static __inline__ __m128i
+smooth8_sse2 (JSAMPROW above_ptr, JSAMPROW inptr0, JSAMPROW inptr1,
+	      JSAMPROW below_ptr, __m128i scales)
+{
+  __m128i membersum, neighsum, lo, hi;
+
+  membersum = _mm_add_epi16(pairsum_sse2(inptr0), pairsum_sse2(inptr1));
+  /* edge neighbors count twice as much as corner neighbors */
+  neighsum = _mm_add_epi16(
+	       _mm_add_epi16(pairsum_sse2(above_ptr), pairsum_sse2(below_ptr)),
+	       _mm_add_epi16(outersum_sse2(inptr0), outersum_sse2(inptr1)));
+  neighsum = _mm_add_epi16(_mm_add_epi16(neighsum, neighsum),
+			   _mm_add_epi16(outersum_sse2(above_ptr),
+					 outersum_sse2(below_ptr)));
+  /* membersum * memberscale + neighsum * neighscale, rounded */
+  lo = _mm_madd_epi16(_mm_unpacklo_epi16(membersum, neighsum), scales);
+  hi = _mm_madd_epi16(_mm_unpackhi_epi16(membersum, neighsum), scales);
+  lo = _mm_srli_epi32(_mm_add_epi32(lo, _mm_set1_epi32(32768)), 16);
+  hi = _mm_srli_epi32(_mm_add_epi32(hi, _mm_set1_epi32(32768)), 16);
+  return _mm_packs_epi32(lo, hi);
+}
+
+SSE2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v2_smooth_sse2 (JSAMPROW above_ptr, JSAMPROW inptr0,
+			JSAMPROW inptr1, JSAMPROW below_ptr,
+			JSAMPROW outptr, JDIMENSION output_cols,
+			int memberscale, int neighscale)
+{
+  __m128i scales = _mm_set1_epi32((neighscale << 16) | memberscale);
+  JDIMENSION outcol, incol;
+
+  for (outcol = 0; outcol + 16 <= output_cols; outcol += 16) {
+    incol = outcol * 2;
+    _mm_storeu_si128((__m128i *) (outptr + outcol),
+      _mm_packus_epi16(
+	smooth8_sse2(above_ptr + incol, inptr0 + incol, inptr1 + incol,
+		     below_ptr + incol, scales),
+	smooth8_sse2(above_ptr + incol + 16, inptr0 + incol + 16,
+		     inptr1 + incol + 16, below_ptr + incol + 16, scales)));
+  }
+  return outcol;
+}
+
+
+/*
+ * AVX2 versions: the same steps on 32 output samples.  The final 16->8
+ * bit pack works within 128-bit halves, hence the permute after it.
+ */
+
+AVX2_TARGET static __inline__ __m256i
+pairsum_avx2 (JSAMPROW inptr)
+{
+  __m256i v = _mm256_loadu_si256((const __m256i *) inptr);
+
+  return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0xFF)),
+			  _mm256_srli_epi16(v, 8));
+}
+
+AVX2_TARGET static __inline__ void
+store32_avx2 (JSAMPROW outptr, __m256i first, __m256i second)
+{
+  _mm256_storeu_si256((__m256i *) outptr,
+		      _mm256_permute4x64_epi64(_mm256_packus_epi16(first,
+								   second),
+					       0xD8));
+}
+
+AVX2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v1_downsample_avx2 (JSAMPROW inptr, JSAMPROW outptr,
+			    JDIMENSION output_cols)
+{
+  __m256i bias = _mm256_set1_epi32(1 << 16);
+  JDIMENSION outcol;
+
+  for (outcol = 0; outcol + 32 <= output_cols; outcol += 32) {
+    store32_avx2(outptr + outcol,
+      _mm256_srli_epi16(_mm256_add_epi16(pairsum_avx2(inptr + outcol * 2),
+					 bias), 1),
+      _mm256_srli_epi16(_mm256_add_epi16(pairsum_avx2(inptr + outcol * 2
+						      + 32), bias), 1));
+  }
+  return outcol;
+}
+
+AVX2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v2_downsample_avx2 (JSAMPROW inptr0, JSAMPROW inptr1,
+			    JSAMPROW outptr, JDIMENSION output_cols)
+{
+  __m256i bias = _mm256_set1_epi32(1 + (2 << 16));
+  __m256i lo, hi;
+  JDIMENSION outcol;
+
+  for (outcol = 0; outcol + 32 <= output_cols; outcol += 32) {
+    lo = _mm256_add_epi16(pairsum_avx2(inptr0 + outcol * 2),
+			  pairsum_avx2(inptr1 + outcol * 2));
+    hi = _mm256_add_epi16(pairsum_avx2(inptr0 + outcol * 2 + 32),
+			  pairsum_avx2(inptr1 + outcol * 2 + 32));
+    store32_avx2(outptr + outcol,
+		 _mm256_srli_epi16(_mm256_add_epi16(lo, bias), 2),
+		 _mm256_srli_epi16(_mm256_add_epi16(hi, bias), 2));
+  }
+  return outcol;
+}
+
+AVX2_TARGET static __inline__ __m256i
+outersum_avx2 (JSAMPROW inptr)
+{
+  return _mm256_add_epi16(
+	   _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (inptr - 1)),
+			    _mm256_set1_epi16(0xFF)),
+	   _mm256_srli_epi16(_mm256_loadu_si256((const __m256i *) (inptr + 1)),
+			     8));
+}
+
+AVX2_TARGET static __inline__ __m256i
+smooth16_avx2 (JSAMPROW above_ptr, JSAMPROW inptr0, JSAMPROW inptr1,
+	       JSAMPROW below_ptr, __m256i scales)
+{
+  __m256i membersum, neighsum, lo, hi;
+
+  membersum = _mm256_add_epi16(pairsum_avx2(inptr0), pairsum_avx2(inptr1));
+  neighsum = _mm256_add_epi16(
+	       _mm256_add_epi16(pairsum_avx2(above_ptr),
+				pairsum_avx2(below_ptr)),
+	       _mm256_add_epi16(outersum_avx2(inptr0), outersum_avx2(inptr1)));
+  neighsum = _mm256_add_epi16(_mm256_add_epi16(neighsum, neighsum),
+			      _mm256_add_epi16(outersum_avx2(above_ptr),
+					       outersum_avx2(below_ptr)));
+  /* The unpacks and the pack below undo each other's lane order */
+  lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(membersum, neighsum), scales);
+  hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(membersum, neighsum), scales);
+  lo = _mm256_srli_epi32(_mm256_add_epi32(lo, _mm256_set1_epi32(32768)), 16);
+  hi = _mm256_srli_epi32(_mm256_add_epi32(hi, _mm256_set1_epi32(32768)), 16);
+  return _mm256_packs_epi32(lo, hi);
+}
+
+AVX2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v2_smooth_avx2 (JSAMPROW above_ptr, JSAMPROW inptr0,
+			JSAMPROW inptr1, JSAMPROW below_ptr,
+			JSAMPROW outptr, JDIMENSION output_cols,
+			int memberscale, int neighscale)
+{
+  __m256i scales = _mm256_set1_epi32((neighscale << 16) | memberscale);
+  JDIMENSION outcol, incol;
+
+  for (outcol = 0; outcol + 32 <= output_cols; outcol += 32) {
+    incol = outcol * 2;
+    store32_avx2(outptr + outcol,
+		 smooth16_avx2(above_ptr + incol, inptr0 + incol,
+			       inptr1 + incol, below_ptr + incol, scales),
+		 smooth16_avx2(above_ptr + incol + 32, inptr0 + incol + 32,
+			       inptr1 + incol + 32, below_ptr + incol + 32,
+			       scales));
+  }
+  return outcol;
+}
+
+#endif /* JSIMD_X86 */
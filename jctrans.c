@@ -376,6 +376,10 @@ transencode_coef_controller (j_compress_ptr cinfo,
 
   /* Save pointer to virtual arrays */
   coef->whole_image = coef_arrays;
+  /* The application's arrays may not allow whole-array access, so they
+   * are not offered to the entropy encoder (see jchuff.c).
+   */
+  coef->pub.coef_arrays = NULL;
 
   /* Allocate and pre-zero space for dummy DCT blocks. */
   buffer = (JBLOCKROW)
@@ -19,8 +19,8 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
-#include "jopenclstore.h"
-#include "jopenclprogpool.h"
+#include "jopenclenv.h"
+#include "jthreadpool.h"
 
 /*
  * Initialization of a JPEG decompression object.
@@ -81,46 +81,6 @@ jpeg_CreateDecompress (j_decompress_ptr cinfo, int version, size_t structsize)
 
   /* OK, I'm ready */
   cinfo->global_state = DSTATE_START;
-  // init cl_context
-  {
-      cl_int error_code;
-      cl_platform_id platform_id;
-      cl_device_id device_id;
-      
-      if(CL_SUCCESS != (error_code = clGetPlatformIDs(1,&platform_id,NULL)) )
-      {
-          ERREXIT(cinfo,error_code);
-      }
-      if(CL_SUCCESS != (error_code = clGetDeviceIDs(platform_id,CL_DEVICE_TYPE_GPU,1,&device_id,NULL)) )
-      {
-          ERREXIT(cinfo,error_code);
-      }
-      cinfo->current_cl_context = clCreateContext(NULL,1,&device_id,NULL,NULL,&error_code);
-      if(error_code != CL_SUCCESS)
-      {
-          ERREXIT(cinfo,error_code);
-      }
-      cinfo->current_cl_queue = clCreateCommandQueue(cinfo->current_cl_context,
-              device_id,(cl_command_queue_properties)NULL,&error_code);
-      if(error_code != CL_SUCCESS)
-      {
-          ERREXIT(cinfo,error_code);
-      }
-      cinfo->current_device_id = device_id;
-  }
-
-  // init cl store
-  cinfo->cl_store = j_opencl_store_create();
-  if(!cinfo->cl_store)
-  {
-      ERREXIT(cinfo,JERR_OUT_OF_MEMORY);
-  }
-  // init cl prog pool
-  cinfo->cl_prog_pool = j_opencl_prog_pool_create(cinfo);
-  if(!cinfo->cl_prog_pool)
-  {
-      ERREXIT(cinfo,JERR_OUT_OF_MEMORY);
-  }
 }
 
 
@@ -131,10 +91,11 @@ jpeg_CreateDecompress (j_decompress_ptr cinfo, int version, size_t structsize)
 GLOBAL(void)
 jpeg_destroy_decompress (j_decompress_ptr cinfo)
 {
-    j_opencl_store_destroy(cinfo->cl_store);
-    j_opencl_prog_pool_destroy(cinfo->cl_prog_pool);
-    clReleaseCommandQueue(cinfo->current_cl_queue);
-    clReleaseContext(cinfo->current_cl_context);
+    j_opencl_env_release(cinfo);
+    if (cinfo->cpu_pool) {
+        j_threadpool_destroy(cinfo->cpu_pool);
+        cinfo->cpu_pool = NULL;
+    }
     jpeg_destroy((j_common_ptr) cinfo); /* use common routine */
 }
 
@@ -252,6 +213,13 @@ default_decompress_parms (j_decompress_ptr cinfo)
   cinfo->enable_1pass_quant = FALSE;
   cinfo->enable_external_quant = FALSE;
   cinfo->enable_2pass_quant = FALSE;
+  /* The whole image unless jpeg_set_region says otherwise. */
+  cinfo->region_x = cinfo->region_y = 0;
+  cinfo->region_width = cinfo->region_height = 0;
+  /* No entropy index unless jpeg_build_index or jpeg_read_index is called. */
+  cinfo->index_interval = 0;
+  cinfo->index_file = NULL;
+  cinfo->entropy_index = NULL;
 }
 
 
@@ -427,6 +395,18 @@ jpeg_finish_decompress (j_decompress_ptr cinfo)
     /* STOPPING = repeat call after a suspension, anything else is error */
     ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
   }
+  /* A single-scan image whose lines were all skipped with
+   * jpeg_skip_scanlines has not been entropy decoded yet; the coefficient
+   * controller does that now, and no IDCT, as no output rows are left.
+   */
+  while (! cinfo->buffered_image &&
+	 cinfo->input_iMCU_row < cinfo->total_iMCU_rows &&
+	 ! cinfo->inputctl->has_multiple_scans &&
+	 ! cinfo->inputctl->eoi_reached) {
+    if ((*cinfo->coef->decompress_data) (cinfo, (JSAMPIMAGE) NULL)
+	== JPEG_SUSPENDED)
+      return FALSE;		/* Suspend, come back later */
+  }
   /* Read until EOI */
   while (! cinfo->inputctl->eoi_reached) {
     if ((*cinfo->inputctl->consume_input) (cinfo) == JPEG_SUSPENDED)
@@ -17,12 +17,35 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jopenclenv.h"
+#include "jthreadpool.h"
 #include <time.h>
 
 /* Forward declarations */
 LOCAL(boolean) output_pass_setup JPP((j_decompress_ptr cinfo));
 
 
+/*
+ * Ask for just a rectangle of the image, in pixels of the scaled output.
+ * Must be called after jpeg_read_header, which resets the region, and
+ * before jpeg_start_decompress; jpeg_calc_output_dimensions checks that
+ * the rectangle fits.  The application then reads output_height rows of
+ * output_width pixels, the region alone.
+ */
+
+GLOBAL(void)
+jpeg_set_region (j_decompress_ptr cinfo, JDIMENSION x, JDIMENSION y,
+		 JDIMENSION width, JDIMENSION height)
+{
+  if (cinfo->global_state != DSTATE_READY)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  cinfo->region_x = x;
+  cinfo->region_y = y;
+  cinfo->region_width = width;
+  cinfo->region_height = height;
+}
+
+
 /*
  * Decompression initialization.
  * jpeg_read_header must be completed before calling this.
@@ -34,11 +57,67 @@ LOCAL(boolean) output_pass_setup JPP((j_decompress_ptr cinfo));
  * a suspending data source is used.
  */
 
+/*
+ * Rough peak of the memory the OpenCL pipeline needs for this image: the
+ * coefficients on the host and on the device, on the device the sample
+ * planes, the upsampled planes and the converted pixels, and the whole
+ * output image they are read back into.
+ */
+
+LOCAL(long)
+device_pipeline_space (j_decompress_ptr cinfo)
+{
+  long coefs, samples, pixels;
+  int ci;
+  jpeg_component_info *compptr;
+
+  jpeg_calc_output_dimensions(cinfo);
+  coefs = samples = 0;
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    coefs += (long) compptr->width_in_blocks * compptr->height_in_blocks *
+	     SIZEOF(JBLOCK);
+    samples += (long) compptr->width_in_blocks * compptr->height_in_blocks *
+	       compptr->DCT_scaled_size * compptr->DCT_scaled_size;
+  }
+  pixels = (long) cinfo->output_width * cinfo->output_height *
+	   cinfo->out_color_components;
+  return 2 * coefs + samples + 3 * pixels;
+}
+
+
 GLOBAL(boolean)
 jpeg_start_decompress (j_decompress_ptr cinfo)
 {
   if (cinfo->global_state == DSTATE_READY) {
-    /* First call: initialize master control, select active modules */
+    /* First call: bring up the OpenCL device the output side runs on,
+     * or the host thread pool when there is none or the device pipeline
+     * would not fit in the memory budget.
+     */
+    cinfo->cpu_pipeline = cinfo->cl_disable;
+    if (! cinfo->cpu_pipeline && cinfo->mem->memory_budget > 0) {
+      long over = cinfo->mem->host_space_allocated +
+		  cinfo->mem->device_space_allocated +
+		  device_pipeline_space(cinfo) - cinfo->mem->memory_budget;
+      if (over > 0) {
+	TRACEMS1(cinfo, 1, JTRC_BUDGET_PIPELINE, (int) ((over + 1023L) / 1024L));
+	cinfo->cpu_pipeline = TRUE;
+      }
+    }
+    if (! cinfo->cpu_pipeline) {
+      cl_int error_code = j_opencl_env_init(cinfo);
+      if (error_code != CL_SUCCESS) {
+	TRACEMS1(cinfo, 1, JTRC_CPU_PIPELINE, (int) error_code);
+	cinfo->cpu_pipeline = TRUE;
+      }
+    }
+    /* Progressive scans are decoded on the pool too, either way.
+     * A pool that fails to start just leaves us single-threaded.
+     */
+    if ((cinfo->cpu_pipeline || cinfo->progressive_mode) &&
+	cinfo->cpu_pool == NULL)
+      cinfo->cpu_pool = j_threadpool_create(cinfo->cpu_threads);
+    /* Initialize master control, select active modules */
     jinit_master_decompress(cinfo);
     if (cinfo->buffered_image) {
       /* No more work here; expecting jpeg_start_output next */
@@ -171,6 +250,35 @@ jpeg_read_scanlines (j_decompress_ptr cinfo, JSAMPARRAY scanlines,
 }
 
 
+/*
+ * Skip some scanlines of data from the JPEG decompressor.
+ *
+ * The whole image is reconstructed by the first jpeg_read_scanlines call,
+ * so lines can only be skipped ahead of it.  The skipped lines are still
+ * entropy decoded, which the DC predictions need, but the IDCT, upsampling
+ * and color conversion are done only for the lines read afterwards (plus
+ * one iMCU row of context).  The first line read then lands in the first
+ * row of the buffer passed to jpeg_read_scanlines.
+ *
+ * The return value is the number of lines actually skipped: fewer than
+ * requested at the bottom of the image, and none once reading has begun.
+ */
+
+GLOBAL(JDIMENSION)
+jpeg_skip_scanlines (j_decompress_ptr cinfo, JDIMENSION num_lines)
+{
+  if (cinfo->global_state != DSTATE_SCANNING)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  /* The quantizers work on whole images */
+  if (cinfo->quantize_colors)
+    ERREXIT(cinfo, JERR_NOTIMPL);
+  if (num_lines > cinfo->output_height - cinfo->output_scanline)
+    num_lines = cinfo->output_height - cinfo->output_scanline;
+  cinfo->output_scanline += num_lines;
+  return num_lines;
+}
+
+
 /*
  * Alternate entry point to read raw data.
  * Processes exactly one iMCU row per call, unless suspended.
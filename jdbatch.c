@@ -0,0 +1,760 @@
+/*
+ * jdbatch.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains batched decompression for many small images.
+ * Decoding thumbnails one at a time pays the per-image costs (descriptor
+ * upload, buffer creation, three or four kernel launches) for only a few
+ * thousand pixels each.  Here the entropy decoding of all images runs on
+ * CPU threads, the coefficients are concatenated into one buffer, and a
+ * single IDCT, upsample and color conversion launch covers the whole batch.
+ *
+ * All images of a batch must share one geometry (dimensions, component
+ * count and sampling factors); the first decodable image sets it.  Images
+ * that do not match are reported back and can be decoded individually.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"
+#include "jopenclenv.h"
+#include "jopenclprogpool.h"
+#include "jopenclsched.h"
+#include "jthreadpool.h"
+#include <setjmp.h>
+
+#define MAX_COMPONENT_INFO_COUNT 5
+
+/* Must match struct BatchComponentInfo / BatchImageInfo in decode_idct.cl */
+struct BatchComponentInfo {
+  unsigned int block_offset;	/* first block of this plane in its image */
+  unsigned int width_in_blocks;	/* padded to a whole MCU */
+  unsigned int height_in_blocks;
+  unsigned int plane_offset;	/* first sample of this plane in its image */
+  FLOAT_MULT_TYPE dct_table[DCTSIZE2];
+};
+
+struct BatchImageInfo {
+  struct BatchComponentInfo component_infos[MAX_COMPONENT_INFO_COUNT];
+};
+
+/* Must match struct ConverterInfo in ycc_to_rgb_convert.cl */
+struct ConverterInfo {
+  int  Cr_r_tab[MAXJSAMPLE + 1];
+  int  Cb_b_tab[MAXJSAMPLE + 1];
+  int  Cr_g_tab[MAXJSAMPLE + 1];
+  int  Cb_g_tab[MAXJSAMPLE + 1];
+  JSAMPLE  sample_range_limit[(5 * (MAXJSAMPLE+1) + CENTERJSAMPLE)];
+};
+
+#define RANGE_TABLE_SIZE  (5 * (MAXJSAMPLE+1) + CENTERJSAMPLE)
+
+
+/* Error manager for the per-image decompress objects: a corrupt image
+ * must fail on its own instead of taking the whole process down.
+ */
+
+typedef struct {
+  struct jpeg_error_mgr pub;	/* "public" fields */
+  jmp_buf setjmp_buffer;	/* for return to caller */
+} batch_error_mgr;
+
+typedef struct {
+  struct jpeg_decompress_struct cinfo;
+  batch_error_mgr jerr;
+  boolean live;			/* cinfo needs jpeg_destroy_decompress */
+  jvirt_barray_ptr * coef_arrays;
+  int slot;			/* position among the compatible images */
+} batch_member;
+
+typedef struct {
+  jpeg_batch_image * images;
+  batch_member * members;
+  int num_members;
+  batch_member * reference;	/* image that defines the batch geometry */
+
+  /* Geometry shared by every image of the batch */
+  int num_components;
+  JDIMENSION width_in_blocks[MAX_COMPONENT_INFO_COUNT];	/* MCU-padded */
+  JDIMENSION height_in_blocks[MAX_COMPONENT_INFO_COUNT];
+  size_t block_offset[MAX_COMPONENT_INFO_COUNT];	/* within one image */
+  size_t plane_offset[MAX_COMPONENT_INFO_COUNT];	/* within one image */
+  size_t blocks_per_image;
+  size_t samples_per_image;
+
+  JBLOCK * blocks;		/* host copy of all coefficients */
+  struct BatchImageInfo * image_infos;
+  int * slot_image;		/* image index of every slot */
+  int slots;
+  int slots_per_chunk;		/* images handed to a device at once */
+  struct ConverterInfo * converter;
+} batch_state;
+
+
+METHODDEF(void)
+batch_error_exit (j_common_ptr cinfo)
+{
+  batch_error_mgr * err = (batch_error_mgr *) cinfo->err;
+
+  longjmp(err->setjmp_buffer, 1);
+}
+
+
+/*
+ * Phase 1, run on the thread pool: entropy-decode one image into the
+ * whole-image coefficient arrays of its own decompress object.
+ */
+
+METHODDEF(void)
+read_member (void * arg, int index, int worker)
+{
+  batch_state * state = (batch_state *) arg;
+  batch_member * member = &state->members[index];
+  jpeg_batch_image * image = &state->images[index];
+  j_decompress_ptr cinfo = &member->cinfo;
+
+  member->live = FALSE;
+  member->coef_arrays = NULL;
+  image->status = JBATCH_CORRUPT;
+  cinfo->err = jpeg_std_error(&member->jerr.pub);
+  member->jerr.pub.error_exit = batch_error_exit;
+  if (setjmp(member->jerr.setjmp_buffer)) {
+    if (member->live)
+      jpeg_destroy_decompress(cinfo);
+    member->live = FALSE;
+    return;
+  }
+  jpeg_create_decompress(cinfo);
+  member->live = TRUE;
+  jpeg_mem_src(cinfo, (void *) image->data, image->data_size);
+  (void) jpeg_read_header(cinfo, TRUE);
+  member->coef_arrays = jpeg_read_coefficients(cinfo);
+  image->status = JBATCH_OK;
+}
+
+
+/*
+ * Can the batch kernels handle this image at all?
+ * We support grayscale and YCbCr with 1x1, 2x1 or 2x2 luma sampling.
+ */
+
+LOCAL(boolean)
+batch_supported (j_decompress_ptr cinfo)
+{
+  jpeg_component_info * compptr = cinfo->comp_info;
+
+  if (cinfo->num_components == 1)
+    return TRUE;
+  if (cinfo->num_components != 3 || cinfo->jpeg_color_space != JCS_YCbCr)
+    return FALSE;
+  if (compptr[0].h_samp_factor != cinfo->max_h_samp_factor ||
+      compptr[0].v_samp_factor != cinfo->max_v_samp_factor ||
+      cinfo->max_h_samp_factor > 2 || cinfo->max_v_samp_factor > 2 ||
+      (cinfo->max_h_samp_factor == 1 && cinfo->max_v_samp_factor == 2))
+    return FALSE;
+  if (compptr[1].h_samp_factor != 1 || compptr[1].v_samp_factor != 1 ||
+      compptr[2].h_samp_factor != 1 || compptr[2].v_samp_factor != 1)
+    return FALSE;
+  /* the fancy upsampling kernels need a left and a right neighbour */
+  if (cinfo->max_h_samp_factor == 2 && compptr[1].downsampled_width <= 2)
+    return FALSE;
+  return TRUE;
+}
+
+
+LOCAL(boolean)
+same_geometry (j_decompress_ptr a, j_decompress_ptr b)
+{
+  int ci;
+
+  if (a->image_width != b->image_width ||
+      a->image_height != b->image_height ||
+      a->num_components != b->num_components ||
+      a->jpeg_color_space != b->jpeg_color_space)
+    return FALSE;
+  for (ci = 0; ci < a->num_components; ci++) {
+    if (a->comp_info[ci].h_samp_factor != b->comp_info[ci].h_samp_factor ||
+	a->comp_info[ci].v_samp_factor != b->comp_info[ci].v_samp_factor)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Build the float AA&N multiplier table for one component.
+ * Same arithmetic as the JDCT_FLOAT case of jddctmgr.c's start_pass.
+ */
+
+LOCAL(void)
+build_float_table (JQUANT_TBL * qtbl, FLOAT_MULT_TYPE * fmtbl)
+{
+  static const double aanscalefactor[DCTSIZE] = {
+    1.0, 1.387039845, 1.306562965, 1.175875602,
+    1.0, 0.785694958, 0.541196100, 0.275899379
+  };
+  int row, col, i;
+
+  i = 0;
+  for (row = 0; row < DCTSIZE; row++) {
+    for (col = 0; col < DCTSIZE; col++) {
+      fmtbl[i] = (FLOAT_MULT_TYPE)
+	((double) qtbl->quantval[i] *
+	 aanscalefactor[row] * aanscalefactor[col]);
+      i++;
+    }
+  }
+}
+
+
+/*
+ * Phase 2, run on the thread pool: copy one image's coefficients into its
+ * slot of the concatenated buffer, fill its descriptor, and release the
+ * per-image decompress object, except the reference.
+ */
+
+METHODDEF(void)
+pack_member (void * arg, int index, int worker)
+{
+  batch_state * state = (batch_state *) arg;
+  batch_member * member = &state->members[index];
+  j_decompress_ptr cinfo = &member->cinfo;
+  struct BatchImageInfo * image_info;
+  JBLOCK * image_blocks;
+  JBLOCKARRAY buffer;
+  JDIMENSION row;
+  int ci;
+
+  if (member->slot < 0)
+    return;
+  image_info = &state->image_infos[member->slot];
+  image_blocks = state->blocks + member->slot * state->blocks_per_image;
+  for (ci = 0; ci < state->num_components; ci++) {
+    struct BatchComponentInfo * info = &image_info->component_infos[ci];
+    JBLOCK * dest = image_blocks + state->block_offset[ci];
+
+    info->block_offset = (unsigned int) state->block_offset[ci];
+    info->width_in_blocks = (unsigned int) state->width_in_blocks[ci];
+    info->height_in_blocks = (unsigned int) state->height_in_blocks[ci];
+    info->plane_offset = (unsigned int) state->plane_offset[ci];
+    build_float_table(cinfo->comp_info[ci].quant_table, info->dct_table);
+
+    /* One block row at a time: that is all the access window promises. */
+    for (row = 0; row < state->height_in_blocks[ci]; row++) {
+      buffer = (*cinfo->mem->access_virt_barray)
+	((j_common_ptr) cinfo, member->coef_arrays[ci], row,
+	 (JDIMENSION) 1, FALSE);
+      MEMCOPY(dest, buffer[0], state->width_in_blocks[ci] * SIZEOF(JBLOCK));
+      dest += state->width_in_blocks[ci];
+    }
+  }
+  /* the reference still describes the geometry for the kernel launches */
+  if (member != state->reference) {
+    jpeg_destroy_decompress(cinfo);
+    member->live = FALSE;
+  }
+}
+
+
+/*
+ * Tables for the color conversion kernel and the IDCT range limiting.
+ * Same values as jdcolor.c's build_ycc_rgb_table and jdmaster.c's
+ * prepare_range_limit_table, which are not set up on this path.
+ */
+
+#define SCALEBITS	16
+#define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
+#undef FIX
+#define FIX(x)		((INT32) ((x) * (1L<<SCALEBITS) + 0.5))
+
+LOCAL(void)
+build_converter_info (struct ConverterInfo * info)
+{
+  JSAMPLE * table;
+  int i;
+  INT32 x;
+  SHIFT_TEMPS
+
+  for (i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
+    info->Cr_r_tab[i] = (int) RIGHT_SHIFT(FIX(1.40200) * x + ONE_HALF, SCALEBITS);
+    info->Cb_b_tab[i] = (int) RIGHT_SHIFT(FIX(1.77200) * x + ONE_HALF, SCALEBITS);
+    info->Cr_g_tab[i] = (int) ((- FIX(0.71414)) * x);
+    info->Cb_g_tab[i] = (int) ((- FIX(0.34414)) * x + ONE_HALF);
+  }
+
+  table = info->sample_range_limit + (MAXJSAMPLE+1);
+  MEMZERO(table - (MAXJSAMPLE+1), (MAXJSAMPLE+1) * SIZEOF(JSAMPLE));
+  for (i = 0; i <= MAXJSAMPLE; i++)
+    table[i] = (JSAMPLE) i;
+  table += CENTERJSAMPLE;
+  for (i = CENTERJSAMPLE; i < 2*(MAXJSAMPLE+1); i++)
+    table[i] = MAXJSAMPLE;
+  MEMZERO(table + (2 * (MAXJSAMPLE+1)),
+	  (2 * (MAXJSAMPLE+1) - CENTERJSAMPLE) * SIZEOF(JSAMPLE));
+  MEMCOPY(table + (4 * (MAXJSAMPLE+1) - CENTERJSAMPLE),
+	  info->sample_range_limit + (MAXJSAMPLE+1),
+	  CENTERJSAMPLE * SIZEOF(JSAMPLE));
+}
+
+
+/*
+ * Run the three kernels over slots [first_slot, first_slot+slots) of the
+ * batch on one device and read back the pixels.  The device's queue may be
+ * out-of-order, so every command waits on the event of the one before.
+ * Returns an OpenCL error code; may run on a pool thread, so no ERREXIT.
+ */
+
+LOCAL(cl_int)
+run_batch_kernels (batch_state * state, struct j_opencl_device * device,
+		   int first_slot, int slots)
+{
+  j_decompress_ptr ref = &state->reference->cinfo;
+  cl_int error_code;
+  cl_program program;
+  cl_kernel idct_kernel = NULL;
+  cl_kernel upsample_kernel = NULL;
+  cl_kernel convert_kernel = NULL;
+  cl_mem info_buf = NULL;
+  cl_mem converter_buf = NULL;
+  cl_mem range_buf = NULL;
+  cl_mem block_buf = NULL;
+  cl_mem plane_buf = NULL;
+  cl_mem full_buf = NULL;
+  cl_mem pixel_buf = NULL;
+  cl_event idct_done = NULL;
+  cl_event upsample_done = NULL;
+  cl_event convert_done = NULL;
+  cl_event chroma_ready;
+  JSAMPLE * gray_planes = NULL;
+  size_t work_dim[3];
+  size_t local_work_dim[3];
+  cl_uint num_components = (cl_uint) state->num_components;
+  cl_uint block_stride = (cl_uint) state->blocks_per_image;
+  cl_uint sample_stride = (cl_uint) state->samples_per_image;
+  cl_uint y_pitch, c_pitch, c_plane_size, c_image_stride, c_offset;
+  cl_uint full_plane_size, full_image_stride, out_image_stride;
+  cl_uint zero = 0;
+  cl_uint two = 2;
+  JDIMENSION out_width = ref->image_width;
+  JDIMENSION out_height = ref->image_height;
+  int slot;
+
+  converter_buf = clCreateBuffer(device->context,
+		CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+		sizeof(struct ConverterInfo), state->converter, &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  range_buf = clCreateBuffer(device->context,
+		CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+		RANGE_TABLE_SIZE * sizeof(JSAMPLE),
+		state->converter->sample_range_limit, &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  info_buf = clCreateBuffer(device->context,
+		CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+		sizeof(struct BatchImageInfo) * slots,
+		state->image_infos + first_slot, &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  block_buf = clCreateBuffer(device->context,
+		CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+		sizeof(JBLOCK) * state->blocks_per_image * slots,
+		state->blocks + first_slot * state->blocks_per_image, &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  plane_buf = clCreateBuffer(device->context, CL_MEM_READ_WRITE,
+		sizeof(JSAMPLE) * state->samples_per_image * slots, NULL,
+		&error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+
+  /* IDCT: every block of every plane of every image */
+  error_code = j_opencl_prog_pool_get_idct(device->prog_pool, &program);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  idct_kernel = clCreateKernel(program, "idct_batch", &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  clSetKernelArg(idct_kernel, 0, sizeof(cl_mem), &range_buf);
+  clSetKernelArg(idct_kernel, 1, sizeof(cl_mem), &info_buf);
+  clSetKernelArg(idct_kernel, 2, sizeof(cl_mem), &block_buf);
+  clSetKernelArg(idct_kernel, 3, sizeof(cl_mem), &plane_buf);
+  clSetKernelArg(idct_kernel, 4, sizeof(cl_uint), &num_components);
+  clSetKernelArg(idct_kernel, 5, sizeof(cl_uint), &block_stride);
+  error_code = clSetKernelArg(idct_kernel, 6, sizeof(cl_uint), &sample_stride);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  work_dim[0] = state->height_in_blocks[0];
+  work_dim[1] = state->width_in_blocks[0];
+  work_dim[2] = (size_t) slots * num_components * DCTSIZE;
+  local_work_dim[0] = 1;
+  local_work_dim[1] = 1;
+  local_work_dim[2] = DCTSIZE;
+  error_code = clEnqueueNDRangeKernel(device->queue, idct_kernel,
+		3, NULL, work_dim, local_work_dim, 0, NULL, &idct_done);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+
+  y_pitch = (cl_uint) (state->width_in_blocks[0] * DCTSIZE);
+
+  if (num_components == 1) {
+    /* Grayscale: the IDCT output is the image, just crop the padding */
+    gray_planes = (JSAMPLE *) malloc(state->samples_per_image * slots);
+    if (!gray_planes) {
+      error_code = CL_OUT_OF_HOST_MEMORY;
+      goto EXIT;
+    }
+    error_code = clEnqueueReadBuffer(device->queue, plane_buf,
+		CL_TRUE, 0, state->samples_per_image * slots, gray_planes,
+		1, &idct_done, NULL);
+    goto EXIT;
+  }
+
+  /* Upsample Cb and Cr of every image in one launch, if needed */
+  full_plane_size = (cl_uint) (y_pitch * state->height_in_blocks[0] * DCTSIZE);
+  full_image_stride = 2 * full_plane_size;
+  chroma_ready = idct_done;
+  if (ref->max_h_samp_factor == 2) {
+    jpeg_component_info * chroma = &ref->comp_info[1];
+    cl_uint in_offset = (cl_uint) state->plane_offset[1];
+    cl_uint in_pitch = (cl_uint) (state->width_in_blocks[1] * DCTSIZE);
+    cl_uint in_plane_size = (cl_uint) (state->plane_offset[2] - state->plane_offset[1]);
+
+    full_buf = clCreateBuffer(device->context, CL_MEM_READ_WRITE,
+		sizeof(JSAMPLE) * full_image_stride * slots, NULL, &error_code);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    if (ref->max_v_samp_factor == 2)
+      error_code = j_opencl_prog_pool_get_h2v2(device->prog_pool, &program);
+    else
+      error_code = j_opencl_prog_pool_get_h2v1(device->prog_pool, &program);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    upsample_kernel = clCreateKernel(program, "my_upsample_batch", &error_code);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    clSetKernelArg(upsample_kernel, 0, sizeof(cl_mem), &plane_buf);
+    clSetKernelArg(upsample_kernel, 1, sizeof(cl_uint), &in_offset);
+    clSetKernelArg(upsample_kernel, 2, sizeof(cl_uint), &in_pitch);
+    clSetKernelArg(upsample_kernel, 3, sizeof(cl_uint), &in_plane_size);
+    clSetKernelArg(upsample_kernel, 4, sizeof(cl_uint), &sample_stride);
+    clSetKernelArg(upsample_kernel, 5, sizeof(cl_mem), &full_buf);
+    clSetKernelArg(upsample_kernel, 6, sizeof(cl_uint), &y_pitch);
+    clSetKernelArg(upsample_kernel, 7, sizeof(cl_uint), &full_plane_size);
+    clSetKernelArg(upsample_kernel, 8, sizeof(cl_uint), &full_image_stride);
+    error_code = clSetKernelArg(upsample_kernel, 9, sizeof(cl_uint), &two);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    work_dim[0] = chroma->downsampled_height * ref->max_v_samp_factor;
+    work_dim[1] = chroma->downsampled_width;
+    work_dim[2] = (size_t) slots * 2;
+    error_code = clEnqueueNDRangeKernel(device->queue, upsample_kernel,
+		3, NULL, work_dim, NULL, 1, &idct_done, &upsample_done);
+    if (error_code != CL_SUCCESS)
+      goto EXIT;
+    chroma_ready = upsample_done;
+    c_offset = 0;
+    c_pitch = y_pitch;
+    c_plane_size = full_plane_size;
+    c_image_stride = full_image_stride;
+  } else {
+    /* Full-size chroma is read straight from the IDCT output */
+    c_offset = (cl_uint) state->plane_offset[1];
+    c_pitch = (cl_uint) (state->width_in_blocks[1] * DCTSIZE);
+    c_plane_size = (cl_uint) (state->plane_offset[2] - state->plane_offset[1]);
+    c_image_stride = sample_stride;
+  }
+
+  /* Color conversion of every image in one launch */
+  out_image_stride = (cl_uint) (out_width * out_height * 3);
+  pixel_buf = clCreateBuffer(device->context, CL_MEM_WRITE_ONLY,
+		sizeof(JSAMPLE) * out_image_stride * slots, NULL, &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  error_code = j_opencl_prog_pool_get_ycc_to_rgb(device->prog_pool, &program);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  convert_kernel = clCreateKernel(program, "convert_batch", &error_code);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  clSetKernelArg(convert_kernel, 0, sizeof(cl_mem), &converter_buf);
+  clSetKernelArg(convert_kernel, 1, sizeof(cl_mem), &plane_buf);
+  clSetKernelArg(convert_kernel, 2, sizeof(cl_uint), &zero);
+  clSetKernelArg(convert_kernel, 3, sizeof(cl_uint), &y_pitch);
+  clSetKernelArg(convert_kernel, 4, sizeof(cl_uint), &sample_stride);
+  clSetKernelArg(convert_kernel, 5, sizeof(cl_mem),
+		 full_buf ? &full_buf : &plane_buf);
+  clSetKernelArg(convert_kernel, 6, sizeof(cl_uint), &c_offset);
+  clSetKernelArg(convert_kernel, 7, sizeof(cl_uint), &c_pitch);
+  clSetKernelArg(convert_kernel, 8, sizeof(cl_uint), &c_plane_size);
+  clSetKernelArg(convert_kernel, 9, sizeof(cl_uint), &c_image_stride);
+  clSetKernelArg(convert_kernel, 10, sizeof(cl_mem), &pixel_buf);
+  error_code = clSetKernelArg(convert_kernel, 11, sizeof(cl_uint),
+			      &out_image_stride);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+  work_dim[0] = out_height;
+  work_dim[1] = out_width;
+  work_dim[2] = (size_t) slots;
+  /* the IDCT event also covers luma when chroma came through upsampling */
+  error_code = clEnqueueNDRangeKernel(device->queue, convert_kernel,
+		3, NULL, work_dim, NULL, 1, &chroma_ready, &convert_done);
+  if (error_code != CL_SUCCESS)
+    goto EXIT;
+
+  /* Hand each image its pixels */
+  for (slot = 0; slot < slots; slot++) {
+    error_code = clEnqueueReadBuffer(device->queue, pixel_buf,
+		CL_FALSE, (size_t) slot * out_image_stride,
+		(size_t) out_image_stride,
+		state->images[state->slot_image[first_slot + slot]].pixels,
+		1, &convert_done, NULL);
+    if (error_code != CL_SUCCESS)
+      break;
+  }
+
+EXIT:
+  /* nothing may be left running on buffers we are about to release */
+  if (device->queue)
+    clFinish(device->queue);
+  if (error_code == CL_SUCCESS && gray_planes) {
+    for (slot = 0; slot < slots; slot++) {
+      JSAMPLE * src = gray_planes + slot * state->samples_per_image;
+      JSAMPLE * dst = state->images[state->slot_image[first_slot + slot]].pixels;
+      JDIMENSION row;
+
+      for (row = 0; row < out_height; row++) {
+	MEMCOPY(dst, src, out_width * SIZEOF(JSAMPLE));
+	src += y_pitch;
+	dst += out_width;
+      }
+    }
+  }
+  if (idct_done)
+    clReleaseEvent(idct_done);
+  if (upsample_done)
+    clReleaseEvent(upsample_done);
+  if (convert_done)
+    clReleaseEvent(convert_done);
+  if (idct_kernel)
+    clReleaseKernel(idct_kernel);
+  if (upsample_kernel)
+    clReleaseKernel(upsample_kernel);
+  if (convert_kernel)
+    clReleaseKernel(convert_kernel);
+  if (info_buf)
+    clReleaseMemObject(info_buf);
+  if (converter_buf)
+    clReleaseMemObject(converter_buf);
+  if (range_buf)
+    clReleaseMemObject(range_buf);
+  if (block_buf)
+    clReleaseMemObject(block_buf);
+  if (plane_buf)
+    clReleaseMemObject(plane_buf);
+  if (full_buf)
+    clReleaseMemObject(full_buf);
+  if (pixel_buf)
+    clReleaseMemObject(pixel_buf);
+  if (gray_planes)
+    free(gray_planes);
+  return error_code;
+}
+
+
+/*
+ * Scheduler task: one chunk of consecutive slots on whichever device
+ * picked it up.
+ */
+
+METHODDEF(cl_int)
+decode_chunk (void * arg, int index, struct j_opencl_device * device)
+{
+  batch_state * state = (batch_state *) arg;
+  int first_slot = index * state->slots_per_chunk;
+  int slots = state->slots - first_slot;
+
+  if (slots > state->slots_per_chunk)
+    slots = state->slots_per_chunk;
+  return run_batch_kernels(state, device, first_slot, slots);
+}
+
+
+/*
+ * Run the kernels for the whole batch: in one go on cinfo's own device, or
+ * split into chunks over every device when the application asked for it.
+ */
+
+LOCAL(cl_int)
+decode_slots (j_decompress_ptr cinfo, batch_state * state)
+{
+  struct j_opencl_device device;
+  cl_int error_code;
+  int devices, chunks;
+
+  if (cinfo->cl_multi_device) {
+    if (cinfo->cl_scheduler == NULL) {
+      cinfo->cl_scheduler = j_opencl_sched_create(CL_DEVICE_TYPE_ALL,
+						  &error_code);
+      if (cinfo->cl_scheduler == NULL)
+	return error_code;
+    }
+    /* a few chunks per device, so a fast device can steal from a slow one */
+    devices = j_opencl_sched_get_device_count(cinfo->cl_scheduler);
+    chunks = devices * 4;
+    if (chunks > state->slots)
+      chunks = state->slots;
+    state->slots_per_chunk = (state->slots + chunks - 1) / chunks;
+    chunks = (state->slots + state->slots_per_chunk - 1) / state->slots_per_chunk;
+    return j_opencl_sched_run(cinfo->cl_scheduler, chunks, decode_chunk,
+			      state);
+  }
+
+  MEMZERO(&device, SIZEOF(device));
+  device.device_id = cinfo->current_device_id;
+  device.context = cinfo->current_cl_context;
+  device.queue = cinfo->current_cl_queue;
+  device.prog_pool = cinfo->cl_prog_pool;
+  return run_batch_kernels(state, &device, 0, state->slots);
+}
+
+
+/*
+ * Decompress a batch of images.  cinfo only supplies the OpenCL environment,
+ * the memory manager and the error handler; it must be in the start state.
+ * Returns the number of images decoded; every image gets a status code.
+ * The output pixels live in cinfo's image pool until jpeg_abort_decompress.
+ */
+
+GLOBAL(int)
+jpeg_decompress_batch (j_decompress_ptr cinfo, jpeg_batch_image * images,
+		       int num_images, int num_threads)
+{
+  batch_state state;
+  struct j_threadpool * pool;
+  j_decompress_ptr ref;
+  cl_int error_code;
+  size_t pixel_count;
+  int index, ci;
+
+  if (cinfo->global_state != DSTATE_START)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  if (num_images <= 0)
+    return 0;
+  error_code = j_opencl_env_init(cinfo);
+  if (error_code != CL_SUCCESS)
+    ERREXIT(cinfo, error_code);
+
+  MEMZERO(&state, SIZEOF(state));
+  state.images = images;
+  state.num_members = num_images;
+  state.members = (batch_member *) malloc(sizeof(batch_member) * num_images);
+  if (!state.members)
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+  pool = j_threadpool_create(num_threads);
+
+  /* Entropy decoding is the serial part of each image: spread it out. */
+  j_threadpool_run(pool, num_images, read_member, &state);
+
+  /* The first usable image decides the geometry of the batch */
+  for (index = 0; index < num_images; index++) {
+    images[index].pixels = NULL;
+    state.members[index].slot = -1;
+    if (images[index].status != JBATCH_OK)
+      continue;
+    if (state.reference == NULL && batch_supported(&state.members[index].cinfo))
+      state.reference = &state.members[index];
+    if (state.reference == NULL ||
+	!same_geometry(&state.reference->cinfo, &state.members[index].cinfo)) {
+      images[index].status = JBATCH_INCOMPATIBLE;
+      jpeg_destroy_decompress(&state.members[index].cinfo);
+      state.members[index].live = FALSE;
+    }
+  }
+  if (state.reference == NULL) {
+    j_threadpool_destroy(pool);
+    free(state.members);
+    return 0;
+  }
+
+  ref = &state.reference->cinfo;
+  state.num_components = ref->num_components;
+  for (ci = 0; ci < ref->num_components; ci++) {
+    jpeg_component_info * compptr = &ref->comp_info[ci];
+
+    /* pad to whole MCUs, which is what the coefficient arrays hold */
+    state.width_in_blocks[ci] = (JDIMENSION)
+      jround_up((long) compptr->width_in_blocks, (long) compptr->h_samp_factor);
+    state.height_in_blocks[ci] = (JDIMENSION)
+      jround_up((long) compptr->height_in_blocks, (long) compptr->v_samp_factor);
+    state.block_offset[ci] = state.blocks_per_image;
+    state.plane_offset[ci] = state.samples_per_image;
+    state.blocks_per_image += (size_t) state.width_in_blocks[ci] *
+			      state.height_in_blocks[ci];
+    state.samples_per_image += (size_t) state.width_in_blocks[ci] *
+			       state.height_in_blocks[ci] * DCTSIZE2;
+  }
+
+  state.slot_image = (int *) (*cinfo->mem->alloc_small)
+    ((j_common_ptr) cinfo, JPOOL_IMAGE, num_images * SIZEOF(int));
+  pixel_count = (size_t) ref->image_width * ref->image_height *
+		ref->num_components;
+  for (index = 0; index < num_images; index++) {
+    if (images[index].status != JBATCH_OK)
+      continue;
+    state.slot_image[state.slots] = index;
+    state.members[index].slot = state.slots++;
+    images[index].output_width = ref->image_width;
+    images[index].output_height = ref->image_height;
+    images[index].output_components = ref->num_components;
+    images[index].pixels = (JSAMPLE *) (*cinfo->mem->alloc_large)
+      ((j_common_ptr) cinfo, JPOOL_IMAGE, pixel_count * SIZEOF(JSAMPLE));
+  }
+
+  state.blocks = (JBLOCK *)
+    malloc(sizeof(JBLOCK) * state.blocks_per_image * state.slots);
+  state.image_infos = (struct BatchImageInfo *)
+    malloc(sizeof(struct BatchImageInfo) * state.slots);
+  state.converter = (struct ConverterInfo *)
+    malloc(sizeof(struct ConverterInfo));
+  if (!state.blocks || !state.image_infos || !state.converter) {
+    error_code = CL_OUT_OF_HOST_MEMORY;
+  } else {
+    MEMZERO(state.image_infos, sizeof(struct BatchImageInfo) * state.slots);
+    build_converter_info(state.converter);
+    j_threadpool_run(pool, num_images, pack_member, &state);
+    error_code = decode_slots(cinfo, &state);
+  }
+
+  for (index = 0; index < num_images; index++) {
+    if (state.members[index].live)
+      jpeg_destroy_decompress(&state.members[index].cinfo);
+  }
+  j_threadpool_destroy(pool);
+  if (state.blocks)
+    free(state.blocks);
+  if (state.image_infos)
+    free(state.image_infos);
+  if (state.converter)
+    free(state.converter);
+  free(state.members);
+  if (error_code != CL_SUCCESS)
+    ERREXIT(cinfo, error_code);
+  return state.slots;
+}
+
+
+/*
+ * Print how the cl_multi_device batches were spread over the devices.
+ */
+
+GLOBAL(void)
+jpeg_opencl_report_devices (j_decompress_ptr cinfo, FILE * outfile)
+{
+  if (cinfo->cl_scheduler)
+    j_opencl_sched_report(cinfo->cl_scheduler, outfile);
+}
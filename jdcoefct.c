@@ -19,6 +19,8 @@
 #include "jpeglib.h"
 #include "jopenclprogpool.h"
 #include "jopenclstore.h"
+#include "jopenclprof.h"
+#include "jthreadpool.h"
 
 /* Block smoothing is only applicable for progressive JPEG, so: */
 #ifndef D_PROGRESSIVE_SUPPORTED
@@ -35,6 +37,16 @@ typedef struct {
     JDIMENSION MCU_ctr;		/* counts MCUs processed in current row */
     int MCU_vert_offset;		/* counts MCU rows within iMCU row */
     int MCU_rows_per_iMCU_row;	/* number of such rows needed */
+    JDIMENSION MCU_num;		/* MCUs entropy decoded by decompress_onepass */
+
+    /* Entropy index (jdindex.c): the input buffer the scan started in, the
+     * index being recorded, if any, and the MCU at which decoding can stop
+     * and jump to the end of the scan with a loaded one.
+     */
+    const JOCTET * index_base;
+    const JOCTET * index_limit;
+    jpeg_entropy_index * recording;
+    JDIMENSION stop_MCU;
 
     /* The output side's location is represented by cinfo->output_iMCU_row. */
 
@@ -61,6 +73,32 @@ typedef struct {
 #endif
     JBLOCK * decoded_mcus_base;
     JBLOCK * decoded_mcus_current;
+    struct DecodeInfo * decode_info;	/* parameters of the idct kernel */
+
+#ifdef D_PROGRESSIVE_SUPPORTED
+    /* Flat progressive mode (see below): the scans are kept in memory as
+     * they arrive, in one chain per group of dependent scans, and decoded
+     * into decoded_mcus_base at the end.
+     */
+    struct flat_scan * chains[MAX_COMPONENTS+1];
+    struct flat_scan ** chain_tails[MAX_COMPONENTS+1];
+    struct flat_scan * cur_scan;	/* scan being read in */
+    boolean pending_ff;		/* last byte read in was an 0xFF */
+    JDIMENSION flat_MCUs_per_row;	/* layout of decoded_mcus_base */
+    int flat_blocks_in_MCU;
+    int flat_offset[MAX_COMPONENTS]; /* first block of each component */
+    /* In buffered-image mode the scans are decoded as they arrive instead;
+     * these bound the iMCU rows changed since the device copy was updated.
+     */
+    JDIMENSION dirty_first, dirty_end;
+#ifdef BLOCK_SMOOTHING_SUPPORTED
+    /* Copy of decoded_mcus_base with the K.8 estimates filled in, output
+     * in its place by passes that use block smoothing.
+     */
+    JBLOCK * smoothed_base;
+    boolean smooth_flat;		/* smooth the pass being output */
+#endif
+#endif
 
 } my_coef_controller;
 
@@ -69,14 +107,25 @@ typedef my_coef_controller * my_coef_ptr;
 /* Forward declarations */
 METHODDEF(int) decompress_onepass
 JPP((j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
+LOCAL(void) index_seek JPP((j_decompress_ptr cinfo, JDIMENSION total_MCUs));
 #ifdef D_MULTISCAN_FILES_SUPPORTED
 METHODDEF(int) decompress_data
 JPP((j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
 #endif
+#ifdef D_PROGRESSIVE_SUPPORTED
+METHODDEF(void) start_input_pass_flat JPP((j_decompress_ptr cinfo));
+METHODDEF(int) consume_data_flat JPP((j_decompress_ptr cinfo));
+METHODDEF(int) decompress_flat
+JPP((j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
+METHODDEF(int) consume_flat_rows JPP((j_decompress_ptr cinfo));
+METHODDEF(int) decompress_flat_buffered
+JPP((j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
+#endif
 #ifdef BLOCK_SMOOTHING_SUPPORTED
 LOCAL(boolean) smoothing_ok JPP((j_decompress_ptr cinfo));
 METHODDEF(int) decompress_smooth_data
 JPP((j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
+LOCAL(void) smooth_flat_rows JPP((j_decompress_ptr cinfo));
 #endif
 
 
@@ -132,6 +181,8 @@ start_output_pass (j_decompress_ptr cinfo)
             coef->pub.decompress_data = decompress_smooth_data;
         else
             coef->pub.decompress_data = decompress_data;
+    } else if (coef->pub.decompress_data == decompress_flat_buffered) {
+        coef->smooth_flat = cinfo->do_block_smoothing && smoothing_ok(cinfo);
     }
 #endif
     cinfo->output_iMCU_row = 0;
@@ -140,6 +191,8 @@ start_output_pass (j_decompress_ptr cinfo)
 
     METHODDEF(int)
 decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf);
+    METHODDEF(int)
+decompress_onepass_cpu (j_decompress_ptr cinfo, JSAMPIMAGE output_buf);
 /*
  * Decompress and return some data in the single-pass case.
  * Always attempts to emit one fully interleaved MCU row ("iMCU" row).
@@ -154,46 +207,83 @@ decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf);
 decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 {
     my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
-    JDIMENSION MCU_col_num;	/* index of current MCU within row */
-    JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
-    int yoffset;
-    int rows;
+    JDIMENSION total_MCUs = cinfo->MCUs_per_row
+        * coef->MCU_rows_per_iMCU_row * cinfo->MCU_rows_in_scan;
+    jpeg_entropy_index * index;
+    int i;
+    double start;
 
-    size_t decoded_mucs_size = sizeof(JBLOCK) * cinfo->blocks_in_MCU 
-            * coef->MCU_rows_per_iMCU_row * cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan;
-    coef->decoded_mcus_base = cinfo->mem->alloc_large((j_common_ptr)cinfo,JPOOL_IMAGE, decoded_mucs_size);
     if(!coef->decoded_mcus_base)
     {
-        return JPEG_SUSPENDED;
+        /* First call: the whole scan is entropy decoded into one buffer */
+        size_t decoded_mucs_size = sizeof(JBLOCK) * cinfo->blocks_in_MCU * total_MCUs;
+        coef->decoded_mcus_base = cinfo->mem->alloc_large((j_common_ptr)cinfo,JPOOL_IMAGE, decoded_mucs_size);
+        jzero_far((void FAR *) coef->decoded_mcus_base, decoded_mucs_size);
+        coef->decoded_mcus_current = coef->decoded_mcus_base;
+        coef->MCU_num = 0;
+        coef->stop_MCU = total_MCUs;
+        coef->index_base = cinfo->src->next_input_byte;
+        coef->index_limit = coef->index_base + cinfo->src->bytes_in_buffer;
+        coef->recording = NULL;
+        if (cinfo->index_interval > 0 && cinfo->index_file != NULL)
+            coef->recording = jindex_alloc(cinfo, cinfo->index_interval, total_MCUs);
+        else if (cinfo->entropy_index != NULL)
+            index_seek(cinfo, total_MCUs);
     }
-    jzero_far((void FAR *) coef->decoded_mcus_base, decoded_mucs_size);
 
-    coef->decoded_mcus_current = coef->decoded_mcus_base;
-    for(rows = 0 ; rows < cinfo->MCU_rows_in_scan ; ++ rows)
+    /* A suspension leaves MCU_num at the MCU that could not be decoded, and
+     * decoded_mcus_current at its blocks, so the next call picks up there
+     * once more data has arrived.
+     */
+    start = j_opencl_prof_begin(cinfo);
+    for(; coef->MCU_num < total_MCUs; ++ coef->MCU_num)
     {
-        for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
-                yoffset++) {
-            for (MCU_col_num = coef->MCU_ctr; MCU_col_num <= last_MCU_col;
-                    MCU_col_num++) {
-                /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed. */
-                {
-                    int i ;
-                    for(i = 0 ; i < cinfo->blocks_in_MCU ; ++i,++coef->decoded_mcus_current)
-                    {
-                        coef->MCU_buffer[i] = coef->decoded_mcus_current;
-                    }
-                }
-                if (! (*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
-                    /* this is deadly status */
-                    return JPEG_SUSPENDED;
-                }
-            }
+        if (coef->MCU_num == coef->stop_MCU) {
+            /* The rest of the scan is not needed: skip to its end */
+            jindex_restore_entry(cinfo, coef->index_base, coef->index_limit,
+                    &cinfo->entropy_index->end);
+            break;
+        }
+        index = coef->recording;
+        if (index != NULL && coef->MCU_num % index->interval == 0 &&
+                ! jindex_save_entry(cinfo, coef->index_base, coef->index_limit,
+                    &index->entries[coef->MCU_num / index->interval])) {
+            WARNMS(cinfo, JWRN_INDEX_NOT_WRITTEN);
+            coef->recording = NULL;
         }
+        /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed. */
+        for(i = 0 ; i < cinfo->blocks_in_MCU ; ++i)
+        {
+            coef->MCU_buffer[i] = coef->decoded_mcus_current + i;
+        }
+        if (! (*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
+            /* Suspension forced; MCU_num stays at this MCU */
+            j_opencl_prof_end(cinfo,JSTAGE_ENTROPY,start);
+            return JPEG_SUSPENDED;
+        }
+        coef->decoded_mcus_current += cinfo->blocks_in_MCU;
     }
+    if (coef->recording != NULL) {
+        if (jindex_save_entry(cinfo, coef->index_base, coef->index_limit,
+                    &coef->recording->end))
+            jindex_write(cinfo, coef->recording);
+        else
+            WARNMS(cinfo, JWRN_INDEX_NOT_WRITTEN);
+        coef->recording = NULL;
+    }
+    j_opencl_prof_end(cinfo,JSTAGE_ENTROPY,start);
     coef->decoded_mcus_current = coef->decoded_mcus_base;
-    coef->pub.decompress_data = decompress_onepass2;
-    decompress_onepass2(cinfo,output_buf);
-    return 1; // no error
+    if(cinfo->cpu_pipeline)
+    {
+        coef->pub.decompress_data = decompress_onepass_cpu;
+        decompress_onepass_cpu(cinfo,output_buf);
+    }
+    else
+    {
+        coef->pub.decompress_data = decompress_onepass2;
+        decompress_onepass2(cinfo,output_buf);
+    }
+    return JPEG_SCAN_COMPLETED;
 }
 
 static void print_build_log(j_decompress_ptr cinfo,cl_program program)
@@ -235,13 +325,116 @@ struct ComponentInfo
 struct DecodeInfo
 {
    unsigned int componets_mcu_width;
+   unsigned int MCUs_per_row;
    JSAMPLE  sample_range_limit[(5 * (MAXJSAMPLE+1) + CENTERJSAMPLE)]; 
    struct ComponentInfo component_infos[MAX_COMPONENT_INFO_COUNT]; 
 };
 
 
-    METHODDEF(int)
-decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+/*
+ * The iMCU rows [*first_row, *end_row) and columns [*first_col, *end_col)
+ * to transform: those under the output lines still to be emitted, i.e. the
+ * region of interest less any lines skipped with jpeg_skip_scanlines, and
+ * one more on each side, whose samples fancy upsampling reads at the edges.
+ * All columns when no region is set.
+ */
+
+    LOCAL(void)
+region_window (j_decompress_ptr cinfo, JDIMENSION * first_row,
+        JDIMENSION * end_row, JDIMENSION * first_col, JDIMENSION * end_col)
+{
+    JDIMENSION iMCU_width, iMCU_height, iMCU_cols;
+
+    iMCU_width = cinfo->max_h_samp_factor * cinfo->min_DCT_scaled_size;
+    iMCU_height = cinfo->max_v_samp_factor * cinfo->min_DCT_scaled_size;
+    iMCU_cols = (JDIMENSION) jdiv_round_up((long) cinfo->image_width,
+            (long) (cinfo->max_h_samp_factor * DCTSIZE));
+
+    *first_row = (cinfo->region_y + cinfo->output_scanline) / iMCU_height;
+    if (*first_row > 0)
+        (*first_row)--;
+    *end_row = MIN(cinfo->total_iMCU_rows,
+            (cinfo->region_y + cinfo->output_height - 1) / iMCU_height + 2);
+    if (cinfo->output_scanline >= cinfo->output_height)
+        *end_row = *first_row;	/* every line skipped */
+    *first_col = 0;
+    *end_col = iMCU_cols;
+    if (cinfo->region_width == 0)
+        return;
+
+    *first_col = cinfo->region_x / iMCU_width;
+    if (*first_col > 0)
+        (*first_col)--;
+    *end_col = MIN(iMCU_cols,
+            (cinfo->region_x + cinfo->region_width - 1) / iMCU_width + 2);
+}
+
+
+/* The same window in MCUs of the current scan */
+
+    LOCAL(void)
+region_scan_window (j_decompress_ptr cinfo, JDIMENSION * first_row,
+        JDIMENSION * end_row, JDIMENSION * first_col, JDIMENSION * end_col)
+{
+    int h;
+
+    region_window(cinfo, first_row, end_row, first_col, end_col);
+    if (cinfo->comps_in_scan == 1) {
+        /* A noninterleaved scan has one block per MCU */
+        h = cinfo->cur_comp_info[0]->h_samp_factor;
+        *first_col *= h;
+        *end_col = MIN(cinfo->MCUs_per_row, *end_col * h);
+    }
+}
+
+
+/*
+ * Use the loaded entropy index to decode only the MCU rows under the
+ * window: restore the entry at or before its first MCU, and have decoding
+ * stop at its end.  jpeg_read_index has checked that the index was made
+ * for a scan of this many MCUs; it is ignored unless the whole scan is in
+ * the input buffer.
+ */
+
+    LOCAL(void)
+index_seek (j_decompress_ptr cinfo, JDIMENSION total_MCUs)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    jpeg_entropy_index * index = cinfo->entropy_index;
+    JDIMENSION first_row, end_row, first_col, end_col;
+    JDIMENSION MCUs_per_iMCU_row, first_MCU, entry;
+
+    if (index->end.offset > (long) (coef->index_limit - coef->index_base))
+        return;
+
+    region_scan_window(cinfo, &first_row, &end_row, &first_col, &end_col);
+    MCUs_per_iMCU_row = coef->MCU_rows_per_iMCU_row * cinfo->MCUs_per_row;
+    first_MCU = first_row * MCUs_per_iMCU_row;
+    coef->stop_MCU = MIN(total_MCUs, end_row * MCUs_per_iMCU_row);
+    if (coef->stop_MCU <= first_MCU) {
+        coef->stop_MCU = 0;	/* every line skipped: nothing to decode */
+        return;
+    }
+    entry = first_MCU / index->interval;
+    if (entry == 0)
+        return;
+    jindex_restore_entry(cinfo, coef->index_base, coef->index_limit,
+            &index->entries[entry]);
+    coef->MCU_num = entry * index->interval;
+    coef->decoded_mcus_current = coef->decoded_mcus_base
+        + (size_t) coef->MCU_num * cinfo->blocks_in_MCU;
+}
+
+
+/*
+ * Run the idct kernel over the whole image, or the window of the region
+ * of interest, reading the MCU-interleaved coefficients from the device
+ * buffer coefs, and leave the samples in a new session of cl_store for
+ * the upsampler.
+ */
+
+    LOCAL(void)
+run_idct_kernel (j_decompress_ptr cinfo, cl_mem coefs)
 {
     my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
     unsigned int componets_mcu_width;
@@ -264,10 +457,12 @@ decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
         int previous_decoded_mcu_size;
         cl_kernel dct_kernel;
         cl_mem constant_decode_info;
-        cl_mem constant_decoded_mcu;
         cl_mem my_cl_output_buffer; 
+        size_t work_offset[3];
         size_t work_dim[3];
         size_t local_work_dim[3];
+        JDIMENSION first_row, end_row, first_col, end_col;
+        double start;
         // JSAMPLE * from_cl_output;
 
         error_code = j_opencl_prog_pool_get_idct(cinfo->cl_prog_pool,&my_program);
@@ -275,12 +470,15 @@ decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
         {
             ERREXIT(cinfo,error_code);
         }
-        decode_info = (struct DecodeInfo*)malloc(sizeof(struct DecodeInfo));
-        if(!decode_info)
+        if(!coef->decode_info)
         {
-            ERREXIT(cinfo,JERR_OUT_OF_MEMORY);
+            coef->decode_info = (struct DecodeInfo *)
+                (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                        SIZEOF(struct DecodeInfo));
         }
+        decode_info = coef->decode_info;
         decode_info->componets_mcu_width = componets_mcu_width;
+        decode_info->MCUs_per_row = cinfo->MCUs_per_row;
         memcpy(decode_info->sample_range_limit,cinfo->sample_range_limit - (MAXJSAMPLE+1),(5 * (MAXJSAMPLE+1) + CENTERJSAMPLE) * sizeof(JSAMPLE));
         previous_image_size = 0;
         previous_decoded_mcu_size = 0 ;
@@ -305,41 +503,47 @@ decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
             previous_decoded_mcu_size += compptr->MCU_width * compptr->MCU_height;
         }
 
+        (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+                (long) (sizeof(struct DecodeInfo)
+                    + sizeof(JSAMPLE) * previous_image_size));
+        start = j_opencl_prof_begin(cinfo);
         constant_decode_info = clCreateBuffer(cinfo->current_cl_context,
                 CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
                 sizeof(struct DecodeInfo),
                 decode_info,
                 &error_code);
-        constant_decoded_mcu = clCreateBuffer(cinfo->current_cl_context,
-                CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
-                sizeof(JBLOCK) *  cinfo->blocks_in_MCU * 
-                coef->MCU_rows_per_iMCU_row * cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan,
-                coef->decoded_mcus_base,
-                &error_code);
         my_cl_output_buffer = clCreateBuffer(cinfo->current_cl_context,
                 CL_MEM_READ_WRITE,
                 sizeof(JSAMPLE) * previous_image_size,
                 NULL,
                 &error_code);
+        j_opencl_prof_end(cinfo,JSTAGE_UPLOAD,start);
         dct_kernel = clCreateKernel(my_program,"idct",&error_code);
         error_code = clSetKernelArg(dct_kernel,0,sizeof(cl_mem),&constant_decode_info);
-        error_code = clSetKernelArg(dct_kernel,1,sizeof(cl_mem),&constant_decoded_mcu);
+        error_code = clSetKernelArg(dct_kernel,1,sizeof(cl_mem),&coefs);
         error_code = clSetKernelArg(dct_kernel,2,sizeof(cl_mem),&my_cl_output_buffer);
-        work_dim[0] = cinfo->total_iMCU_rows;
-        work_dim[1] = cinfo->MCUs_per_row;
+        region_scan_window(cinfo, &first_row, &end_row, &first_col, &end_col);
+        work_offset[0] = first_row;
+        work_offset[1] = first_col;
+        work_offset[2] = 0;
+        work_dim[0] = end_row - first_row;
+        work_dim[1] = end_col - first_col;
         work_dim[2] = cinfo->comps_in_scan * DCTSIZE;
         local_work_dim[0] = 1;
         local_work_dim[1] = 1;
         local_work_dim[2] = DCTSIZE;
         
-        error_code = clEnqueueNDRangeKernel(cinfo->current_cl_queue,dct_kernel,
-                    3,
-                    NULL,
-                    work_dim,
-                    local_work_dim,
-                    NULL,
-                    NULL,
-                    NULL);
+        start = j_opencl_prof_begin(cinfo);
+        if (work_dim[0] > 0)	/* nothing to do if every line was skipped */
+            error_code = clEnqueueNDRangeKernel(cinfo->current_cl_queue,dct_kernel,
+                        3,
+                        work_offset,
+                        work_dim,
+                        local_work_dim,
+                        NULL,
+                        NULL,
+                        j_opencl_prof_event(cinfo,JSTAGE_IDCT));
+        j_opencl_prof_end(cinfo,JSTAGE_IDCT,start);
         if(j_opencl_store_new_session(cinfo->cl_store))
         {
             ERREXIT(cinfo,JERR_OUT_OF_MEMORY);
@@ -355,9 +559,66 @@ decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
         //                     NULL,
         //                     NULL);
         clReleaseMemObject(constant_decode_info);
-        clReleaseMemObject(constant_decoded_mcu);
+        (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+                - (long) sizeof(struct DecodeInfo));
         clReleaseKernel(dct_kernel);
     }
+}
+
+    METHODDEF(int)
+decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    cl_int error_code;
+    cl_mem constant_decoded_mcu;
+    size_t size, row_size;
+    JDIMENSION first_row, end_row, first_col, end_col;
+    double start;
+
+    row_size = sizeof(JBLOCK) *  cinfo->blocks_in_MCU * 
+            coef->MCU_rows_per_iMCU_row * cinfo->MCUs_per_row;
+    size = row_size * cinfo->MCU_rows_in_scan;
+    (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,(long) size);
+    start = j_opencl_prof_begin(cinfo);
+    if (cinfo->region_width == 0 && cinfo->output_scanline == 0)
+    {
+        constant_decoded_mcu = clCreateBuffer(cinfo->current_cl_context,
+                CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+                size,
+                coef->decoded_mcus_base,
+                &error_code);
+    }
+    else
+    {
+        /* Only the rows the kernel will read go over, leaving out those
+         * outside the region or skipped */
+        region_scan_window(cinfo, &first_row, &end_row, &first_col, &end_col);
+        constant_decoded_mcu = clCreateBuffer(cinfo->current_cl_context,
+                CL_MEM_READ_ONLY,
+                size,
+                NULL,
+                &error_code);
+        if (error_code == CL_SUCCESS && end_row > first_row)
+        {
+            error_code = clEnqueueWriteBuffer(cinfo->current_cl_queue,
+                    constant_decoded_mcu,
+                    CL_TRUE,
+                    row_size * first_row,
+                    row_size * (end_row - first_row),
+                    (JOCTET *) coef->decoded_mcus_base + row_size * first_row,
+                    0,
+                    NULL,
+                    j_opencl_prof_event(cinfo,JSTAGE_UPLOAD));
+        }
+    }
+    j_opencl_prof_end(cinfo,JSTAGE_UPLOAD,start);
+    if (error_code != CL_SUCCESS)
+    {
+        ERREXIT(cinfo,error_code);
+    }
+    run_idct_kernel(cinfo,constant_decoded_mcu);
+    clReleaseMemObject(constant_decoded_mcu);
+    (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,- (long) size);
     cinfo->output_iMCU_row = cinfo->total_iMCU_rows;
     cinfo->input_iMCU_row = cinfo->total_iMCU_rows;
     /* Completed the scan */
@@ -369,6 +630,103 @@ decompress_onepass2 (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 
 }
 
+// Host version of the idct kernel: one task per iMCU row, walking the
+// MCU-interleaved coefficients the same way the kernel does and writing
+// into the whole-image planes of the main controller.  With a region of
+// interest or skipped lines only the rows and columns of the window are
+// done.
+struct CpuIdctJob
+{
+    j_decompress_ptr cinfo;
+    JBLOCK * decoded_mcus_base;
+    JSAMPIMAGE output_buf;
+    unsigned int componets_mcu_width;
+    JDIMENSION first_row;	/* window of the region of interest */
+    JDIMENSION first_col, end_col;
+};
+
+static void idct_band(void * arg,int index,int worker)
+{
+    struct CpuIdctJob * job = (struct CpuIdctJob *)arg;
+    j_decompress_ptr cinfo = job->cinfo;
+    JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
+    JDIMENSION MCU_col_num, start_col, output_col;
+    int ci, xindex, yindex, useful_width;
+    int previous_decoded_mcu_size;
+    jpeg_component_info * compptr;
+    inverse_DCT_method_ptr inverse_DCT;
+    JSAMPARRAY cur_row;
+    JBLOCK * block;
+
+    index += job->first_row;
+    previous_decoded_mcu_size = 0;
+    for(ci = 0 ; ci < cinfo->comps_in_scan ; ++ci)
+    {
+        compptr = cinfo->cur_comp_info[ci];
+        inverse_DCT = cinfo->idct->inverse_DCT[compptr->component_index];
+        for(MCU_col_num = job->first_col ; MCU_col_num < job->end_col ; ++MCU_col_num)
+        {
+            cur_row = job->output_buf[compptr->component_index]
+                + index * compptr->MCU_height * compptr->DCT_scaled_size;
+            start_col = MCU_col_num * compptr->MCU_sample_width;
+            useful_width = (MCU_col_num < last_MCU_col) ? compptr->MCU_width
+                : compptr->last_col_width;
+            block = job->decoded_mcus_base
+                + (index * cinfo->MCUs_per_row + MCU_col_num) * job->componets_mcu_width
+                + previous_decoded_mcu_size;
+            for(yindex = 0 ; yindex < compptr->MCU_height ; ++yindex)
+            {
+                output_col = start_col;
+                for(xindex = 0 ; xindex < useful_width ; ++xindex)
+                {
+                    (*inverse_DCT)(cinfo,compptr,(JCOEFPTR)(block + xindex),
+                            cur_row,output_col);
+                    output_col += compptr->DCT_scaled_size;
+                }
+                block += compptr->MCU_width;
+                cur_row += compptr->DCT_scaled_size;
+            }
+        }
+        previous_decoded_mcu_size += compptr->MCU_width * compptr->MCU_height;
+    }
+}
+
+    LOCAL(void)
+run_idct_cpu (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    struct CpuIdctJob job;
+    jpeg_component_info * compptr;
+    JDIMENSION end_row;
+    int ci;
+    double start;
+
+    job.cinfo = cinfo;
+    job.decoded_mcus_base = coef->decoded_mcus_base;
+    job.output_buf = output_buf;
+    for (job.componets_mcu_width = 0 ,ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        compptr = cinfo->cur_comp_info[ci];
+        job.componets_mcu_width += compptr->MCU_width * compptr->MCU_height;
+    }
+
+    region_scan_window(cinfo, &job.first_row, &end_row, &job.first_col, &job.end_col);
+
+    start = j_opencl_prof_begin(cinfo);
+    j_threadpool_run(cinfo->cpu_pool,(int) (end_row - job.first_row),idct_band,&job);
+    j_opencl_prof_end(cinfo,JSTAGE_IDCT,start);
+}
+
+    METHODDEF(int)
+decompress_onepass_cpu (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+    run_idct_cpu(cinfo,output_buf);
+    cinfo->output_iMCU_row = cinfo->total_iMCU_rows;
+    cinfo->input_iMCU_row = cinfo->total_iMCU_rows;
+    /* Completed the scan */
+    (*cinfo->inputctl->finish_input_pass) (cinfo);
+    return JPEG_SCAN_COMPLETED;
+}
+
 /*
  * Dummy consume-input routine for single-pass operation.
  */
@@ -460,12 +818,13 @@ consume_data (j_decompress_ptr cinfo)
  * NB: output_buf contains a plane for each component in image.
  */
 
-    METHODDEF(int)
-decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+    LOCAL(int)
+decompress_data_row (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 {
     my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
     JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-    JDIMENSION block_num;
+    JDIMENSION block_num, first_block, end_block;
+    JDIMENSION first_row, end_row, first_col, end_col;
     int ci, block_row, block_rows;
     JBLOCKARRAY buffer;
     JBLOCKROW buffer_ptr;
@@ -482,12 +841,22 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
             return JPEG_SUSPENDED;
     }
 
+    /* Rows and columns outside the region of interest, and rows skipped
+     * with jpeg_skip_scanlines, are left alone.
+     */
+    region_window(cinfo, &first_row, &end_row, &first_col, &end_col);
+    if (cinfo->output_iMCU_row < first_row || cinfo->output_iMCU_row >= end_row)
+        end_col = first_col;
+
     /* OK, output from the virtual arrays. */
     for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
             ci++, compptr++) {
         /* Don't bother to IDCT an uninteresting component. */
-        if (! compptr->component_needed)
+        if (! compptr->component_needed || end_col == first_col)
             continue;
+        first_block = first_col * compptr->h_samp_factor;
+        end_block = MIN(compptr->width_in_blocks,
+                end_col * compptr->h_samp_factor);
         /* Align the virtual buffer for this component. */
         buffer = (*cinfo->mem->access_virt_barray)
             ((j_common_ptr) cinfo, coef->whole_image[ci],
@@ -502,12 +871,13 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
             if (block_rows == 0) block_rows = compptr->v_samp_factor;
         }
         inverse_DCT = cinfo->idct->inverse_DCT[ci];
-        output_ptr = output_buf[ci];
+        output_ptr = output_buf[ci] + cinfo->output_iMCU_row *
+            compptr->v_samp_factor * compptr->DCT_scaled_size;
         /* Loop over all DCT blocks to be processed. */
         for (block_row = 0; block_row < block_rows; block_row++) {
-            buffer_ptr = buffer[block_row];
-            output_col = 0;
-            for (block_num = 0; block_num < compptr->width_in_blocks; block_num++) {
+            buffer_ptr = buffer[block_row] + first_block;
+            output_col = first_block * compptr->DCT_scaled_size;
+            for (block_num = first_block; block_num < end_block; block_num++) {
                 (*inverse_DCT) (cinfo, compptr, (JCOEFPTR) buffer_ptr,
                         output_ptr, output_col);
                 buffer_ptr++;
@@ -522,9 +892,689 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     return JPEG_SCAN_COMPLETED;
 }
 
+/*
+ * The main controller takes the whole image in one call, so the rows go
+ * on into the whole-image planes of the host pipeline (output_buf) until
+ * the scan is done or the input suspends.
+ */
+
+    METHODDEF(int)
+decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+    int retcode;
+
+    do {
+        retcode = decompress_data_row(cinfo, output_buf);
+    } while (retcode == JPEG_ROW_COMPLETED);
+    return retcode;
+}
+
 #endif /* D_MULTISCAN_FILES_SUPPORTED */
 
 
+#ifdef D_PROGRESSIVE_SUPPORTED
+
+/*
+ * Flat progressive mode.
+ *
+ * A progressive file is only complete at EOI, so when it is decoded in one
+ * output pass there is no point decoding its scans as they arrive.  The
+ * entropy-coded data of each scan is kept in memory instead, together with
+ * a private copy of everything needed to decode it: the decompression
+ * record, the scan's components, the entropy decoder and its tables.
+ * At output time the scans are decoded straight into one flat coefficient
+ * buffer laid out like the MCUs of an interleaved baseline scan, which
+ * then goes to the same IDCT stage (OpenCL or host) as a baseline image.
+ * No virtual arrays are involved.
+ *
+ * Scans depend on each other only through the coefficients they share.
+ * DC scans touch coefficient 0 only and AC scans a single component's
+ * coefficients 1..63, so the DC scans form one chain and each component's
+ * AC scans another.  The chains are decoded in parallel on cpu_pool, each
+ * in file order.
+ *
+ * Worker threads must not reach the application's error manager, so
+ * each scan's warnings are noted and passed on afterwards.  Block smoothing
+ * is not applied; it matters only for files whose scans leave AC
+ * coefficients incomplete.
+ */
+
+#define FLAT_CHUNK_SIZE  32768	/* bytes of scan data per chunk */
+
+typedef struct flat_chunk {
+    struct flat_chunk * next;
+    size_t used;			/* bytes of data filled in */
+    /* FLAT_CHUNK_SIZE bytes of data follow */
+} flat_chunk;
+
+typedef struct {
+    struct jpeg_source_mgr pub;	/* public fields */
+    flat_chunk * next_chunk;	/* chunk to hand out next */
+} flat_source_mgr;
+
+typedef struct {
+    struct jpeg_error_mgr pub;	/* public fields */
+    int first_code;		/* first warning issued while decoding */
+    char first_parm[SIZEOF(((struct jpeg_error_mgr *) 0)->msg_parm)];
+} flat_error_mgr;
+
+typedef struct flat_scan {
+    struct flat_scan * next;	/* next scan of the same chain */
+    struct jpeg_decompress_struct info; /* private copy for decoding */
+    jpeg_component_info comps[MAX_COMPS_IN_SCAN];
+    struct jpeg_marker_reader marker;
+    flat_source_mgr src;
+    flat_error_mgr err;
+    flat_chunk * first_chunk;
+    flat_chunk * last_chunk;
+} flat_scan;
+
+
+/* Data source handing out a scan's chunks, then a fake EOI */
+
+    METHODDEF(void)
+flat_init_source (j_decompress_ptr cinfo)
+{
+}
+
+    METHODDEF(boolean)
+flat_fill_input_buffer (j_decompress_ptr cinfo)
+{
+    static const JOCTET fake_eoi[2] = { (JOCTET) 0xFF, (JOCTET) JPEG_EOI };
+    flat_source_mgr * src = (flat_source_mgr *) cinfo->src;
+
+    if (src->next_chunk != NULL) {
+        src->pub.next_input_byte = (const JOCTET *) (src->next_chunk + 1);
+        src->pub.bytes_in_buffer = src->next_chunk->used;
+        src->next_chunk = src->next_chunk->next;
+    } else {
+        /* The scan data ended at the marker after it */
+        src->pub.next_input_byte = fake_eoi;
+        src->pub.bytes_in_buffer = 2;
+    }
+    return TRUE;
+}
+
+    METHODDEF(void)
+flat_skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+    flat_source_mgr * src = (flat_source_mgr *) cinfo->src;
+
+    while (num_bytes > (long) src->pub.bytes_in_buffer) {
+        num_bytes -= (long) src->pub.bytes_in_buffer;
+        (void) flat_fill_input_buffer(cinfo);
+    }
+    if (num_bytes > 0) {
+        src->pub.next_input_byte += (size_t) num_bytes;
+        src->pub.bytes_in_buffer -= (size_t) num_bytes;
+    }
+}
+
+    METHODDEF(void)
+flat_term_source (j_decompress_ptr cinfo)
+{
+}
+
+
+/* Note a message from a worker thread; trace messages are dropped */
+
+    METHODDEF(void)
+flat_emit_message (j_common_ptr cinfo, int msg_level)
+{
+    flat_error_mgr * err = (flat_error_mgr *) cinfo->err;
+
+    if (msg_level >= 0)
+        return;
+    if (err->pub.num_warnings == 0) {
+        err->first_code = err->pub.msg_code;
+        MEMCOPY(err->first_parm, &err->pub.msg_parm, SIZEOF(err->first_parm));
+    }
+    err->pub.num_warnings++;
+}
+
+
+/*
+ * Start reading in a scan: the input controller has just set up the
+ * decoder for it, so take the private copies now.
+ */
+
+    METHODDEF(void)
+start_input_pass_flat (j_decompress_ptr cinfo)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    flat_scan * scan;
+    int ci, chain;
+
+    scan = (flat_scan *)
+        (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                SIZEOF(flat_scan));
+    MEMCOPY(&scan->info, cinfo, SIZEOF(struct jpeg_decompress_struct));
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        MEMCOPY(&scan->comps[ci], cinfo->cur_comp_info[ci],
+                SIZEOF(jpeg_component_info));
+        scan->info.cur_comp_info[ci] = &scan->comps[ci];
+    }
+    scan->info.entropy = jcopy_phuff_decoder(cinfo);
+
+    MEMCOPY(&scan->marker, cinfo->marker, SIZEOF(struct jpeg_marker_reader));
+    scan->info.marker = &scan->marker;
+
+    scan->src.pub.init_source = flat_init_source;
+    scan->src.pub.fill_input_buffer = flat_fill_input_buffer;
+    scan->src.pub.skip_input_data = flat_skip_input_data;
+    scan->src.pub.resync_to_restart = jpeg_resync_to_restart;
+    scan->src.pub.term_source = flat_term_source;
+    scan->src.pub.bytes_in_buffer = 0;
+    scan->src.pub.next_input_byte = NULL;
+    scan->info.src = &scan->src.pub;
+
+    MEMCOPY(&scan->err.pub, cinfo->err, SIZEOF(struct jpeg_error_mgr));
+    scan->err.pub.emit_message = flat_emit_message;
+    scan->err.pub.num_warnings = 0;
+    scan->info.err = &scan->err.pub;
+
+    scan->first_chunk = scan->last_chunk = NULL;
+    scan->next = NULL;
+
+    /* DC scans make chain 0, each component's AC scans the next ones */
+    if (cinfo->Ss == 0)
+        chain = 0;
+    else
+        chain = 1 + cinfo->cur_comp_info[0]->component_index;
+    *coef->chain_tails[chain] = scan;
+    coef->chain_tails[chain] = &scan->next;
+
+    coef->cur_scan = scan;
+    coef->pending_ff = FALSE;
+    cinfo->input_iMCU_row = 0;
+}
+
+
+/* Append n bytes of scan data to the current scan */
+
+    LOCAL(void)
+append_scan_data (j_decompress_ptr cinfo, const JOCTET * data, size_t n)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    flat_scan * scan = coef->cur_scan;
+    flat_chunk * chunk;
+    size_t count;
+
+    while (n > 0) {
+        chunk = scan->last_chunk;
+        if (chunk == NULL || chunk->used == FLAT_CHUNK_SIZE) {
+            chunk = (flat_chunk *)
+                (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                        SIZEOF(flat_chunk) + FLAT_CHUNK_SIZE);
+            chunk->next = NULL;
+            chunk->used = 0;
+            if (scan->last_chunk == NULL)
+                scan->first_chunk = chunk;
+            else
+                scan->last_chunk->next = chunk;
+            scan->last_chunk = chunk;
+        }
+        count = MIN(n, FLAT_CHUNK_SIZE - chunk->used);
+        MEMCOPY((JOCTET *) (chunk + 1) + chunk->used, data, count);
+        chunk->used += count;
+        data += count;
+        n -= count;
+    }
+}
+
+
+/*
+ * Read in the entropy-coded data of a scan, up to the marker that ends it.
+ * Stuffed zero bytes and RSTn markers belong to the data; fill bytes
+ * before the marker are dropped.  The marker is left in unread_marker, as
+ * the entropy decoders leave it.
+ * Return value is JPEG_SCAN_COMPLETED or JPEG_SUSPENDED.
+ */
+
+    METHODDEF(int)
+consume_data_flat (j_decompress_ptr cinfo)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    struct jpeg_source_mgr * src = cinfo->src;
+    const JOCTET * ff;
+    size_t n;
+    int c;
+
+    for (;;) {
+        if (src->bytes_in_buffer == 0) {
+            if (! (*src->fill_input_buffer) (cinfo))
+                return JPEG_SUSPENDED;
+        }
+        if (coef->pending_ff) {
+            c = GETJOCTET(*src->next_input_byte);
+            src->next_input_byte++;
+            src->bytes_in_buffer--;
+            if (c == 0xFF)		/* fill byte; still pending */
+                continue;
+            coef->pending_ff = FALSE;
+            if (c == 0 || (c >= JPEG_RST0 && c <= JPEG_RST0 + 7)) {
+                JOCTET pair[2];
+
+                pair[0] = (JOCTET) 0xFF;
+                pair[1] = (JOCTET) c;
+                append_scan_data(cinfo, pair, 2);
+                continue;
+            }
+            /* Any other marker ends the scan */
+            cinfo->unread_marker = c;
+            break;
+        }
+        ff = (const JOCTET *) memchr(src->next_input_byte, 0xFF,
+                src->bytes_in_buffer);
+        n = (ff != NULL) ? (size_t) (ff - src->next_input_byte)
+            : src->bytes_in_buffer;
+        append_scan_data(cinfo, src->next_input_byte, n);
+        src->next_input_byte += n;
+        src->bytes_in_buffer -= n;
+        if (ff != NULL) {
+            src->next_input_byte++;
+            src->bytes_in_buffer--;
+            coef->pending_ff = TRUE;
+        }
+    }
+
+    cinfo->input_iMCU_row = cinfo->total_iMCU_rows;
+    (*cinfo->inputctl->finish_input_pass) (cinfo);
+    return JPEG_SCAN_COMPLETED;
+}
+
+
+/* Find a component's block in the interleaved layout */
+
+    LOCAL(JBLOCKROW)
+flat_block (my_coef_ptr coef, jpeg_component_info * compptr,
+        JDIMENSION block_row, JDIMENSION block_col)
+{
+    return coef->decoded_mcus_base
+        + ((block_row / compptr->v_samp_factor) * coef->flat_MCUs_per_row
+                + block_col / compptr->h_samp_factor)
+        * coef->flat_blocks_in_MCU
+        + coef->flat_offset[compptr->component_index]
+        + (block_row % compptr->v_samp_factor) * compptr->h_samp_factor
+        + block_col % compptr->h_samp_factor;
+}
+
+
+/* Decode one kept scan into the flat buffer */
+
+    LOCAL(void)
+decode_flat_scan (my_coef_ptr coef, flat_scan * scan)
+{
+    j_decompress_ptr cinfo = &scan->info;
+    JBLOCKROW MCU_buffer[D_MAX_BLOCKS_IN_MCU];
+    JDIMENSION MCU_row, MCU_col, block_row, block_col;
+    jpeg_component_info *compptr;
+    int blkn, ci, xindex, yindex;
+
+    scan->src.next_chunk = scan->first_chunk;
+    for (MCU_row = 0; MCU_row < cinfo->MCU_rows_in_scan; MCU_row++) {
+        for (MCU_col = 0; MCU_col < cinfo->MCUs_per_row; MCU_col++) {
+            blkn = 0;
+            for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+                compptr = cinfo->cur_comp_info[ci];
+                for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+                    block_row = MCU_row * compptr->MCU_height + yindex;
+                    for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+                        block_col = MCU_col * compptr->MCU_width + xindex;
+                        MCU_buffer[blkn++] =
+                            flat_block(coef, compptr, block_row, block_col);
+                    }
+                }
+            }
+            /* The memory source never suspends */
+            (void) (*cinfo->entropy->decode_mcu) (cinfo, MCU_buffer);
+        }
+    }
+}
+
+struct FlatDecodeJob
+{
+    my_coef_ptr coef;
+};
+
+static void decode_flat_chain(void * arg,int index,int worker)
+{
+    struct FlatDecodeJob * job = (struct FlatDecodeJob *)arg;
+    flat_scan * scan;
+
+    for(scan = job->coef->chains[index] ; scan != NULL ; scan = scan->next)
+    {
+        decode_flat_scan(job->coef,scan);
+    }
+}
+
+
+/*
+ * Lay out the image as one interleaved scan for the IDCT stage, as
+ * per_scan_setup (jdinput.c) does: onepass2 and the host version walk
+ * the MCUs of cur_comp_info just as they do after a baseline scan.
+ */
+
+    LOCAL(void)
+set_flat_layout (j_decompress_ptr cinfo)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    jpeg_component_info *compptr;
+    int ci, tmp;
+
+    cinfo->comps_in_scan = cinfo->num_components;
+    cinfo->MCUs_per_row = coef->flat_MCUs_per_row;
+    cinfo->MCU_rows_in_scan = cinfo->total_iMCU_rows;
+    cinfo->blocks_in_MCU = 0;
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+            ci++, compptr++) {
+        cinfo->cur_comp_info[ci] = compptr;
+        compptr->MCU_width = compptr->h_samp_factor;
+        compptr->MCU_height = compptr->v_samp_factor;
+        compptr->MCU_blocks = compptr->MCU_width * compptr->MCU_height;
+        compptr->MCU_sample_width = compptr->MCU_width * compptr->DCT_scaled_size;
+        tmp = (int) (compptr->width_in_blocks % compptr->MCU_width);
+        if (tmp == 0) tmp = compptr->MCU_width;
+        compptr->last_col_width = tmp;
+        tmp = (int) (compptr->height_in_blocks % compptr->MCU_height);
+        if (tmp == 0) tmp = compptr->MCU_height;
+        compptr->last_row_height = tmp;
+        for (tmp = 0; tmp < compptr->MCU_blocks; tmp++)
+            cinfo->MCU_membership[cinfo->blocks_in_MCU++] = ci;
+    }
+}
+
+
+/* Decode all the kept scans, then hand the image to the IDCT stage */
+
+    METHODDEF(int)
+decompress_flat (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    struct FlatDecodeJob job;
+    flat_scan * scan;
+    int chain;
+    double start;
+
+    job.coef = coef;
+    start = j_opencl_prof_begin(cinfo);
+    j_threadpool_run(cinfo->cpu_pool,cinfo->num_components + 1,
+            decode_flat_chain,&job);
+    j_opencl_prof_end(cinfo,JSTAGE_ENTROPY,start);
+
+    /* Pass on the warnings of the scans */
+    for (chain = 0; chain <= cinfo->num_components; chain++) {
+        for (scan = coef->chains[chain]; scan != NULL; scan = scan->next) {
+            if (scan->err.pub.num_warnings == 0)
+                continue;
+            cinfo->err->msg_code = scan->err.first_code;
+            MEMCOPY(&cinfo->err->msg_parm, scan->err.first_parm,
+                    SIZEOF(scan->err.first_parm));
+            (*cinfo->err->emit_message) ((j_common_ptr) cinfo, -1);
+            cinfo->err->num_warnings += scan->err.pub.num_warnings - 1;
+        }
+    }
+
+    set_flat_layout(cinfo);
+    coef->MCU_rows_per_iMCU_row = 1;
+
+    if(cinfo->cpu_pipeline)
+    {
+        coef->pub.decompress_data = decompress_onepass_cpu;
+        return decompress_onepass_cpu(cinfo,output_buf);
+    }
+    coef->pub.decompress_data = decompress_onepass2;
+    return decompress_onepass2(cinfo,output_buf);
+}
+
+
+/*
+ * Buffered-image mode.
+ *
+ * Here the application displays the image after any scan, so the scans
+ * are decoded as they arrive, one iMCU row per call as consume_data does,
+ * into the same flat buffer.  Each output pass runs the IDCT over the
+ * whole image.  On the OpenCL pipeline the coefficients stay on the device
+ * (cinfo->cl_coef_buffer) from one pass to the next, and a pass uploads
+ * only the iMCU rows that the scans read in since the last one changed;
+ * upsampling and color conversion then follow on the device as usual.
+ */
+
+    METHODDEF(int)
+consume_flat_rows (j_decompress_ptr cinfo)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    JDIMENSION MCU_col_num;	/* index of current MCU within row */
+    JDIMENSION block_row;
+    int blkn, ci, xindex, yindex, yoffset;
+    jpeg_component_info *compptr;
+
+    if (coef->dirty_first > cinfo->input_iMCU_row)
+        coef->dirty_first = cinfo->input_iMCU_row;
+    if (coef->dirty_end <= cinfo->input_iMCU_row)
+        coef->dirty_end = cinfo->input_iMCU_row + 1;
+
+    /* Loop to process one whole iMCU row */
+    for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
+            yoffset++) {
+        for (MCU_col_num = coef->MCU_ctr; MCU_col_num < cinfo->MCUs_per_row;
+                MCU_col_num++) {
+            /* Construct list of pointers to DCT blocks belonging to this MCU */
+            blkn = 0;
+            for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+                compptr = cinfo->cur_comp_info[ci];
+                block_row = cinfo->input_iMCU_row * compptr->v_samp_factor
+                    + yoffset;
+                for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+                    for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+                        coef->MCU_buffer[blkn++] = flat_block(coef, compptr,
+                                block_row + yindex,
+                                MCU_col_num * compptr->MCU_width + xindex);
+                    }
+                }
+            }
+            /* Try to fetch the MCU. */
+            if (! (*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
+                /* Suspension forced; update state counters and exit */
+                coef->MCU_vert_offset = yoffset;
+                coef->MCU_ctr = MCU_col_num;
+                return JPEG_SUSPENDED;
+            }
+        }
+        /* Completed an MCU row, but perhaps not an iMCU row */
+        coef->MCU_ctr = 0;
+    }
+    /* Completed the iMCU row, advance counters for next one */
+    if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
+        start_iMCU_row(cinfo);
+        return JPEG_ROW_COMPLETED;
+    }
+    /* Completed the scan */
+    (*cinfo->inputctl->finish_input_pass) (cinfo);
+    return JPEG_SCAN_COMPLETED;
+}
+
+
+/* Bring the device copy of the coefficients up to date */
+
+    LOCAL(void)
+upload_dirty_rows (j_decompress_ptr cinfo)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    size_t row_size, size;
+    cl_int error_code;
+    double start;
+
+    row_size = (size_t) coef->flat_MCUs_per_row * coef->flat_blocks_in_MCU
+        * SIZEOF(JBLOCK);
+    size = row_size * cinfo->total_iMCU_rows;
+    start = j_opencl_prof_begin(cinfo);
+    if (cinfo->cl_coef_buffer != NULL && cinfo->cl_coef_size < size) {
+        clReleaseMemObject(cinfo->cl_coef_buffer);
+        (*cinfo->mem->account_device_space) ((j_common_ptr) cinfo,
+                - (long) cinfo->cl_coef_size);
+        cinfo->cl_coef_buffer = NULL;
+        cinfo->cl_coef_size = 0;
+    }
+    if (cinfo->cl_coef_buffer == NULL) {
+        (*cinfo->mem->account_device_space) ((j_common_ptr) cinfo,
+                (long) size);
+        cinfo->cl_coef_buffer = clCreateBuffer(cinfo->current_cl_context,
+                CL_MEM_READ_ONLY, size, NULL, &error_code);
+        if (error_code != CL_SUCCESS) {
+            (*cinfo->mem->account_device_space) ((j_common_ptr) cinfo,
+                    - (long) size);
+            ERREXIT(cinfo, error_code);
+        }
+        cinfo->cl_coef_size = size;
+    }
+    /* A blocking write: the input side goes on decoding into these rows */
+    if (coef->dirty_first < coef->dirty_end) {
+        error_code = clEnqueueWriteBuffer(cinfo->current_cl_queue,
+                cinfo->cl_coef_buffer, CL_TRUE,
+                row_size * coef->dirty_first,
+                row_size * (coef->dirty_end - coef->dirty_first),
+                (JOCTET *) coef->decoded_mcus_base
+                + row_size * coef->dirty_first,
+                0, NULL, NULL);
+        if (error_code != CL_SUCCESS)
+            ERREXIT(cinfo, error_code);
+    }
+    coef->dirty_first = cinfo->total_iMCU_rows;
+    coef->dirty_end = 0;
+    j_opencl_prof_end(cinfo,JSTAGE_UPLOAD,start);
+}
+
+
+/*
+ * Emit the whole image as of the scan being displayed.
+ * The input side may be in the middle of a later scan, so its geometry
+ * is put back once the IDCT stage has been set going.
+ */
+
+    METHODDEF(int)
+decompress_flat_buffered (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    JBLOCK * decoded_mcus_base;
+    int comps_in_scan, blocks_in_MCU;
+    jpeg_component_info * cur_comp_info[MAX_COMPS_IN_SCAN];
+    jpeg_component_info comps[MAX_COMPS_IN_SCAN];
+    JDIMENSION MCUs_per_row, MCU_rows_in_scan;
+    int MCU_membership[D_MAX_BLOCKS_IN_MCU];
+
+    if (cinfo->output_iMCU_row >= cinfo->total_iMCU_rows)
+        return JPEG_SCAN_COMPLETED;	/* pass already emitted */
+
+    /* Force input to complete the scan being displayed. */
+    while ((cinfo->input_scan_number < cinfo->output_scan_number ||
+                (cinfo->input_scan_number == cinfo->output_scan_number &&
+                 cinfo->input_iMCU_row < cinfo->total_iMCU_rows)) &&
+            ! cinfo->inputctl->eoi_reached) {
+        if ((*cinfo->inputctl->consume_input)(cinfo) == JPEG_SUSPENDED)
+            return JPEG_SUSPENDED;
+    }
+
+    comps_in_scan = cinfo->comps_in_scan;
+    MEMCOPY(cur_comp_info, cinfo->cur_comp_info, SIZEOF(cur_comp_info));
+    MEMCOPY(comps, cinfo->comp_info,
+            cinfo->num_components * SIZEOF(jpeg_component_info));
+    MCUs_per_row = cinfo->MCUs_per_row;
+    MCU_rows_in_scan = cinfo->MCU_rows_in_scan;
+    blocks_in_MCU = cinfo->blocks_in_MCU;
+    MEMCOPY(MCU_membership, cinfo->MCU_membership, SIZEOF(MCU_membership));
+
+    set_flat_layout(cinfo);
+#ifdef BLOCK_SMOOTHING_SUPPORTED
+    if (coef->smooth_flat) {
+        /* Output the smoothed copy; all of it differs from the device copy */
+        smooth_flat_rows(cinfo);
+        decoded_mcus_base = coef->decoded_mcus_base;
+        coef->decoded_mcus_base = coef->smoothed_base;
+        coef->dirty_first = 0;
+        coef->dirty_end = cinfo->total_iMCU_rows;
+    }
+#endif
+    if (cinfo->cpu_pipeline) {
+        run_idct_cpu(cinfo, output_buf);
+    } else {
+        upload_dirty_rows(cinfo);
+        run_idct_kernel(cinfo, cinfo->cl_coef_buffer);
+    }
+#ifdef BLOCK_SMOOTHING_SUPPORTED
+    if (coef->smooth_flat) {
+        coef->decoded_mcus_base = decoded_mcus_base;
+        coef->dirty_first = 0;
+        coef->dirty_end = cinfo->total_iMCU_rows;
+    }
+#endif
+
+    cinfo->comps_in_scan = comps_in_scan;
+    MEMCOPY(cinfo->cur_comp_info, cur_comp_info, SIZEOF(cur_comp_info));
+    MEMCOPY(cinfo->comp_info, comps,
+            cinfo->num_components * SIZEOF(jpeg_component_info));
+    cinfo->MCUs_per_row = MCUs_per_row;
+    cinfo->MCU_rows_in_scan = MCU_rows_in_scan;
+    cinfo->blocks_in_MCU = blocks_in_MCU;
+    MEMCOPY(cinfo->MCU_membership, MCU_membership, SIZEOF(MCU_membership));
+
+    cinfo->output_iMCU_row = cinfo->total_iMCU_rows;
+    return JPEG_SCAN_COMPLETED;
+}
+
+
+/*
+ * Flat mode needs a layout of all the components that fits in one
+ * interleaved MCU.  A transcoder reads the coefficients out of virtual
+ * arrays, so it keeps them; jpeg_read_coefficients enters DSTATE_RDCOEFS
+ * before selecting the modules.  So does the host pipeline when the flat
+ * buffer would break the memory budget: virtual arrays can go to backing
+ * store.  (The OpenCL pipeline only takes flat coefficients; the budget
+ * check in jpeg_start_decompress covers it.)
+ */
+
+    LOCAL(boolean)
+flat_mode_ok (j_decompress_ptr cinfo)
+{
+    int ci, blocks;
+    long flat_size, room;
+    jpeg_component_info *compptr;
+
+    if (! cinfo->progressive_mode || cinfo->global_state == DSTATE_RDCOEFS ||
+            cinfo->num_components > MAX_COMPS_IN_SCAN)
+        return FALSE;
+    blocks = 0;
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+            ci++, compptr++)
+        blocks += compptr->h_samp_factor * compptr->v_samp_factor;
+    if (blocks > D_MAX_BLOCKS_IN_MCU)
+        return FALSE;
+    if (cinfo->cpu_pipeline && cinfo->mem->memory_budget > 0) {
+        /* The buffer must fit with the sample planes the main controller
+         * is about to allocate and the whole output image, which the
+         * application has to hold as well.
+         */
+        flat_size = (long) cinfo->total_iMCU_rows * blocks * SIZEOF(JBLOCK) *
+            jdiv_round_up((long) cinfo->image_width,
+                    (long) (cinfo->max_h_samp_factor*DCTSIZE));
+        for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+                ci++, compptr++)
+            flat_size += (long) compptr->width_in_blocks *
+                compptr->v_samp_factor * cinfo->total_iMCU_rows *
+                compptr->DCT_scaled_size * compptr->DCT_scaled_size;
+        flat_size += (long) cinfo->output_width * cinfo->output_height *
+            cinfo->out_color_components;
+        room = cinfo->mem->memory_budget - cinfo->mem->host_space_allocated
+            - cinfo->mem->device_space_allocated;
+        if (flat_size > room)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+#endif /* D_PROGRESSIVE_SUPPORTED */
+
+
 #ifdef BLOCK_SMOOTHING_SUPPORTED
 
 /*
@@ -602,12 +1652,52 @@ smoothing_ok (j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Estimate the first 5 AC coefficients of one block per K.8 from the DC
+ * values of the 3x3 blocks around it, DC[0..8] row by row (DC[4] is the
+ * block's own).  An estimate is applied only if the coefficient is still
+ * zero, and is not known to be fully accurate.
+ */
+
+    LOCAL(void)
+smooth_block (JCOEFPTR workspace, const int * coef_bits,
+        JQUANT_TBL * quanttbl, const int * DC)
+{
+    static const int pos[5] = { Q01_POS, Q10_POS, Q20_POS, Q11_POS, Q02_POS };
+    INT32 Q00, Qk, num[5];
+    int k, Al, pred;
+
+    Q00 = quanttbl->quantval[0];
+    num[0] = 36 * Q00 * (DC[3] - DC[5]);		/* AC01 */
+    num[1] = 36 * Q00 * (DC[1] - DC[7]);		/* AC10 */
+    num[2] = 9 * Q00 * (DC[1] + DC[7] - 2*DC[4]);	/* AC20 */
+    num[3] = 5 * Q00 * (DC[0] - DC[2] - DC[6] + DC[8]); /* AC11 */
+    num[4] = 9 * Q00 * (DC[3] + DC[5] - 2*DC[4]);	/* AC02 */
+    for (k = 0; k < 5; k++) {
+        if ((Al=coef_bits[k+1]) == 0 || workspace[pos[k]] != 0)
+            continue;
+        Qk = quanttbl->quantval[pos[k]];
+        if (num[k] >= 0) {
+            pred = (int) (((Qk<<7) + num[k]) / (Qk<<8));
+            if (Al > 0 && pred >= (1<<Al))
+                pred = (1<<Al)-1;
+        } else {
+            pred = (int) (((Qk<<7) - num[k]) / (Qk<<8));
+            if (Al > 0 && pred >= (1<<Al))
+                pred = (1<<Al)-1;
+            pred = -pred;
+        }
+        workspace[pos[k]] = (JCOEF) pred;
+    }
+}
+
+
 /*
  * Variant of decompress_data for use when doing block smoothing.
  */
 
-    METHODDEF(int)
-decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+    LOCAL(int)
+decompress_smooth_row (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 {
     my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
     JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
@@ -623,9 +1713,8 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     JBLOCK workspace;
     int *coef_bits;
     JQUANT_TBL *quanttbl;
-    INT32 Q00,Q01,Q02,Q10,Q11,Q20, num;
-    int DC1,DC2,DC3,DC4,DC5,DC6,DC7,DC8,DC9;
-    int Al, pred;
+    int DC[9];
+    JDIMENSION region_first_row, region_end_row, region_first_col, region_end_col;
 
     /* Force some input to be done if we are getting ahead of the input. */
     while (cinfo->input_scan_number <= cinfo->output_scan_number &&
@@ -644,11 +1733,19 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
             return JPEG_SUSPENDED;
     }
 
+    /* Rows outside the region of interest, or skipped, are left alone.
+     * Columns are all done, as the DC values slide along each block row.
+     */
+    region_window(cinfo, &region_first_row, &region_end_row,
+            &region_first_col, &region_end_col);
+
     /* OK, output from the virtual arrays. */
     for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
             ci++, compptr++) {
         /* Don't bother to IDCT an uninteresting component. */
-        if (! compptr->component_needed)
+        if (! compptr->component_needed ||
+                cinfo->output_iMCU_row < region_first_row ||
+                cinfo->output_iMCU_row >= region_end_row)
             continue;
         /* Count non-dummy DCT block rows in this iMCU row. */
         if (cinfo->output_iMCU_row < last_iMCU_row) {
@@ -680,14 +1777,9 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
         /* Fetch component-dependent info */
         coef_bits = coef->coef_bits_latch + (ci * SAVED_COEFS);
         quanttbl = compptr->quant_table;
-        Q00 = quanttbl->quantval[0];
-        Q01 = quanttbl->quantval[Q01_POS];
-        Q10 = quanttbl->quantval[Q10_POS];
-        Q20 = quanttbl->quantval[Q20_POS];
-        Q11 = quanttbl->quantval[Q11_POS];
-        Q02 = quanttbl->quantval[Q02_POS];
         inverse_DCT = cinfo->idct->inverse_DCT[ci];
-        output_ptr = output_buf[ci];
+        output_ptr = output_buf[ci] + cinfo->output_iMCU_row *
+            compptr->v_samp_factor * compptr->DCT_scaled_size;
         /* Loop over all DCT blocks to be processed. */
         for (block_row = 0; block_row < block_rows; block_row++) {
             buffer_ptr = buffer[block_row];
@@ -702,9 +1794,9 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
             /* We fetch the surrounding DC values using a sliding-register approach.
              * Initialize all nine here so as to do the right thing on narrow pics.
              */
-            DC1 = DC2 = DC3 = (int) prev_block_row[0][0];
-            DC4 = DC5 = DC6 = (int) buffer_ptr[0][0];
-            DC7 = DC8 = DC9 = (int) next_block_row[0][0];
+            DC[0] = DC[1] = DC[2] = (int) prev_block_row[0][0];
+            DC[3] = DC[4] = DC[5] = (int) buffer_ptr[0][0];
+            DC[6] = DC[7] = DC[8] = (int) next_block_row[0][0];
             output_col = 0;
             last_block_column = compptr->width_in_blocks - 1;
             for (block_num = 0; block_num <= last_block_column; block_num++) {
@@ -712,96 +1804,19 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
                 jcopy_block_row(buffer_ptr, (JBLOCKROW) workspace, (JDIMENSION) 1);
                 /* Update DC values */
                 if (block_num < last_block_column) {
-                    DC3 = (int) prev_block_row[1][0];
-                    DC6 = (int) buffer_ptr[1][0];
-                    DC9 = (int) next_block_row[1][0];
-                }
-                /* Compute coefficient estimates per K.8.
-                 * An estimate is applied only if coefficient is still zero,
-                 * and is not known to be fully accurate.
-                 */
-                /* AC01 */
-                if ((Al=coef_bits[1]) != 0 && workspace[1] == 0) {
-                    num = 36 * Q00 * (DC4 - DC6);
-                    if (num >= 0) {
-                        pred = (int) (((Q01<<7) + num) / (Q01<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                    } else {
-                        pred = (int) (((Q01<<7) - num) / (Q01<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                        pred = -pred;
-                    }
-                    workspace[1] = (JCOEF) pred;
-                }
-                /* AC10 */
-                if ((Al=coef_bits[2]) != 0 && workspace[8] == 0) {
-                    num = 36 * Q00 * (DC2 - DC8);
-                    if (num >= 0) {
-                        pred = (int) (((Q10<<7) + num) / (Q10<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                    } else {
-                        pred = (int) (((Q10<<7) - num) / (Q10<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                        pred = -pred;
-                    }
-                    workspace[8] = (JCOEF) pred;
-                }
-                /* AC20 */
-                if ((Al=coef_bits[3]) != 0 && workspace[16] == 0) {
-                    num = 9 * Q00 * (DC2 + DC8 - 2*DC5);
-                    if (num >= 0) {
-                        pred = (int) (((Q20<<7) + num) / (Q20<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                    } else {
-                        pred = (int) (((Q20<<7) - num) / (Q20<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                        pred = -pred;
-                    }
-                    workspace[16] = (JCOEF) pred;
-                }
-                /* AC11 */
-                if ((Al=coef_bits[4]) != 0 && workspace[9] == 0) {
-                    num = 5 * Q00 * (DC1 - DC3 - DC7 + DC9);
-                    if (num >= 0) {
-                        pred = (int) (((Q11<<7) + num) / (Q11<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                    } else {
-                        pred = (int) (((Q11<<7) - num) / (Q11<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                        pred = -pred;
-                    }
-                    workspace[9] = (JCOEF) pred;
-                }
-                /* AC02 */
-                if ((Al=coef_bits[5]) != 0 && workspace[2] == 0) {
-                    num = 9 * Q00 * (DC4 + DC6 - 2*DC5);
-                    if (num >= 0) {
-                        pred = (int) (((Q02<<7) + num) / (Q02<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                    } else {
-                        pred = (int) (((Q02<<7) - num) / (Q02<<8));
-                        if (Al > 0 && pred >= (1<<Al))
-                            pred = (1<<Al)-1;
-                        pred = -pred;
-                    }
-                    workspace[2] = (JCOEF) pred;
+                    DC[2] = (int) prev_block_row[1][0];
+                    DC[5] = (int) buffer_ptr[1][0];
+                    DC[8] = (int) next_block_row[1][0];
                 }
+                /* Compute coefficient estimates per K.8. */
+                smooth_block(workspace, coef_bits, quanttbl, DC);
                 /* OK, do the IDCT */
                 (*inverse_DCT) (cinfo, compptr, (JCOEFPTR) workspace,
                         output_ptr, output_col);
                 /* Advance for next column */
-                DC1 = DC2; DC2 = DC3;
-                DC4 = DC5; DC5 = DC6;
-                DC7 = DC8; DC8 = DC9;
+                DC[0] = DC[1]; DC[1] = DC[2];
+                DC[3] = DC[4]; DC[4] = DC[5];
+                DC[6] = DC[7]; DC[7] = DC[8];
                 buffer_ptr++, prev_block_row++, next_block_row++;
                 output_col += compptr->DCT_scaled_size;
             }
@@ -814,6 +1829,87 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     return JPEG_SCAN_COMPLETED;
 }
 
+/* The whole image in one call, as decompress_data does */
+
+    METHODDEF(int)
+decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+    int retcode;
+
+    do {
+        retcode = decompress_smooth_row(cinfo, output_buf);
+    } while (retcode == JPEG_ROW_COMPLETED);
+    return retcode;
+}
+
+
+/*
+ * Block smoothing for the flat buffer of buffered-image mode: fill
+ * smoothed_base with the blocks of the iMCU rows to be output, with the
+ * estimates made.  The edges repeat the outermost blocks, as above.
+ */
+
+    LOCAL(void)
+smooth_flat_rows (j_decompress_ptr cinfo)
+{
+    my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+    JDIMENSION first_row, end_row, first_col, end_col;
+    JDIMENSION row_blocks, block_row, end_block_row, block_num;
+    JDIMENSION rows[3], last_block_row, last_block_column;
+    JBLOCKROW src, dst;
+    jpeg_component_info *compptr;
+    int ci, r, DC[9];
+
+    region_window(cinfo, &first_row, &end_row, &first_col, &end_col);
+    if (first_row >= end_row)
+        return;
+    if (coef->smoothed_base == NULL)
+        coef->smoothed_base = (JBLOCK *)
+            (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                    (size_t) cinfo->total_iMCU_rows * coef->flat_MCUs_per_row
+                    * coef->flat_blocks_in_MCU * SIZEOF(JBLOCK));
+
+    /* The flat layout is in iMCU rows: copy the window's rows as they are */
+    row_blocks = coef->flat_MCUs_per_row * coef->flat_blocks_in_MCU;
+    jcopy_block_row(coef->decoded_mcus_base + (size_t) first_row * row_blocks,
+            coef->smoothed_base + (size_t) first_row * row_blocks,
+            (end_row - first_row) * row_blocks);
+
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+            ci++, compptr++) {
+        if (! compptr->component_needed)
+            continue;
+        last_block_row = compptr->height_in_blocks - 1;
+        last_block_column = compptr->width_in_blocks - 1;
+        end_block_row = MIN(compptr->height_in_blocks,
+                end_row * compptr->v_samp_factor);
+        for (block_row = first_row * compptr->v_samp_factor;
+                block_row < end_block_row; block_row++) {
+            rows[0] = block_row > 0 ? block_row - 1 : block_row;
+            rows[1] = block_row;
+            rows[2] = block_row < last_block_row ? block_row + 1 : block_row;
+            for (r = 0; r < 3; r++)
+                DC[3*r] = DC[3*r+1] = DC[3*r+2] =
+                    (int) flat_block(coef, compptr, rows[r], 0)[0][0];
+            for (block_num = 0; block_num <= last_block_column; block_num++) {
+                if (block_num < last_block_column) {
+                    for (r = 0; r < 3; r++)
+                        DC[3*r+2] = (int) flat_block(coef, compptr, rows[r],
+                                block_num + 1)[0][0];
+                }
+                src = flat_block(coef, compptr, block_row, block_num);
+                dst = coef->smoothed_base + (src - coef->decoded_mcus_base);
+                smooth_block(dst[0], coef->coef_bits_latch + ci * SAVED_COEFS,
+                        compptr->quant_table, DC);
+                for (r = 0; r < 3; r++) {
+                    DC[3*r] = DC[3*r+1];
+                    DC[3*r+1] = DC[3*r+2];
+                }
+            }
+        }
+    }
+}
+
 #endif /* BLOCK_SMOOTHING_SUPPORTED */
 
 
@@ -832,11 +1928,58 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
     cinfo->coef = (struct jpeg_d_coef_controller *) coef;
     coef->pub.start_input_pass = start_input_pass;
     coef->pub.start_output_pass = start_output_pass;
+    coef->decode_info = NULL;
 #ifdef BLOCK_SMOOTHING_SUPPORTED
     coef->coef_bits_latch = NULL;
 #endif
 
     /* Create the coefficient buffer. */
+#ifdef D_PROGRESSIVE_SUPPORTED
+    if (need_full_buffer && flat_mode_ok(cinfo)) {
+        /* One flat buffer of interleaved MCUs, zeroed for the decoder */
+        int ci;
+        size_t flat_size;
+        jpeg_component_info *compptr;
+
+        coef->flat_MCUs_per_row = (JDIMENSION)
+            jdiv_round_up((long) cinfo->image_width,
+                    (long) (cinfo->max_h_samp_factor*DCTSIZE));
+        coef->flat_blocks_in_MCU = 0;
+        for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+                ci++, compptr++) {
+            coef->flat_offset[ci] = coef->flat_blocks_in_MCU;
+            coef->flat_blocks_in_MCU +=
+                compptr->h_samp_factor * compptr->v_samp_factor;
+        }
+        for (ci = 0; ci <= cinfo->num_components; ci++) {
+            coef->chains[ci] = NULL;
+            coef->chain_tails[ci] = &coef->chains[ci];
+        }
+        coef->cur_scan = NULL;
+        flat_size = (size_t) cinfo->total_iMCU_rows * coef->flat_MCUs_per_row
+            * coef->flat_blocks_in_MCU * SIZEOF(JBLOCK);
+        coef->decoded_mcus_base = (JBLOCK *)
+            (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                    flat_size);
+        jzero_far((void FAR *) coef->decoded_mcus_base, flat_size);
+#ifdef BLOCK_SMOOTHING_SUPPORTED
+        coef->smoothed_base = NULL;	/* allocated by smooth_flat_rows */
+        coef->smooth_flat = FALSE;
+#endif
+        if (cinfo->buffered_image) {
+            /* The device copy may hold another image: upload all rows */
+            coef->dirty_first = 0;
+            coef->dirty_end = cinfo->total_iMCU_rows;
+            coef->pub.consume_data = consume_flat_rows;
+            coef->pub.decompress_data = decompress_flat_buffered;
+        } else {
+            coef->pub.start_input_pass = start_input_pass_flat;
+            coef->pub.consume_data = consume_data_flat;
+            coef->pub.decompress_data = decompress_flat;
+        }
+        coef->pub.coef_arrays = NULL; /* no virtual arrays */
+    } else
+#endif
     if (need_full_buffer) {
 #ifdef D_MULTISCAN_FILES_SUPPORTED
         /* Allocate a full-image virtual array for each component, */
@@ -878,6 +2021,7 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
         for (i = 0; i < D_MAX_BLOCKS_IN_MCU; i++) {
             coef->MCU_buffer[i] = buffer + i;
         }
+        coef->decoded_mcus_base = NULL; /* allocated by decompress_onepass */
         coef->pub.consume_data = dummy_consume_data;
         coef->pub.decompress_data = decompress_onepass;
         coef->pub.coef_arrays = NULL; /* flag for no virtual arrays */
@@ -12,7 +12,10 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jopenclstore.h"
+#include "jopenclenv.h"
 #include "jopenclprogpool.h"
+#include "jopenclprof.h"
+#include "jsimd.h"
 
 
 /* Private subobject */
@@ -25,6 +28,9 @@ typedef struct {
   int * Cb_b_tab;		/* => table for Cb to B conversion */
   INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
   INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
+
+  /* SSE2/AVX2 version of the YCC->RGB row loop, or NULL */
+  jsimd_ycc_rgb_row_ptr ycc_rgb_row;
 } my_color_deconverter;
 
 typedef my_color_deconverter * my_cconvert_ptr;
@@ -136,11 +142,14 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
     cl_mem color_buf;
     cl_mem cl_input_buf;
     cl_mem convertInfoBuf;
+    size_t color_size;
     cl_kernel my_kernel;
     cl_int error_code;
     size_t global_work_size[2];
+    cl_uint in_pitch, plane_size, first_row, out_rows;
     struct ConverterInfo convert_info;
     my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+    double start;
 
 
     color_buf = NULL;
@@ -150,13 +159,20 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
     {
         ERREXIT(cinfo,error_code);
     }
+    color_size = (size_t) cinfo->output_height * cinfo->output_width
+        * cinfo->out_color_components;
+    (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+            (long) (color_size + sizeof(struct ConverterInfo)));
     color_buf = clCreateBuffer(cinfo->current_cl_context,
             CL_MEM_READ_WRITE,
-            cinfo->output_height * cinfo->output_width * cinfo->out_color_components,
+            color_size,
             NULL,
             &error_code);
     if(error_code != CL_SUCCESS)
     {
+        (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+                - (long) color_size);
+        color_buf = NULL;
         goto EXIT2;
     }
     my_kernel = clCreateKernel(ycc_to_rgb,"convert",&error_code);
@@ -198,8 +214,26 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
     {
         goto EXIT2;
     }
-    global_work_size [0] = cinfo->output_height;
+    // The upsampled planes are full size; only the region is converted,
+    // less the lines skipped with jpeg_skip_scanlines
+    in_pitch = cinfo->full_output_width;
+    plane_size = cinfo->full_output_width * cinfo->full_output_height;
+    first_row = cinfo->region_y + cinfo->output_scanline;
+    out_rows = cinfo->output_height - cinfo->output_scanline;
+    error_code = clSetKernelArg(my_kernel,3,sizeof(cl_uint),&in_pitch);
+    if(error_code == CL_SUCCESS)
+        error_code = clSetKernelArg(my_kernel,4,sizeof(cl_uint),&plane_size);
+    if(error_code == CL_SUCCESS)
+        error_code = clSetKernelArg(my_kernel,5,sizeof(cl_uint),&cinfo->region_x);
+    if(error_code == CL_SUCCESS)
+        error_code = clSetKernelArg(my_kernel,6,sizeof(cl_uint),&first_row);
+    if(error_code != CL_SUCCESS)
+    {
+        goto EXIT2;
+    }
+    global_work_size [0] = out_rows;
     global_work_size [1] = cinfo->output_width;
+    start = j_opencl_prof_begin(cinfo);
     error_code = clEnqueueNDRangeKernel(cinfo->current_cl_queue,my_kernel,
             2,
             NULL,
@@ -207,7 +241,8 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
             NULL,
             NULL,
             NULL,
-            NULL);
+            j_opencl_prof_event(cinfo,JSTAGE_COLOR));
+    j_opencl_prof_end(cinfo,JSTAGE_COLOR,start);
     j_opencl_store_new_session(cinfo->cl_store);
     j_opencl_store_append_buffer(cinfo->cl_store,color_buf);
     // {
@@ -228,26 +263,38 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
     //                 0);
     //     }
     // }
+    // blocking, so this also waits for every kernel queued before it
+    start = j_opencl_prof_begin(cinfo);
     error_code = clEnqueueReadBuffer(cinfo->current_cl_queue,
         color_buf,
         CL_TRUE,
         0,
-        cinfo->output_height * cinfo->output_width * cinfo->out_color_components,
+        out_rows * cinfo->output_width * cinfo->out_color_components,
         output_buf[0],
         0,
         0,
-        0);
+        j_opencl_prof_event(cinfo,JSTAGE_READBACK));
+    j_opencl_prof_end(cinfo,JSTAGE_READBACK,start);
+    j_opencl_prof_collect(cinfo);
     color_buf = NULL;
 EXIT2:
     if(convertInfoBuf)
     {
         clReleaseMemObject(convertInfoBuf);
     }
+    (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+            - (long) sizeof(struct ConverterInfo));
     if(color_buf)
     {
         clReleaseMemObject(color_buf);
+        (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+                - (long) color_size);
+    }
+    // The pixels are read back: nothing on the device is needed any more
+    while(!j_opencl_store_is_empty(cinfo->cl_store))
+    {
+        j_opencl_env_pop_session(cinfo);
     }
-    j_opencl_store_pop_session(cinfo->cl_store);
 
     if(CL_SUCCESS != error_code)
     {
@@ -280,7 +327,13 @@ _ycc_rgb_convert (j_decompress_ptr cinfo,
     inptr2 = input_buf[2][input_row];
     input_row++;
     outptr = *output_buf++;
-    for (col = 0; col < num_cols; col++) {
+    col = 0;
+    if (cconvert->ycc_rgb_row != NULL) {
+      /* vector code does all but the last few pixels */
+      col = (*cconvert->ycc_rgb_row) (inptr0, inptr1, inptr2, outptr, num_cols);
+      outptr += col * RGB_PIXELSIZE;
+    }
+    for (; col < num_cols; col++) {
       y  = GETJSAMPLE(inptr0[col]);
       cb = GETJSAMPLE(inptr1[col]);
       cr = GETJSAMPLE(inptr2[col]);
@@ -450,6 +503,7 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
 				SIZEOF(my_color_deconverter));
   cinfo->cconvert = (struct jpeg_color_deconverter *) cconvert;
   cconvert->pub.start_pass = start_pass_dcolor;
+  cconvert->ycc_rgb_row = NULL;
 
   /* Make sure num_components agrees with jpeg_color_space */
   switch (cinfo->jpeg_color_space) {
@@ -497,7 +551,17 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
   case JCS_RGB:
     cinfo->out_color_components = RGB_PIXELSIZE;
     if (cinfo->jpeg_color_space == JCS_YCbCr) {
-      cconvert->pub.color_convert = ycc_rgb_convert;
+      /* Without an OpenCL device, convert row by row on the host */
+      if (cinfo->cpu_pipeline) {
+	cconvert->pub.color_convert = _ycc_rgb_convert;
+#ifdef JSIMD_X86_RGB
+	if (jsimd_cpu_features() & JSIMD_AVX2)
+	  cconvert->ycc_rgb_row = jsimd_ycc_rgb_row_avx2;
+	else if (jsimd_cpu_features() & JSIMD_SSE2)
+	  cconvert->ycc_rgb_row = jsimd_ycc_rgb_row_sse2;
+#endif
+      } else
+	cconvert->pub.color_convert = ycc_rgb_convert;
       build_ycc_rgb_table(cinfo);
     } else if (cinfo->jpeg_color_space == JCS_GRAYSCALE) {
       cconvert->pub.color_convert = gray_rgb_convert;
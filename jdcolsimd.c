@@ -0,0 +1,344 @@
+/*
+ * jdcolsimd.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains SSE2 and AVX2 row helpers for YCbCr->RGB conversion,
+ * used by jdcolor.c and by the merged upsampler in jdmerge.c.
+ *
+ * The scalar code looks the chroma terms up in tables built as
+ *	Cr=>R  = (FIX(1.40200) * x + ONE_HALF) >> SCALEBITS
+ *	Cb=>B  = (FIX(1.77200) * x + ONE_HALF) >> SCALEBITS
+ *	Cb,Cr=>G = (- FIX(0.34414) * xb - FIX(0.71414) * xr + ONE_HALF)
+ *		   >> SCALEBITS
+ * with x the sample less CENTERJSAMPLE.  Here the same products are formed
+ * with pmaddwd, which multiplies 16-bit pairs and adds them into 32 bits.
+ * The multipliers do not fit 16 bits, so each is split over the pair
+ * (x, 4x) or (xb, 2xr): FIX(1.40200) = 91881 = 1 + 4 * 22970, and so on.
+ * The sums are exact, so the results equal the table entries.  Y plus a
+ * chroma term lies within the "simple" part of the range-limit table,
+ * which is a plain clamp to 0..MAXJSAMPLE, so unsigned saturation does
+ * the range limiting.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86_RGB
+
+#include <immintrin.h>
+
+#define SSE2_TARGET  __attribute__((target("sse2")))
+#define AVX2_TARGET  __attribute__((target("avx2")))
+
+#define SCALEBITS	16
+#define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
+
+/* A pmaddwd multiplier pair, first element in the low half */
+#define PAIR(lo,hi)  \
+  ((int) (((unsigned int) (hi) << 16) | ((unsigned int) (lo) & 0xFFFF)))
+
+/* 1.40200 * x from (x, 4x); 1.77200 * x from (x, 4x) */
+#define CR_R_PAIR	PAIR(1, 22970)
+#define CB_B_PAIR	PAIR(2, 29032)
+/* -0.34414 * xb - 0.71414 * xr from (xb, 2xr) */
+#define CBCR_G_PAIR	PAIR(-22554, -23401)
+
+
+/*
+ * SSE2 versions.
+ */
+
+/* (madd of the pairs + ONE_HALF) >> SCALEBITS, for 8 16-bit lanes */
+SSE2_TARGET static __inline__ __m128i
+chroma_term_sse2 (__m128i first, __m128i second, int pair)
+{
+  __m128i mult = _mm_set1_epi32(pair);
+  __m128i half = _mm_set1_epi32(ONE_HALF);
+  __m128i lo, hi;
+
+  lo = _mm_madd_epi16(_mm_unpacklo_epi16(first, second), mult);
+  hi = _mm_madd_epi16(_mm_unpackhi_epi16(first, second), mult);
+  lo = _mm_srai_epi32(_mm_add_epi32(lo, half), SCALEBITS);
+  hi = _mm_srai_epi32(_mm_add_epi32(hi, half), SCALEBITS);
+  return _mm_packs_epi32(lo, hi);
+}
+
+/* The R, G, B chroma terms of 8 Cb/Cr samples widened to 16 bits */
+SSE2_TARGET static __inline__ void
+chroma_terms_sse2 (__m128i cb, __m128i cr,
+		   __m128i * red, __m128i * green, __m128i * blue)
+{
+  __m128i center = _mm_set1_epi16(CENTERJSAMPLE);
+
+  cb = _mm_sub_epi16(cb, center);
+  cr = _mm_sub_epi16(cr, center);
+  *red = chroma_term_sse2(cr, _mm_slli_epi16(cr, 2), CR_R_PAIR);
+  *blue = chroma_term_sse2(cb, _mm_slli_epi16(cb, 2), CB_B_PAIR);
+  *green = chroma_term_sse2(cb, _mm_slli_epi16(cr, 1), CBCR_G_PAIR);
+}
+
+/* Squeeze four 0RGB dwords (R in the low byte) into 12 bytes at the bottom */
+SSE2_TARGET static __inline__ __m128i
+pack_rgb4_sse2 (__m128i pixels)
+{
+  __m128i low_dword = _mm_set_epi32(0, -1, 0, -1);
+  __m128i low_qword = _mm_set_epi32(0, 0, -1, -1);
+
+  /* two pixels in bytes 0-5 of each quadword */
+  pixels = _mm_or_si128(_mm_and_si128(pixels, low_dword),
+			_mm_srli_epi64(_mm_andnot_si128(low_dword, pixels), 8));
+  /* close the 2-byte gap between the quadwords */
+  return _mm_or_si128(_mm_and_si128(pixels, low_qword),
+		      _mm_srli_si128(_mm_andnot_si128(low_qword, pixels), 2));
+}
+
+/* Interleave 16 pixels of R, G, B and store them as 48 bytes */
+SSE2_TARGET static __inline__ void
+store_rgb16_sse2 (JSAMPROW outptr, __m128i red, __m128i green, __m128i blue)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i rg, b0, last;
+  int tail;
+
+  rg = _mm_unpacklo_epi8(red, green);
+  b0 = _mm_unpacklo_epi8(blue, zero);
+  /* each store spills 4 bytes that the next one overwrites */
+  _mm_storeu_si128((__m128i *) outptr,
+		   pack_rgb4_sse2(_mm_unpacklo_epi16(rg, b0)));
+  _mm_storeu_si128((__m128i *) (outptr + 12),
+		   pack_rgb4_sse2(_mm_unpackhi_epi16(rg, b0)));
+  rg = _mm_unpackhi_epi8(red, green);
+  b0 = _mm_unpackhi_epi8(blue, zero);
+  _mm_storeu_si128((__m128i *) (outptr + 24),
+		   pack_rgb4_sse2(_mm_unpacklo_epi16(rg, b0)));
+  last = pack_rgb4_sse2(_mm_unpackhi_epi16(rg, b0));
+  _mm_storel_epi64((__m128i *) (outptr + 36), last);
+  tail = _mm_cvtsi128_si32(_mm_srli_si128(last, 8));
+  MEMCOPY(outptr + 44, &tail, 4);
+}
+
+SSE2_TARGET GLOBAL(JDIMENSION)
+jsimd_ycc_rgb_row_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+			JSAMPROW outptr, JDIMENSION num_cols)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i y, cb, cr, ylo, yhi;
+  __m128i rlo, glo, blo, rhi, ghi, bhi;
+  JDIMENSION col;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    y = _mm_loadu_si128((const __m128i *) (inptr0 + col));
+    cb = _mm_loadu_si128((const __m128i *) (inptr1 + col));
+    cr = _mm_loadu_si128((const __m128i *) (inptr2 + col));
+    ylo = _mm_unpacklo_epi8(y, zero);
+    yhi = _mm_unpackhi_epi8(y, zero);
+    chroma_terms_sse2(_mm_unpacklo_epi8(cb, zero), _mm_unpacklo_epi8(cr, zero),
+		      &rlo, &glo, &blo);
+    chroma_terms_sse2(_mm_unpackhi_epi8(cb, zero), _mm_unpackhi_epi8(cr, zero),
+		      &rhi, &ghi, &bhi);
+    store_rgb16_sse2(outptr + col * RGB_PIXELSIZE,
+		     _mm_packus_epi16(_mm_add_epi16(ylo, rlo),
+				      _mm_add_epi16(yhi, rhi)),
+		     _mm_packus_epi16(_mm_add_epi16(ylo, glo),
+				      _mm_add_epi16(yhi, ghi)),
+		     _mm_packus_epi16(_mm_add_epi16(ylo, blo),
+				      _mm_add_epi16(yhi, bhi)));
+  }
+  return col;
+}
+
+/* Emit 32 pixels of one output row: luma plus the duplicated chroma terms
+ * of chroma samples 0-7 (lo) and 8-15 (hi).
+ */
+SSE2_TARGET static __inline__ void
+merged_pixels_sse2 (JSAMPROW inptr0, JSAMPROW outptr,
+		    __m128i rlo, __m128i glo, __m128i blo,
+		    __m128i rhi, __m128i ghi, __m128i bhi)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i y, y0, y1;
+
+  y = _mm_loadu_si128((const __m128i *) inptr0);
+  y0 = _mm_unpacklo_epi8(y, zero);
+  y1 = _mm_unpackhi_epi8(y, zero);
+  store_rgb16_sse2(outptr,
+    _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(rlo, rlo)),
+		     _mm_add_epi16(y1, _mm_unpackhi_epi16(rlo, rlo))),
+    _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(glo, glo)),
+		     _mm_add_epi16(y1, _mm_unpackhi_epi16(glo, glo))),
+    _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(blo, blo)),
+		     _mm_add_epi16(y1, _mm_unpackhi_epi16(blo, blo))));
+  y = _mm_loadu_si128((const __m128i *) (inptr0 + 16));
+  y0 = _mm_unpacklo_epi8(y, zero);
+  y1 = _mm_unpackhi_epi8(y, zero);
+  store_rgb16_sse2(outptr + 16 * RGB_PIXELSIZE,
+    _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(rhi, rhi)),
+		     _mm_add_epi16(y1, _mm_unpackhi_epi16(rhi, rhi))),
+    _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(ghi, ghi)),
+		     _mm_add_epi16(y1, _mm_unpackhi_epi16(ghi, ghi))),
+    _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(bhi, bhi)),
+		     _mm_add_epi16(y1, _mm_unpackhi_epi16(bhi, bhi))));
+}
+
+SSE2_TARGET GLOBAL(JDIMENSION)
+jsimd_merged_row_sse2 (JSAMPROW inptr00, JSAMPROW inptr01,
+		       JSAMPROW inptr1, JSAMPROW inptr2,
+		       JSAMPROW outptr0, JSAMPROW outptr1, JDIMENSION num_cols)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i cb, cr, rlo, glo, blo, rhi, ghi, bhi;
+  JDIMENSION col;
+
+  for (col = 0; col + 32 <= num_cols; col += 32) {
+    cb = _mm_loadu_si128((const __m128i *) (inptr1 + col / 2));
+    cr = _mm_loadu_si128((const __m128i *) (inptr2 + col / 2));
+    chroma_terms_sse2(_mm_unpacklo_epi8(cb, zero), _mm_unpacklo_epi8(cr, zero),
+		      &rlo, &glo, &blo);
+    chroma_terms_sse2(_mm_unpackhi_epi8(cb, zero), _mm_unpackhi_epi8(cr, zero),
+		      &rhi, &ghi, &bhi);
+    merged_pixels_sse2(inptr00 + col, outptr0 + col * RGB_PIXELSIZE,
+		       rlo, glo, blo, rhi, ghi, bhi);
+    if (inptr01 != NULL)
+      merged_pixels_sse2(inptr01 + col, outptr1 + col * RGB_PIXELSIZE,
+			 rlo, glo, blo, rhi, ghi, bhi);
+  }
+  return col;
+}
+
+
+/*
+ * AVX2 versions.  Samples are widened to 16 bits with vpmovzxbw, which
+ * keeps them in order across the two 128-bit lanes; the in-lane unpack,
+ * pmaddwd and pack steps of the chroma terms then preserve that order.
+ */
+
+AVX2_TARGET static __inline__ __m256i
+chroma_term_avx2 (__m256i first, __m256i second, int pair)
+{
+  __m256i mult = _mm256_set1_epi32(pair);
+  __m256i half = _mm256_set1_epi32(ONE_HALF);
+  __m256i lo, hi;
+
+  lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(first, second), mult);
+  hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(first, second), mult);
+  lo = _mm256_srai_epi32(_mm256_add_epi32(lo, half), SCALEBITS);
+  hi = _mm256_srai_epi32(_mm256_add_epi32(hi, half), SCALEBITS);
+  return _mm256_packs_epi32(lo, hi);
+}
+
+/* The R, G, B chroma terms of 16 Cb/Cr samples */
+AVX2_TARGET static __inline__ void
+chroma_terms_avx2 (JSAMPROW inptr1, JSAMPROW inptr2,
+		   __m256i * red, __m256i * green, __m256i * blue)
+{
+  __m256i center = _mm256_set1_epi16(CENTERJSAMPLE);
+  __m256i cb, cr;
+
+  cb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) inptr1));
+  cr = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) inptr2));
+  cb = _mm256_sub_epi16(cb, center);
+  cr = _mm256_sub_epi16(cr, center);
+  *red = chroma_term_avx2(cr, _mm256_slli_epi16(cr, 2), CR_R_PAIR);
+  *blue = chroma_term_avx2(cb, _mm256_slli_epi16(cb, 2), CB_B_PAIR);
+  *green = chroma_term_avx2(cb, _mm256_slli_epi16(cr, 1), CBCR_G_PAIR);
+}
+
+/* Saturate two vectors of 16 words into 32 bytes, in order */
+AVX2_TARGET static __inline__ __m256i
+pack_bytes_avx2 (__m256i first, __m256i second)
+{
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(first, second),
+				  _MM_SHUFFLE(3,1,2,0));
+}
+
+/* Interleave 32 pixels of R, G, B and store them as 96 bytes */
+AVX2_TARGET static __inline__ void
+store_rgb32_avx2 (JSAMPROW outptr, __m256i red, __m256i green, __m256i blue)
+{
+  store_rgb16_sse2(outptr, _mm256_castsi256_si128(red),
+		   _mm256_castsi256_si128(green),
+		   _mm256_castsi256_si128(blue));
+  store_rgb16_sse2(outptr + 16 * RGB_PIXELSIZE,
+		   _mm256_extracti128_si256(red, 1),
+		   _mm256_extracti128_si256(green, 1),
+		   _mm256_extracti128_si256(blue, 1));
+}
+
+AVX2_TARGET GLOBAL(JDIMENSION)
+jsimd_ycc_rgb_row_avx2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+			JSAMPROW outptr, JDIMENSION num_cols)
+{
+  __m256i y0, y1, r0, g0, b0, r1, g1, b1;
+  JDIMENSION col;
+
+  for (col = 0; col + 32 <= num_cols; col += 32) {
+    y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)
+					      (inptr0 + col)));
+    y1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)
+					      (inptr0 + col + 16)));
+    chroma_terms_avx2(inptr1 + col, inptr2 + col, &r0, &g0, &b0);
+    chroma_terms_avx2(inptr1 + col + 16, inptr2 + col + 16, &r1, &g1, &b1);
+    store_rgb32_avx2(outptr + col * RGB_PIXELSIZE,
+		     pack_bytes_avx2(_mm256_add_epi16(y0, r0),
+				     _mm256_add_epi16(y1, r1)),
+		     pack_bytes_avx2(_mm256_add_epi16(y0, g0),
+				     _mm256_add_epi16(y1, g1)),
+		     pack_bytes_avx2(_mm256_add_epi16(y0, b0),
+				     _mm256_add_epi16(y1, b1)));
+  }
+  return col;
+}
+
+/* Emit 32 pixels of one output row from the terms of 16 chroma samples */
+AVX2_TARGET static __inline__ void
+merged_pixels_avx2 (JSAMPROW inptr0, JSAMPROW outptr,
+		    __m256i red, __m256i green, __m256i blue)
+{
+  __m256i y0, y1, lo, hi;
+  __m256i out[3];
+  __m256i term[3];
+  int i;
+
+  y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) inptr0));
+  y1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)
+					    (inptr0 + 16)));
+  term[0] = red;
+  term[1] = green;
+  term[2] = blue;
+  for (i = 0; i < 3; i++) {
+    /* the in-lane unpacks give pixels 0-7,16-23 and 8-15,24-31 */
+    lo = _mm256_unpacklo_epi16(term[i], term[i]);
+    hi = _mm256_unpackhi_epi16(term[i], term[i]);
+    out[i] = pack_bytes_avx2(
+	_mm256_add_epi16(y0, _mm256_permute2x128_si256(lo, hi, 0x20)),
+	_mm256_add_epi16(y1, _mm256_permute2x128_si256(lo, hi, 0x31)));
+  }
+  store_rgb32_avx2(outptr, out[0], out[1], out[2]);
+}
+
+AVX2_TARGET GLOBAL(JDIMENSION)
+jsimd_merged_row_avx2 (JSAMPROW inptr00, JSAMPROW inptr01,
+		       JSAMPROW inptr1, JSAMPROW inptr2,
+		       JSAMPROW outptr0, JSAMPROW outptr1, JDIMENSION num_cols)
+{
+  __m256i red, green, blue;
+  JDIMENSION col;
+
+  for (col = 0; col + 32 <= num_cols; col += 32) {
+    chroma_terms_avx2(inptr1 + col / 2, inptr2 + col / 2,
+		      &red, &green, &blue);
+    merged_pixels_avx2(inptr00 + col, outptr0 + col * RGB_PIXELSIZE,
+		       red, green, blue);
+    if (inptr01 != NULL)
+      merged_pixels_avx2(inptr01 + col, outptr1 + col * RGB_PIXELSIZE,
+			 red, green, blue);
+  }
+  return col;
+}
+
+#endif /* JSIMD_X86_RGB */
@@ -35,6 +35,28 @@ typedef INT32 DCTELEM;		/* must have 32 bits */
 typedef JMETHOD(void, forward_DCT_method_ptr, (DCTELEM * data));
 typedef JMETHOD(void, float_DCT_method_ptr, (FAST_FLOAT * data));
 
+/*
+ * The SIMD quantizers (jfdctsimd.c) take the DCT output from the work area
+ * and store the quantized coefficients into a JBLOCK.  The integer version
+ * multiplies by reciprocals instead of dividing: its table holds, for each
+ * coefficient in natural order, ceil(2^RECIP_BITS / divisor), followed by
+ * DCTSIZE2 rounding terms divisor>>1.  For DCT outputs below 2^16 in
+ * magnitude the product, shifted down by RECIP_BITS, is exactly the
+ * quotient jcdctmgr.c computes, provided every divisor lies between
+ * 2 and MAX_RECIP_DIVISOR; tables with other divisors stay with the
+ * scalar division.  The float version takes the float_divisors table.
+ */
+
+#define RECIP_BITS  31
+#define MAX_RECIP_DIVISOR  16384
+
+typedef JMETHOD(void, quantize_method_ptr,
+		(JCOEFPTR coef_block, DCTELEM * reciprocals,
+		 DCTELEM * workspace));
+typedef JMETHOD(void, float_quantize_method_ptr,
+		(JCOEFPTR coef_block, FAST_FLOAT * divisors,
+		 FAST_FLOAT * workspace));
+
 
 /*
  * An inverse DCT routine is given a pointer to the input JBLOCK and a pointer
@@ -90,6 +112,22 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 #define jpeg_idct_4x4		jRD4x4
 #define jpeg_idct_2x2		jRD2x2
 #define jpeg_idct_1x1		jRD1x1
+#define jpeg_fdct_islow_sse2	jFDislS2
+#define jpeg_fdct_islow_avx2	jFDislA2
+#define jpeg_fdct_ifast_sse2	jFDifsS2
+#define jpeg_fdct_ifast_avx2	jFDifsA2
+#define jpeg_fdct_float_sse2	jFDfltS2
+#define jpeg_fdct_float_avx2	jFDfltA2
+#define jsimd_quantize_sse2	jSQuantS2
+#define jsimd_quantize_avx2	jSQuantA2
+#define jsimd_quantize_float_sse2	jSQFltS2
+#define jsimd_quantize_float_avx2	jSQFltA2
+#define jpeg_idct_islow_sse2	jRDislS2
+#define jpeg_idct_islow_avx2	jRDislA2
+#define jpeg_idct_ifast_sse2	jRDifsS2
+#define jpeg_idct_ifast_avx2	jRDifsA2
+#define jpeg_idct_float_sse2	jRDfltS2
+#define jpeg_idct_float_avx2	jRDfltA2
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 /* Extern declarations for the forward and inverse DCT routines. */
@@ -117,6 +155,44 @@ EXTERN(void) jpeg_idct_1x1
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
 
+/* SIMD versions of the FDCTs and quantizers (jfdctsimd.c, see jsimd.h) */
+
+EXTERN(void) jpeg_fdct_islow_sse2 JPP((DCTELEM * data));
+EXTERN(void) jpeg_fdct_islow_avx2 JPP((DCTELEM * data));
+EXTERN(void) jpeg_fdct_ifast_sse2 JPP((DCTELEM * data));
+EXTERN(void) jpeg_fdct_ifast_avx2 JPP((DCTELEM * data));
+EXTERN(void) jpeg_fdct_float_sse2 JPP((FAST_FLOAT * data));
+EXTERN(void) jpeg_fdct_float_avx2 JPP((FAST_FLOAT * data));
+EXTERN(void) jsimd_quantize_sse2
+    JPP((JCOEFPTR coef_block, DCTELEM * reciprocals, DCTELEM * workspace));
+EXTERN(void) jsimd_quantize_avx2
+    JPP((JCOEFPTR coef_block, DCTELEM * reciprocals, DCTELEM * workspace));
+EXTERN(void) jsimd_quantize_float_sse2
+    JPP((JCOEFPTR coef_block, FAST_FLOAT * divisors, FAST_FLOAT * workspace));
+EXTERN(void) jsimd_quantize_float_avx2
+    JPP((JCOEFPTR coef_block, FAST_FLOAT * divisors, FAST_FLOAT * workspace));
+
+/* SIMD versions of the full-size IDCTs (jidctsimd.c, see jsimd.h) */
+
+EXTERN(void) jpeg_idct_islow_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_islow_avx2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_ifast_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_ifast_avx2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_float_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_float_avx2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+
 
 /*
  * Macros for handling fixed-point arithmetic; these are used by many
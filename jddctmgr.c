@@ -19,6 +19,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
 
 
 /*
@@ -49,6 +50,8 @@ typedef struct {
    * per-component comp_info structures.
    */
   int cur_method[MAX_COMPONENTS];
+
+  int simd;			/* JSIMD_xxx features of this CPU */
 } my_idct_controller;
 
 typedef my_idct_controller * my_idct_ptr;
@@ -137,6 +140,35 @@ start_pass (j_decompress_ptr cinfo)
 	ERREXIT(cinfo, JERR_NOT_COMPILED);
 	break;
       }
+#ifdef JSIMD_X86
+      /* Same results, several columns or rows at a time */
+      switch (method) {
+#ifdef DCT_ISLOW_SUPPORTED
+      case JDCT_ISLOW:
+	if (idct->simd & JSIMD_AVX2)
+	  method_ptr = jpeg_idct_islow_avx2;
+	else if (idct->simd & JSIMD_SSE2)
+	  method_ptr = jpeg_idct_islow_sse2;
+	break;
+#endif
+#ifdef DCT_IFAST_SUPPORTED
+      case JDCT_IFAST:
+	if (idct->simd & JSIMD_AVX2)
+	  method_ptr = jpeg_idct_ifast_avx2;
+	else if (idct->simd & JSIMD_SSE2)
+	  method_ptr = jpeg_idct_ifast_sse2;
+	break;
+#endif
+#ifdef DCT_FLOAT_SUPPORTED
+      case JDCT_FLOAT:
+	if (idct->simd & JSIMD_AVX2)
+	  method_ptr = jpeg_idct_float_avx2;
+	else if (idct->simd & JSIMD_SSE2)
+	  method_ptr = jpeg_idct_float_sse2;
+	break;
+#endif
+      }
+#endif
       break;
     default:
       ERREXIT1(cinfo, JERR_BAD_DCTSIZE, compptr->DCT_scaled_size);
@@ -255,6 +287,7 @@ jinit_inverse_dct (j_decompress_ptr cinfo)
 				SIZEOF(my_idct_controller));
   cinfo->idct = (struct jpeg_inverse_dct *) idct;
   idct->pub.start_pass = start_pass;
+  idct->simd = jsimd_cpu_features();
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
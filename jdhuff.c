@@ -627,6 +627,43 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+/*
+ * Entropy index support: the state carried from one MCU to the next.
+ */
+
+METHODDEF(boolean)
+save_state (j_decompress_ptr cinfo, jpeg_index_entry * entry)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  int ci;
+
+  if (entropy->pub.insufficient_data)
+    return FALSE;		/* only zeroes from here on */
+  entry->get_buffer = (INT32) entropy->bitstate.get_buffer;
+  entry->bits_left = entropy->bitstate.bits_left;
+  entry->restarts_to_go = entropy->restarts_to_go;
+  for (ci = 0; ci < MAX_COMPS_IN_SCAN; ci++)
+    entry->last_dc_val[ci] =
+      (ci < cinfo->comps_in_scan) ? entropy->saved.last_dc_val[ci] : 0;
+  return TRUE;
+}
+
+
+METHODDEF(void)
+restore_state (j_decompress_ptr cinfo, const jpeg_index_entry * entry)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  int ci;
+
+  entropy->bitstate.get_buffer = (bit_buf_type) entry->get_buffer;
+  entropy->bitstate.bits_left = entry->bits_left;
+  entropy->restarts_to_go = entry->restarts_to_go;
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++)
+    entropy->saved.last_dc_val[ci] = entry->last_dc_val[ci];
+  entropy->pub.insufficient_data = FALSE;
+}
+
+
 /*
  * Module initialization routine for Huffman entropy decoding.
  */
@@ -643,6 +680,8 @@ jinit_huff_decoder (j_decompress_ptr cinfo)
   cinfo->entropy = (struct jpeg_entropy_decoder *) entropy;
   entropy->pub.start_pass = start_pass_huff_decoder;
   entropy->pub.decode_mcu = decode_mcu;
+  entropy->pub.save_state = save_state;
+  entropy->pub.restore_state = restore_state;
 
   /* Mark tables unallocated */
   for (i = 0; i < NUM_HUFF_TBLS; i++) {
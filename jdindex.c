@@ -0,0 +1,410 @@
+/*
+ * jdindex.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains the entropy index of a sequential single-scan image.
+ * Huffman data can only be decoded front to back, so decoding a region
+ * near the bottom of a large image normally costs nearly as much entropy
+ * decoding as the whole image.  An index records the decoder's complete
+ * state (input position, bit buffer, restart bookkeeping and DC
+ * predictions) at every interval'th MCU; with one loaded, the coefficient
+ * controller restores the entry just before the rows it needs, decodes
+ * those, and jumps to the end of the scan.
+ *
+ * The index is kept in a sidecar file next to the image:
+ *	"JIDX", then 32-bit big-endian words: version, image_width,
+ *	image_height, num_components, restart_interval, interval, total_MCUs,
+ *	num_entries, table hash, followed by num_entries + 1 entries (the
+ *	last one is the state at the end of the scan) of ENTRY_WORDS words
+ *	each.
+ * Offsets count from the first byte of the entropy-coded data, so the
+ * index stays good whatever container or source manager the image is
+ * read through, as long as the whole scan is in one input buffer.
+ *
+ * Geometry alone does not tell two encodes of an image apart, so the
+ * index also carries a hash of the quantization and Huffman tables and
+ * scan parameters, and the end entry fixes the length of the entropy
+ * data: jpeg_read_index checks that this file's scan ends in a marker
+ * exactly there.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+
+
+#define INDEX_VERSION	2
+#define HEADER_WORDS	9
+#define ENTRY_WORDS	(6 + MAX_COMPS_IN_SCAN)
+
+
+/*
+ * Allocate an index with room for the entries of a scan of total_MCUs MCUs.
+ */
+
+GLOBAL(jpeg_entropy_index *)
+jindex_alloc (j_decompress_ptr cinfo, JDIMENSION interval,
+	      JDIMENSION total_MCUs)
+{
+  jpeg_entropy_index * index;
+
+  index = (jpeg_entropy_index *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				SIZEOF(jpeg_entropy_index));
+  index->interval = interval;
+  index->total_MCUs = total_MCUs;
+  index->num_entries = (total_MCUs + interval - 1) / interval;
+  index->entries = (jpeg_index_entry *)
+    (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				(size_t) index->num_entries *
+				SIZEOF(jpeg_index_entry));
+  return index;
+}
+
+
+/*
+ * Record the decoder's state at the start of the next MCU.  base and limit
+ * delimit the input buffer the scan started in; returns FALSE if the
+ * source manager has since moved on to another buffer, or if the entropy
+ * decoder cannot or will not save its state.
+ */
+
+GLOBAL(boolean)
+jindex_save_entry (j_decompress_ptr cinfo, const JOCTET * base,
+		   const JOCTET * limit, jpeg_index_entry * entry)
+{
+  struct jpeg_source_mgr * src = cinfo->src;
+
+  if (cinfo->entropy->save_state == NULL)
+    return FALSE;
+  if (src->next_input_byte < base || src->next_input_byte > limit ||
+      src->next_input_byte + src->bytes_in_buffer != limit)
+    return FALSE;
+  entry->offset = (long) (src->next_input_byte - base);
+  entry->unread_marker = cinfo->unread_marker;
+  entry->next_restart_num = cinfo->marker->next_restart_num;
+  return (*cinfo->entropy->save_state) (cinfo, entry);
+}
+
+
+/*
+ * Put the decoder back into a recorded state.  The entry must lie inside
+ * [base, limit]: jpeg_read_index accepts only entries in order and no
+ * further than the end entry, and index_seek in jdcoefct.c uses an index
+ * only if the end entry lies inside the buffer.
+ */
+
+GLOBAL(void)
+jindex_restore_entry (j_decompress_ptr cinfo, const JOCTET * base,
+		      const JOCTET * limit, const jpeg_index_entry * entry)
+{
+  struct jpeg_source_mgr * src = cinfo->src;
+
+  src->next_input_byte = base + entry->offset;
+  src->bytes_in_buffer = (size_t) (limit - src->next_input_byte);
+  cinfo->unread_marker = entry->unread_marker;
+  cinfo->marker->next_restart_num = entry->next_restart_num;
+  (*cinfo->entropy->restore_state) (cinfo, entry);
+}
+
+
+/*
+ * FNV-1a hash of the tables and parameters the scan is decoded with:
+ * the quantization table of every component, and the Huffman tables,
+ * component selectors and spectral parameters of the SOS marker.
+ */
+
+#define HASH_BYTE(h,b)  ((h) = ((h) ^ ((b) & 0xFF)) * 16777619UL)
+
+LOCAL(INT32)
+table_hash (j_decompress_ptr cinfo)
+{
+  unsigned long h = 2166136261UL;
+  jpeg_component_info * compptr;
+  JQUANT_TBL * qtbl;
+  JHUFF_TBL * htbl;
+  int ci, i, t, count;
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    HASH_BYTE(h, compptr->component_id);
+    qtbl = cinfo->quant_tbl_ptrs[compptr->quant_tbl_no];
+    if (qtbl == NULL)
+      continue;
+    for (i = 0; i < DCTSIZE2; i++) {
+      HASH_BYTE(h, qtbl->quantval[i] >> 8);
+      HASH_BYTE(h, qtbl->quantval[i]);
+    }
+  }
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    HASH_BYTE(h, compptr->component_id);
+    for (t = 0; t < 2; t++) {
+      htbl = t == 0 ? cinfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no]
+		    : cinfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no];
+      if (htbl == NULL)
+	continue;
+      count = 0;
+      for (i = 1; i <= 16; i++) {
+	HASH_BYTE(h, htbl->bits[i]);
+	count += htbl->bits[i];
+      }
+      /* huffval past the symbols DHT defined is left uninitialized */
+      for (i = 0; i < count && i < 256; i++)
+	HASH_BYTE(h, htbl->huffval[i]);
+    }
+  }
+  HASH_BYTE(h, cinfo->Ss);
+  HASH_BYTE(h, cinfo->Se);
+  HASH_BYTE(h, (cinfo->Ah << 4) + cinfo->Al);
+  return (INT32) (h & 0xFFFFFFFFUL);
+}
+
+
+/*
+ * Does the entropy-coded data starting at scan, with avail bytes in the
+ * buffer, end in a marker where the end entry says it does?  Either the
+ * decoder had already read the marker at the end of the scan, or the
+ * marker comes next.
+ */
+
+LOCAL(boolean)
+scan_ends_at (const JOCTET * scan, size_t avail, const jpeg_index_entry * end)
+{
+  size_t pos = (size_t) end->offset;
+
+  if (pos > avail)
+    return FALSE;
+  if (end->unread_marker != 0)
+    return (pos >= 2 && GETJOCTET(scan[pos - 1]) == end->unread_marker &&
+	    GETJOCTET(scan[pos - 2]) == 0xFF);
+  if (pos >= avail || GETJOCTET(scan[pos]) != 0xFF)
+    return FALSE;
+  while (pos < avail && GETJOCTET(scan[pos]) == 0xFF)
+    pos++;			/* a marker may be preceded by fill bytes */
+  /* 0 is a stuffed data byte; RSTn cannot follow the last MCU */
+  return (pos < avail && GETJOCTET(scan[pos]) != 0 &&
+	  (GETJOCTET(scan[pos]) < JPEG_RST0 ||
+	   GETJOCTET(scan[pos]) > JPEG_RST0 + 7));
+}
+
+
+/*
+ * The number of MCUs decompress_onepass in jdcoefct.c counts in the scan.
+ * jpeg_read_index runs before per_scan_setup has filled in MCUs_per_row and
+ * MCU_rows_in_scan, so they are worked out here from the frame.
+ */
+
+LOCAL(JDIMENSION)
+scan_MCUs (j_decompress_ptr cinfo)
+{
+  jpeg_component_info * compptr;
+  int rows;
+
+  if (cinfo->comps_in_scan == 1) {
+    /* One block per MCU, times the MCU rows of the first iMCU row */
+    compptr = cinfo->cur_comp_info[0];
+    rows = compptr->v_samp_factor;
+    if (cinfo->total_iMCU_rows == 1) {
+      rows = (int) (compptr->height_in_blocks % compptr->v_samp_factor);
+      if (rows == 0) rows = compptr->v_samp_factor;
+    }
+    return compptr->width_in_blocks * compptr->height_in_blocks *
+	   (JDIMENSION) rows;
+  }
+  return (JDIMENSION)
+    (jdiv_round_up((long) cinfo->image_width,
+		   (long) (cinfo->max_h_samp_factor * DCTSIZE)) *
+     jdiv_round_up((long) cinfo->image_height,
+		   (long) (cinfo->max_v_samp_factor * DCTSIZE)));
+}
+
+
+/* Sidecar file I/O */
+
+LOCAL(void)
+put_word (FILE * outfile, INT32 value)
+{
+  putc((int) ((value >> 24) & 0xFF), outfile);
+  putc((int) ((value >> 16) & 0xFF), outfile);
+  putc((int) ((value >> 8) & 0xFF), outfile);
+  putc((int) (value & 0xFF), outfile);
+}
+
+
+LOCAL(boolean)
+get_word (FILE * infile, INT32 * value)
+{
+  unsigned char b[4];
+
+  if (JFREAD(infile, b, 4) != 4)
+    return FALSE;
+  *value = (INT32) (((unsigned long) b[0] << 24) |
+		    ((unsigned long) b[1] << 16) |
+		    ((unsigned long) b[2] << 8) | (unsigned long) b[3]);
+  return TRUE;
+}
+
+
+LOCAL(void)
+put_entry (FILE * outfile, const jpeg_index_entry * entry)
+{
+  int ci;
+
+  put_word(outfile, (INT32) entry->offset);
+  put_word(outfile, entry->get_buffer);
+  put_word(outfile, (INT32) entry->bits_left);
+  put_word(outfile, (INT32) entry->unread_marker);
+  put_word(outfile, (INT32) entry->restarts_to_go);
+  put_word(outfile, (INT32) entry->next_restart_num);
+  for (ci = 0; ci < MAX_COMPS_IN_SCAN; ci++)
+    put_word(outfile, (INT32) entry->last_dc_val[ci]);
+}
+
+
+LOCAL(boolean)
+get_entry (FILE * infile, jpeg_index_entry * entry)
+{
+  INT32 w[ENTRY_WORDS];
+  int i;
+
+  for (i = 0; i < ENTRY_WORDS; i++)
+    if (! get_word(infile, &w[i]))
+      return FALSE;
+  if (w[0] < 0 || w[2] < 0 || w[2] > 32 || w[3] < 0 || w[3] > 0xFF ||
+      w[5] < 0 || w[5] > 7)
+    return FALSE;
+  entry->offset = (long) w[0];
+  entry->get_buffer = w[1];
+  entry->bits_left = (int) w[2];
+  entry->unread_marker = (int) w[3];
+  entry->restarts_to_go = (unsigned int) w[4];
+  entry->next_restart_num = (int) w[5];
+  for (i = 0; i < MAX_COMPS_IN_SCAN; i++)
+    entry->last_dc_val[i] = (int) w[6 + i];
+  return TRUE;
+}
+
+
+/*
+ * Write a completed index to the file given to jpeg_build_index.
+ * Called by the coefficient controller at the end of the scan.
+ */
+
+GLOBAL(void)
+jindex_write (j_decompress_ptr cinfo, jpeg_entropy_index * index)
+{
+  FILE * outfile = cinfo->index_file;
+  JDIMENSION i;
+
+  putc('J', outfile);
+  putc('I', outfile);
+  putc('D', outfile);
+  putc('X', outfile);
+  put_word(outfile, (INT32) INDEX_VERSION);
+  put_word(outfile, (INT32) cinfo->image_width);
+  put_word(outfile, (INT32) cinfo->image_height);
+  put_word(outfile, (INT32) cinfo->num_components);
+  put_word(outfile, (INT32) cinfo->restart_interval);
+  put_word(outfile, (INT32) index->interval);
+  put_word(outfile, (INT32) index->total_MCUs);
+  put_word(outfile, (INT32) index->num_entries);
+  put_word(outfile, table_hash(cinfo));
+  for (i = 0; i < index->num_entries; i++)
+    put_entry(outfile, &index->entries[i]);
+  put_entry(outfile, &index->end);
+  fflush(outfile);
+  if (ferror(outfile))
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+}
+
+
+/*
+ * Have an index recorded while the image is decoded, with an entry every
+ * interval MCUs, and written to outfile when the scan has been decoded.
+ * Call after jpeg_read_header.  The scan must be in one input buffer (see
+ * jpeg_mem_src, jpeg_mmap_src); otherwise a warning is issued and nothing
+ * is written.  An interval of 0 cancels a previous call.
+ */
+
+GLOBAL(void)
+jpeg_build_index (j_decompress_ptr cinfo, JDIMENSION interval,
+		  FILE * outfile)
+{
+  if (cinfo->global_state != DSTATE_READY)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  /* Only the state of a single sequential Huffman scan can be recorded */
+  if (cinfo->progressive_mode || cinfo->arith_code ||
+      cinfo->inputctl->has_multiple_scans)
+    ERREXIT(cinfo, JERR_NOTIMPL);
+
+  cinfo->index_interval = interval;
+  cinfo->index_file = outfile;
+}
+
+
+/*
+ * Load an index written by jpeg_build_index for this image.
+ * Call after jpeg_read_header, with the whole scan in the input buffer.
+ * Returns FALSE, with no index loaded, if the file does not hold an index
+ * of this very encode of the image (same layout, tables and entropy data
+ * length), or the image is not one an index can be used with; the image
+ * is then simply decoded from the start.
+ */
+
+GLOBAL(boolean)
+jpeg_read_index (j_decompress_ptr cinfo, FILE * infile)
+{
+  jpeg_entropy_index * index;
+  char magic[4];
+  INT32 header[HEADER_WORDS];
+  JDIMENSION i;
+
+  if (cinfo->global_state != DSTATE_READY)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  if (cinfo->progressive_mode || cinfo->arith_code ||
+      cinfo->inputctl->has_multiple_scans)
+    return FALSE;
+
+  if (JFREAD(infile, magic, 4) != 4 || magic[0] != 'J' || magic[1] != 'I' ||
+      magic[2] != 'D' || magic[3] != 'X')
+    return FALSE;
+  for (i = 0; i < HEADER_WORDS; i++)
+    if (! get_word(infile, &header[i]))
+      return FALSE;
+  if (header[0] != INDEX_VERSION ||
+      header[1] != (INT32) cinfo->image_width ||
+      header[2] != (INT32) cinfo->image_height ||
+      header[3] != (INT32) cinfo->num_components ||
+      header[4] != (INT32) cinfo->restart_interval ||
+      header[5] <= 0 || header[6] != (INT32) scan_MCUs(cinfo) ||
+      header[7] != (header[6] + header[5] - 1) / header[5] ||
+      header[8] != table_hash(cinfo))
+    return FALSE;
+
+  index = jindex_alloc(cinfo, (JDIMENSION) header[5], (JDIMENSION) header[6]);
+  for (i = 0; i < index->num_entries; i++)
+    if (! get_entry(infile, &index->entries[i]))
+      return FALSE;
+  if (! get_entry(infile, &index->end))
+    return FALSE;
+  /* The entries must be in order and within the scan, or restoring one
+   * could leave the input position outside the buffer.
+   */
+  for (i = 0; i < index->num_entries; i++) {
+    if (index->entries[i].offset > (i + 1 < index->num_entries ?
+				    index->entries[i + 1].offset :
+				    index->end.offset))
+      return FALSE;
+  }
+
+  if (! scan_ends_at(cinfo->src->next_input_byte, cinfo->src->bytes_in_buffer,
+		     &index->end))
+    return FALSE;		/* another encode, or not all in memory */
+
+  cinfo->entropy_index = index;
+  return TRUE;
+}
@@ -366,7 +366,7 @@ process_data_simple_main (j_decompress_ptr cinfo,
     /* Feed the postprocessor */
     (*cinfo->post->post_process_data) (cinfo, main->buffer,
             &main->rowgroup_ctr, rowgroups_avail,
-            output_buf, &cinfo->output_scanline, out_rows_avail);
+            output_buf, out_row_ctr, out_rows_avail);
 
     /* Has postprocessor consumed all the data yet? If so, mark buffer empty */
     if (main->rowgroup_ctr >= rowgroups_avail) {
@@ -482,6 +482,27 @@ jinit_d_main_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
       compptr->dimesion_size += rgroup * 4;
       sTotoalDimensionSize += compptr->dimesion_size;
   }
+
+  /* The OpenCL path keeps the samples in device buffers.  The host pipeline
+   * needs them here: one contiguous plane per component, so the IDCT can
+   * step from row to row of a block by row_buffer_size.
+   */
+  if (cinfo->cpu_pipeline) {
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+	 ci++, compptr++) {
+      JDIMENSION row, rows;
+
+      rows = compptr->image_buffer_size / compptr->row_buffer_size;
+      sSampleBuffer = (JSAMPROW) (*cinfo->mem->alloc_large)
+	((j_common_ptr) cinfo, JPOOL_IMAGE,
+	 (size_t) compptr->image_buffer_size * SIZEOF(JSAMPLE));
+      sSampleArrays = (JSAMPARRAY) (*cinfo->mem->alloc_small)
+	((j_common_ptr) cinfo, JPOOL_IMAGE, rows * SIZEOF(JSAMPROW));
+      for (row = 0; row < rows; row++)
+	sSampleArrays[row] = sSampleBuffer + row * compptr->row_buffer_size;
+      main->buffer[ci] = sSampleArrays;
+    }
+  }
   // sSampleArrays = (JSAMPARRAY)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo,
   //         JPOOL_IMAGE,sTotoalDimensionSize *  sizeof(JSAMPROW) );
   // sSampleBuffer = (JSAMPROW)(*cinfo->mem->alloc_large)((j_common_ptr)cinfo,JPOOL_IMAGE,sTotalImageSize * sizeof(JSAMPLE));
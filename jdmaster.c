@@ -47,6 +47,9 @@ use_merged_upsample (j_decompress_ptr cinfo)
   /* Merging is the equivalent of plain box-filter upsampling */
   if (cinfo->do_fancy_upsampling || cinfo->CCIR601_sampling)
     return FALSE;
+  /* jdmerge.c always emits whole rows */
+  if (cinfo->region_width != 0)
+    return FALSE;
   /* jdmerge.c only supports YCC=>RGB color conversion */
   if (cinfo->jpeg_color_space != JCS_YCbCr || cinfo->num_components != 3 ||
       cinfo->out_color_space != JCS_RGB ||
@@ -168,6 +171,23 @@ jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
 
 #endif /* IDCT_SCALING_SUPPORTED */
 
+  /* Crop to the region of interest, if any. */
+  cinfo->full_output_width = cinfo->output_width;
+  cinfo->full_output_height = cinfo->output_height;
+  if (cinfo->region_width != 0) {
+    if (cinfo->region_height == 0 ||
+	cinfo->region_x >= cinfo->full_output_width ||
+	cinfo->region_width > cinfo->full_output_width - cinfo->region_x ||
+	cinfo->region_y >= cinfo->full_output_height ||
+	cinfo->region_height > cinfo->full_output_height - cinfo->region_y)
+      ERREXIT2(cinfo, JERR_BAD_REGION,
+	       cinfo->full_output_width, cinfo->full_output_height);
+    if (cinfo->raw_data_out)
+      ERREXIT(cinfo, JERR_NOTIMPL);
+    cinfo->output_width = cinfo->region_width;
+    cinfo->output_height = cinfo->region_height;
+  }
+
   /* Report number of components in selected colorspace. */
   /* Probably this should be in the color conversion module... */
   switch (cinfo->out_color_space) {
@@ -316,7 +336,10 @@ master_selection (j_decompress_ptr cinfo)
     cinfo->enable_2pass_quant = FALSE;
   }
   if (cinfo->quantize_colors) {
-    if (cinfo->raw_data_out)
+    /* The CPU pipeline converts straight into the application's buffer,
+     * leaving no rows for a quantizer to work on.
+     */
+    if (cinfo->raw_data_out || cinfo->cpu_pipeline)
       ERREXIT(cinfo, JERR_NOTIMPL);
     /* 2-pass quantizer only works in 3-component color space. */
     if (cinfo->out_color_components != 3) {
@@ -35,6 +35,9 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jopenclprof.h"
+#include "jthreadpool.h"
+#include "jsimd.h"
 
 #ifdef UPSAMPLE_MERGING_SUPPORTED
 
@@ -55,6 +58,9 @@ typedef struct {
   INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
   INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
 
+  /* SSE2/AVX2 version of the pixel-pair loop, or NULL */
+  jsimd_merged_row_ptr merged_row;
+
   /* For 2:1 vertical sampling, we produce two output rows at a time.
    * We need a "spare" row buffer to hold the second output row if the
    * application provides just a one-row buffer; we also use the spare
@@ -208,6 +214,97 @@ merged_1v_upsample (j_decompress_ptr cinfo,
 }
 
 
+/*
+ * Host pipeline version, used when there is no OpenCL device.
+ * As in jdsample.c, the main controller hands us the whole image, so the
+ * row groups are converted in parallel on the CPU thread pool and the
+ * whole image is emitted in one call into the contiguous buffer at
+ * output_buf[0].
+ */
+
+typedef struct {
+  j_decompress_ptr cinfo;
+  JSAMPIMAGE input_buf;
+  JSAMPROW output_base;
+  JDIMENSION output_stride;
+  JDIMENSION first_row;		/* first row to emit, at output_base */
+  int first_group;		/* row group holding first_row */
+} cpu_merged_job;
+
+LOCAL(void)
+merged_row_group (void * arg, int index, int worker)
+{
+  cpu_merged_job * job = (cpu_merged_job *) arg;
+  j_decompress_ptr cinfo = job->cinfo;
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  JSAMPROW work_ptrs[2];
+  JDIMENSION out_row;
+
+  index += job->first_group;
+  out_row = (JDIMENSION) index * cinfo->max_v_samp_factor;
+  if (out_row < job->first_row) {
+    /* The top row of the first group was skipped: only the bottom one
+     * goes out.  The top one goes to the second spare row, as the last
+     * group may be using the first at the same time.
+     */
+    work_ptrs[0] = upsample->spare_row + upsample->out_row_width;
+    work_ptrs[1] = job->output_base;
+  } else {
+    work_ptrs[0] = job->output_base +
+      (size_t) (out_row - job->first_row) * job->output_stride;
+    if (cinfo->max_v_samp_factor == 2) {
+      /* Only the last row group of an odd-height image lacks a second row */
+      if (out_row + 1 < cinfo->output_height)
+	work_ptrs[1] = work_ptrs[0] + job->output_stride;
+      else
+	work_ptrs[1] = upsample->spare_row;
+    }
+  }
+  (*upsample->upmethod) (cinfo, job->input_buf, (JDIMENSION) index,
+			 work_ptrs);
+}
+
+
+METHODDEF(void)
+merged_upsample_cpu (j_decompress_ptr cinfo,
+		     JSAMPIMAGE input_buf, JDIMENSION *in_row_group_ctr,
+		     JDIMENSION in_row_groups_avail,
+		     JSAMPARRAY output_buf, JDIMENSION *out_row_ctr,
+		     JDIMENSION out_rows_avail)
+{
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  cpu_merged_job job;
+  JDIMENSION skipped;
+  int row_groups;
+  double start;
+
+  job.cinfo = cinfo;
+  job.input_buf = input_buf;
+  job.output_base = output_buf[0];
+  job.output_stride = upsample->out_row_width;
+  /* Lines skipped with jpeg_skip_scanlines are not converted; the first
+   * line still to go lands at output_buf[0].
+   */
+  skipped = cinfo->output_scanline;
+  job.first_row = skipped;
+  job.first_group = (int) (skipped / cinfo->max_v_samp_factor);
+  row_groups = (int) ((cinfo->output_height + cinfo->max_v_samp_factor - 1) /
+		      cinfo->max_v_samp_factor) - job.first_group;
+
+  /* Upsampling and color conversion are one step here; the time is
+   * charged to the upsample stage.
+   */
+  start = j_opencl_prof_begin(cinfo);
+  j_threadpool_run(cinfo->cpu_pool, row_groups, merged_row_group, &job);
+  j_opencl_prof_end(cinfo, JSTAGE_UPSAMPLE, start);
+
+  /* Adjust counts */
+  *out_row_ctr += cinfo->output_height - skipped;
+  *in_row_group_ctr = in_row_groups_avail;
+  upsample->rows_to_go = 0;
+}
+
+
 /*
  * These are the routines invoked by the control routines to do
  * the actual upsampling/conversion.  One row group is processed per call.
@@ -232,7 +329,7 @@ h2v1_merged_upsample (j_decompress_ptr cinfo,
   int cb, cr;
   register JSAMPROW outptr;
   JSAMPROW inptr0, inptr1, inptr2;
-  JDIMENSION col;
+  JDIMENSION col, simd_cols;
   /* copy these pointers into registers if possible */
   register JSAMPLE * range_limit = cinfo->sample_range_limit;
   int * Crrtab = upsample->Cr_r_tab;
@@ -245,8 +342,18 @@ h2v1_merged_upsample (j_decompress_ptr cinfo,
   inptr1 = input_buf[1][in_row_group_ctr];
   inptr2 = input_buf[2][in_row_group_ctr];
   outptr = output_buf[0];
+  /* Vector code does the bulk of the row, an even number of pixels */
+  simd_cols = 0;
+  if (upsample->merged_row != NULL) {
+    simd_cols = (*upsample->merged_row) (inptr0, NULL, inptr1, inptr2,
+					 outptr, NULL, cinfo->output_width);
+    inptr0 += simd_cols;
+    inptr1 += simd_cols >> 1;
+    inptr2 += simd_cols >> 1;
+    outptr += simd_cols * RGB_PIXELSIZE;
+  }
   /* Loop for each pair of output pixels */
-  for (col = cinfo->output_width >> 1; col > 0; col--) {
+  for (col = (cinfo->output_width - simd_cols) >> 1; col > 0; col--) {
     /* Do the chroma part of the calculation */
     cb = GETJSAMPLE(*inptr1++);
     cr = GETJSAMPLE(*inptr2++);
@@ -294,7 +401,7 @@ h2v2_merged_upsample (j_decompress_ptr cinfo,
   int cb, cr;
   register JSAMPROW outptr0, outptr1;
   JSAMPROW inptr00, inptr01, inptr1, inptr2;
-  JDIMENSION col;
+  JDIMENSION col, simd_cols;
   /* copy these pointers into registers if possible */
   register JSAMPLE * range_limit = cinfo->sample_range_limit;
   int * Crrtab = upsample->Cr_r_tab;
@@ -309,8 +416,20 @@ h2v2_merged_upsample (j_decompress_ptr cinfo,
   inptr2 = input_buf[2][in_row_group_ctr];
   outptr0 = output_buf[0];
   outptr1 = output_buf[1];
+  /* Vector code does the bulk of the rows, an even number of pixels */
+  simd_cols = 0;
+  if (upsample->merged_row != NULL) {
+    simd_cols = (*upsample->merged_row) (inptr00, inptr01, inptr1, inptr2,
+					 outptr0, outptr1, cinfo->output_width);
+    inptr00 += simd_cols;
+    inptr01 += simd_cols;
+    inptr1 += simd_cols >> 1;
+    inptr2 += simd_cols >> 1;
+    outptr0 += simd_cols * RGB_PIXELSIZE;
+    outptr1 += simd_cols * RGB_PIXELSIZE;
+  }
   /* Loop for each group of output pixels */
-  for (col = cinfo->output_width >> 1; col > 0; col--) {
+  for (col = (cinfo->output_width - simd_cols) >> 1; col > 0; col--) {
     /* Do the chroma part of the calculation */
     cb = GETJSAMPLE(*inptr1++);
     cr = GETJSAMPLE(*inptr2++);
@@ -383,16 +502,28 @@ jinit_merged_upsampler (j_decompress_ptr cinfo)
   if (cinfo->max_v_samp_factor == 2) {
     upsample->pub.upsample = merged_2v_upsample;
     upsample->upmethod = h2v2_merged_upsample;
-    /* Allocate a spare row buffer */
+    /* Allocate a spare row buffer, and a second one for the host
+     * pipeline to drop a skipped line into
+     */
     upsample->spare_row = (JSAMPROW)
       (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-		(size_t) (upsample->out_row_width * SIZEOF(JSAMPLE)));
+		(size_t) (2 * upsample->out_row_width * SIZEOF(JSAMPLE)));
   } else {
     upsample->pub.upsample = merged_1v_upsample;
     upsample->upmethod = h2v1_merged_upsample;
     /* No spare row needed */
     upsample->spare_row = NULL;
   }
+  if (cinfo->cpu_pipeline)
+    upsample->pub.upsample = merged_upsample_cpu;
+
+  upsample->merged_row = NULL;
+#ifdef JSIMD_X86_RGB
+  if (jsimd_cpu_features() & JSIMD_AVX2)
+    upsample->merged_row = jsimd_merged_row_avx2;
+  else if (jsimd_cpu_features() & JSIMD_SSE2)
+    upsample->merged_row = jsimd_merged_row_sse2;
+#endif
 
   build_ycc_rgb_table(cinfo);
 }
@@ -649,6 +649,8 @@ jinit_phuff_decoder (j_decompress_ptr cinfo)
 				SIZEOF(phuff_entropy_decoder));
   cinfo->entropy = (struct jpeg_entropy_decoder *) entropy;
   entropy->pub.start_pass = start_pass_phuff_decoder;
+  entropy->pub.save_state = NULL; /* no entropy index for progressive */
+  entropy->pub.restore_state = NULL;
 
   /* Mark derived tables unallocated */
   for (i = 0; i < NUM_HUFF_TBLS; i++) {
@@ -665,4 +667,54 @@ jinit_phuff_decoder (j_decompress_ptr cinfo)
       *coef_bit_ptr++ = -1;
 }
 
+
+/*
+ * Make a copy of the decoder as set up for the current scan, so that the
+ * scan can be decoded later and on another thread (see jdcoefct.c).  The
+ * copy gets its own derived tables and Huffman tables: a DHT marker or the
+ * start of a later scan must not change them under it.
+ */
+
+GLOBAL(struct jpeg_entropy_decoder *)
+jcopy_phuff_decoder (j_decompress_ptr cinfo)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
+  phuff_entropy_ptr copy;
+  d_derived_tbl * dtbl;
+  jpeg_component_info * compptr;
+  int ci, tbl;
+
+  copy = (phuff_entropy_ptr)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				SIZEOF(phuff_entropy_decoder));
+  MEMCOPY(copy, entropy, SIZEOF(phuff_entropy_decoder));
+  for (tbl = 0; tbl < NUM_HUFF_TBLS; tbl++)
+    copy->derived_tbls[tbl] = NULL;
+  copy->ac_derived_tbl = NULL;
+
+  /* Copy just the tables this scan uses, as start_pass picked them */
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    if (cinfo->Ss == 0) {
+      if (cinfo->Ah != 0)	/* DC refinement needs no table */
+	continue;
+      tbl = compptr->dc_tbl_no;
+    } else
+      tbl = compptr->ac_tbl_no;
+    if (copy->derived_tbls[tbl] == NULL) {
+      dtbl = (d_derived_tbl *)
+	(*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				    SIZEOF(d_derived_tbl) + SIZEOF(JHUFF_TBL));
+      MEMCOPY(dtbl, entropy->derived_tbls[tbl], SIZEOF(d_derived_tbl));
+      dtbl->pub = (JHUFF_TBL *) (dtbl + 1);
+      MEMCOPY(dtbl->pub, entropy->derived_tbls[tbl]->pub, SIZEOF(JHUFF_TBL));
+      copy->derived_tbls[tbl] = dtbl;
+    }
+    if (cinfo->Ss != 0)
+      copy->ac_derived_tbl = copy->derived_tbls[tbl];
+  }
+
+  return (struct jpeg_entropy_decoder *) copy;
+}
+
 #endif /* D_PROGRESSIVE_SUPPORTED */
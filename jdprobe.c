@@ -0,0 +1,148 @@
+/*
+ * jdprobe.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains a lightweight header probe for callers that want only
+ * an image's dimensions, sampling and metadata segments (EXIF, ICC, ...)
+ * for very many files.  jpeg_read_header needs a JPEG object, and so the
+ * allocation of the decompressor and its memory pools, plus the whole of
+ * jdmarker.c.  Probing avoids all of that: jpeg_probe_header walks the
+ * markers of a file already in memory up to the first SOS, decodes the SOF
+ * and DRI markers itself, and reports each APPn and COM payload as an
+ * offset into the caller's buffer without copying it.  Nothing is
+ * allocated and no library state is touched, so it may be called from any
+ * number of threads at once.
+ */
+
+/* this is not a core library module, so it doesn't define JPEG_INTERNALS */
+#include "jinclude.h"
+#include "jpeglib.h"
+
+
+/* Marker codes used here; see jdmarker.c for the full list */
+
+#define M_SOF0	0xc0
+#define M_SOF15	0xcf
+#define M_DHT	0xc4
+#define M_JPG	0xc8
+#define M_DAC	0xcc
+#define M_SOI	0xd8
+#define M_SOS	0xda
+#define M_DRI	0xdd
+#define M_APP15	0xef
+#define M_TEM	0x01
+
+
+/* Read a 2-byte big-endian value */
+#define GET_2B(p)  (((unsigned int) (p)[0] << 8) + (unsigned int) (p)[1])
+
+
+/*
+ * Decode a SOFn marker's payload.  Returns FALSE if it is malformed.
+ */
+
+LOCAL(boolean)
+probe_sof (const JOCTET * p, size_t length, int marker, jpeg_probe_info * info)
+{
+  int ci;
+
+  if (length < 6)
+    return FALSE;
+  info->num_components = p[5];
+  if (info->num_components <= 0 || info->num_components > MAX_COMPONENTS ||
+      length != 6 + (size_t) info->num_components * 3)
+    return FALSE;
+
+  info->data_precision = p[0];
+  info->image_height = (JDIMENSION) GET_2B(p + 1);
+  info->image_width = (JDIMENSION) GET_2B(p + 3);
+  for (ci = 0; ci < info->num_components; ci++) {
+    info->comp[ci].component_id = p[6 + ci * 3];
+    info->comp[ci].h_samp_factor = (p[7 + ci * 3] >> 4) & 15;
+    info->comp[ci].v_samp_factor = p[7 + ci * 3] & 15;
+    info->comp[ci].quant_tbl_no = p[8 + ci * 3];
+  }
+  info->sof_marker = marker;
+  /* SOF2, SOF6, SOF10 and SOF14 are progressive; SOF9 and up arithmetic */
+  info->progressive_mode = ((marker & 3) == 2);
+  info->arith_code = (marker > M_JPG);
+  return TRUE;
+}
+
+
+/*
+ * Probe the markers of the JPEG file held in data[0..size-1].
+ * Fills in *info and returns TRUE if a frame header (SOFn) precedes the
+ * first SOS.  Returns FALSE if the data does not start with SOI, or ends
+ * or becomes unreadable before a SOF marker is found; whatever was found
+ * up to then is still reported.  No JPEG object is needed.
+ */
+
+GLOBAL(boolean)
+jpeg_probe_header (const JOCTET * data, size_t size, jpeg_probe_info * info)
+{
+  size_t pos, marker_pos, length;
+  const JOCTET * payload;
+  jpeg_probe_segment * seg;
+  int c;
+
+  MEMZERO(info, SIZEOF(jpeg_probe_info));
+  if (size < 2 || data[0] != 0xFF || data[1] != M_SOI)
+    return FALSE;
+
+  pos = 2;
+  for (;;) {
+    /* Find the next marker, skipping garbage and fill bytes as
+     * next_marker in jdmarker.c does.
+     */
+    while (pos < size && data[pos] != 0xFF)
+      pos++;
+    while (pos < size && data[pos] == 0xFF)
+      pos++;
+    if (pos >= size)
+      break;
+    marker_pos = pos - 1;
+    c = data[pos++];
+
+    if (c == 0 || c == M_TEM || (c >= M_SOI - 8 && c <= M_SOI))
+      continue;			/* stuffed zero or parameterless marker */
+    if (c == M_SOS) {
+      info->sos_offset = marker_pos;
+      break;
+    }
+    if (c == M_SOI + 1)		/* EOI */
+      break;
+
+    /* Every other marker has a length word counting itself */
+    if (size - pos < 2)
+      break;
+    length = GET_2B(data + pos);
+    if (length < 2 || size - pos < length)
+      break;
+    payload = data + pos + 2;
+    length -= 2;
+
+    if (c >= M_SOF0 && c <= M_SOF15 &&
+	c != M_DHT && c != M_JPG && c != M_DAC) {
+      if (info->sof_marker == 0 && ! probe_sof(payload, length, c, info))
+	return FALSE;
+    } else if (c == M_DRI) {
+      if (length >= 2)
+	info->restart_interval = GET_2B(payload);
+    } else if ((c >= JPEG_APP0 && c <= M_APP15) || c == JPEG_COM) {
+      if (info->num_segments < JPEG_PROBE_MAX_SEGMENTS) {
+	seg = &info->segment[info->num_segments++];
+	seg->marker = (UINT8) c;
+	seg->offset = (size_t) (payload - data);
+	seg->length = length;
+      } else
+	info->segments_dropped = TRUE;
+    }
+    pos += length + 2;
+  }
+
+  return (info->sof_marker != 0);
+}
@@ -22,7 +22,11 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jopenclstore.h"
+#include "jopenclenv.h"
 #include "jopenclprogpool.h"
+#include "jopenclprof.h"
+#include "jthreadpool.h"
+#include "jsimd.h"
 
 
 /* Pointer to routine to upsample a single component */
@@ -58,6 +62,15 @@ typedef struct {
      */
     UINT8 h_expand[MAX_COMPONENTS];
     UINT8 v_expand[MAX_COMPONENTS];
+
+    /* Host pipeline only: a private color_buf[] for every pool worker,
+     * worker_color_buf[worker * MAX_COMPONENTS + ci].
+     */
+    JSAMPARRAY * worker_color_buf;
+
+    /* SSE2/AVX2 helpers for the fancy upsamplers, or NULL */
+    jsimd_h2v1_fancy_ptr h2v1_fancy_row;
+    jsimd_h2v2_fancy_ptr h2v2_fancy_row;
 } my_upsampler;
 
 typedef my_upsampler * my_upsample_ptr;
@@ -147,7 +160,7 @@ int_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
         /* Generate one output row with proper horizontal expansion */
         inptr = input_data[inrow];
         outptr = output_data[outrow];
-        outend = outptr + cinfo->output_width;
+        outend = outptr + cinfo->full_output_width;
         while (outptr < outend) {
             invalue = *inptr++;	/* don't need GETJSAMPLE() here */
             for (h = h_expand; h > 0; h--) {
@@ -157,7 +170,7 @@ int_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
         /* Generate any additional output rows by duplicating the first one */
         if (v_expand > 1) {
             jcopy_sample_rows(output_data, outrow, output_data, outrow+1,
-                    v_expand-1, cinfo->output_width);
+                    v_expand-1, cinfo->full_output_width);
         }
         inrow++;
         outrow += v_expand;
@@ -183,7 +196,7 @@ h2v1_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
     for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++) {
         inptr = input_data[inrow];
         outptr = output_data[inrow];
-        outend = outptr + cinfo->output_width;
+        outend = outptr + cinfo->full_output_width;
         while (outptr < outend) {
             invalue = *inptr++;	/* don't need GETJSAMPLE() here */
             *outptr++ = invalue;
@@ -212,14 +225,14 @@ h2v2_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
     while (outrow < cinfo->max_v_samp_factor) {
         inptr = input_data[inrow];
         outptr = output_data[outrow];
-        outend = outptr + cinfo->output_width;
+        outend = outptr + cinfo->full_output_width;
         while (outptr < outend) {
             invalue = *inptr++;	/* don't need GETJSAMPLE() here */
             *outptr++ = invalue;
             *outptr++ = invalue;
         }
         jcopy_sample_rows(output_data, outrow, output_data, outrow+1,
-                1, cinfo->output_width);
+                1, cinfo->full_output_width);
         inrow++;
         outrow += 2;
     }
@@ -245,10 +258,12 @@ h2v2_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
 h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
         JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
 {
+    my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
     JSAMPARRAY output_data = *output_data_ptr;
     register JSAMPROW inptr, outptr;
     register int invalue;
     register JDIMENSION colctr;
+    JDIMENSION simd_cols;
     int inrow;
 
     for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++) {
@@ -259,7 +274,16 @@ h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
         *outptr++ = (JSAMPLE) invalue;
         *outptr++ = (JSAMPLE) ((invalue * 3 + GETJSAMPLE(*inptr) + 2) >> 2);
 
-        for (colctr = compptr->downsampled_width - 2; colctr > 0; colctr--) {
+        /* Vector code takes what it can of the general case */
+        simd_cols = 0;
+        if (upsample->h2v1_fancy_row != NULL) {
+            simd_cols = (*upsample->h2v1_fancy_row) (inptr, outptr,
+                    compptr->downsampled_width - 2);
+            inptr += simd_cols;
+            outptr += simd_cols * 2;
+        }
+
+        for (colctr = compptr->downsampled_width - 2 - simd_cols; colctr > 0; colctr--) {
             /* General case: 3/4 * nearer pixel + 1/4 * further pixel */
             invalue = GETJSAMPLE(*inptr++) * 3;
             *outptr++ = (JSAMPLE) ((invalue + GETJSAMPLE(inptr[-2]) + 1) >> 2);
@@ -286,6 +310,7 @@ h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
 h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
         JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
 {
+    my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
     JSAMPARRAY output_data = *output_data_ptr;
     register JSAMPROW inptr0, inptr1, outptr;
 #if BITS_IN_JSAMPLE == 8
@@ -294,6 +319,7 @@ h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
     register INT32 thiscolsum, lastcolsum, nextcolsum;
 #endif
     register JDIMENSION colctr;
+    JDIMENSION simd_cols;
     int inrow, outrow, v;
 
     inrow = outrow = 0;
@@ -314,7 +340,23 @@ h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
             *outptr++ = (JSAMPLE) ((thiscolsum * 3 + nextcolsum + 7) >> 4);
             lastcolsum = thiscolsum; thiscolsum = nextcolsum;
 
-            for (colctr = compptr->downsampled_width - 2; colctr > 0; colctr--) {
+            /* Vector code takes what it can of the general case; pick up
+             * the column sums where it stopped.
+             */
+            simd_cols = 0;
+            if (upsample->h2v2_fancy_row != NULL) {
+                simd_cols = (*upsample->h2v2_fancy_row) (inptr0 - 1, inptr1 - 1,
+                        outptr, compptr->downsampled_width - 2);
+                if (simd_cols > 0) {
+                    inptr0 += simd_cols;
+                    inptr1 += simd_cols;
+                    outptr += simd_cols * 2;
+                    lastcolsum = GETJSAMPLE(inptr0[-2]) * 3 + GETJSAMPLE(inptr1[-2]);
+                    thiscolsum = GETJSAMPLE(inptr0[-1]) * 3 + GETJSAMPLE(inptr1[-1]);
+                }
+            }
+
+            for (colctr = compptr->downsampled_width - 2 - simd_cols; colctr > 0; colctr--) {
                 /* General case: 3/4 * nearer pixel + 1/4 * further pixel in each */
                 /* dimension, thus 9/16, 3/16, 3/16, 1/16 overall */
                 nextcolsum = GETJSAMPLE(*inptr0++) * 3 + GETJSAMPLE(*inptr1++);
@@ -350,7 +392,7 @@ sep_upsample (j_decompress_ptr cinfo,
     my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
     int ci;
     jpeg_component_info * compptr;
-    JDIMENSION num_rows;
+    JDIMENSION num_rows, skipped;
 
     /* Fill the conversion buffer, if it's empty */
     {
@@ -359,19 +401,27 @@ sep_upsample (j_decompress_ptr cinfo,
         int buffer_offset;
         int out_image_size;
         int previous_image_size;
+        double start;
 
+        // The planes are upsampled at full size; color conversion picks
+        // the region of interest out of them.
+        start = j_opencl_prof_begin(cinfo);
+        (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+                (long) cinfo->full_output_height * cinfo->full_output_width * cinfo->out_color_components);
         full_buf = clCreateBuffer(cinfo->current_cl_context,
                 CL_MEM_READ_WRITE,
-                cinfo->output_height * cinfo->output_width * cinfo->out_color_components,
+                cinfo->full_output_height * cinfo->full_output_width * cinfo->out_color_components,
                 NULL,
                 &error_code);
         if(error_code != CL_SUCCESS)
         {
+            (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+                    - (long) cinfo->full_output_height * cinfo->full_output_width * cinfo->out_color_components);
             ERREXIT(cinfo,error_code);
         }
         input_buffer = j_opencl_store_get_buffer(cinfo->cl_store,0);
 
-        out_image_size = cinfo->output_width * cinfo->output_height;
+        out_image_size = cinfo->full_output_width * cinfo->full_output_height;
         for (ci = 0, buffer_offset = 0 ,compptr = cinfo->comp_info,previous_image_size = 0;
                 ci < cinfo->num_components;
                 previous_image_size += compptr->image_buffer_size,ci++, compptr++,buffer_offset += out_image_size) {
@@ -397,7 +447,7 @@ sep_upsample (j_decompress_ptr cinfo,
                         out_image_size,
                         NULL,
                         0,
-                        NULL);
+                        j_opencl_prof_event(cinfo,JSTAGE_UPSAMPLE));
                 if(error_code != CL_SUCCESS)
                 {
                     ERREXIT(cinfo,error_code);
@@ -478,7 +528,7 @@ sep_upsample (j_decompress_ptr cinfo,
                         NULL,
                         0,
                         NULL,
-                        NULL);
+                        j_opencl_prof_event(cinfo,JSTAGE_UPSAMPLE));
             if(error_code != CL_SUCCESS)
             {
                 goto EXIT;
@@ -502,9 +552,9 @@ EXIT:
             }
         }
         upsample->next_row_out = 0;
-
+        j_opencl_prof_end(cinfo,JSTAGE_UPSAMPLE,start);
     }
-    j_opencl_store_pop_session(cinfo->cl_store);
+    j_opencl_env_pop_session(cinfo);
     j_opencl_store_new_session(cinfo->cl_store);
     j_opencl_store_append_buffer(cinfo->cl_store,full_buf);
 
@@ -523,13 +573,16 @@ EXIT:
     if (num_rows > out_rows_avail)
         num_rows = out_rows_avail;
 
+    // The whole image goes out in this one call, from the first line not
+    // skipped with jpeg_skip_scanlines on, into output_buf[0] onwards.
+    skipped = cinfo->output_scanline;
     (*cinfo->cconvert->color_convert) (cinfo, upsample->color_buf,
             (JDIMENSION) upsample->next_row_out,
-            output_buf + *out_row_ctr,
+            output_buf,
             (int) num_rows);
 
     /* Adjust counts */
-    *out_row_ctr = cinfo->output_height;
+    *out_row_ctr += cinfo->output_height - skipped;
     upsample->rows_to_go -= num_rows;
     upsample->next_row_out += num_rows;
     /* When the buffer is emptied, declare this input row group consumed */
@@ -537,6 +590,134 @@ EXIT:
         (*in_row_group_ctr)++;
 }
 
+/*
+ * Host version of sep_upsample, used when there is no OpenCL device.
+ * The main controller hands us every sample row of the image at once,
+ * so row groups are independent and are spread over the CPU thread pool.
+ * Like the OpenCL path, the whole image is emitted in a single call into
+ * the contiguous buffer at output_buf[0].
+ */
+
+typedef struct {
+    j_decompress_ptr cinfo;
+    JSAMPIMAGE input_buf;
+    JSAMPROW output_base;
+    JDIMENSION output_stride;
+    JDIMENSION first_row;	/* first and last+1 image rows to emit */
+    JDIMENSION end_row;
+    int first_group;		/* row group holding first_row */
+} cpu_upsample_job;
+
+static void upsample_row_group(void * arg, int index, int worker)
+{
+    cpu_upsample_job * job = (cpu_upsample_job *) arg;
+    j_decompress_ptr cinfo = job->cinfo;
+    my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+    JSAMPROW window[MAX_COMPONENTS][MAX_SAMP_FACTOR * DCTSIZE + 2];
+    JSAMPROW output_rows[MAX_SAMP_FACTOR];
+    JSAMPROW region_rows[MAX_COMPONENTS][MAX_SAMP_FACTOR];
+    JSAMPARRAY color_buf[MAX_COMPONENTS];
+    jpeg_component_info * compptr;
+    JDIMENSION first_row, last_row, out_row, skip_rows;
+    long row;
+    int ci, i, height, num_rows;
+
+    index += job->first_group;
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+            ci++, compptr++) {
+        /* Row group plus one context row above and below.  Rows outside
+         * the image repeat the edge row, as jdmainct.c does for the
+         * single-threaded path.
+         */
+        height = upsample->rowgroup_height[ci];
+        first_row = (JDIMENSION) index * height;
+        last_row = compptr->downsampled_height - 1;
+        for (i = 0; i < height + 2; i++) {
+            row = (long) first_row + i - 1;
+            if (row < 0)
+                row = 0;
+            if (row > (long) last_row)
+                row = last_row;
+            window[ci][i] = job->input_buf[ci][row];
+        }
+        color_buf[ci] = upsample->worker_color_buf[worker * MAX_COMPONENTS + ci];
+        (*upsample->methods[ci]) (cinfo, compptr, window[ci] + 1,
+                color_buf + ci);
+    }
+
+    /* Emit the rows of the group that fall in [first_row, end_row), from
+     * the first column of the region on; without a region or skipped lines
+     * that is the whole group.
+     */
+    out_row = (JDIMENSION) index * cinfo->max_v_samp_factor;
+    skip_rows = 0;
+    if (out_row < job->first_row)
+        skip_rows = job->first_row - out_row;
+    num_rows = cinfo->max_v_samp_factor;
+    if (out_row + num_rows > job->end_row)
+        num_rows = job->end_row - out_row;
+    num_rows -= skip_rows;
+    if (num_rows <= 0)
+        return;
+    for (i = 0; i < num_rows; i++)
+        output_rows[i] = job->output_base +
+            (size_t) (out_row + skip_rows + i - job->first_row) * job->output_stride;
+    if (cinfo->region_width != 0) {
+        for (ci = 0; ci < cinfo->num_components; ci++) {
+            if (color_buf[ci] == NULL)
+                continue;
+            for (i = 0; i < num_rows; i++)
+                region_rows[ci][i] = color_buf[ci][skip_rows + i] + cinfo->region_x;
+            color_buf[ci] = region_rows[ci];
+        }
+        skip_rows = 0;
+    }
+    (*cinfo->cconvert->color_convert) (cinfo, color_buf, skip_rows,
+            output_rows, num_rows);
+}
+
+    METHODDEF(void)
+sep_upsample_cpu (j_decompress_ptr cinfo,
+        JSAMPIMAGE input_buf, JDIMENSION *in_row_group_ctr,
+        JDIMENSION in_row_groups_avail,
+        JSAMPARRAY output_buf, JDIMENSION *out_row_ctr,
+        JDIMENSION out_rows_avail)
+{
+    my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+    cpu_upsample_job job;
+    JDIMENSION skipped;
+    int row_groups;
+    double start;
+
+    job.cinfo = cinfo;
+    job.input_buf = input_buf;
+    job.output_base = output_buf[0];
+    job.output_stride = cinfo->output_width * cinfo->out_color_components;
+    /* Only the row groups under the region of interest, if one is set,
+     * less the lines skipped with jpeg_skip_scanlines; the first line
+     * still to go lands at output_buf[0].
+     */
+    skipped = cinfo->output_scanline;
+    job.first_row = cinfo->region_y + skipped;
+    job.end_row = cinfo->region_y + cinfo->output_height;
+    job.first_group = (int) (job.first_row / cinfo->max_v_samp_factor);
+    row_groups = (int) ((job.end_row + cinfo->max_v_samp_factor - 1) /
+            cinfo->max_v_samp_factor) - job.first_group;
+
+    /* Upsampling and color conversion run fused, one row group per task;
+     * the time is charged to the upsample stage.
+     */
+    start = j_opencl_prof_begin(cinfo);
+    j_threadpool_run(cinfo->cpu_pool, row_groups, upsample_row_group, &job);
+    j_opencl_prof_end(cinfo, JSTAGE_UPSAMPLE, start);
+
+    /* Adjust counts */
+    *out_row_ctr += cinfo->output_height - skipped;
+    *in_row_group_ctr = in_row_groups_avail;
+    upsample->rows_to_go = 0;
+    upsample->next_row_out = cinfo->max_v_samp_factor;
+}
+
 /*
  * Module initialization routine for upsampling.
  */
@@ -555,8 +736,24 @@ jinit_upsampler (j_decompress_ptr cinfo)
                 SIZEOF(my_upsampler));
     cinfo->upsample = (struct jpeg_upsampler *) upsample;
     upsample->pub.start_pass = start_pass_upsample;
-    upsample->pub.upsample = sep_upsample;
+    upsample->pub.upsample = cinfo->cpu_pipeline ? sep_upsample_cpu : sep_upsample;
     upsample->pub.need_context_rows = FALSE; /* until we find out differently */
+    upsample->worker_color_buf = NULL;
+    upsample->h2v1_fancy_row = NULL;
+    upsample->h2v2_fancy_row = NULL;
+#ifdef JSIMD_X86
+    {
+        int simd = jsimd_cpu_features();
+
+        if (simd & JSIMD_AVX2) {
+            upsample->h2v1_fancy_row = jsimd_h2v1_fancy_avx2;
+            upsample->h2v2_fancy_row = jsimd_h2v2_fancy_avx2;
+        } else if (simd & JSIMD_SSE2) {
+            upsample->h2v1_fancy_row = jsimd_h2v1_fancy_sse2;
+            upsample->h2v2_fancy_row = jsimd_h2v2_fancy_sse2;
+        }
+    }
+#endif
 
     if (cinfo->CCIR601_sampling)	/* this isn't supported */
         ERREXIT(cinfo, JERR_CCIR601_NOTIMPL);
@@ -616,9 +813,35 @@ jinit_upsampler (j_decompress_ptr cinfo)
         if (need_buffer) {
             upsample->color_buf[ci] = (*cinfo->mem->alloc_sarray)
                 ((j_common_ptr) cinfo, JPOOL_IMAGE,
-                 (JDIMENSION) jround_up((long) cinfo->output_width,
+                 (JDIMENSION) jround_up((long) cinfo->full_output_width,
                      (long) cinfo->max_h_samp_factor),
                  (JDIMENSION) cinfo->max_v_samp_factor);
+        } else
+            upsample->color_buf[ci] = NULL;
+    }
+
+    if (cinfo->cpu_pipeline) {
+        /* Each pool worker upsamples into a buffer of its own */
+        int worker, workers;
+
+        workers = j_threadpool_get_worker_count(cinfo->cpu_pool);
+        upsample->worker_color_buf = (JSAMPARRAY *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                    workers * MAX_COMPONENTS * SIZEOF(JSAMPARRAY));
+        for (worker = 0; worker < workers; worker++) {
+            for (ci = 0; ci < cinfo->num_components; ci++) {
+                if (worker == 0 || upsample->color_buf[ci] == NULL) {
+                    upsample->worker_color_buf[worker * MAX_COMPONENTS + ci] =
+                        upsample->color_buf[ci];
+                    continue;
+                }
+                upsample->worker_color_buf[worker * MAX_COMPONENTS + ci] =
+                    (*cinfo->mem->alloc_sarray)
+                    ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                     (JDIMENSION) jround_up((long) cinfo->full_output_width,
+                         (long) cinfo->max_h_samp_factor),
+                     (JDIMENSION) cinfo->max_v_samp_factor);
+            }
         }
     }
 }
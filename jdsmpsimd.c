@@ -0,0 +1,184 @@
+/*
+ * jdsmpsimd.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains SSE2 and AVX2 row helpers for the "fancy" (triangle
+ * filter) upsamplers of jdsample.c.  They take over the interior columns
+ * of a row; the edge columns stay with the scalar code.
+ *
+ * The sums are formed in 16-bit lanes, where they cannot overflow, and
+ * each output pair is built as the word (even | odd << 8), which is the
+ * two samples in memory order.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#include <immintrin.h>
+
+#define SSE2_TARGET  __attribute__((target("sse2")))
+#define AVX2_TARGET  __attribute__((target("avx2")))
+
+
+/*
+ * SSE2 versions: 16 input columns, 32 output samples per step.
+ */
+
+/* Columns 0-7 (hi = 0) or 8-15 (hi = 1) of a 16-byte load, as words */
+#define WIDEN_SSE2(v,hi)  \
+  ((hi) ? _mm_unpackhi_epi8(v, _mm_setzero_si128()) \
+	: _mm_unpacklo_epi8(v, _mm_setzero_si128()))
+
+SSE2_TARGET static __inline__ __m128i
+load_sse2 (JSAMPROW ptr)
+{
+  return _mm_loadu_si128((const __m128i *) ptr);
+}
+
+/* Store 8 even and 8 odd output samples, interleaved */
+SSE2_TARGET static __inline__ void
+store_pairs_sse2 (JSAMPROW outptr, __m128i even, __m128i odd)
+{
+  _mm_storeu_si128((__m128i *) outptr,
+		   _mm_or_si128(even, _mm_slli_epi16(odd, 8)));
+}
+
+SSE2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v1_fancy_sse2 (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  __m128i last, this, next, three_this;
+  JDIMENSION col;
+  int hi;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    for (hi = 0; hi < 2; hi++) {
+      last = WIDEN_SSE2(load_sse2(inptr + col - 1), hi);
+      this = WIDEN_SSE2(load_sse2(inptr + col), hi);
+      next = WIDEN_SSE2(load_sse2(inptr + col + 1), hi);
+      /* 3/4 * nearer pixel + 1/4 * further pixel */
+      three_this = _mm_add_epi16(this, _mm_add_epi16(this, this));
+      store_pairs_sse2(outptr + (col + hi * 8) * 2,
+	_mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(three_this, last),
+				     _mm_set1_epi16(1)), 2),
+	_mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(three_this, next),
+				     _mm_set1_epi16(2)), 2));
+    }
+  }
+  return col;
+}
+
+/* 3 * nearer row + further row, for 8 columns */
+SSE2_TARGET static __inline__ __m128i
+colsum_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, int hi)
+{
+  __m128i near = WIDEN_SSE2(load_sse2(inptr0), hi);
+
+  return _mm_add_epi16(_mm_add_epi16(near, _mm_add_epi16(near, near)),
+		       WIDEN_SSE2(load_sse2(inptr1), hi));
+}
+
+SSE2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v2_fancy_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+		       JDIMENSION num_cols)
+{
+  __m128i lastcolsum, thiscolsum, nextcolsum, three_this;
+  JDIMENSION col;
+  int hi;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    for (hi = 0; hi < 2; hi++) {
+      lastcolsum = colsum_sse2(inptr0 + col - 1, inptr1 + col - 1, hi);
+      thiscolsum = colsum_sse2(inptr0 + col, inptr1 + col, hi);
+      nextcolsum = colsum_sse2(inptr0 + col + 1, inptr1 + col + 1, hi);
+      /* 9/16, 3/16, 3/16, 1/16 of the four nearest input pixels */
+      three_this = _mm_add_epi16(thiscolsum,
+				 _mm_add_epi16(thiscolsum, thiscolsum));
+      store_pairs_sse2(outptr + (col + hi * 8) * 2,
+	_mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(three_this, lastcolsum),
+				     _mm_set1_epi16(8)), 4),
+	_mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(three_this, nextcolsum),
+				     _mm_set1_epi16(7)), 4));
+    }
+  }
+  return col;
+}
+
+
+/*
+ * AVX2 versions: the same steps with all 16 columns in one vector.
+ */
+
+AVX2_TARGET static __inline__ __m256i
+load_avx2 (JSAMPROW ptr)
+{
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) ptr));
+}
+
+AVX2_TARGET static __inline__ void
+store_pairs_avx2 (JSAMPROW outptr, __m256i even, __m256i odd)
+{
+  _mm256_storeu_si256((__m256i *) outptr,
+		      _mm256_or_si256(even, _mm256_slli_epi16(odd, 8)));
+}
+
+AVX2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v1_fancy_avx2 (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  __m256i last, this, next, three_this;
+  JDIMENSION col;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    last = load_avx2(inptr + col - 1);
+    this = load_avx2(inptr + col);
+    next = load_avx2(inptr + col + 1);
+    three_this = _mm256_add_epi16(this, _mm256_add_epi16(this, this));
+    store_pairs_avx2(outptr + col * 2,
+      _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(three_this, last),
+					 _mm256_set1_epi16(1)), 2),
+      _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(three_this, next),
+					 _mm256_set1_epi16(2)), 2));
+  }
+  return col;
+}
+
+AVX2_TARGET static __inline__ __m256i
+colsum_avx2 (JSAMPROW inptr0, JSAMPROW inptr1)
+{
+  __m256i near = load_avx2(inptr0);
+
+  return _mm256_add_epi16(_mm256_add_epi16(near, _mm256_add_epi16(near, near)),
+			  load_avx2(inptr1));
+}
+
+AVX2_TARGET GLOBAL(JDIMENSION)
+jsimd_h2v2_fancy_avx2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+		       JDIMENSION num_cols)
+{
+  __m256i lastcolsum, thiscolsum, nextcolsum, three_this;
+  JDIMENSION col;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    lastcolsum = colsum_avx2(inptr0 + col - 1, inptr1 + col - 1);
+    thiscolsum = colsum_avx2(inptr0 + col, inptr1 + col);
+    nextcolsum = colsum_avx2(inptr0 + col + 1, inptr1 + col + 1);
+    three_this = _mm256_add_epi16(thiscolsum,
+				  _mm256_add_epi16(thiscolsum, thiscolsum));
+    store_pairs_avx2(outptr + col * 2,
+      _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(three_this,
+							  lastcolsum),
+					 _mm256_set1_epi16(8)), 4),
+      _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(three_this,
+							  nextcolsum),
+					 _mm256_set1_epi16(7)), 4));
+  }
+  return col;
+}
+
+#endif /* JSIMD_X86 */
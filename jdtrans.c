@@ -45,9 +45,11 @@ GLOBAL(jvirt_barray_ptr *)
 jpeg_read_coefficients (j_decompress_ptr cinfo)
 {
   if (cinfo->global_state == DSTATE_READY) {
-    /* First call: initialize active modules */
-    transdecode_master_selection(cinfo);
+    /* First call: initialize active modules.  The state is set first so
+     * that the coefficient controller knows to keep virtual arrays.
+     */
     cinfo->global_state = DSTATE_RDCOEFS;
+    transdecode_master_selection(cinfo);
   }
   if (cinfo->global_state == DSTATE_RDCOEFS) {
     /* Absorb whole file into the coef buffer */
@@ -60,6 +60,7 @@ JMESSAGE(JERR_BAD_PROGRESSION,
 	 "Invalid progressive parameters Ss=%d Se=%d Ah=%d Al=%d")
 JMESSAGE(JERR_BAD_PROG_SCRIPT,
 	 "Invalid progressive parameters at scan script entry %d")
+JMESSAGE(JERR_BAD_REGION, "Region does not fit in the %ux%u output image")
 JMESSAGE(JERR_BAD_SAMPLING, "Bogus sampling factors")
 JMESSAGE(JERR_BAD_SCAN_SCRIPT, "Invalid scan script at entry %d")
 JMESSAGE(JERR_BAD_STATE, "Improper call to JPEG library in state %d")
@@ -87,6 +88,7 @@ JMESSAGE(JERR_HUFF_MISSING_CODE, "Missing Huffman code table entry")
 JMESSAGE(JERR_IMAGE_TOO_BIG, "Maximum supported image dimension is %u pixels")
 JMESSAGE(JERR_INPUT_EMPTY, "Empty input file")
 JMESSAGE(JERR_INPUT_EOF, "Premature end of input file")
+JMESSAGE(JERR_MEMORY_BUDGET, "Memory budget exceeded")
 JMESSAGE(JERR_MISMATCHED_QUANT_TABLE,
 	 "Cannot transcode due to multiple use of quantization table %d")
 JMESSAGE(JERR_MISSING_DATA, "Scan script does not transmit all data")
@@ -127,6 +129,11 @@ JMESSAGE(JTRC_ADOBE,
 	 "Adobe APP14 marker: version %d, flags 0x%04x 0x%04x, transform %d")
 JMESSAGE(JTRC_APP0, "Unknown APP0 marker (not JFIF), length %u")
 JMESSAGE(JTRC_APP14, "Unknown APP14 marker (not Adobe), length %u")
+JMESSAGE(JTRC_BUDGET_PIPELINE,
+	 "OpenCL pipeline needs %d KB over the memory budget, decoding on the CPU")
+JMESSAGE(JTRC_CPU_COMPRESS,
+	 "OpenCL compression unavailable (error %d), using the CPU")
+JMESSAGE(JTRC_CPU_PIPELINE, "No OpenCL device (error %d), decoding on the CPU")
 JMESSAGE(JTRC_DAC, "Define Arithmetic Table 0x%02x: 0x%02x")
 JMESSAGE(JTRC_DHT, "Define Huffman Table 0x%02x")
 JMESSAGE(JTRC_DQT, "Define Quantization Table %d  precision %d")
@@ -176,6 +183,8 @@ JMESSAGE(JWRN_EXTRANEOUS_DATA,
 	 "Corrupt JPEG data: %u extraneous bytes before marker 0x%02x")
 JMESSAGE(JWRN_HIT_MARKER, "Corrupt JPEG data: premature end of data segment")
 JMESSAGE(JWRN_HUFF_BAD_CODE, "Corrupt JPEG data: bad Huffman code")
+JMESSAGE(JWRN_INDEX_NOT_WRITTEN,
+	 "Entropy index not written: scan data incomplete or not in memory")
 JMESSAGE(JWRN_JFIF_MAJOR, "Warning: unknown JFIF revision number %d.%02d")
 JMESSAGE(JWRN_JPEG_EOF, "Premature end of JPEG file")
 JMESSAGE(JWRN_MUST_RESYNC,
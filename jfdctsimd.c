@@ -0,0 +1,643 @@
+/*
+ * jfdctsimd.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains SSE2 and AVX2 versions of the forward DCTs in
+ * jfdctint.c, jfdctfst.c and jfdctflt.c, and of the quantization step of
+ * jcdctmgr.c.  jcdctmgr.c picks them at run time according to
+ * jsimd_cpu_features().
+ *
+ * Each DCT performs exactly the arithmetic of its scalar counterpart, only
+ * on several rows (pass 1) or columns (pass 2) at once, so the output is
+ * bit-identical.  (The float version matches jfdctflt.c as compiled for
+ * SSE math without fused multiply-add, the x86-64 default.)
+ *
+ * The integer quantizer replaces the division by a multiplication with a
+ * precomputed reciprocal; see jdct.h for the table layout and the range
+ * over which this gives exactly the quotient of the scalar code.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#include <immintrin.h>
+
+#define SSE2_TARGET  __attribute__((target("sse2")))
+#define AVX2_TARGET  __attribute__((target("avx2")))
+
+
+/*
+ * The 1-D transforms, written once over the vector operations
+ * VADD, VSUB, VMUL (by a constant) and the output scalings named in the
+ * arguments; each SIMD flavor defines those and then expands the bodies.
+ * v[0..7] are the eight inputs of the 1-D transform, replaced in place by
+ * its eight outputs.
+ */
+
+/* LL&M, as jfdctint.c.  SUM_OUT scales outputs 0 and 4, which involve no
+ * multiplication; PROD_OUT descales the other six.
+ */
+#define ISLOW_CONST_BITS  13
+#define ISLOW_PASS1_BITS  2
+
+#define ISLOW_FIX_0_298631336  ((INT32)  2446)
+#define ISLOW_FIX_0_390180644  ((INT32)  3196)
+#define ISLOW_FIX_0_541196100  ((INT32)  4433)
+#define ISLOW_FIX_0_765366865  ((INT32)  6270)
+#define ISLOW_FIX_0_899976223  ((INT32)  7373)
+#define ISLOW_FIX_1_175875602  ((INT32)  9633)
+#define ISLOW_FIX_1_501321110  ((INT32)  12299)
+#define ISLOW_FIX_1_847759065  ((INT32)  15137)
+#define ISLOW_FIX_1_961570560  ((INT32)  16069)
+#define ISLOW_FIX_2_053119869  ((INT32)  16819)
+#define ISLOW_FIX_2_562915447  ((INT32)  20995)
+#define ISLOW_FIX_3_072711026  ((INT32)  25172)
+
+#define ISLOW_FDCT_1D(VEC, v, SUM_OUT, PROD_OUT) { \
+  VEC tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7; \
+  VEC tmp10, tmp11, tmp12, tmp13, z1, z2, z3, z4, z5; \
+  tmp0 = VADD(v[0], v[7]); \
+  tmp7 = VSUB(v[0], v[7]); \
+  tmp1 = VADD(v[1], v[6]); \
+  tmp6 = VSUB(v[1], v[6]); \
+  tmp2 = VADD(v[2], v[5]); \
+  tmp5 = VSUB(v[2], v[5]); \
+  tmp3 = VADD(v[3], v[4]); \
+  tmp4 = VSUB(v[3], v[4]); \
+  tmp10 = VADD(tmp0, tmp3); \
+  tmp13 = VSUB(tmp0, tmp3); \
+  tmp11 = VADD(tmp1, tmp2); \
+  tmp12 = VSUB(tmp1, tmp2); \
+  v[0] = SUM_OUT(VADD(tmp10, tmp11)); \
+  v[4] = SUM_OUT(VSUB(tmp10, tmp11)); \
+  z1 = VMUL(VADD(tmp12, tmp13), ISLOW_FIX_0_541196100); \
+  v[2] = PROD_OUT(VADD(z1, VMUL(tmp13, ISLOW_FIX_0_765366865))); \
+  v[6] = PROD_OUT(VADD(z1, VMUL(tmp12, - ISLOW_FIX_1_847759065))); \
+  z1 = VADD(tmp4, tmp7); \
+  z2 = VADD(tmp5, tmp6); \
+  z3 = VADD(tmp4, tmp6); \
+  z4 = VADD(tmp5, tmp7); \
+  z5 = VMUL(VADD(z3, z4), ISLOW_FIX_1_175875602); \
+  tmp4 = VMUL(tmp4, ISLOW_FIX_0_298631336); \
+  tmp5 = VMUL(tmp5, ISLOW_FIX_2_053119869); \
+  tmp6 = VMUL(tmp6, ISLOW_FIX_3_072711026); \
+  tmp7 = VMUL(tmp7, ISLOW_FIX_1_501321110); \
+  z1 = VMUL(z1, - ISLOW_FIX_0_899976223); \
+  z2 = VMUL(z2, - ISLOW_FIX_2_562915447); \
+  z3 = VADD(VMUL(z3, - ISLOW_FIX_1_961570560), z5); \
+  z4 = VADD(VMUL(z4, - ISLOW_FIX_0_390180644), z5); \
+  v[7] = PROD_OUT(VADD(VADD(tmp4, z1), z3)); \
+  v[5] = PROD_OUT(VADD(VADD(tmp5, z2), z4)); \
+  v[3] = PROD_OUT(VADD(VADD(tmp6, z2), z3)); \
+  v[1] = PROD_OUT(VADD(VADD(tmp7, z1), z4)); \
+}
+
+/* AA&N, as jfdctfst.c and jfdctflt.c; both passes are alike.  For the
+ * integer version VMUL includes the descaling of the product by CONST_BITS.
+ * CONSTANTS is one of the lists below, expanded into the four multipliers.
+ */
+#define IFAST_CONST_BITS  8
+
+#define IFAST_FIX_0_382683433  ((INT32)   98)
+#define IFAST_FIX_0_541196100  ((INT32)  139)
+#define IFAST_FIX_0_707106781  ((INT32)  181)
+#define IFAST_FIX_1_306562965  ((INT32)  334)
+
+#define AAN_FDCT_1D(VEC, v, CONSTANTS)  AAN_FDCT_1D_BODY(VEC, v, CONSTANTS)
+#define AAN_FDCT_1D_BODY(VEC, v, C0_707, C0_382, C0_541, C1_306) { \
+  VEC tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7; \
+  VEC tmp10, tmp11, tmp12, tmp13, z1, z2, z3, z4, z5, z11, z13; \
+  tmp0 = VADD(v[0], v[7]); \
+  tmp7 = VSUB(v[0], v[7]); \
+  tmp1 = VADD(v[1], v[6]); \
+  tmp6 = VSUB(v[1], v[6]); \
+  tmp2 = VADD(v[2], v[5]); \
+  tmp5 = VSUB(v[2], v[5]); \
+  tmp3 = VADD(v[3], v[4]); \
+  tmp4 = VSUB(v[3], v[4]); \
+  tmp10 = VADD(tmp0, tmp3); \
+  tmp13 = VSUB(tmp0, tmp3); \
+  tmp11 = VADD(tmp1, tmp2); \
+  tmp12 = VSUB(tmp1, tmp2); \
+  v[0] = VADD(tmp10, tmp11); \
+  v[4] = VSUB(tmp10, tmp11); \
+  z1 = VMUL(VADD(tmp12, tmp13), C0_707); \
+  v[2] = VADD(tmp13, z1); \
+  v[6] = VSUB(tmp13, z1); \
+  tmp10 = VADD(tmp4, tmp5); \
+  tmp11 = VADD(tmp5, tmp6); \
+  tmp12 = VADD(tmp6, tmp7); \
+  z5 = VMUL(VSUB(tmp10, tmp12), C0_382); \
+  z2 = VADD(VMUL(tmp10, C0_541), z5); \
+  z4 = VADD(VMUL(tmp12, C1_306), z5); \
+  z3 = VMUL(tmp11, C0_707); \
+  z11 = VADD(tmp7, z3); \
+  z13 = VSUB(tmp7, z3); \
+  v[5] = VADD(z13, z2); \
+  v[3] = VSUB(z13, z2); \
+  v[1] = VADD(z11, z4); \
+  v[7] = VSUB(z11, z4); \
+}
+
+#define IFAST_CONSTANTS \
+  IFAST_FIX_0_707106781, IFAST_FIX_0_382683433, \
+  IFAST_FIX_0_541196100, IFAST_FIX_1_306562965
+
+/* Float constants in the form jfdctflt.c writes them (see there) */
+#define FLOAT_CONSTANTS \
+  ((FAST_FLOAT) 0.707106781), ((FAST_FLOAT) 0.382683433), \
+  ((FAST_FLOAT) 0.541196100), ((FAST_FLOAT) 1.306562965)
+
+/* jfdctfst.c descales its products by a plain shift unless told otherwise */
+#ifdef USE_ACCURATE_ROUNDING
+#define IFAST_ROUND  (1 << (IFAST_CONST_BITS-1))
+#else
+#define IFAST_ROUND  0
+#endif
+
+
+/*
+ * SSE2 versions.  A vector holds four 32-bit lanes, so each pass runs
+ * twice: pass 1 over rows 0-3 and 4-7, pass 2 over columns 0-3 and 4-7.
+ */
+
+/* SSE2 has no 32x32->32 multiply; build it from the 32x32->64 one */
+SSE2_TARGET static __inline__ __m128i
+mullo_sse2 (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+			    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+SSE2_TARGET static __inline__ void
+transpose4_sse2 (__m128i * r)
+{
+  __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+  __m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+  __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+  __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+
+  r[0] = _mm_unpacklo_epi64(t0, t1);
+  r[1] = _mm_unpackhi_epi64(t0, t1);
+  r[2] = _mm_unpacklo_epi64(t2, t3);
+  r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+/* Pass 1 for rows 4*half..4*half+3: the 4x4 quarters of the block are
+ * transposed so lanes are rows, transformed, and transposed back into
+ * ws_left/ws_right, which hold columns 0-3/4-7 of every row.
+ */
+#define PASS1_SSE2(TRANSFORM, LOAD) { \
+  for (half = 0; half < 2; half++) { \
+    for (ctr = 0; ctr < 4; ctr++) { \
+      v[ctr] = LOAD(data + (half*4 + ctr)*DCTSIZE); \
+      v[ctr+4] = LOAD(data + (half*4 + ctr)*DCTSIZE + 4); \
+    } \
+    transpose4_sse2(v); \
+    transpose4_sse2(v + 4); \
+    TRANSFORM; \
+    transpose4_sse2(v); \
+    transpose4_sse2(v + 4); \
+    for (ctr = 0; ctr < 4; ctr++) { \
+      ws_left[half*4 + ctr] = v[ctr]; \
+      ws_right[half*4 + ctr] = v[ctr+4]; \
+    } \
+  } \
+}
+
+/* Pass 2 for columns 0-3 and 4-7: lanes are columns already */
+#define PASS2_SSE2(TRANSFORM, STORE) { \
+  for (half = 0; half < 2; half++) { \
+    for (ctr = 0; ctr < DCTSIZE; ctr++) \
+      v[ctr] = (half ? ws_right : ws_left)[ctr]; \
+    TRANSFORM; \
+    for (ctr = 0; ctr < DCTSIZE; ctr++) \
+      STORE(data + ctr*DCTSIZE + half*4, v[ctr]); \
+  } \
+}
+
+#define LOAD_EPI32(p)     _mm_loadu_si128((const __m128i *) (p))
+#define STORE_EPI32(p,a)  _mm_storeu_si128((__m128i *) (p), a)
+
+#define VADD(a,b)  _mm_add_epi32(a, b)
+#define VSUB(a,b)  _mm_sub_epi32(a, b)
+
+
+#ifdef DCT_ISLOW_SUPPORTED
+
+#define VMUL(a,c)  mullo_sse2(a, _mm_set1_epi32((int) (c)))
+#define ISLOW_PASS1_SUM(a)   _mm_slli_epi32(a, ISLOW_PASS1_BITS)
+#define ISLOW_PASS1_PROD(a)  _mm_srai_epi32(_mm_add_epi32(a, \
+  _mm_set1_epi32(1 << (ISLOW_CONST_BITS-ISLOW_PASS1_BITS-1))), \
+  ISLOW_CONST_BITS-ISLOW_PASS1_BITS)
+#define ISLOW_PASS2_SUM(a)   _mm_srai_epi32(_mm_add_epi32(a, \
+  _mm_set1_epi32(1 << (ISLOW_PASS1_BITS-1))), ISLOW_PASS1_BITS)
+#define ISLOW_PASS2_PROD(a)  _mm_srai_epi32(_mm_add_epi32(a, \
+  _mm_set1_epi32(1 << (ISLOW_CONST_BITS+ISLOW_PASS1_BITS-1))), \
+  ISLOW_CONST_BITS+ISLOW_PASS1_BITS)
+
+SSE2_TARGET GLOBAL(void)
+jpeg_fdct_islow_sse2 (DCTELEM * data)
+{
+  __m128i v[DCTSIZE], ws_left[DCTSIZE], ws_right[DCTSIZE];
+  int half, ctr;
+
+  /* Pass 1: process rows, scaling the results up by 2**PASS1_BITS. */
+  PASS1_SSE2(ISLOW_FDCT_1D(__m128i, v, ISLOW_PASS1_SUM, ISLOW_PASS1_PROD),
+	     LOAD_EPI32);
+
+  /* Pass 2: process columns, removing the PASS1_BITS scaling. */
+  PASS2_SSE2(ISLOW_FDCT_1D(__m128i, v, ISLOW_PASS2_SUM, ISLOW_PASS2_PROD),
+	     STORE_EPI32);
+}
+
+#undef VMUL
+#undef ISLOW_PASS1_SUM
+#undef ISLOW_PASS1_PROD
+#undef ISLOW_PASS2_SUM
+#undef ISLOW_PASS2_PROD
+
+#endif /* DCT_ISLOW_SUPPORTED */
+
+
+#ifdef DCT_IFAST_SUPPORTED
+
+#define VMUL(a,c)  _mm_srai_epi32(_mm_add_epi32( \
+  mullo_sse2(a, _mm_set1_epi32((int) (c))), _mm_set1_epi32(IFAST_ROUND)), \
+  IFAST_CONST_BITS)
+
+SSE2_TARGET GLOBAL(void)
+jpeg_fdct_ifast_sse2 (DCTELEM * data)
+{
+  __m128i v[DCTSIZE], ws_left[DCTSIZE], ws_right[DCTSIZE];
+  int half, ctr;
+
+  /* Pass 1: process rows. */
+  PASS1_SSE2(AAN_FDCT_1D(__m128i, v, IFAST_CONSTANTS), LOAD_EPI32);
+
+  /* Pass 2: process columns. */
+  PASS2_SSE2(AAN_FDCT_1D(__m128i, v, IFAST_CONSTANTS), STORE_EPI32);
+}
+
+#undef VMUL
+
+#endif /* DCT_IFAST_SUPPORTED */
+
+#undef VADD
+#undef VSUB
+
+
+#ifdef DCT_FLOAT_SUPPORTED
+
+#define VADD(a,b)  _mm_add_ps(a, b)
+#define VSUB(a,b)  _mm_sub_ps(a, b)
+#define VMUL(a,c)  _mm_mul_ps(a, _mm_set1_ps(c))
+
+SSE2_TARGET GLOBAL(void)
+jpeg_fdct_float_sse2 (FAST_FLOAT * data)
+{
+  __m128 v[DCTSIZE], ws_left[DCTSIZE], ws_right[DCTSIZE];
+  int half, ctr;
+
+  /* Pass 1: process rows. */
+  for (half = 0; half < 2; half++) {
+    for (ctr = 0; ctr < 4; ctr++) {
+      v[ctr] = _mm_loadu_ps(data + (half*4 + ctr)*DCTSIZE);
+      v[ctr+4] = _mm_loadu_ps(data + (half*4 + ctr)*DCTSIZE + 4);
+    }
+    _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+    _MM_TRANSPOSE4_PS(v[4], v[5], v[6], v[7]);
+    AAN_FDCT_1D(__m128, v, FLOAT_CONSTANTS);
+    _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+    _MM_TRANSPOSE4_PS(v[4], v[5], v[6], v[7]);
+    for (ctr = 0; ctr < 4; ctr++) {
+      ws_left[half*4 + ctr] = v[ctr];
+      ws_right[half*4 + ctr] = v[ctr+4];
+    }
+  }
+
+  /* Pass 2: process columns. */
+  PASS2_SSE2(AAN_FDCT_1D(__m128, v, FLOAT_CONSTANTS), _mm_storeu_ps);
+}
+
+#undef VADD
+#undef VSUB
+#undef VMUL
+
+#endif /* DCT_FLOAT_SUPPORTED */
+
+
+/* Divide four coefficients by their divisors, rounding to nearest with
+ * ties away from zero, via the reciprocal table (see jdct.h).
+ */
+SSE2_TARGET static __inline__ __m128i
+quantize4_sse2 (__m128i coef, DCTELEM * reciprocals)
+{
+  __m128i recip = _mm_loadu_si128((const __m128i *) reciprocals);
+  __m128i sign = _mm_srai_epi32(coef, 31);
+  __m128i even, odd;
+
+  /* |coef| plus half the divisor */
+  coef = _mm_add_epi32(_mm_sub_epi32(_mm_xor_si128(coef, sign), sign),
+		       _mm_loadu_si128((const __m128i *)
+				       (reciprocals + DCTSIZE2)));
+  even = _mm_srli_epi64(_mm_mul_epu32(coef, recip), RECIP_BITS);
+  odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(coef, 32),
+				     _mm_srli_epi64(recip, 32)), RECIP_BITS);
+  coef = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+  return _mm_sub_epi32(_mm_xor_si128(coef, sign), sign);
+}
+
+SSE2_TARGET GLOBAL(void)
+jsimd_quantize_sse2 (JCOEFPTR coef_block, DCTELEM * reciprocals,
+		     DCTELEM * workspace)
+{
+  int i;
+
+  for (i = 0; i < DCTSIZE2; i += 8) {
+    _mm_storeu_si128((__m128i *) (coef_block + i),
+      _mm_packs_epi32(quantize4_sse2(LOAD_EPI32(workspace + i),
+				     reciprocals + i),
+		      quantize4_sse2(LOAD_EPI32(workspace + i + 4),
+				     reciprocals + i + 4)));
+  }
+}
+
+#ifdef DCT_FLOAT_SUPPORTED
+
+/* Scale four coefficients and round them as forward_DCT_float does */
+SSE2_TARGET static __inline__ __m128i
+quantize4_float_sse2 (FAST_FLOAT * workspace, FAST_FLOAT * divisors)
+{
+  __m128 temp = _mm_mul_ps(_mm_loadu_ps(workspace), _mm_loadu_ps(divisors));
+
+  return _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(temp,
+						   _mm_set1_ps(16384.5f))),
+		       _mm_set1_epi32(16384));
+}
+
+SSE2_TARGET GLOBAL(void)
+jsimd_quantize_float_sse2 (JCOEFPTR coef_block, FAST_FLOAT * divisors,
+			   FAST_FLOAT * workspace)
+{
+  int i;
+
+  for (i = 0; i < DCTSIZE2; i += 8) {
+    _mm_storeu_si128((__m128i *) (coef_block + i),
+      _mm_packs_epi32(quantize4_float_sse2(workspace + i, divisors + i),
+		      quantize4_float_sse2(workspace + i + 4,
+					   divisors + i + 4)));
+  }
+}
+
+#endif /* DCT_FLOAT_SUPPORTED */
+
+
+/*
+ * AVX2 versions.  After an 8x8 transpose a vector holds a whole column
+ * (pass 1); without one it holds a whole row (pass 2).
+ */
+
+AVX2_TARGET static __inline__ void
+transpose8_avx2 (__m256i * r)
+{
+  __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+  __m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+  t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+  t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+  t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+  t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+  t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+  u0 = _mm256_unpacklo_epi64(t0, t2);
+  u1 = _mm256_unpackhi_epi64(t0, t2);
+  u2 = _mm256_unpacklo_epi64(t1, t3);
+  u3 = _mm256_unpackhi_epi64(t1, t3);
+  u4 = _mm256_unpacklo_epi64(t4, t6);
+  u5 = _mm256_unpackhi_epi64(t4, t6);
+  u6 = _mm256_unpacklo_epi64(t5, t7);
+  u7 = _mm256_unpackhi_epi64(t5, t7);
+  r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+AVX2_TARGET static __inline__ void
+transpose8_ps_avx2 (__m256 * r)
+{
+  __m256i t[DCTSIZE];
+  int i;
+
+  for (i = 0; i < DCTSIZE; i++)
+    t[i] = _mm256_castps_si256(r[i]);
+  transpose8_avx2(t);
+  for (i = 0; i < DCTSIZE; i++)
+    r[i] = _mm256_castsi256_ps(t[i]);
+}
+
+#define LOAD_EPI32_AVX2(p)     _mm256_loadu_si256((const __m256i *) (p))
+#define STORE_EPI32_AVX2(p,a)  _mm256_storeu_si256((__m256i *) (p), a)
+
+#define VADD(a,b)  _mm256_add_epi32(a, b)
+#define VSUB(a,b)  _mm256_sub_epi32(a, b)
+
+
+#ifdef DCT_ISLOW_SUPPORTED
+
+#define VMUL(a,c)  _mm256_mullo_epi32(a, _mm256_set1_epi32((int) (c)))
+#define ISLOW_PASS1_SUM(a)   _mm256_slli_epi32(a, ISLOW_PASS1_BITS)
+#define ISLOW_PASS1_PROD(a)  _mm256_srai_epi32(_mm256_add_epi32(a, \
+  _mm256_set1_epi32(1 << (ISLOW_CONST_BITS-ISLOW_PASS1_BITS-1))), \
+  ISLOW_CONST_BITS-ISLOW_PASS1_BITS)
+#define ISLOW_PASS2_SUM(a)   _mm256_srai_epi32(_mm256_add_epi32(a, \
+  _mm256_set1_epi32(1 << (ISLOW_PASS1_BITS-1))), ISLOW_PASS1_BITS)
+#define ISLOW_PASS2_PROD(a)  _mm256_srai_epi32(_mm256_add_epi32(a, \
+  _mm256_set1_epi32(1 << (ISLOW_CONST_BITS+ISLOW_PASS1_BITS-1))), \
+  ISLOW_CONST_BITS+ISLOW_PASS1_BITS)
+
+AVX2_TARGET GLOBAL(void)
+jpeg_fdct_islow_avx2 (DCTELEM * data)
+{
+  __m256i v[DCTSIZE];
+  int ctr;
+
+  /* Pass 1: process rows, scaling the results up by 2**PASS1_BITS. */
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = LOAD_EPI32_AVX2(data + ctr*DCTSIZE);
+  transpose8_avx2(v);
+  ISLOW_FDCT_1D(__m256i, v, ISLOW_PASS1_SUM, ISLOW_PASS1_PROD);
+  transpose8_avx2(v);
+
+  /* Pass 2: process columns, removing the PASS1_BITS scaling. */
+  ISLOW_FDCT_1D(__m256i, v, ISLOW_PASS2_SUM, ISLOW_PASS2_PROD);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    STORE_EPI32_AVX2(data + ctr*DCTSIZE, v[ctr]);
+}
+
+#undef VMUL
+#undef ISLOW_PASS1_SUM
+#undef ISLOW_PASS1_PROD
+#undef ISLOW_PASS2_SUM
+#undef ISLOW_PASS2_PROD
+
+#endif /* DCT_ISLOW_SUPPORTED */
+
+
+#ifdef DCT_IFAST_SUPPORTED
+
+#define VMUL(a,c)  _mm256_srai_epi32(_mm256_add_epi32( \
+  _mm256_mullo_epi32(a, _mm256_set1_epi32((int) (c))), \
+  _mm256_set1_epi32(IFAST_ROUND)), IFAST_CONST_BITS)
+
+AVX2_TARGET GLOBAL(void)
+jpeg_fdct_ifast_avx2 (DCTELEM * data)
+{
+  __m256i v[DCTSIZE];
+  int ctr;
+
+  /* Pass 1: process rows. */
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = LOAD_EPI32_AVX2(data + ctr*DCTSIZE);
+  transpose8_avx2(v);
+  AAN_FDCT_1D(__m256i, v, IFAST_CONSTANTS);
+  transpose8_avx2(v);
+
+  /* Pass 2: process columns. */
+  AAN_FDCT_1D(__m256i, v, IFAST_CONSTANTS);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    STORE_EPI32_AVX2(data + ctr*DCTSIZE, v[ctr]);
+}
+
+#undef VMUL
+
+#endif /* DCT_IFAST_SUPPORTED */
+
+#undef VADD
+#undef VSUB
+
+
+#ifdef DCT_FLOAT_SUPPORTED
+
+#define VADD(a,b)  _mm256_add_ps(a, b)
+#define VSUB(a,b)  _mm256_sub_ps(a, b)
+#define VMUL(a,c)  _mm256_mul_ps(a, _mm256_set1_ps(c))
+
+AVX2_TARGET GLOBAL(void)
+jpeg_fdct_float_avx2 (FAST_FLOAT * data)
+{
+  __m256 v[DCTSIZE];
+  int ctr;
+
+  /* Pass 1: process rows. */
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = _mm256_loadu_ps(data + ctr*DCTSIZE);
+  transpose8_ps_avx2(v);
+  AAN_FDCT_1D(__m256, v, FLOAT_CONSTANTS);
+  transpose8_ps_avx2(v);
+
+  /* Pass 2: process columns. */
+  AAN_FDCT_1D(__m256, v, FLOAT_CONSTANTS);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    _mm256_storeu_ps(data + ctr*DCTSIZE, v[ctr]);
+}
+
+#undef VADD
+#undef VSUB
+#undef VMUL
+
+#endif /* DCT_FLOAT_SUPPORTED */
+
+
+/* The AVX2 quantizers work on a row of eight coefficients at a time; the
+ * 32->16 bit pack works within 128-bit halves, hence the final permute.
+ */
+
+AVX2_TARGET static __inline__ __m256i
+quantize8_avx2 (__m256i coef, DCTELEM * reciprocals)
+{
+  __m256i recip = LOAD_EPI32_AVX2(reciprocals);
+  __m256i sign = _mm256_srai_epi32(coef, 31);
+  __m256i even, odd;
+
+  coef = _mm256_add_epi32(_mm256_sub_epi32(_mm256_xor_si256(coef, sign),
+					   sign),
+			  LOAD_EPI32_AVX2(reciprocals + DCTSIZE2));
+  even = _mm256_srli_epi64(_mm256_mul_epu32(coef, recip), RECIP_BITS);
+  odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(coef, 32),
+					   _mm256_srli_epi64(recip, 32)),
+			  RECIP_BITS);
+  coef = _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+  return _mm256_sub_epi32(_mm256_xor_si256(coef, sign), sign);
+}
+
+AVX2_TARGET static __inline__ void
+store_coefs_avx2 (JCOEFPTR outptr, __m256i first, __m256i second)
+{
+  _mm256_storeu_si256((__m256i *) outptr,
+		      _mm256_permute4x64_epi64(_mm256_packs_epi32(first, second),
+					       0xD8));
+}
+
+AVX2_TARGET GLOBAL(void)
+jsimd_quantize_avx2 (JCOEFPTR coef_block, DCTELEM * reciprocals,
+		     DCTELEM * workspace)
+{
+  int i;
+
+  for (i = 0; i < DCTSIZE2; i += 16) {
+    store_coefs_avx2(coef_block + i,
+		     quantize8_avx2(LOAD_EPI32_AVX2(workspace + i),
+				    reciprocals + i),
+		     quantize8_avx2(LOAD_EPI32_AVX2(workspace + i + 8),
+				    reciprocals + i + 8));
+  }
+}
+
+#ifdef DCT_FLOAT_SUPPORTED
+
+AVX2_TARGET static __inline__ __m256i
+quantize8_float_avx2 (FAST_FLOAT * workspace, FAST_FLOAT * divisors)
+{
+  __m256 temp = _mm256_mul_ps(_mm256_loadu_ps(workspace),
+			      _mm256_loadu_ps(divisors));
+
+  return _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(temp,
+					_mm256_set1_ps(16384.5f))),
+			  _mm256_set1_epi32(16384));
+}
+
+AVX2_TARGET GLOBAL(void)
+jsimd_quantize_float_avx2 (JCOEFPTR coef_block, FAST_FLOAT * divisors,
+			   FAST_FLOAT * workspace)
+{
+  int i;
+
+  for (i = 0; i < DCTSIZE2; i += 16) {
+    store_coefs_avx2(coef_block + i,
+		     quantize8_float_avx2(workspace + i, divisors + i),
+		     quantize8_float_avx2(workspace + i + 8, divisors + i + 8));
+  }
+}
+
+#endif /* DCT_FLOAT_SUPPORTED */
+
+#endif /* JSIMD_X86 */
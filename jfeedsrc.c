@@ -0,0 +1,240 @@
+/*
+ * jfeedsrc.c
+ *
+ * Based on jdatasrc.c, Copyright (C) 1994-1996, Thomas G. Lane.
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains a suspending, push-style data source manager for
+ * compressed data that arrives in pieces, e.g. from a socket.  The
+ * application hands each piece to jpeg_feed_bytes as it lands and then
+ * calls the library again; when the decompressor runs out of data it
+ * suspends (see "I/O suspension" in libjpeg.doc) and picks up from its
+ * restart point after the next piece.  jpeg_feed_end says no more is
+ * coming, after which a truncated image ends with a fake EOI, as with
+ * jdatasrc.c.
+ */
+
+/* this is not a core library module, so it doesn't define JPEG_INTERNALS */
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jerror.h"
+
+
+/* Expanded data source object for pushed input */
+
+typedef struct {
+  struct jpeg_source_mgr pub;	/* public fields */
+
+  JOCTET * buffer;		/* start of buffer */
+  size_t buffer_size;		/* allocated size of buffer */
+  long skip_bytes;		/* bytes still to skip from data not yet fed */
+  boolean end_of_data;		/* has jpeg_feed_end been called? */
+  boolean start_of_file;	/* have we gotten any data yet? */
+} my_source_mgr;
+
+typedef my_source_mgr * my_src_ptr;
+
+#define INPUT_BUF_SIZE  4096	/* initial buffer size */
+
+
+/*
+ * Initialize source --- called by jpeg_read_header
+ * before any data is actually read.
+ */
+
+METHODDEF(void)
+init_source (j_decompress_ptr cinfo)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+
+  /* Data fed for this image may already be waiting in the buffer,
+   * possibly following the end of the previous image.
+   */
+  src->start_of_file = (src->pub.bytes_in_buffer == 0);
+}
+
+
+/*
+ * Fill the input buffer --- called whenever buffer is emptied.
+ *
+ * Everything fed so far is already in the buffer, so there is nothing to
+ * load here: we suspend, leaving next_input_byte & bytes_in_buffer at the
+ * decompressor's restart point for jpeg_feed_bytes to append to.  Once
+ * the end of the data has been signalled, we insert a fake EOI marker
+ * instead, or complain about an empty input file.
+ */
+
+METHODDEF(boolean)
+fill_input_buffer (j_decompress_ptr cinfo)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+  static const JOCTET fake_eoi[2] = { (JOCTET) 0xFF, (JOCTET) JPEG_EOI };
+
+  if (! src->end_of_data)
+    return FALSE;		/* suspend until more data is fed */
+
+  if (src->start_of_file)	/* Treat empty input file as fatal error */
+    ERREXIT(cinfo, JERR_INPUT_EMPTY);
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+  /* Insert a fake EOI marker */
+  src->pub.next_input_byte = fake_eoi;
+  src->pub.bytes_in_buffer = 2;
+
+  return TRUE;
+}
+
+
+/*
+ * Skip data --- used to skip over a potentially large amount of
+ * uninteresting data (such as an APPn marker).
+ *
+ * A skip past the data fed so far empties the buffer and leaves the rest
+ * to be dropped from the front of the following pieces; the fill call
+ * that comes next suspends.
+ */
+
+METHODDEF(void)
+skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+
+  if (num_bytes <= 0)
+    return;
+  if (num_bytes > (long) src->pub.bytes_in_buffer) {
+    src->skip_bytes += num_bytes - (long) src->pub.bytes_in_buffer;
+    num_bytes = (long) src->pub.bytes_in_buffer;
+  }
+  src->pub.next_input_byte += (size_t) num_bytes;
+  src->pub.bytes_in_buffer -= (size_t) num_bytes;
+}
+
+
+/*
+ * An additional method that can be provided by data source modules is the
+ * resync_to_restart method for error recovery in the presence of RST markers.
+ * For the moment, this source module just uses the default resync method
+ * provided by the JPEG library.
+ */
+
+
+/*
+ * Terminate source --- called by jpeg_finish_decompress
+ * after all data has been read.  Often a no-op.
+ */
+
+METHODDEF(void)
+term_source (j_decompress_ptr cinfo)
+{
+  /* no work necessary here */
+}
+
+
+/*
+ * Append a piece of compressed data.
+ * Call this only between library calls, typically after one of them has
+ * suspended.  The data is copied, so the caller may reuse its buffer.
+ * Unread data is moved to the front of the buffer first; the buffer grows
+ * when the unread data and the new piece do not fit.
+ */
+
+GLOBAL(void)
+jpeg_feed_bytes (j_decompress_ptr cinfo, const JOCTET * data, size_t size)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+  size_t unread, new_size;
+  boolean move;
+
+  if (src->skip_bytes > 0) {	/* finish a skip_input_data call */
+    if ((size_t) src->skip_bytes >= size) {
+      src->skip_bytes -= (long) size;
+      return;
+    }
+    data += src->skip_bytes;
+    size -= (size_t) src->skip_bytes;
+    src->skip_bytes = 0;
+  }
+  if (size == 0)
+    return;
+
+  unread = src->pub.bytes_in_buffer;
+  move = (unread == 0);
+  if (unread + size > src->buffer_size) {
+    /* The old buffer stays in the permanent pool; doubling bounds the waste */
+    new_size = src->buffer_size * 2;
+    if (new_size < unread + size)
+      new_size = unread + size;
+    src->buffer = (JOCTET *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  new_size * SIZEOF(JOCTET));
+    src->buffer_size = new_size;
+    move = TRUE;
+  } else if (src->pub.next_input_byte + unread + size >
+	     src->buffer + src->buffer_size)
+    move = TRUE;
+  if (move) {
+    /* Move the unread data down to the front of the buffer */
+    if (unread > 0)
+      memmove(src->buffer, src->pub.next_input_byte, unread);
+    src->pub.next_input_byte = src->buffer;
+  }
+  MEMCOPY((JOCTET *) src->pub.next_input_byte + unread, data, size);
+  src->pub.bytes_in_buffer = unread + size;
+  src->start_of_file = FALSE;
+}
+
+
+/*
+ * Signal that no more data will be fed.  A decompressor that then runs out
+ * of data gets a fake EOI marker rather than suspending.
+ */
+
+GLOBAL(void)
+jpeg_feed_end (j_decompress_ptr cinfo)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+
+  src->end_of_data = TRUE;
+}
+
+
+/*
+ * Prepare for pushed input.  Feed the data with jpeg_feed_bytes before and
+ * after library calls; every call that needs more data than was fed
+ * suspends.  Calling this again discards any data not yet read and starts
+ * a new stream.
+ */
+
+GLOBAL(void)
+jpeg_feed_src (j_decompress_ptr cinfo)
+{
+  my_src_ptr src;
+
+  /* The source object and input buffer are made permanent so that a series
+   * of JPEG images can be read from the same stream, as in jdatasrc.c.
+   * This makes it unsafe to use this manager and a different source
+   * manager serially with the same JPEG object.  Caveat programmer.
+   */
+  if (cinfo->src == NULL) {	/* first time for this JPEG object? */
+    cinfo->src = (struct jpeg_source_mgr *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  SIZEOF(my_source_mgr));
+    src = (my_src_ptr) cinfo->src;
+    src->buffer = (JOCTET *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  INPUT_BUF_SIZE * SIZEOF(JOCTET));
+    src->buffer_size = INPUT_BUF_SIZE;
+  }
+
+  src = (my_src_ptr) cinfo->src;
+  src->pub.init_source = init_source;
+  src->pub.fill_input_buffer = fill_input_buffer;
+  src->pub.skip_input_data = skip_input_data;
+  src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
+  src->pub.term_source = term_source;
+  src->skip_bytes = 0;
+  src->end_of_data = FALSE;
+  src->start_of_file = TRUE;
+  src->pub.bytes_in_buffer = 0; /* nothing fed yet */
+  src->pub.next_input_byte = NULL; /* until data is fed */
+}
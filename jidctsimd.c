@@ -0,0 +1,585 @@
+/*
+ * jidctsimd.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains SSE2 and AVX2 versions of the inverse DCTs in
+ * jidctint.c, jidctfst.c and jidctflt.c.  jddctmgr.c picks them at run
+ * time according to jsimd_cpu_features().
+ *
+ * Each version performs exactly the arithmetic of its scalar counterpart,
+ * only on several columns (pass 1) or rows (pass 2) at once, so the
+ * output is bit-identical for any valid coefficient data.  (The integer
+ * versions work in 32-bit lanes where the scalar code uses INT32; the two
+ * can only part ways on corrupt data whose products overflow 32 bits.
+ * The float version matches jidctflt.c as compiled for SSE math without
+ * fused multiply-add, the x86-64 default.)
+ *
+ * The column shortcut for all-zero AC terms and the zero-row test are
+ * left out: for those inputs the full computation yields the same values.
+ * The range-limit table lookup is replaced by the equivalent arithmetic:
+ * the table maps (x & RANGE_MASK), read as a signed 10-bit number, to
+ * that number plus CENTERJSAMPLE clamped to 0..MAXJSAMPLE.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#include <immintrin.h>
+
+#define SSE2_TARGET  __attribute__((target("sse2")))
+#define AVX2_TARGET  __attribute__((target("avx2")))
+
+/* Shift that turns x into (x & RANGE_MASK) sign-extended from 10 bits */
+#define RANGE_SHIFT  (32 - 10)
+
+/* Output row addressing: jidctint.c and jidctflt.c place rows
+ * row_buffer_size apart from the first one, jidctfst.c follows output_buf.
+ */
+#define PITCHED_OUTROW(ctr)  \
+  ((*output_buf) + (ctr) * compptr->row_buffer_size + output_col)
+#define INDEXED_OUTROW(ctr)  (output_buf[ctr] + output_col)
+
+
+/*
+ * The 1-D transforms, written once over the vector operations
+ * VADD, VSUB, VMUL (by a constant), VSHL and VDESCALE (by a constant shift);
+ * each SIMD flavor defines those and then expands the bodies.
+ * v[0..7] are the eight inputs of the 1-D transform, replaced in place by
+ * its eight outputs.
+ */
+
+/* LL&M, as jidctint.c; outputs still scaled up by CONST_BITS */
+#define ISLOW_CONST_BITS  13
+#define ISLOW_PASS1_BITS  2
+
+#define ISLOW_FIX_0_298631336  ((INT32)  2446)
+#define ISLOW_FIX_0_390180644  ((INT32)  3196)
+#define ISLOW_FIX_0_541196100  ((INT32)  4433)
+#define ISLOW_FIX_0_765366865  ((INT32)  6270)
+#define ISLOW_FIX_0_899976223  ((INT32)  7373)
+#define ISLOW_FIX_1_175875602  ((INT32)  9633)
+#define ISLOW_FIX_1_501321110  ((INT32)  12299)
+#define ISLOW_FIX_1_847759065  ((INT32)  15137)
+#define ISLOW_FIX_1_961570560  ((INT32)  16069)
+#define ISLOW_FIX_2_053119869  ((INT32)  16819)
+#define ISLOW_FIX_2_562915447  ((INT32)  20995)
+#define ISLOW_FIX_3_072711026  ((INT32)  25172)
+
+#define ISLOW_1D(VEC, v) { \
+  VEC z1, z2, z3, z4, z5; \
+  VEC tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13; \
+  z1 = VMUL(VADD(v[2], v[6]), ISLOW_FIX_0_541196100); \
+  tmp2 = VADD(z1, VMUL(v[6], - ISLOW_FIX_1_847759065)); \
+  tmp3 = VADD(z1, VMUL(v[2], ISLOW_FIX_0_765366865)); \
+  tmp0 = VSHL(VADD(v[0], v[4]), ISLOW_CONST_BITS); \
+  tmp1 = VSHL(VSUB(v[0], v[4]), ISLOW_CONST_BITS); \
+  tmp10 = VADD(tmp0, tmp3); \
+  tmp13 = VSUB(tmp0, tmp3); \
+  tmp11 = VADD(tmp1, tmp2); \
+  tmp12 = VSUB(tmp1, tmp2); \
+  z1 = VADD(v[7], v[1]); \
+  z2 = VADD(v[5], v[3]); \
+  z3 = VADD(v[7], v[3]); \
+  z4 = VADD(v[5], v[1]); \
+  z5 = VMUL(VADD(z3, z4), ISLOW_FIX_1_175875602); \
+  tmp0 = VMUL(v[7], ISLOW_FIX_0_298631336); \
+  tmp1 = VMUL(v[5], ISLOW_FIX_2_053119869); \
+  tmp2 = VMUL(v[3], ISLOW_FIX_3_072711026); \
+  tmp3 = VMUL(v[1], ISLOW_FIX_1_501321110); \
+  z1 = VMUL(z1, - ISLOW_FIX_0_899976223); \
+  z2 = VMUL(z2, - ISLOW_FIX_2_562915447); \
+  z3 = VADD(VMUL(z3, - ISLOW_FIX_1_961570560), z5); \
+  z4 = VADD(VMUL(z4, - ISLOW_FIX_0_390180644), z5); \
+  tmp0 = VADD(tmp0, VADD(z1, z3)); \
+  tmp1 = VADD(tmp1, VADD(z2, z4)); \
+  tmp2 = VADD(tmp2, VADD(z2, z3)); \
+  tmp3 = VADD(tmp3, VADD(z1, z4)); \
+  v[0] = VADD(tmp10, tmp3); \
+  v[7] = VSUB(tmp10, tmp3); \
+  v[1] = VADD(tmp11, tmp2); \
+  v[6] = VSUB(tmp11, tmp2); \
+  v[2] = VADD(tmp12, tmp1); \
+  v[5] = VSUB(tmp12, tmp1); \
+  v[3] = VADD(tmp13, tmp0); \
+  v[4] = VSUB(tmp13, tmp0); \
+}
+
+/* AA&N, as jidctfst.c and jidctflt.c.  For the integer version VMUL
+ * includes the descaling of the product by CONST_BITS.  CONSTANTS is one
+ * of the lists below, expanded into the four multipliers.
+ */
+#define IFAST_CONST_BITS  8
+#define IFAST_PASS1_BITS  2
+
+#define IFAST_FIX_1_082392200  ((INT32)  277)
+#define IFAST_FIX_1_414213562  ((INT32)  362)
+#define IFAST_FIX_1_847759065  ((INT32)  473)
+#define IFAST_FIX_2_613125930  ((INT32)  669)
+
+#define AAN_1D(VEC, v, CONSTANTS)  AAN_1D_BODY(VEC, v, CONSTANTS)
+#define AAN_1D_BODY(VEC, v, C1_414, C1_847, C1_082, CM2_613) { \
+  VEC tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7; \
+  VEC tmp10, tmp11, tmp12, tmp13, z5, z10, z11, z12, z13; \
+  tmp10 = VADD(v[0], v[4]); \
+  tmp11 = VSUB(v[0], v[4]); \
+  tmp13 = VADD(v[2], v[6]); \
+  tmp12 = VSUB(VMUL(VSUB(v[2], v[6]), C1_414), tmp13); \
+  tmp0 = VADD(tmp10, tmp13); \
+  tmp3 = VSUB(tmp10, tmp13); \
+  tmp1 = VADD(tmp11, tmp12); \
+  tmp2 = VSUB(tmp11, tmp12); \
+  z13 = VADD(v[5], v[3]); \
+  z10 = VSUB(v[5], v[3]); \
+  z11 = VADD(v[1], v[7]); \
+  z12 = VSUB(v[1], v[7]); \
+  tmp7 = VADD(z11, z13); \
+  tmp11 = VMUL(VSUB(z11, z13), C1_414); \
+  z5 = VMUL(VADD(z10, z12), C1_847); \
+  tmp10 = VSUB(VMUL(z12, C1_082), z5); \
+  tmp12 = VADD(VMUL(z10, CM2_613), z5); \
+  tmp6 = VSUB(tmp12, tmp7); \
+  tmp5 = VSUB(tmp11, tmp6); \
+  tmp4 = VADD(tmp10, tmp5); \
+  v[0] = VADD(tmp0, tmp7); \
+  v[7] = VSUB(tmp0, tmp7); \
+  v[1] = VADD(tmp1, tmp6); \
+  v[6] = VSUB(tmp1, tmp6); \
+  v[2] = VADD(tmp2, tmp5); \
+  v[5] = VSUB(tmp2, tmp5); \
+  v[4] = VADD(tmp3, tmp4); \
+  v[3] = VSUB(tmp3, tmp4); \
+}
+
+#define IFAST_CONSTANTS \
+  IFAST_FIX_1_414213562, IFAST_FIX_1_847759065, \
+  IFAST_FIX_1_082392200, - IFAST_FIX_2_613125930
+
+/* Float constants in the form jidctflt.c writes them (see there) */
+#define FLOAT_CONSTANTS \
+  ((FAST_FLOAT) 1.414213562), ((FAST_FLOAT) 1.847759065), \
+  ((FAST_FLOAT) 1.082392200), ((FAST_FLOAT) -2.613125930)
+
+
+/*
+ * SSE2 versions.  A vector holds four 32-bit lanes, so each pass runs
+ * twice: pass 1 over columns 0-3 and 4-7, pass 2 over rows 0-3 and 4-7.
+ */
+
+/* SSE2 has no 32x32->32 multiply; build it from the 32x32->64 one */
+SSE2_TARGET static __inline__ __m128i
+mullo_sse2 (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+			    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+SSE2_TARGET static __inline__ void
+transpose4_sse2 (__m128i * r)
+{
+  __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+  __m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+  __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+  __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+
+  r[0] = _mm_unpacklo_epi64(t0, t1);
+  r[1] = _mm_unpackhi_epi64(t0, t1);
+  r[2] = _mm_unpacklo_epi64(t2, t3);
+  r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+/* Four coefficients of a row, widened to 32 bits and dequantized */
+SSE2_TARGET static __inline__ __m128i
+dequantize_sse2 (JCOEFPTR inptr, MULTIPLIER * quantptr)
+{
+  __m128i coef = _mm_loadl_epi64((const __m128i *) inptr);
+
+  coef = _mm_srai_epi32(_mm_unpacklo_epi16(coef, coef), 16);
+  return mullo_sse2(coef, _mm_loadu_si128((const __m128i *) quantptr));
+}
+
+/* Range-limit two vectors holding one output row and store it */
+SSE2_TARGET static __inline__ void
+store_row_sse2 (JSAMPROW outptr, __m128i left, __m128i right)
+{
+  __m128i center = _mm_set1_epi32(CENTERJSAMPLE);
+  __m128i row;
+
+  left = _mm_srai_epi32(_mm_slli_epi32(left, RANGE_SHIFT), RANGE_SHIFT);
+  right = _mm_srai_epi32(_mm_slli_epi32(right, RANGE_SHIFT), RANGE_SHIFT);
+  row = _mm_packs_epi32(_mm_add_epi32(left, center),
+			_mm_add_epi32(right, center));
+  _mm_storel_epi64((__m128i *) outptr, _mm_packus_epi16(row, row));
+}
+
+/* Pass 2 for rows 4*half..4*half+3: the 4x4 quarters of the workspace
+ * are transposed so lanes are rows, transformed, and transposed back.
+ * ws_left/ws_right hold columns 0-3/4-7 of every workspace row.
+ */
+#define PASS2_SSE2(TRANSFORM, DESCALE_OUT, outrow) { \
+  for (half = 0; half < 2; half++) { \
+    for (ctr = 0; ctr < 4; ctr++) { \
+      v[ctr] = ws_left[half*4 + ctr]; \
+      v[ctr+4] = ws_right[half*4 + ctr]; \
+    } \
+    transpose4_sse2(v); \
+    transpose4_sse2(v + 4); \
+    TRANSFORM; \
+    for (ctr = 0; ctr < DCTSIZE; ctr++) \
+      v[ctr] = DESCALE_OUT(v[ctr]); \
+    transpose4_sse2(v); \
+    transpose4_sse2(v + 4); \
+    for (ctr = 0; ctr < 4; ctr++) \
+      store_row_sse2(outrow(half*4 + ctr), v[ctr], v[ctr+4]); \
+  } \
+}
+
+#define VADD(a,b)  _mm_add_epi32(a, b)
+#define VSUB(a,b)  _mm_sub_epi32(a, b)
+#define VSHL(a,n)  _mm_slli_epi32(a, n)
+
+
+#ifdef DCT_ISLOW_SUPPORTED
+
+#define VMUL(a,c)  mullo_sse2(a, _mm_set1_epi32((int) (c)))
+#define ISLOW_PASS1_OUT(a)  _mm_srai_epi32(_mm_add_epi32(a, \
+  _mm_set1_epi32(1 << (ISLOW_CONST_BITS-ISLOW_PASS1_BITS-1))), \
+  ISLOW_CONST_BITS-ISLOW_PASS1_BITS)
+#define ISLOW_PASS2_OUT(a)  _mm_srai_epi32(_mm_add_epi32(a, \
+  _mm_set1_epi32(1 << (ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3-1))), \
+  ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3)
+
+SSE2_TARGET GLOBAL(void)
+jpeg_idct_islow_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  __m128i v[DCTSIZE], ws_left[DCTSIZE], ws_right[DCTSIZE];
+  int half, ctr;
+
+  /* Pass 1: process columns from input, lanes are columns. */
+  for (half = 0; half < 2; half++) {
+    for (ctr = 0; ctr < DCTSIZE; ctr++)
+      v[ctr] = dequantize_sse2(coef_block + ctr*DCTSIZE + half*4,
+			       quantptr + ctr*DCTSIZE + half*4);
+    ISLOW_1D(__m128i, v);
+    for (ctr = 0; ctr < DCTSIZE; ctr++)
+      (half ? ws_right : ws_left)[ctr] = ISLOW_PASS1_OUT(v[ctr]);
+  }
+
+  /* Pass 2: process rows from work array, store into output array. */
+  PASS2_SSE2(ISLOW_1D(__m128i, v), ISLOW_PASS2_OUT, PITCHED_OUTROW);
+}
+
+#undef VMUL
+
+#endif /* DCT_ISLOW_SUPPORTED */
+
+
+#ifdef DCT_IFAST_SUPPORTED
+
+#define VMUL(a,c)  _mm_srai_epi32(mullo_sse2(a, _mm_set1_epi32((int) (c))), \
+				  IFAST_CONST_BITS)
+#define IFAST_PASS2_OUT(a)  _mm_srai_epi32(a, IFAST_PASS1_BITS+3)
+
+SSE2_TARGET GLOBAL(void)
+jpeg_idct_ifast_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  IFAST_MULT_TYPE * quantptr = (IFAST_MULT_TYPE *) compptr->dct_table;
+  __m128i v[DCTSIZE], ws_left[DCTSIZE], ws_right[DCTSIZE];
+  int half, ctr;
+
+  /* Pass 1: process columns from input, lanes are columns. */
+  for (half = 0; half < 2; half++) {
+    for (ctr = 0; ctr < DCTSIZE; ctr++)
+      v[ctr] = dequantize_sse2(coef_block + ctr*DCTSIZE + half*4,
+			       quantptr + ctr*DCTSIZE + half*4);
+    AAN_1D(__m128i, v, IFAST_CONSTANTS);
+    for (ctr = 0; ctr < DCTSIZE; ctr++)
+      (half ? ws_right : ws_left)[ctr] = v[ctr];
+  }
+
+  /* Pass 2: process rows from work array, store into output array. */
+  PASS2_SSE2(AAN_1D(__m128i, v, IFAST_CONSTANTS), IFAST_PASS2_OUT,
+	     INDEXED_OUTROW);
+}
+
+#undef VMUL
+
+#endif /* DCT_IFAST_SUPPORTED */
+
+#undef VADD
+#undef VSUB
+#undef VSHL
+
+
+#ifdef DCT_FLOAT_SUPPORTED
+
+#define VADD(a,b)  _mm_add_ps(a, b)
+#define VSUB(a,b)  _mm_sub_ps(a, b)
+#define VMUL(a,c)  _mm_mul_ps(a, _mm_set1_ps(c))
+
+SSE2_TARGET GLOBAL(void)
+jpeg_idct_float_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  FLOAT_MULT_TYPE * quantptr = (FLOAT_MULT_TYPE *) compptr->dct_table;
+  __m128 v[DCTSIZE], ws_left[DCTSIZE], ws_right[DCTSIZE];
+  __m128i left, right, coef;
+  int half, ctr;
+
+  /* Pass 1: process columns from input, lanes are columns. */
+  for (half = 0; half < 2; half++) {
+    for (ctr = 0; ctr < DCTSIZE; ctr++) {
+      coef = _mm_loadl_epi64((const __m128i *)
+			     (coef_block + ctr*DCTSIZE + half*4));
+      coef = _mm_srai_epi32(_mm_unpacklo_epi16(coef, coef), 16);
+      v[ctr] = _mm_mul_ps(_mm_cvtepi32_ps(coef),
+			  _mm_loadu_ps(quantptr + ctr*DCTSIZE + half*4));
+    }
+    AAN_1D(__m128, v, FLOAT_CONSTANTS);
+    for (ctr = 0; ctr < DCTSIZE; ctr++)
+      (half ? ws_right : ws_left)[ctr] = v[ctr];
+  }
+
+  /* Pass 2: process rows from work array, store into output array.
+   * Results are truncated to integers, then descaled by 8 with rounding.
+   */
+  for (half = 0; half < 2; half++) {
+    for (ctr = 0; ctr < 4; ctr++) {
+      v[ctr] = ws_left[half*4 + ctr];
+      v[ctr+4] = ws_right[half*4 + ctr];
+    }
+    _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+    _MM_TRANSPOSE4_PS(v[4], v[5], v[6], v[7]);
+    AAN_1D(__m128, v, FLOAT_CONSTANTS);
+    _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+    _MM_TRANSPOSE4_PS(v[4], v[5], v[6], v[7]);
+    for (ctr = 0; ctr < 4; ctr++) {
+      left = _mm_srai_epi32(_mm_add_epi32(_mm_cvttps_epi32(v[ctr]),
+					  _mm_set1_epi32(4)), 3);
+      right = _mm_srai_epi32(_mm_add_epi32(_mm_cvttps_epi32(v[ctr+4]),
+					   _mm_set1_epi32(4)), 3);
+      store_row_sse2(PITCHED_OUTROW(half*4 + ctr), left, right);
+    }
+  }
+}
+
+#undef VADD
+#undef VSUB
+#undef VMUL
+
+#endif /* DCT_FLOAT_SUPPORTED */
+
+
+/*
+ * AVX2 versions.  A vector holds a whole row (pass 1) or, after an 8x8
+ * transpose, a whole column (pass 2).
+ */
+
+AVX2_TARGET static __inline__ void
+transpose8_avx2 (__m256i * r)
+{
+  __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+  __m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+  t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+  t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+  t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+  t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+  t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+  u0 = _mm256_unpacklo_epi64(t0, t2);
+  u1 = _mm256_unpackhi_epi64(t0, t2);
+  u2 = _mm256_unpacklo_epi64(t1, t3);
+  u3 = _mm256_unpackhi_epi64(t1, t3);
+  u4 = _mm256_unpacklo_epi64(t4, t6);
+  u5 = _mm256_unpackhi_epi64(t4, t6);
+  u6 = _mm256_unpacklo_epi64(t5, t7);
+  u7 = _mm256_unpackhi_epi64(t5, t7);
+  r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+AVX2_TARGET static __inline__ void
+transpose8_ps_avx2 (__m256 * r)
+{
+  __m256i t[DCTSIZE];
+  int i;
+
+  for (i = 0; i < DCTSIZE; i++)
+    t[i] = _mm256_castps_si256(r[i]);
+  transpose8_avx2(t);
+  for (i = 0; i < DCTSIZE; i++)
+    r[i] = _mm256_castsi256_ps(t[i]);
+}
+
+/* One row of coefficients, widened to 32 bits */
+AVX2_TARGET static __inline__ __m256i
+load_row_avx2 (JCOEFPTR inptr)
+{
+  return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) inptr));
+}
+
+/* Range-limit a vector holding one output row and store it */
+AVX2_TARGET static __inline__ void
+store_row_avx2 (JSAMPROW outptr, __m256i row)
+{
+  __m128i packed;
+
+  row = _mm256_srai_epi32(_mm256_slli_epi32(row, RANGE_SHIFT), RANGE_SHIFT);
+  row = _mm256_add_epi32(row, _mm256_set1_epi32(CENTERJSAMPLE));
+  packed = _mm_packs_epi32(_mm256_castsi256_si128(row),
+			   _mm256_extracti128_si256(row, 1));
+  _mm_storel_epi64((__m128i *) outptr, _mm_packus_epi16(packed, packed));
+}
+
+#define VADD(a,b)  _mm256_add_epi32(a, b)
+#define VSUB(a,b)  _mm256_sub_epi32(a, b)
+#define VSHL(a,n)  _mm256_slli_epi32(a, n)
+
+
+#ifdef DCT_ISLOW_SUPPORTED
+
+#define VMUL(a,c)  _mm256_mullo_epi32(a, _mm256_set1_epi32((int) (c)))
+
+AVX2_TARGET GLOBAL(void)
+jpeg_idct_islow_avx2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  __m256i v[DCTSIZE];
+  int ctr;
+
+  /* Pass 1: process columns from input, lanes are columns. */
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = _mm256_mullo_epi32(load_row_avx2(coef_block + ctr*DCTSIZE),
+	_mm256_loadu_si256((const __m256i *) (quantptr + ctr*DCTSIZE)));
+  ISLOW_1D(__m256i, v);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = _mm256_srai_epi32(_mm256_add_epi32(v[ctr],
+	_mm256_set1_epi32(1 << (ISLOW_CONST_BITS-ISLOW_PASS1_BITS-1))),
+	ISLOW_CONST_BITS-ISLOW_PASS1_BITS);
+
+  /* Pass 2: process rows from work array, store into output array. */
+  transpose8_avx2(v);
+  ISLOW_1D(__m256i, v);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = _mm256_srai_epi32(_mm256_add_epi32(v[ctr],
+	_mm256_set1_epi32(1 << (ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3-1))),
+	ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3);
+  transpose8_avx2(v);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    store_row_avx2(PITCHED_OUTROW(ctr), v[ctr]);
+}
+
+#undef VMUL
+
+#endif /* DCT_ISLOW_SUPPORTED */
+
+
+#ifdef DCT_IFAST_SUPPORTED
+
+#define VMUL(a,c)  _mm256_srai_epi32(_mm256_mullo_epi32(a, \
+		     _mm256_set1_epi32((int) (c))), IFAST_CONST_BITS)
+
+AVX2_TARGET GLOBAL(void)
+jpeg_idct_ifast_avx2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  IFAST_MULT_TYPE * quantptr = (IFAST_MULT_TYPE *) compptr->dct_table;
+  __m256i v[DCTSIZE];
+  int ctr;
+
+  /* Pass 1: process columns from input, lanes are columns. */
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = _mm256_mullo_epi32(load_row_avx2(coef_block + ctr*DCTSIZE),
+	_mm256_loadu_si256((const __m256i *) (quantptr + ctr*DCTSIZE)));
+  AAN_1D(__m256i, v, IFAST_CONSTANTS);
+
+  /* Pass 2: process rows from work array, store into output array. */
+  transpose8_avx2(v);
+  AAN_1D(__m256i, v, IFAST_CONSTANTS);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = _mm256_srai_epi32(v[ctr], IFAST_PASS1_BITS+3);
+  transpose8_avx2(v);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    store_row_avx2(INDEXED_OUTROW(ctr), v[ctr]);
+}
+
+#undef VMUL
+
+#endif /* DCT_IFAST_SUPPORTED */
+
+#undef VADD
+#undef VSUB
+#undef VSHL
+
+
+#ifdef DCT_FLOAT_SUPPORTED
+
+#define VADD(a,b)  _mm256_add_ps(a, b)
+#define VSUB(a,b)  _mm256_sub_ps(a, b)
+#define VMUL(a,c)  _mm256_mul_ps(a, _mm256_set1_ps(c))
+
+AVX2_TARGET GLOBAL(void)
+jpeg_idct_float_avx2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  FLOAT_MULT_TYPE * quantptr = (FLOAT_MULT_TYPE *) compptr->dct_table;
+  __m256 v[DCTSIZE];
+  __m256i out[DCTSIZE];
+  int ctr;
+
+  /* Pass 1: process columns from input, lanes are columns. */
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    v[ctr] = _mm256_mul_ps(
+	_mm256_cvtepi32_ps(load_row_avx2(coef_block + ctr*DCTSIZE)),
+	_mm256_loadu_ps(quantptr + ctr*DCTSIZE));
+  AAN_1D(__m256, v, FLOAT_CONSTANTS);
+
+  /* Pass 2: process rows from work array, store into output array.
+   * Results are truncated to integers, then descaled by 8 with rounding.
+   */
+  transpose8_ps_avx2(v);
+  AAN_1D(__m256, v, FLOAT_CONSTANTS);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    out[ctr] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(v[ctr]),
+						  _mm256_set1_epi32(4)), 3);
+  transpose8_avx2(out);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    store_row_avx2(PITCHED_OUTROW(ctr), out[ctr]);
+}
+
+#undef VADD
+#undef VSUB
+#undef VMUL
+
+#endif /* DCT_FLOAT_SUPPORTED */
+
+#endif /* JSIMD_X86 */
@@ -0,0 +1,124 @@
+/*
+ * jmemhuge.c
+ *
+ * This file provides a huge-page allocator for the JPEG memory manager
+ * (see struct jpeg_allocator in jpeglib.h).  Large objects of at least the
+ * threshold size, in practice the whole-image coefficient and sample
+ * buffers, are mapped straight from the kernel: on reserved huge pages
+ * (MAP_HUGETLB) when there are any, else on ordinary pages aligned to a
+ * huge page and marked for transparent huge pages (MADV_HUGEPAGE).
+ * Everything else goes to jpeg_get_small/jpeg_get_large as usual.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jmemsys.h"		/* import the system-dependent declarations */
+#include <sys/mman.h>
+
+#ifndef HUGE_PAGE_SIZE		/* so can override from jconfig.h */
+#define HUGE_PAGE_SIZE  ((size_t) 2 << 20) /* 2MB, as on x86-64 */
+#endif
+
+
+/* Size of the mapping for an object: whole huge pages */
+
+LOCAL(size_t)
+mapped_size (size_t sizeofobject)
+{
+  return (sizeofobject + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+
+LOCAL(void *)
+map_huge (size_t size)
+{
+  char * raw;
+  char * aligned;
+  size_t head;
+
+#ifdef MAP_HUGETLB
+  raw = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (raw != (char *) MAP_FAILED)
+    return (void *) raw;
+#endif
+
+  /* No huge pages reserved: map one huge page more than needed and trim
+   * the mapping to a huge page boundary, so that the kernel can back it
+   * with transparent huge pages.
+   */
+  raw = (char *) mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == (char *) MAP_FAILED)
+    return NULL;
+  aligned = (char *) (((size_t) raw + HUGE_PAGE_SIZE - 1) &
+		      ~(HUGE_PAGE_SIZE - 1));
+  head = (size_t) (aligned - raw);
+  if (head > 0)
+    (void) munmap(raw, head);
+  (void) munmap(aligned + size, HUGE_PAGE_SIZE - head);
+#ifdef MADV_HUGEPAGE
+  (void) madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+  return (void *) aligned;
+}
+
+
+METHODDEF(void *)
+huge_get_small (j_common_ptr cinfo, struct jpeg_allocator * allocator,
+		size_t sizeofobject)
+{
+  return jpeg_get_small(cinfo, sizeofobject);
+}
+
+METHODDEF(void)
+huge_free_small (j_common_ptr cinfo, struct jpeg_allocator * allocator,
+		 void * object, size_t sizeofobject)
+{
+  jpeg_free_small(cinfo, object, sizeofobject);
+}
+
+
+METHODDEF(void FAR *)
+huge_get_large (j_common_ptr cinfo, struct jpeg_allocator * allocator,
+		size_t sizeofobject)
+{
+  struct jpeg_huge_allocator * alloc = (struct jpeg_huge_allocator *) allocator;
+
+  if (sizeofobject < alloc->threshold)
+    return jpeg_get_large(cinfo, sizeofobject);
+  return (void FAR *) map_huge(mapped_size(sizeofobject));
+}
+
+METHODDEF(void)
+huge_free_large (j_common_ptr cinfo, struct jpeg_allocator * allocator,
+		 void FAR * object, size_t sizeofobject)
+{
+  struct jpeg_huge_allocator * alloc = (struct jpeg_huge_allocator *) allocator;
+
+  if (sizeofobject < alloc->threshold)
+    jpeg_free_large(cinfo, object, sizeofobject);
+  else
+    (void) munmap((void *) object, mapped_size(sizeofobject));
+}
+
+
+/*
+ * Fill in the huge-page allocator's methods.  The structure belongs to the
+ * application, like the error manager given to jpeg_std_error, and must
+ * outlive every JPEG object it is installed in.  A threshold below
+ * HUGE_PAGE_SIZE maps even small buffers on a whole huge page.
+ */
+
+GLOBAL(struct jpeg_allocator *)
+jpeg_huge_allocator (struct jpeg_huge_allocator * alloc, size_t threshold)
+{
+  alloc->pub.get_small = huge_get_small;
+  alloc->pub.free_small = huge_free_small;
+  alloc->pub.get_large = huge_get_large;
+  alloc->pub.free_large = huge_free_large;
+  alloc->threshold = threshold;
+
+  return &alloc->pub;
+}
@@ -76,9 +76,10 @@ extern char * getenv JPP((const char * name));
 
 /*
  * We allocate objects from "pools", where each pool is gotten with a single
- * request to jpeg_get_small() or jpeg_get_large().  There is no per-object
- * overhead within a pool, except for alignment padding.  Each pool has a
- * header with a link to the next pool of the same class.
+ * request to jpeg_get_small() or jpeg_get_large(), or to the application's
+ * allocator.  There is no per-object overhead within a pool, except for
+ * alignment padding.  Each pool has a header with a link to the next pool
+ * of the same class.
  * Small and large pool headers are identical except that the latter's
  * link pointer must be FAR on 80x86 machines.
  * Notice that the "real" header fields are union'ed with a dummy ALIGN_TYPE
@@ -93,6 +94,7 @@ typedef union small_pool_struct {
     small_pool_ptr next;	/* next in list of pools */
     size_t bytes_used;		/* how many bytes already used within pool */
     size_t bytes_left;		/* bytes still available in this pool */
+    struct jpeg_allocator * allocator; /* what obtained the pool, or NULL */
   } hdr;
   ALIGN_TYPE dummy;		/* included in union to ensure alignment */
 } small_pool_hdr;
@@ -104,6 +106,7 @@ typedef union large_pool_struct {
     large_pool_ptr next;	/* next in list of pools */
     size_t bytes_used;		/* how many bytes already used within pool */
     size_t bytes_left;		/* bytes still available in this pool */
+    struct jpeg_allocator * allocator; /* what obtained the pool, or NULL */
   } hdr;
   ALIGN_TYPE dummy;		/* included in union to ensure alignment */
 } large_pool_hdr;
@@ -128,8 +131,16 @@ typedef struct {
   jvirt_sarray_ptr virt_sarray_list;
   jvirt_barray_ptr virt_barray_list;
 
-  /* This counts total space obtained from jpeg_get_small/large */
-  long total_space_allocated;
+  /* The space obtained from jpeg_get_small/large is counted in
+   * pub.host_space_allocated, OpenCL buffers in pub.device_space_allocated.
+   */
+
+  /* IMAGE pools kept by free_pool for the next image, emptied, and the
+   * space they take (not counted in host_space_allocated).
+   */
+  small_pool_ptr small_retained;
+  large_pool_ptr large_retained;
+  long space_retained;
 
   /* alloc_sarray and alloc_barray set this value for use by virtual
    * array routines.
@@ -194,7 +205,7 @@ print_mem_stats (j_common_ptr cinfo, int pool_id)
    * This is helpful because message parm array can't handle longs.
    */
   fprintf(stderr, "Freeing pool %d, total space = %ld\n",
-	  pool_id, mem->total_space_allocated);
+	  pool_id, mem->pub.host_space_allocated);
 
   for (lhdr_ptr = mem->large_list[pool_id]; lhdr_ptr != NULL;
        lhdr_ptr = lhdr_ptr->hdr.next) {
@@ -253,6 +264,202 @@ static const size_t extra_pool_slop[JPOOL_NUMPOOLS] =
 #define MIN_SLOP  50		/* greater than 0 to avoid futile looping */
 
 
+/*
+ * Pools are obtained from the application's allocator when it has
+ * installed one, and always released through the one that obtained them.
+ */
+
+LOCAL(small_pool_ptr)
+get_small_pool (j_common_ptr cinfo, size_t sizeofpool)
+{
+  struct jpeg_allocator * allocator = cinfo->mem->allocator;
+  small_pool_ptr hdr_ptr;
+
+  if (allocator != NULL)
+    hdr_ptr = (small_pool_ptr)
+      (*allocator->get_small) (cinfo, allocator, sizeofpool);
+  else
+    hdr_ptr = (small_pool_ptr) jpeg_get_small(cinfo, sizeofpool);
+  if (hdr_ptr != NULL)
+    hdr_ptr->hdr.allocator = allocator;
+  return hdr_ptr;
+}
+
+LOCAL(void)
+free_small_pool (j_common_ptr cinfo, small_pool_ptr hdr_ptr, size_t sizeofpool)
+{
+  struct jpeg_allocator * allocator = hdr_ptr->hdr.allocator;
+
+  if (allocator != NULL)
+    (*allocator->free_small) (cinfo, allocator, (void *) hdr_ptr, sizeofpool);
+  else
+    jpeg_free_small(cinfo, (void *) hdr_ptr, sizeofpool);
+}
+
+LOCAL(large_pool_ptr)
+get_large_pool (j_common_ptr cinfo, size_t sizeofpool)
+{
+  struct jpeg_allocator * allocator = cinfo->mem->allocator;
+  large_pool_ptr hdr_ptr;
+
+  if (allocator != NULL)
+    hdr_ptr = (large_pool_ptr)
+      (*allocator->get_large) (cinfo, allocator, sizeofpool);
+  else
+    hdr_ptr = (large_pool_ptr) jpeg_get_large(cinfo, sizeofpool);
+  if (hdr_ptr != NULL)
+    hdr_ptr->hdr.allocator = allocator;
+  return hdr_ptr;
+}
+
+LOCAL(void)
+free_large_pool (j_common_ptr cinfo, large_pool_ptr hdr_ptr, size_t sizeofpool)
+{
+  struct jpeg_allocator * allocator = hdr_ptr->hdr.allocator;
+
+  if (allocator != NULL)
+    (*allocator->free_large) (cinfo, allocator, (void FAR *) hdr_ptr,
+			      sizeofpool);
+  else
+    jpeg_free_large(cinfo, (void FAR *) hdr_ptr, sizeofpool);
+}
+
+
+/*
+ * Accounting.  Pools and device buffers are counted as they come and go,
+ * with the peak of their sum.
+ */
+
+LOCAL(void)
+note_space (my_mem_ptr mem, long host_bytes, long device_bytes)
+{
+  long in_use;
+
+  mem->pub.host_space_allocated += host_bytes;
+  mem->pub.device_space_allocated += device_bytes;
+  in_use = mem->pub.host_space_allocated + mem->pub.device_space_allocated;
+  if (in_use > mem->pub.peak_space_allocated)
+    mem->pub.peak_space_allocated = in_use;
+}
+
+
+/*
+ * Reuse of pools kept from the last image.
+ * When max_memory_to_retain allows, free_pool keeps the IMAGE pools it
+ * releases instead of handing them back to the system, so that a program
+ * decoding a run of similar images on one object stops going to malloc for
+ * each of them.  A kept pool is emptied; all its space is in bytes_left.
+ * Large requests take the smallest kept pool that fits, small ones the
+ * first.  Pools the next image does not reuse are released when it ends.
+ */
+
+LOCAL(small_pool_ptr)
+reuse_small_pool (my_mem_ptr mem, size_t sizeofobject)
+/* Take a kept pool with room for the object off the list, or NULL */
+{
+  small_pool_ptr hdr_ptr, * link_ptr;
+  size_t space;
+
+  for (link_ptr = &mem->small_retained; (hdr_ptr = *link_ptr) != NULL;
+       link_ptr = &hdr_ptr->hdr.next) {
+    if (hdr_ptr->hdr.bytes_left >= sizeofobject) {
+      *link_ptr = hdr_ptr->hdr.next;
+      space = hdr_ptr->hdr.bytes_left + SIZEOF(small_pool_hdr);
+      mem->space_retained -= space;
+      note_space(mem, (long) space, 0L);
+      return hdr_ptr;
+    }
+  }
+  return NULL;
+}
+
+
+LOCAL(large_pool_ptr)
+reuse_large_pool (my_mem_ptr mem, size_t sizeofobject)
+/* Take the smallest kept pool that fits the object off the list, or NULL */
+{
+  large_pool_ptr hdr_ptr;
+  large_pool_ptr FAR * link_ptr;
+  large_pool_ptr FAR * best_ptr;
+  size_t space;
+
+  best_ptr = NULL;
+  for (link_ptr = &mem->large_retained; (hdr_ptr = *link_ptr) != NULL;
+       link_ptr = &hdr_ptr->hdr.next) {
+    if (hdr_ptr->hdr.bytes_left >= sizeofobject &&
+	(best_ptr == NULL ||
+	 hdr_ptr->hdr.bytes_left < (*best_ptr)->hdr.bytes_left))
+      best_ptr = link_ptr;
+  }
+  if (best_ptr == NULL)
+    return NULL;
+  hdr_ptr = *best_ptr;
+  *best_ptr = hdr_ptr->hdr.next;
+  space = hdr_ptr->hdr.bytes_left + SIZEOF(large_pool_hdr);
+  mem->space_retained -= space;
+  note_space(mem, (long) space, 0L);
+  return hdr_ptr;
+}
+
+
+LOCAL(void)
+release_retained (j_common_ptr cinfo)
+/* Hand all kept pools back to the system */
+{
+  my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
+  small_pool_ptr shdr_ptr;
+  large_pool_ptr lhdr_ptr;
+
+  while ((lhdr_ptr = mem->large_retained) != NULL) {
+    mem->large_retained = lhdr_ptr->hdr.next;
+    free_large_pool(cinfo, lhdr_ptr,
+		    lhdr_ptr->hdr.bytes_left + SIZEOF(large_pool_hdr));
+  }
+  while ((shdr_ptr = mem->small_retained) != NULL) {
+    mem->small_retained = shdr_ptr->hdr.next;
+    free_small_pool(cinfo, shdr_ptr,
+		    shdr_ptr->hdr.bytes_left + SIZEOF(small_pool_hdr));
+  }
+  mem->space_retained = 0;
+}
+
+
+/*
+ * Check a request for new space against memory_budget, which also covers
+ * the kept pools; they are given up first if that makes room.  Returns how
+ * much more could be had after this request.
+ */
+
+LOCAL(size_t)
+check_budget (j_common_ptr cinfo, size_t sizeofobject)
+{
+  my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
+  long room;
+
+  if (mem->pub.memory_budget <= 0)
+    return (size_t) MAX_ALLOC_CHUNK;
+  room = mem->pub.memory_budget - mem->pub.host_space_allocated -
+	 mem->pub.device_space_allocated - mem->space_retained;
+  if (room < (long) sizeofobject && mem->space_retained > 0) {
+    room += mem->space_retained;
+    release_retained(cinfo);
+  }
+  if (room < (long) sizeofobject)
+    ERREXIT(cinfo, JERR_MEMORY_BUDGET);
+  return (size_t) (room - (long) sizeofobject);
+}
+
+
+METHODDEF(void)
+account_device_space (j_common_ptr cinfo, long bytes)
+/* Count an OpenCL buffer created or released for this object */
+{
+  if (bytes > 0)
+    (void) check_budget(cinfo, (size_t) bytes);
+  note_space((my_mem_ptr) cinfo->mem, 0L, bytes);
+}
+
+
 METHODDEF(void *)
 alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
 /* Allocate a "small" object */
@@ -260,7 +467,7 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
   small_pool_ptr hdr_ptr, prev_hdr_ptr;
   char * data_ptr;
-  size_t odd_bytes, min_request, slop;
+  size_t odd_bytes, min_request, slop, room;
 
   /* Check for unsatisfiable request (do now to ensure no overflow below) */
   if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-SIZEOF(small_pool_hdr)))
@@ -294,16 +501,26 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
     /* Don't ask for more than MAX_ALLOC_CHUNK */
     if (slop > (size_t) (MAX_ALLOC_CHUNK-min_request))
       slop = (size_t) (MAX_ALLOC_CHUNK-min_request);
-    /* Try to get space, if fail reduce slop and try again */
-    for (;;) {
-      hdr_ptr = (small_pool_ptr) jpeg_get_small(cinfo, min_request + slop);
-      if (hdr_ptr != NULL)
-	break;
-      slop /= 2;
-      if (slop < MIN_SLOP)	/* give up when it gets real small */
-	out_of_memory(cinfo, 2); /* jpeg_get_small failed */
+    /* A pool kept from the last image will do, whatever its slop */
+    if (pool_id == JPOOL_IMAGE &&
+	(hdr_ptr = reuse_small_pool(mem, sizeofobject)) != NULL) {
+      slop = hdr_ptr->hdr.bytes_left - sizeofobject;
+    } else {
+      /* Keep the slop within the budget, if there is one */
+      room = check_budget(cinfo, min_request);
+      if (slop > room)
+	slop = room;
+      /* Try to get space, if fail reduce slop and try again */
+      for (;;) {
+	hdr_ptr = get_small_pool(cinfo, min_request + slop);
+	if (hdr_ptr != NULL)
+	  break;
+	slop /= 2;
+	if (slop < MIN_SLOP)	/* give up when it gets real small */
+	  out_of_memory(cinfo, 2); /* jpeg_get_small failed */
+      }
+      note_space(mem, (long) (min_request + slop), 0L);
     }
-    mem->total_space_allocated += min_request + slop;
     /* Success, initialize the new pool header and add to end of list */
     hdr_ptr->hdr.next = NULL;
     hdr_ptr->hdr.bytes_used = 0;
@@ -355,15 +572,21 @@ alloc_large (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   if (odd_bytes > 0)
     sizeofobject += SIZEOF(ALIGN_TYPE) - odd_bytes;
 
-  /* Always make a new pool */
+  /* Always make a new pool, unless one kept from the last image fits */
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
 
-  hdr_ptr = (large_pool_ptr) jpeg_get_large(cinfo, sizeofobject +
-					    SIZEOF(large_pool_hdr));
-  if (hdr_ptr == NULL)
-    out_of_memory(cinfo, 4);	/* jpeg_get_large failed */
-  mem->total_space_allocated += sizeofobject + SIZEOF(large_pool_hdr);
+  if (pool_id == JPOOL_IMAGE &&
+      (hdr_ptr = reuse_large_pool(mem, sizeofobject)) != NULL) {
+    hdr_ptr->hdr.bytes_left -= sizeofobject;
+  } else {
+    (void) check_budget(cinfo, sizeofobject + SIZEOF(large_pool_hdr));
+    hdr_ptr = get_large_pool(cinfo, sizeofobject + SIZEOF(large_pool_hdr));
+    if (hdr_ptr == NULL)
+      out_of_memory(cinfo, 4);	/* jpeg_get_large failed */
+    note_space(mem, (long) (sizeofobject + SIZEOF(large_pool_hdr)), 0L);
+    hdr_ptr->hdr.bytes_left = 0;
+  }
 
   /* Success, initialize the new pool header and add to list */
   hdr_ptr->hdr.next = mem->large_list[pool_id];
@@ -371,7 +594,6 @@ alloc_large (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
    * even though they are not needed for allocation.
    */
   hdr_ptr->hdr.bytes_used = sizeofobject;
-  hdr_ptr->hdr.bytes_left = 0;
   mem->large_list[pool_id] = hdr_ptr;
 
   return (void FAR *) (hdr_ptr + 1); /* point to first data byte in pool */
@@ -578,6 +800,54 @@ request_virt_barray (j_common_ptr cinfo, int pool_id, boolean pre_zero,
 }
 
 
+/*
+ * A backing-store object that jpeg_open_backing_store has mapped into memory
+ * (mapped_addr != NULL) serves as the whole-height buffer of its virtual
+ * array: the row pointers go straight into the mapping, so accessing the
+ * array never reads or writes the store, and only the pages touched take
+ * up real memory.  The mapping is a single chunk.
+ */
+
+LOCAL(JSAMPARRAY)
+map_sarray (j_common_ptr cinfo, jvirt_sarray_ptr ptr)
+/* Point the rows of a virtual sample array into its mapped backing store */
+{
+  JSAMPARRAY result;
+  JSAMPROW workspace = (JSAMPROW) ptr->b_s_info.mapped_addr;
+  JDIMENSION currow;
+
+  result = (JSAMPARRAY) alloc_small(cinfo, JPOOL_IMAGE,
+				    (size_t) (ptr->rows_in_array *
+					      SIZEOF(JSAMPROW)));
+  for (currow = 0; currow < ptr->rows_in_array; currow++) {
+    result[currow] = workspace;
+    workspace += ptr->samplesperrow;
+  }
+  ptr->rowsperchunk = ptr->rows_in_array;
+  return result;
+}
+
+
+LOCAL(JBLOCKARRAY)
+map_barray (j_common_ptr cinfo, jvirt_barray_ptr ptr)
+/* Point the rows of a virtual coefficient array into its mapped backing store */
+{
+  JBLOCKARRAY result;
+  JBLOCKROW workspace = (JBLOCKROW) ptr->b_s_info.mapped_addr;
+  JDIMENSION currow;
+
+  result = (JBLOCKARRAY) alloc_small(cinfo, JPOOL_IMAGE,
+				     (size_t) (ptr->rows_in_array *
+					       SIZEOF(JBLOCKROW)));
+  for (currow = 0; currow < ptr->rows_in_array; currow++) {
+    result[currow] = workspace;
+    workspace += ptr->blocksperrow;
+  }
+  ptr->rowsperchunk = ptr->rows_in_array;
+  return result;
+}
+
+
 METHODDEF(void)
 realize_virt_arrays (j_common_ptr cinfo)
 /* Allocate the in-memory buffers for any unrealized virtual arrays */
@@ -616,7 +886,14 @@ realize_virt_arrays (j_common_ptr cinfo)
 
   /* Determine amount of memory to actually use; this is system-dependent. */
   avail_mem = jpeg_mem_available(cinfo, space_per_minheight, maximum_space,
-				 mem->total_space_allocated);
+				 mem->pub.host_space_allocated);
+  /* Within the budget, too; what does not fit goes to backing store */
+  if (mem->pub.memory_budget > 0) {
+    long room = mem->pub.memory_budget - mem->pub.host_space_allocated -
+		mem->pub.device_space_allocated - mem->space_retained;
+    if (avail_mem > room)
+      avail_mem = room;
+  }
 
   /* If the maximum space needed is available, make all the buffers full
    * height; otherwise parcel it out with the same number of minheights
@@ -644,15 +921,23 @@ realize_virt_arrays (j_common_ptr cinfo)
       } else {
 	/* It doesn't fit in memory, create backing store. */
 	sptr->rows_in_mem = (JDIMENSION) (max_minheights * sptr->maxaccess);
+	sptr->b_s_info.mapped_addr = NULL;
 	jpeg_open_backing_store(cinfo, & sptr->b_s_info,
 				(long) sptr->rows_in_array *
 				(long) sptr->samplesperrow *
 				(long) SIZEOF(JSAMPLE));
 	sptr->b_s_open = TRUE;
+	if (sptr->b_s_info.mapped_addr != NULL) {
+	  /* Mapped backing store: let the kernel do the paging */
+	  sptr->rows_in_mem = sptr->rows_in_array;
+	  sptr->mem_buffer = map_sarray(cinfo, sptr);
+	}
+      }
+      if (sptr->mem_buffer == NULL) {
+	sptr->mem_buffer = alloc_sarray(cinfo, JPOOL_IMAGE,
+				       sptr->samplesperrow, sptr->rows_in_mem);
+	sptr->rowsperchunk = mem->last_rowsperchunk;
       }
-      sptr->mem_buffer = alloc_sarray(cinfo, JPOOL_IMAGE,
-				      sptr->samplesperrow, sptr->rows_in_mem);
-      sptr->rowsperchunk = mem->last_rowsperchunk;
       sptr->cur_start_row = 0;
       sptr->first_undef_row = 0;
       sptr->dirty = FALSE;
@@ -668,15 +953,23 @@ realize_virt_arrays (j_common_ptr cinfo)
       } else {
 	/* It doesn't fit in memory, create backing store. */
 	bptr->rows_in_mem = (JDIMENSION) (max_minheights * bptr->maxaccess);
+	bptr->b_s_info.mapped_addr = NULL;
 	jpeg_open_backing_store(cinfo, & bptr->b_s_info,
 				(long) bptr->rows_in_array *
 				(long) bptr->blocksperrow *
 				(long) SIZEOF(JBLOCK));
 	bptr->b_s_open = TRUE;
+	if (bptr->b_s_info.mapped_addr != NULL) {
+	  /* Mapped backing store: let the kernel do the paging */
+	  bptr->rows_in_mem = bptr->rows_in_array;
+	  bptr->mem_buffer = map_barray(cinfo, bptr);
+	}
+      }
+      if (bptr->mem_buffer == NULL) {
+	bptr->mem_buffer = alloc_barray(cinfo, JPOOL_IMAGE,
+				       bptr->blocksperrow, bptr->rows_in_mem);
+	bptr->rowsperchunk = mem->last_rowsperchunk;
       }
-      bptr->mem_buffer = alloc_barray(cinfo, JPOOL_IMAGE,
-				      bptr->blocksperrow, bptr->rows_in_mem);
-      bptr->rowsperchunk = mem->last_rowsperchunk;
       bptr->cur_start_row = 0;
       bptr->first_undef_row = 0;
       bptr->dirty = FALSE;
@@ -932,6 +1225,7 @@ free_pool (j_common_ptr cinfo, int pool_id)
   small_pool_ptr shdr_ptr;
   large_pool_ptr lhdr_ptr;
   size_t space_freed;
+  long budget;
 
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
@@ -962,6 +1256,13 @@ free_pool (j_common_ptr cinfo, int pool_id)
     mem->virt_barray_list = NULL;
   }
 
+  /* Pools kept at the end of the last image and not reused go back now;
+   * this image's pools, large first, are kept instead while they fit.
+   */
+  if (pool_id == JPOOL_IMAGE)
+    release_retained(cinfo);
+  budget = (pool_id == JPOOL_IMAGE) ? mem->pub.max_memory_to_retain : 0L;
+
   /* Release large objects */
   lhdr_ptr = mem->large_list[pool_id];
   mem->large_list[pool_id] = NULL;
@@ -971,8 +1272,15 @@ free_pool (j_common_ptr cinfo, int pool_id)
     space_freed = lhdr_ptr->hdr.bytes_used +
 		  lhdr_ptr->hdr.bytes_left +
 		  SIZEOF(large_pool_hdr);
-    jpeg_free_large(cinfo, (void FAR *) lhdr_ptr, space_freed);
-    mem->total_space_allocated -= space_freed;
+    if (mem->space_retained + (long) space_freed <= budget) {
+      lhdr_ptr->hdr.next = mem->large_retained;
+      lhdr_ptr->hdr.bytes_left += lhdr_ptr->hdr.bytes_used;
+      lhdr_ptr->hdr.bytes_used = 0;
+      mem->large_retained = lhdr_ptr;
+      mem->space_retained += (long) space_freed;
+    } else
+      free_large_pool(cinfo, lhdr_ptr, space_freed);
+    note_space(mem, - (long) space_freed, 0L);
     lhdr_ptr = next_lhdr_ptr;
   }
 
@@ -985,8 +1293,15 @@ free_pool (j_common_ptr cinfo, int pool_id)
     space_freed = shdr_ptr->hdr.bytes_used +
 		  shdr_ptr->hdr.bytes_left +
 		  SIZEOF(small_pool_hdr);
-    jpeg_free_small(cinfo, (void *) shdr_ptr, space_freed);
-    mem->total_space_allocated -= space_freed;
+    if (mem->space_retained + (long) space_freed <= budget) {
+      shdr_ptr->hdr.next = mem->small_retained;
+      shdr_ptr->hdr.bytes_left += shdr_ptr->hdr.bytes_used;
+      shdr_ptr->hdr.bytes_used = 0;
+      mem->small_retained = shdr_ptr;
+      mem->space_retained += (long) space_freed;
+    } else
+      free_small_pool(cinfo, shdr_ptr, space_freed);
+    note_space(mem, - (long) space_freed, 0L);
     shdr_ptr = next_shdr_ptr;
   }
 }
@@ -1005,7 +1320,9 @@ self_destruct (j_common_ptr cinfo)
   /* Close all backing store, release all memory.
    * Releasing pools in reverse order might help avoid fragmentation
    * with some (brain-damaged) malloc libraries.
+   * Nothing is kept this time, and free_pool releases what was kept before.
    */
+  cinfo->mem->max_memory_to_retain = 0;
   for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
     free_pool(cinfo, pool);
   }
@@ -1074,12 +1391,16 @@ jinit_memory_mgr (j_common_ptr cinfo)
   mem->pub.access_virt_barray = access_virt_barray;
   mem->pub.free_pool = free_pool;
   mem->pub.self_destruct = self_destruct;
+  mem->pub.account_device_space = account_device_space;
 
   /* Make MAX_ALLOC_CHUNK accessible to other modules */
   mem->pub.max_alloc_chunk = MAX_ALLOC_CHUNK;
 
   /* Initialize working state */
   mem->pub.max_memory_to_use = max_to_use;
+  mem->pub.max_memory_to_retain = 0;
+  mem->pub.allocator = NULL;
+  mem->pub.memory_budget = 0;
 
   for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
     mem->small_list[pool] = NULL;
@@ -1087,8 +1408,13 @@ jinit_memory_mgr (j_common_ptr cinfo)
   }
   mem->virt_sarray_list = NULL;
   mem->virt_barray_list = NULL;
+  mem->small_retained = NULL;
+  mem->large_retained = NULL;
+  mem->space_retained = 0;
 
-  mem->total_space_allocated = SIZEOF(my_memory_mgr);
+  mem->pub.host_space_allocated = SIZEOF(my_memory_mgr);
+  mem->pub.device_space_allocated = 0;
+  mem->pub.peak_space_allocated = SIZEOF(my_memory_mgr);
 
   /* Declare ourselves open for business */
   cinfo->mem = & mem->pub;
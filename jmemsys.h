@@ -149,6 +149,12 @@ typedef struct backing_store_struct {
   JMETHOD(void, close_backing_store, (j_common_ptr cinfo,
 				      backing_store_ptr info));
 
+  /* Set by jpeg_open_backing_store if it mapped the whole object into
+   * memory at this address (jmemmap.c); jmemmgr.c then uses the mapping
+   * directly and never calls the read/write methods.  NULL otherwise.
+   */
+  void FAR * mapped_addr;
+
   /* Private fields for system-dependent backing-store management */
 #ifdef USE_MSDOS_MEMMGR
   /* For the MS-DOS manager (jmemdos.c), we need: */
@@ -164,6 +170,7 @@ typedef struct backing_store_struct {
   /* For a typical implementation with temp files, we need: */
   FILE * temp_file;		/* stdio reference to temp file */
   char temp_name[TEMP_NAME_LENGTH]; /* name of temp file */
+  long mapped_bytes;		/* size of the mapping, if mapped_addr set */
 #endif
 #endif
 } backing_store_info;
@@ -0,0 +1,207 @@
+/*
+ * jmmapsrc.c
+ *
+ * Based on jdatasrc.c, Copyright (C) 1994-1996, Thomas G. Lane.
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains a decompression data source manager for POSIX systems
+ * that maps the whole input file into memory with mmap() and hands the
+ * mapping to the decompressor as a single input buffer.  Unlike jdatasrc.c
+ * or reading the file into memory for jpeg_mem_src, no compressed byte is
+ * ever copied; the kernel pages the file in as the entropy decoder walks
+ * through it, with read-ahead encouraged by sequential-access advice.
+ */
+
+/* this is not a core library module, so it doesn't define JPEG_INTERNALS */
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jerror.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/* Expanded data source object for mapped file input */
+
+typedef struct {
+  struct jpeg_source_mgr pub;	/* public fields */
+
+  JOCTET * map;			/* start of the file mapping, or NULL */
+  size_t size;			/* length of the file and the mapping */
+  boolean start_of_file;	/* have we gotten any data yet? */
+} my_source_mgr;
+
+typedef my_source_mgr * my_src_ptr;
+
+
+/*
+ * Initialize source --- called by jpeg_read_header
+ * before any data is actually read.
+ */
+
+METHODDEF(void)
+init_source (j_decompress_ptr cinfo)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+
+  /* As in jdatasrc.c, the position in the mapping is kept across images,
+   * so a series of images can be read from one file.
+   */
+  src->start_of_file = TRUE;
+}
+
+
+/*
+ * Fill the input buffer --- called whenever buffer is emptied.
+ *
+ * The first call exposes the whole mapping.  Any later call means the
+ * decompressor ran off the end of the file; as jdatasrc.c does, we warn and
+ * insert a fake EOI marker so that as much of the image as is there gets
+ * output, unless no data at all was left for this image.
+ */
+
+METHODDEF(boolean)
+fill_input_buffer (j_decompress_ptr cinfo)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+  static const JOCTET fake_eoi[2] = { (JOCTET) 0xFF, (JOCTET) JPEG_EOI };
+
+  if (src->pub.next_input_byte == NULL && src->size > 0) {
+    src->pub.next_input_byte = src->map;
+    src->pub.bytes_in_buffer = src->size;
+  } else {
+    if (src->start_of_file)	/* Treat empty input file as fatal error */
+      ERREXIT(cinfo, JERR_INPUT_EMPTY);
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    /* Insert a fake EOI marker */
+    src->pub.next_input_byte = fake_eoi;
+    src->pub.bytes_in_buffer = 2;
+  }
+  src->start_of_file = FALSE;
+
+  return TRUE;
+}
+
+
+/*
+ * Skip data --- used to skip over a potentially large amount of
+ * uninteresting data (such as an APPn marker).
+ *
+ * The whole file is in the buffer, so a skip past its end just empties the
+ * buffer; the next read then gets the fake EOI.
+ */
+
+METHODDEF(void)
+skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+
+  if (num_bytes <= 0)
+    return;
+  if ((size_t) num_bytes > src->pub.bytes_in_buffer)
+    num_bytes = (long) src->pub.bytes_in_buffer;
+  src->pub.next_input_byte += (size_t) num_bytes;
+  src->pub.bytes_in_buffer -= (size_t) num_bytes;
+}
+
+
+/*
+ * An additional method that can be provided by data source modules is the
+ * resync_to_restart method for error recovery in the presence of RST markers.
+ * For the moment, this source module just uses the default resync method
+ * provided by the JPEG library.
+ */
+
+
+/*
+ * Terminate source --- called by jpeg_finish_decompress
+ * after all data has been read.
+ *
+ * The mapping stays until jpeg_mmap_src_close, since further images may
+ * follow in the same file.
+ */
+
+METHODDEF(void)
+term_source (j_decompress_ptr cinfo)
+{
+  /* no work necessary here */
+}
+
+
+/*
+ * Unmap the file mapped by jpeg_mmap_src, if any.
+ * Must be called before jpeg_destroy_decompress, also after an error exit,
+ * since the source object goes away with the JPEG object.
+ */
+
+GLOBAL(void)
+jpeg_mmap_src_close (j_decompress_ptr cinfo)
+{
+  my_src_ptr src = (my_src_ptr) cinfo->src;
+
+  if (src == NULL || src->pub.init_source != init_source)
+    return;			/* not our source manager */
+  if (src->map != NULL)
+    (void) munmap((void *) src->map, src->size);
+  src->map = NULL;
+  src->size = 0;
+  src->pub.bytes_in_buffer = 0;
+  src->pub.next_input_byte = NULL;
+}
+
+
+/*
+ * Prepare for input from a file descriptor open for reading.
+ * The whole file is mapped, so the descriptor may be closed as soon as
+ * this returns.  Returns FALSE, leaving the JPEG object untouched, if the
+ * file cannot be mapped (a pipe, say); the caller can then fall back on
+ * jpeg_stdio_src.  Any file mapped by an earlier call is unmapped.
+ */
+
+GLOBAL(boolean)
+jpeg_mmap_src (j_decompress_ptr cinfo, int fd)
+{
+  my_src_ptr src;
+  struct stat st;
+  void * map = NULL;
+  size_t size;
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    return FALSE;
+  size = (size_t) st.st_size;
+  if ((off_t) size != st.st_size)
+    return FALSE;		/* too big to map in this address space */
+  if (size > 0) {
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+      return FALSE;
+    /* The entropy decoder reads front to back exactly once. */
+    (void) posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+  }
+
+  /* The source object is made permanent, as in jdatasrc.c.
+   * This makes it unsafe to use this manager and a different source
+   * manager serially with the same JPEG object.  Caveat programmer.
+   */
+  if (cinfo->src == NULL) {	/* first time for this JPEG object? */
+    cinfo->src = (struct jpeg_source_mgr *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  SIZEOF(my_source_mgr));
+    src = (my_src_ptr) cinfo->src;
+    src->pub.init_source = init_source;
+    src->map = NULL;
+  }
+  jpeg_mmap_src_close(cinfo);
+
+  src = (my_src_ptr) cinfo->src;
+  src->pub.init_source = init_source;
+  src->pub.fill_input_buffer = fill_input_buffer;
+  src->pub.skip_input_data = skip_input_data;
+  src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
+  src->pub.term_source = term_source;
+  src->map = (JOCTET *) map;
+  src->size = size;
+  src->pub.bytes_in_buffer = 0; /* forces fill_input_buffer on first read */
+  src->pub.next_input_byte = NULL; /* until buffer loaded */
+  return TRUE;
+}
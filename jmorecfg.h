@@ -263,6 +263,7 @@ typedef int boolean;
 // #define DCT_ISLOW_SUPPORTED	/* slow but accurate integer algorithm */
 // #define DCT_IFAST_SUPPORTED	/* faster, less accurate integer method */
 #define DCT_FLOAT_SUPPORTED	/* floating-point: accurate, fast on fast HW */
+#define SIMD_SUPPORTED		/* x86 SSE2/AVX2 DCTs, chosen at run time */
 
 /* Encoder capability options: */
 
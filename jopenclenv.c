@@ -0,0 +1,184 @@
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jopenclenv.h"
+#include "jopenclstore.h"
+#include "jopenclprogpool.h"
+#include "jopenclsched.h"
+#include "jopenclprof.h"
+
+// The OpenCL context, queue, buffer store and program pool are created on
+// first use instead of in jpeg_CreateDecompress, so objects that only read
+// headers or coefficients (batch workers, transcoders) never touch the driver.
+// Compress objects keep the same five fields; the helpers below work on
+// either through pointers to them.
+
+struct j_opencl_env
+{
+    cl_context * context;
+    cl_command_queue * queue;
+    cl_device_id * device_id;
+    struct j_opencl_store ** store;
+    struct j_opencl_prog_pool ** prog_pool;
+};
+
+static void env_release(struct j_opencl_env * env)
+{
+    if(*env->store)
+    {
+        j_opencl_store_destroy(*env->store);
+        *env->store = NULL;
+    }
+    if(*env->prog_pool)
+    {
+        j_opencl_prog_pool_destroy(*env->prog_pool);
+        *env->prog_pool = NULL;
+    }
+    if(*env->queue)
+    {
+        clReleaseCommandQueue(*env->queue);
+        *env->queue = NULL;
+    }
+    if(*env->context)
+    {
+        clReleaseContext(*env->context);
+        *env->context = NULL;
+    }
+    *env->device_id = NULL;
+}
+
+static cl_int env_create(struct j_opencl_env * env,cl_command_queue_properties properties)
+{
+    cl_int error_code;
+    cl_platform_id platform_id;
+    cl_device_id device_id;
+
+    if(CL_SUCCESS != (error_code = clGetPlatformIDs(1,&platform_id,NULL)) )
+    {
+        return error_code;
+    }
+    if(CL_SUCCESS != (error_code = clGetDeviceIDs(platform_id,CL_DEVICE_TYPE_GPU,1,&device_id,NULL)) )
+    {
+        return error_code;
+    }
+    *env->context = clCreateContext(NULL,1,&device_id,NULL,NULL,&error_code);
+    if(error_code != CL_SUCCESS)
+    {
+        *env->context = NULL;
+        return error_code;
+    }
+    *env->queue = clCreateCommandQueue(*env->context,device_id,properties,&error_code);
+    if(error_code != CL_SUCCESS)
+    {
+        *env->queue = NULL;
+        env_release(env);
+        return error_code;
+    }
+    *env->device_id = device_id;
+
+    // init cl store
+    *env->store = j_opencl_store_create();
+    if(!*env->store)
+    {
+        env_release(env);
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    // init cl prog pool
+    *env->prog_pool = j_opencl_prog_pool_create(*env->context,device_id);
+    if(!*env->prog_pool)
+    {
+        env_release(env);
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    return CL_SUCCESS;
+}
+
+// cinfo may be a decompress or a compress object
+#define ENV_OF(env,cinfo)\
+    env.context = &cinfo->current_cl_context;\
+    env.queue = &cinfo->current_cl_queue;\
+    env.device_id = &cinfo->current_device_id;\
+    env.store = &cinfo->cl_store;\
+    env.prog_pool = &cinfo->cl_prog_pool;
+
+cl_int j_opencl_env_init(j_decompress_ptr cinfo)
+{
+    cl_int error_code;
+    struct j_opencl_env env;
+
+    if(j_opencl_env_is_ready(cinfo))
+    {
+        // host timings still work if profiling was switched on late,
+        // the queue just reports no device times
+        return j_opencl_prof_init(cinfo);
+    }
+    ENV_OF(env,cinfo);
+    error_code = env_create(&env,cinfo->cl_profiling ? CL_QUEUE_PROFILING_ENABLE : 0);
+    if(error_code != CL_SUCCESS)
+    {
+        return error_code;
+    }
+    if(CL_SUCCESS != (error_code = j_opencl_prof_init(cinfo)) )
+    {
+        j_opencl_env_release(cinfo);
+        return error_code;
+    }
+    return CL_SUCCESS;
+}
+
+void j_opencl_env_release(j_decompress_ptr cinfo)
+{
+    struct j_opencl_env env;
+
+    j_opencl_prof_release(cinfo);
+    while(cinfo->cl_store && !j_opencl_store_is_empty(cinfo->cl_store))
+    {
+        j_opencl_env_pop_session(cinfo);
+    }
+    if(cinfo->cl_coef_buffer)
+    {
+        (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+                - (long) cinfo->cl_coef_size);
+        clReleaseMemObject(cinfo->cl_coef_buffer);
+        cinfo->cl_coef_buffer = NULL;
+        cinfo->cl_coef_size = 0;
+    }
+    if(cinfo->cl_scheduler)
+    {
+        j_opencl_sched_destroy(cinfo->cl_scheduler);
+        cinfo->cl_scheduler = NULL;
+    }
+    ENV_OF(env,cinfo);
+    env_release(&env);
+}
+
+void j_opencl_env_pop_session(j_decompress_ptr cinfo)
+{
+    (*cinfo->mem->account_device_space)((j_common_ptr)cinfo,
+            - (long) j_opencl_store_session_size(cinfo->cl_store));
+    j_opencl_store_pop_session(cinfo->cl_store);
+}
+
+int j_opencl_env_is_ready(j_decompress_ptr cinfo)
+{
+    return cinfo->current_cl_context != NULL && cinfo->cl_prog_pool != NULL;
+}
+
+cl_int j_opencl_env_init_compress(j_compress_ptr cinfo)
+{
+    struct j_opencl_env env;
+
+    if(cinfo->current_cl_context != NULL && cinfo->cl_prog_pool != NULL)
+    {
+        return CL_SUCCESS;
+    }
+    ENV_OF(env,cinfo);
+    return env_create(&env,0);
+}
+
+void j_opencl_env_release_compress(j_compress_ptr cinfo)
+{
+    struct j_opencl_env env;
+
+    ENV_OF(env,cinfo);
+    env_release(&env);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <CL/opencl.h>
+#include "jpeglib.h"
+
+cl_int j_opencl_env_init(j_decompress_ptr cinfo);
+
+void j_opencl_env_release(j_decompress_ptr cinfo);
+
+int j_opencl_env_is_ready(j_decompress_ptr cinfo);
+
+// Release the oldest session of cl_store and credit its buffers to the
+// memory manager's device accounting
+void j_opencl_env_pop_session(j_decompress_ptr cinfo);
+
+// The same for the OpenCL compression pipeline (jcopencl.c)
+cl_int j_opencl_env_init_compress(j_compress_ptr cinfo);
+
+void j_opencl_env_release_compress(j_compress_ptr cinfo);
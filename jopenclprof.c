@@ -0,0 +1,125 @@
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jopenclprof.h"
+#include <time.h>
+
+#define MAX_PENDING_EVENT_COUNT (64)
+
+struct j_opencl_prof
+{
+    int pending_count;
+    int stages[MAX_PENDING_EVENT_COUNT];
+    cl_event events[MAX_PENDING_EVENT_COUNT];
+};
+
+cl_int j_opencl_prof_init(j_decompress_ptr cinfo)
+{
+    if(!cinfo->cl_profiling || cinfo->cl_prof)
+    {
+        return CL_SUCCESS;
+    }
+    cinfo->cl_prof = (struct j_opencl_prof *)malloc(sizeof(struct j_opencl_prof));
+    if(!cinfo->cl_prof)
+    {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    memset(cinfo->cl_prof,0,sizeof(struct j_opencl_prof));
+    return CL_SUCCESS;
+}
+
+void j_opencl_prof_release(j_decompress_ptr cinfo)
+{
+    int i;
+    struct j_opencl_prof * prof;
+
+    prof = cinfo->cl_prof;
+    if(!prof)
+    {
+        return;
+    }
+    for(i = 0 ; i < prof->pending_count ; ++i)
+    {
+        clReleaseEvent(prof->events[i]);
+    }
+    free(prof);
+    cinfo->cl_prof = NULL;
+}
+
+double j_opencl_prof_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+double j_opencl_prof_begin(j_decompress_ptr cinfo)
+{
+    return cinfo->cl_profiling ? j_opencl_prof_now() : 0.0;
+}
+
+void j_opencl_prof_end(j_decompress_ptr cinfo,int stage,double start)
+{
+    if(cinfo->cl_profiling)
+    {
+        cinfo->cl_stats.stage[stage].host_seconds += j_opencl_prof_now() - start;
+    }
+}
+
+cl_event * j_opencl_prof_event(j_decompress_ptr cinfo,int stage)
+{
+    struct j_opencl_prof * prof;
+
+    prof = cinfo->cl_prof;
+    if(!cinfo->cl_profiling || !prof)
+    {
+        return NULL;
+    }
+    if(prof->pending_count == MAX_PENDING_EVENT_COUNT)
+    {
+        // waits for the oldest commands, only on very long command chains
+        j_opencl_prof_collect(cinfo);
+    }
+    prof->stages[prof->pending_count] = stage;
+    prof->events[prof->pending_count] = NULL;
+    return &prof->events[prof->pending_count ++];
+}
+
+void j_opencl_prof_collect(j_decompress_ptr cinfo)
+{
+    struct j_opencl_prof * prof;
+    jpeg_stage_stats * stats;
+    cl_ulong queued;
+    cl_ulong submit;
+    cl_ulong start;
+    cl_ulong end;
+    int i;
+
+    prof = cinfo->cl_prof;
+    if(!prof)
+    {
+        return;
+    }
+    for(i = 0 ; i < prof->pending_count ; ++i)
+    {
+        // a failed enqueue leaves its slot empty
+        if(!prof->events[i])
+        {
+            continue;
+        }
+        stats = &cinfo->cl_stats.stage[prof->stages[i]];
+        if(CL_SUCCESS == clWaitForEvents(1,&prof->events[i])
+            && CL_SUCCESS == clGetEventProfilingInfo(prof->events[i],CL_PROFILING_COMMAND_QUEUED,sizeof(cl_ulong),&queued,NULL)
+            && CL_SUCCESS == clGetEventProfilingInfo(prof->events[i],CL_PROFILING_COMMAND_SUBMIT,sizeof(cl_ulong),&submit,NULL)
+            && CL_SUCCESS == clGetEventProfilingInfo(prof->events[i],CL_PROFILING_COMMAND_START,sizeof(cl_ulong),&start,NULL)
+            && CL_SUCCESS == clGetEventProfilingInfo(prof->events[i],CL_PROFILING_COMMAND_END,sizeof(cl_ulong),&end,NULL))
+        {
+            stats->queued_seconds += (double)(submit - queued) * 1e-9;
+            stats->submit_seconds += (double)(start - submit) * 1e-9;
+            stats->device_seconds += (double)(end - start) * 1e-9;
+            stats->commands ++;
+        }
+        clReleaseEvent(prof->events[i]);
+    }
+    prof->pending_count = 0;
+}
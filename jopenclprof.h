@@ -0,0 +1,24 @@
+#pragma once
+#include <CL/opencl.h>
+#include "jpeglib.h"
+
+// Fills cinfo->cl_stats.  Everything here is a no-op unless
+// cinfo->cl_profiling is set, so the decode path calls it unconditionally.
+// Device times are read from the events once the commands have finished,
+// which is why events are parked here until j_opencl_prof_collect.
+
+cl_int j_opencl_prof_init(j_decompress_ptr cinfo);
+
+void j_opencl_prof_release(j_decompress_ptr cinfo);
+
+// host wall clock, in seconds
+double j_opencl_prof_now(void);
+
+double j_opencl_prof_begin(j_decompress_ptr cinfo);
+
+void j_opencl_prof_end(j_decompress_ptr cinfo,int stage,double start);
+
+// event slot to pass to a clEnqueue* call, NULL when not profiling
+cl_event * j_opencl_prof_event(j_decompress_ptr cinfo,int stage);
+
+void j_opencl_prof_collect(j_decompress_ptr cinfo);
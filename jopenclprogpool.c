@@ -13,15 +13,17 @@
 #define GET_FUNC_HEADER(a)\
     ;
 
-#define GENERATE_FUNC(file_name) \
+#define GENERATE_FUNC(file_name,source_name) \
     cl_int error_code; \
-    j_decompress_ptr cinfo; \
 \
     SAFE_RELEASE_PROGRAM(pool->current_prog);\
 \
-    cinfo = pool->cinfo; \
-\
-    error_code = create_with_file_name(cinfo,&pool->current_prog,file_name);\
+    error_code = create_with_file_name(pool,&pool->current_prog,file_name);\
+    if(error_code != CL_SUCCESS)\
+    {\
+        SAFE_RELEASE_PROGRAM(pool->current_prog);\
+        error_code = create_with_source_name(pool,&pool->current_prog,source_name);\
+    }\
     if(error_code == CL_SUCCESS)\
     {\
         *pprog = pool->current_prog;\
@@ -35,11 +37,12 @@
 
 struct j_opencl_prog_pool
 {
-    j_decompress_ptr cinfo;
+    cl_context context;
+    cl_device_id device_id;
     cl_program current_prog;
 };
 
-struct j_opencl_prog_pool * j_opencl_prog_pool_create(j_decompress_ptr cinfo)
+struct j_opencl_prog_pool * j_opencl_prog_pool_create(cl_context context,cl_device_id device_id)
 {
     struct j_opencl_prog_pool * pool;
 
@@ -47,7 +50,8 @@ struct j_opencl_prog_pool * j_opencl_prog_pool_create(j_decompress_ptr cinfo)
     if(pool)
     {
         memset(pool,0,sizeof(struct j_opencl_prog_pool));
-        pool->cinfo = cinfo;
+        pool->context = context;
+        pool->device_id = device_id;
     }
     return pool;
 }   
@@ -58,7 +62,7 @@ void j_opencl_prog_pool_destroy(struct j_opencl_prog_pool * pool)
     free(pool);
 }
 
-static cl_int create_with_file_name(j_decompress_ptr cinfo,cl_program * pprog,const char * file_name)
+static cl_int create_with_file_name(struct j_opencl_prog_pool * pool,cl_program * pprog,const char * file_name)
 {
     cl_int error_code;
     int file_size;
@@ -71,9 +75,9 @@ static cl_int create_with_file_name(j_decompress_ptr cinfo,cl_program * pprog,co
     {
         return CL_OUT_OF_RESOURCES;
     }
-    devices[0] = cinfo->current_device_id;
+    devices[0] = pool->device_id;
     devices[1] = 0;
-    *pprog = clCreateProgramWithBinary(cinfo->current_cl_context,1,devices,&file_size
+    *pprog = clCreateProgramWithBinary(pool->context,1,devices,&file_size
                 ,&file_content,NULL,&error_code);
     free_all_bytes(file_content);
     if(error_code == CL_SUCCESS)
@@ -83,22 +87,60 @@ static cl_int create_with_file_name(j_decompress_ptr cinfo,cl_program * pprog,co
     return error_code;
 }
 
+// The .clc binaries are built by cl_compiler for the first GPU only; any
+// other device (a second GPU model, the CPU runtime) builds from source.
+static cl_int create_with_source_name(struct j_opencl_prog_pool * pool,cl_program * pprog,const char * source_name)
+{
+    cl_int error_code;
+    int file_size;
+    char* file_content;
+
+    *pprog = NULL;
+    file_size = read_all_bytes(source_name,&file_content);
+    if(!file_size)
+    {
+        return CL_OUT_OF_RESOURCES;
+    }
+    *pprog = clCreateProgramWithSource(pool->context,1,(const char **)&file_content,NULL,&error_code);
+    free_all_bytes(file_content);
+    if(error_code == CL_SUCCESS)
+    {
+        error_code = clBuildProgram(*pprog,1,&pool->device_id,NULL,NULL,NULL);
+    }
+    return error_code;
+}
+
 cl_int j_opencl_prog_pool_get_idct(struct j_opencl_prog_pool * pool,cl_program * pprog )
 {
-    GENERATE_FUNC("decode_idct.clc");
+    GENERATE_FUNC("decode_idct.clc","decode_idct.cl");
 }
 
 cl_int j_opencl_prog_pool_get_h2v1(struct j_opencl_prog_pool * pool,cl_program * pprog )
 {
-    GENERATE_FUNC("h2v1_fancy_upsample.clc");
+    GENERATE_FUNC("h2v1_fancy_upsample.clc","h2v1_fancy_upsample.cl");
 }
 
 cl_int j_opencl_prog_pool_get_h2v2(struct j_opencl_prog_pool * pool,cl_program * pprog )
 {
-    GENERATE_FUNC("h2v2_fancy_upsample.clc");
+    GENERATE_FUNC("h2v2_fancy_upsample.clc","h2v2_fancy_upsample.cl");
 }
 
 cl_int j_opencl_prog_pool_get_ycc_to_rgb(struct j_opencl_prog_pool * pool,cl_program * pprog )
 {
-    GENERATE_FUNC("ycc_to_rgb_convert.clc");
+    GENERATE_FUNC("ycc_to_rgb_convert.clc","ycc_to_rgb_convert.cl");
+}
+
+cl_int j_opencl_prog_pool_get_rgb_to_ycc(struct j_opencl_prog_pool * pool,cl_program * pprog )
+{
+    GENERATE_FUNC("rgb_to_ycc_convert.clc","rgb_to_ycc_convert.cl");
+}
+
+cl_int j_opencl_prog_pool_get_downsample(struct j_opencl_prog_pool * pool,cl_program * pprog )
+{
+    GENERATE_FUNC("downsample.clc","downsample.cl");
+}
+
+cl_int j_opencl_prog_pool_get_fdct(struct j_opencl_prog_pool * pool,cl_program * pprog )
+{
+    GENERATE_FUNC("encode_fdct.clc","encode_fdct.cl");
 }
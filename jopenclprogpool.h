@@ -5,7 +5,7 @@
 
 struct j_opencl_prog_pool;
 
-struct j_opencl_prog_pool * j_open_cl_prog_pool_create(j_decompress_ptr cinfo);
+struct j_opencl_prog_pool * j_opencl_prog_pool_create(cl_context context,cl_device_id device_id);
 
 void j_opencl_prog_pool_destroy(struct j_opencl_prog_pool * );
 
@@ -16,3 +16,9 @@ cl_int j_opencl_prog_pool_get_h2v1(struct j_opencl_prog_pool *,cl_program * );
 cl_int j_opencl_prog_pool_get_h2v2(struct j_opencl_prog_pool *,cl_program * );
 
 cl_int j_opencl_prog_pool_get_ycc_to_rgb(struct j_opencl_prog_pool * pool,cl_program * pprog );
+
+cl_int j_opencl_prog_pool_get_rgb_to_ycc(struct j_opencl_prog_pool * pool,cl_program * pprog );
+
+cl_int j_opencl_prog_pool_get_downsample(struct j_opencl_prog_pool * pool,cl_program * pprog );
+
+cl_int j_opencl_prog_pool_get_fdct(struct j_opencl_prog_pool * pool,cl_program * pprog );
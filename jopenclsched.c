@@ -0,0 +1,260 @@
+#include "jopenclsched.h"
+#include "jopenclprogpool.h"
+#include "jthreadpool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_PLATFORM_COUNT (8)
+#define MAX_DEVICE_COUNT (16)
+
+struct j_opencl_scheduler
+{
+    int device_count;
+    struct j_opencl_device devices[MAX_DEVICE_COUNT];
+    struct j_threadpool * pool;
+
+    double run_seconds;             // wall time of all j_opencl_sched_run calls
+
+    // state of the running job
+    pfn_opencl_sched_task task;
+    void * arg;
+    pthread_mutex_t error_lock;
+    cl_int error_code;
+};
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void release_device(struct j_opencl_device * device)
+{
+    if(device->prog_pool)
+    {
+        j_opencl_prog_pool_destroy(device->prog_pool);
+        device->prog_pool = NULL;
+    }
+    if(device->queue)
+    {
+        clReleaseCommandQueue(device->queue);
+        device->queue = NULL;
+    }
+    if(device->context)
+    {
+        clReleaseContext(device->context);
+        device->context = NULL;
+    }
+}
+
+static cl_int init_device(struct j_opencl_device * device,cl_device_id device_id)
+{
+    cl_int error_code;
+    cl_command_queue_properties supported;
+    cl_command_queue_properties properties;
+
+    memset(device,0,sizeof(struct j_opencl_device));
+    device->device_id = device_id;
+    if(CL_SUCCESS != clGetDeviceInfo(device_id,CL_DEVICE_NAME,sizeof(device->name) - 1,device->name,NULL))
+    {
+        strcpy(device->name,"unknown");
+    }
+    properties = 0;
+    if(CL_SUCCESS == clGetDeviceInfo(device_id,CL_DEVICE_QUEUE_PROPERTIES,sizeof(supported),&supported,NULL)
+        && (supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE))
+    {
+        properties = CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+        device->out_of_order = 1;
+    }
+    device->context = clCreateContext(NULL,1,&device_id,NULL,NULL,&error_code);
+    if(error_code != CL_SUCCESS)
+    {
+        device->context = NULL;
+        return error_code;
+    }
+    device->queue = clCreateCommandQueue(device->context,device_id,properties,&error_code);
+    if(error_code != CL_SUCCESS)
+    {
+        device->queue = NULL;
+        release_device(device);
+        return error_code;
+    }
+    device->prog_pool = j_opencl_prog_pool_create(device->context,device_id);
+    if(!device->prog_pool)
+    {
+        release_device(device);
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    return CL_SUCCESS;
+}
+
+struct j_opencl_scheduler * j_opencl_sched_create(cl_device_type device_type,cl_int * error_code)
+{
+    struct j_opencl_scheduler * sched;
+    cl_platform_id platforms[MAX_PLATFORM_COUNT];
+    cl_device_id device_ids[MAX_DEVICE_COUNT];
+    cl_uint platform_count;
+    cl_uint device_count;
+    cl_uint platform;
+    cl_uint i;
+
+    sched = (struct j_opencl_scheduler *)malloc(sizeof(struct j_opencl_scheduler));
+    if(!sched)
+    {
+        *error_code = CL_OUT_OF_HOST_MEMORY;
+        return NULL;
+    }
+    memset(sched,0,sizeof(struct j_opencl_scheduler));
+    pthread_mutex_init(&sched->error_lock,NULL);
+
+    *error_code = clGetPlatformIDs(MAX_PLATFORM_COUNT,platforms,&platform_count);
+    if(*error_code != CL_SUCCESS)
+    {
+        j_opencl_sched_destroy(sched);
+        return NULL;
+    }
+    if(platform_count > MAX_PLATFORM_COUNT)
+    {
+        platform_count = MAX_PLATFORM_COUNT;
+    }
+    for(platform = 0 ; platform < platform_count ; ++platform)
+    {
+        if(CL_SUCCESS != clGetDeviceIDs(platforms[platform],device_type,
+                    MAX_DEVICE_COUNT - sched->device_count,device_ids,&device_count))
+        {
+            // CL_DEVICE_NOT_FOUND, this platform has none of the wanted type
+            continue;
+        }
+        if(device_count > (cl_uint)(MAX_DEVICE_COUNT - sched->device_count))
+        {
+            device_count = MAX_DEVICE_COUNT - sched->device_count;
+        }
+        for(i = 0 ; i < device_count ; ++i)
+        {
+            // a device that fails to come up is left out, not fatal
+            if(CL_SUCCESS == init_device(&sched->devices[sched->device_count],device_ids[i]))
+            {
+                sched->device_count ++;
+            }
+        }
+    }
+    if(sched->device_count == 0)
+    {
+        *error_code = CL_DEVICE_NOT_FOUND;
+        j_opencl_sched_destroy(sched);
+        return NULL;
+    }
+
+    // one host thread drives each device
+    sched->pool = j_threadpool_create(sched->device_count);
+    if(!sched->pool)
+    {
+        *error_code = CL_OUT_OF_HOST_MEMORY;
+        j_opencl_sched_destroy(sched);
+        return NULL;
+    }
+    *error_code = CL_SUCCESS;
+    return sched;
+}
+
+void j_opencl_sched_destroy(struct j_opencl_scheduler * sched)
+{
+    int i;
+
+    if(!sched)
+    {
+        return;
+    }
+    if(sched->pool)
+    {
+        j_threadpool_destroy(sched->pool);
+    }
+    for(i = 0 ; i < sched->device_count ; ++i)
+    {
+        release_device(&sched->devices[i]);
+    }
+    pthread_mutex_destroy(&sched->error_lock);
+    free(sched);
+}
+
+int j_opencl_sched_get_device_count(struct j_opencl_scheduler * sched)
+{
+    return sched->device_count;
+}
+
+struct j_opencl_device * j_opencl_sched_get_device(struct j_opencl_scheduler * sched,int index)
+{
+    if(index < 0 || index >= sched->device_count)
+    {
+        return NULL;
+    }
+    return &sched->devices[index];
+}
+
+static void run_on_device(void * arg,int index,int worker)
+{
+    struct j_opencl_scheduler * sched;
+    struct j_opencl_device * device;
+    cl_int error_code;
+    double start;
+
+    sched = (struct j_opencl_scheduler *)arg;
+    // pool worker w is always the same thread, so it owns device w
+    device = &sched->devices[worker];
+
+    pthread_mutex_lock(&sched->error_lock);
+    error_code = sched->error_code;
+    pthread_mutex_unlock(&sched->error_lock);
+    if(error_code != CL_SUCCESS)
+    {
+        // drain the remaining indices, the job already failed
+        return;
+    }
+
+    start = now_seconds();
+    error_code = sched->task(sched->arg,index,device);
+    device->busy_seconds += now_seconds() - start;
+    device->task_count ++;
+
+    if(error_code != CL_SUCCESS)
+    {
+        pthread_mutex_lock(&sched->error_lock);
+        if(sched->error_code == CL_SUCCESS)
+        {
+            sched->error_code = error_code;
+        }
+        pthread_mutex_unlock(&sched->error_lock);
+    }
+}
+
+cl_int j_opencl_sched_run(struct j_opencl_scheduler * sched,int count,pfn_opencl_sched_task task,void * arg)
+{
+    double start;
+
+    sched->task = task;
+    sched->arg = arg;
+    sched->error_code = CL_SUCCESS;
+    start = now_seconds();
+    j_threadpool_run(sched->pool,count,run_on_device,sched);
+    sched->run_seconds += now_seconds() - start;
+    return sched->error_code;
+}
+
+void j_opencl_sched_report(struct j_opencl_scheduler * sched,FILE * output)
+{
+    int i;
+    struct j_opencl_device * device;
+
+    for(i = 0 ; i < sched->device_count ; ++i)
+    {
+        device = &sched->devices[i];
+        fprintf(output,"device %d: %s%s, %lu tasks, busy %.3f s (%.1f%%)\n",
+                i,device->name,device->out_of_order ? " (out-of-order)" : "",
+                device->task_count,device->busy_seconds,
+                sched->run_seconds > 0 ? 100.0 * device->busy_seconds / sched->run_seconds : 0.0);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <CL/opencl.h>
+#include <stdio.h>
+
+// Spreads independent pieces of work (whole images, groups of images)
+// over every OpenCL device of the machine.  Each device gets its own
+// context, queue and program pool and is driven by one thread of a
+// j_threadpool, so a device that runs dry steals work queued for a slower
+// one.  Queues are created out-of-order where the device supports it;
+// tasks must then chain their commands with events.
+
+struct j_opencl_device
+{
+    cl_device_id device_id;
+    cl_context context;
+    cl_command_queue queue;
+    struct j_opencl_prog_pool * prog_pool;
+    int out_of_order;
+    char name[128];
+
+    unsigned long task_count;
+    double busy_seconds;            // time spent inside tasks
+};
+
+// Returns CL_SUCCESS or an OpenCL error code.  Must leave the device's
+// queue finished, the scheduler measures the task on the host clock.
+typedef cl_int (* pfn_opencl_sched_task)(void * arg,int index,struct j_opencl_device * device);
+struct j_opencl_scheduler;
+
+struct j_opencl_scheduler * j_opencl_sched_create(cl_device_type device_type,cl_int * error_code);
+
+void j_opencl_sched_destroy(struct j_opencl_scheduler * sched);
+
+int j_opencl_sched_get_device_count(struct j_opencl_scheduler * sched);
+
+struct j_opencl_device * j_opencl_sched_get_device(struct j_opencl_scheduler * sched,int index);
+
+cl_int j_opencl_sched_run(struct j_opencl_scheduler * sched,int count,pfn_opencl_sched_task task,void * arg);
+
+void j_opencl_sched_report(struct j_opencl_scheduler * sched,FILE * output);
@@ -140,6 +140,30 @@ int j_opencl_store_pop_session(struct j_opencl_store * store)
 }
 
 
+size_t j_opencl_store_session_size(struct j_opencl_store * store)
+{
+    struct j_opencl_store_element * element;
+    size_t total, size;
+    int i;
+
+    element = store->elements;
+    total = 0;
+    if(!element)
+    {
+        return 0;
+    }
+    for( i = 0 ; i < element->buffer_index; ++i)
+    {
+        if(clGetMemObjectInfo(element->buffers[i],CL_MEM_SIZE,
+                    sizeof(size_t),&size,NULL) == CL_SUCCESS)
+        {
+            total += size;
+        }
+    }
+    return total;
+}
+
+
 int j_opencl_store_is_empty(struct j_opencl_store * store)
 {
     return store->elements == NULL;
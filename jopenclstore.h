@@ -21,3 +21,6 @@ cl_mem j_opencl_store_get_buffer(struct j_opencl_store * store,int index);
 int j_opencl_store_new_session(struct j_opencl_store * store);
 
 int j_opencl_store_pop_session(struct j_opencl_store * store);
+
+// Bytes of device memory held by the session pop_session would release
+size_t j_opencl_store_session_size(struct j_opencl_store * store);
@@ -0,0 +1,406 @@
+/*
+ * jpegbench.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains a decoder benchmark.  Every JPEG file of a directory
+ * is loaded into memory once, then decoded repeatedly through jpeg_mem_src
+ * with the output thrown away, so only the decoder is measured:
+ *	jpeg_bench [options]  directory
+ * It reports megapixels/s, images/s, latency percentiles and the per-stage
+ * breakdown collected through cinfo->cl_profiling.  With -cpu the host
+ * pipeline is measured instead; it has no device times.
+ */
+
+#include "cdjpeg.h"		/* Common decls for cjpeg/djpeg applications */
+#include "ReadFile.h"
+#include <dirent.h>
+#include <time.h>
+
+
+typedef struct {
+    char * name;
+    char * data;
+    int size;
+} bench_file;
+
+static const char * progname;	/* program name for error messages */
+static int iterations;		/* timed passes over the corpus */
+static int warmup;		/* untimed passes, to load programs etc. */
+static boolean use_cpu;		/* decode on the host thread pool */
+static int cpu_threads;		/* host threads, 0 = one per core */
+static long retain_bytes;	/* IMAGE pools kept between images */
+static long huge_threshold;	/* huge pages from this size up, 0 = off */
+static long budget_bytes;	/* memory_budget, 0 = none */
+
+
+LOCAL(void)
+usage (void)
+/* complain about bad command line */
+{
+    fprintf(stderr, "usage: %s [switches] directory\n", progname);
+    fprintf(stderr, "Switches (names may be abbreviated):\n");
+    fprintf(stderr, "  -iterations N  Decode the corpus N times (default 10)\n");
+    fprintf(stderr, "  -warmup N      Untimed passes before measuring (default 1)\n");
+    fprintf(stderr, "  -budget N      Hold at most N kbytes on host and device together\n");
+    fprintf(stderr, "  -cpu           Decode on the CPU even if an OpenCL device exists\n");
+    fprintf(stderr, "  -threads N     CPU decode threads (default one per core)\n");
+    fprintf(stderr, "  -retain N      Keep up to N kbytes of image memory between images\n");
+    fprintf(stderr, "  -hugepages N   Map buffers of N kbytes or more on huge pages\n");
+    exit(EXIT_FAILURE);
+}
+
+
+LOCAL(int)
+parse_switches (int argc, char **argv)
+/* Parse optional switches.
+ * Returns argv[] index of the directory argument (== argc if none).
+ */
+{
+    int argn;
+    char * arg;
+
+    iterations = 10;
+    warmup = 1;
+    use_cpu = FALSE;
+    cpu_threads = 0;
+    retain_bytes = 0;
+    huge_threshold = 0;
+    budget_bytes = 0;
+
+    for (argn = 1; argn < argc; argn++) {
+        arg = argv[argn];
+        if (*arg != '-')
+            break;			/* done parsing switches */
+        arg++;			/* advance past switch marker character */
+
+        if (keymatch(arg, "budget", 1)) {
+            /* Memory budget in Kb (or Mb with 'm'). */
+            long lval;
+            char ch = 'x';
+
+            if (++argn >= argc)
+                usage();
+            if (sscanf(argv[argn], "%ld%c", &lval, &ch) < 1 || lval < 0)
+                usage();
+            if (ch == 'm' || ch == 'M')
+                lval *= 1000L;
+            budget_bytes = lval * 1000L;
+
+        } else if (keymatch(arg, "cpu", 1)) {
+            use_cpu = TRUE;
+
+        } else if (keymatch(arg, "hugepages", 1)) {
+            if (++argn >= argc)
+                usage();
+            if (sscanf(argv[argn], "%ld", &huge_threshold) != 1 ||
+                    huge_threshold < 1)
+                usage();
+            huge_threshold *= 1000L;
+
+        } else if (keymatch(arg, "iterations", 1)) {
+            if (++argn >= argc)
+                usage();
+            if (sscanf(argv[argn], "%d", &iterations) != 1 || iterations < 1)
+                usage();
+
+        } else if (keymatch(arg, "retain", 1)) {
+            /* Memory to keep in Kb (or Mb with 'm'). */
+            long lval;
+            char ch = 'x';
+
+            if (++argn >= argc)
+                usage();
+            if (sscanf(argv[argn], "%ld%c", &lval, &ch) < 1 || lval < 0)
+                usage();
+            if (ch == 'm' || ch == 'M')
+                lval *= 1000L;
+            retain_bytes = lval * 1000L;
+
+        } else if (keymatch(arg, "threads", 1)) {
+            if (++argn >= argc)
+                usage();
+            if (sscanf(argv[argn], "%d", &cpu_threads) != 1 || cpu_threads < 0)
+                usage();
+
+        } else if (keymatch(arg, "warmup", 1)) {
+            if (++argn >= argc)
+                usage();
+            if (sscanf(argv[argn], "%d", &warmup) != 1 || warmup < 0)
+                usage();
+
+        } else {
+            usage();			/* bogus switch */
+        }
+    }
+    return argn;
+}
+
+
+LOCAL(boolean)
+is_jpeg_name (const char * name)
+{
+    const char * dot = strrchr(name, '.');
+
+    if (dot == NULL)
+        return FALSE;
+    return strcmp(dot, ".jpg") == 0 || strcmp(dot, ".jpeg") == 0 ||
+        strcmp(dot, ".JPG") == 0 || strcmp(dot, ".JPEG") == 0;
+}
+
+
+/*
+ * Load every JPEG of the directory into memory.
+ * Returns the number of files; *files is malloc'd.
+ */
+
+LOCAL(int)
+load_corpus (const char * dir_name, bench_file ** files)
+{
+    DIR * dir;
+    struct dirent * entry;
+    bench_file * list = NULL;
+    int count = 0;
+    int allocated = 0;
+    char * path;
+
+    if ((dir = opendir(dir_name)) == NULL) {
+        fprintf(stderr, "%s: can't open %s\n", progname, dir_name);
+        exit(EXIT_FAILURE);
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (! is_jpeg_name(entry->d_name))
+            continue;
+        if (count == allocated) {
+            allocated = allocated ? allocated * 2 : 64;
+            list = (bench_file *) realloc(list, allocated * sizeof(bench_file));
+            if (list == NULL) {
+                fprintf(stderr, "%s: out of memory\n", progname);
+                exit(EXIT_FAILURE);
+            }
+        }
+        path = (char *) malloc(strlen(dir_name) + strlen(entry->d_name) + 2);
+        if (path == NULL) {
+            fprintf(stderr, "%s: out of memory\n", progname);
+            exit(EXIT_FAILURE);
+        }
+        sprintf(path, "%s/%s", dir_name, entry->d_name);
+        list[count].size = read_all_bytes(path, &list[count].data);
+        if (list[count].size == 0) {
+            fprintf(stderr, "%s: can't read %s, skipped\n", progname, path);
+            free(path);
+            continue;
+        }
+        list[count].name = path;
+        count++;
+    }
+    closedir(dir);
+    *files = list;
+    return count;
+}
+
+
+LOCAL(double)
+now_seconds (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+
+/*
+ * Give up on an image the decoder cannot finish.  The memory source
+ * suspends rather than faking an EOI, so a truncated file would otherwise
+ * produce no rows forever.
+ */
+
+LOCAL(void)
+fail_image (bench_file * file)
+{
+    fprintf(stderr, "%s: %s: premature end of data, file truncated?\n",
+            progname, file->name);
+    exit(EXIT_FAILURE);
+}
+
+
+/*
+ * Decode one image into a scratch buffer.  The OpenCL pipeline emits the
+ * whole image in one jpeg_read_scanlines call, so the buffer holds the
+ * whole image with contiguous rows.
+ * Returns the number of pixels decoded.
+ */
+
+LOCAL(long)
+decode_one (j_decompress_ptr cinfo, bench_file * file)
+{
+    JSAMPARRAY rows;
+    JSAMPROW pixels;
+    JDIMENSION row, row_stride;
+    long pixel_count;
+
+    jpeg_mem_src(cinfo, file->data, file->size);
+    if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK)
+        fail_image(file);
+    cinfo->dct_method = JDCT_FLOAT;
+    if (! jpeg_start_decompress(cinfo))
+        fail_image(file);
+
+    row_stride = cinfo->output_width * cinfo->output_components;
+    pixels = (JSAMPROW) (*cinfo->mem->alloc_large)
+        ((j_common_ptr) cinfo, JPOOL_IMAGE,
+         (size_t) row_stride * cinfo->output_height * SIZEOF(JSAMPLE));
+    rows = (JSAMPARRAY) (*cinfo->mem->alloc_small)
+        ((j_common_ptr) cinfo, JPOOL_IMAGE,
+         cinfo->output_height * SIZEOF(JSAMPROW));
+    for (row = 0; row < cinfo->output_height; row++)
+        rows[row] = pixels + row * row_stride;
+
+    while (cinfo->output_scanline < cinfo->output_height) {
+        if (jpeg_read_scanlines(cinfo, rows + cinfo->output_scanline,
+                cinfo->output_height - cinfo->output_scanline) == 0)
+            fail_image(file);
+    }
+    pixel_count = (long) cinfo->output_width * cinfo->output_height;
+    if (! jpeg_finish_decompress(cinfo))
+        fail_image(file);
+    return pixel_count;
+}
+
+
+LOCAL(int)
+compare_doubles (const void * a, const void * b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+
+LOCAL(double)
+percentile (double * sorted, long count, int pct)
+{
+    long index = (count * pct + 99) / 100 - 1;
+
+    if (index < 0)
+        index = 0;
+    return sorted[index];
+}
+
+
+LOCAL(void)
+print_report (j_decompress_ptr cinfo, double * latencies, long count,
+        double total_seconds, double total_pixels)
+{
+    static const char * const stage_names[JSTAGE_COUNT] = {
+        "entropy", "upload", "idct", "upsample", "color", "readback"
+    };
+    jpeg_stage_stats * stats;
+    int stage;
+
+    qsort(latencies, count, sizeof(double), compare_doubles);
+    printf("images      %ld in %.3f s\n", count, total_seconds);
+    printf("throughput  %.2f MP/s, %.2f images/s\n",
+            total_pixels / total_seconds / 1e6, count / total_seconds);
+    printf("latency ms  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+            percentile(latencies, count, 50) * 1000.0,
+            percentile(latencies, count, 90) * 1000.0,
+            percentile(latencies, count, 99) * 1000.0,
+            latencies[count - 1] * 1000.0);
+
+    printf("%-10s %12s %12s %12s\n", "stage",
+            "host ms/img", "queue ms/img", "device ms/img");
+    for (stage = 0; stage < JSTAGE_COUNT; stage++) {
+        stats = &cinfo->cl_stats.stage[stage];
+        printf("%-10s %12.3f %12.3f %12.3f\n", stage_names[stage],
+                stats->host_seconds * 1000.0 / count,
+                (stats->queued_seconds + stats->submit_seconds) * 1000.0 / count,
+                stats->device_seconds * 1000.0 / count);
+    }
+    printf("memory      peak %ld KB, %ld KB host and %ld KB device at exit\n",
+            cinfo->mem->peak_space_allocated / 1000L,
+            cinfo->mem->host_space_allocated / 1000L,
+            cinfo->mem->device_space_allocated / 1000L);
+}
+
+
+/*
+ * The main program.
+ */
+
+int
+main (int argc, char **argv)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    struct jpeg_huge_allocator huge_alloc;
+    bench_file * files;
+    int file_count, file_index, pass;
+    double * latencies;
+    long decoded;
+    double start, total_start, total_pixels;
+
+    progname = argv[0];
+    if (progname == NULL || progname[0] == 0)
+        progname = "jpeg_bench";
+
+    file_index = parse_switches(argc, argv);
+    if (file_index != argc - 1)
+        usage();
+    file_count = load_corpus(argv[file_index], &files);
+    if (file_count == 0) {
+        fprintf(stderr, "%s: no JPEG files in %s\n", progname, argv[file_index]);
+        exit(EXIT_FAILURE);
+    }
+    latencies = (double *) malloc((size_t) iterations * file_count * sizeof(double));
+    if (latencies == NULL) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        exit(EXIT_FAILURE);
+    }
+
+    /* One object for the whole run, as a server would keep it. */
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    cinfo.cl_profiling = TRUE;
+    cinfo.cl_disable = use_cpu;
+    cinfo.cpu_threads = cpu_threads;
+    cinfo.mem->max_memory_to_retain = retain_bytes;
+    cinfo.mem->memory_budget = budget_bytes;
+    if (huge_threshold > 0)
+        cinfo.mem->allocator =
+            jpeg_huge_allocator(&huge_alloc, (size_t) huge_threshold);
+
+    for (pass = 0; pass < warmup; pass++) {
+        for (file_index = 0; file_index < file_count; file_index++)
+            (void) decode_one(&cinfo, &files[file_index]);
+    }
+    MEMZERO(&cinfo.cl_stats, SIZEOF(cinfo.cl_stats));
+    cinfo.mem->peak_space_allocated = 0;
+
+    decoded = 0;
+    total_pixels = 0.0;
+    total_start = now_seconds();
+    for (pass = 0; pass < iterations; pass++) {
+        for (file_index = 0; file_index < file_count; file_index++) {
+            start = now_seconds();
+            total_pixels += decode_one(&cinfo, &files[file_index]);
+            latencies[decoded++] = now_seconds() - start;
+        }
+    }
+    print_report(&cinfo, latencies, decoded, now_seconds() - total_start,
+            total_pixels);
+
+    jpeg_destroy_decompress(&cinfo);
+    for (file_index = 0; file_index < file_count; file_index++) {
+        free_all_bytes(files[file_index].data);
+        free(files[file_index].name);
+    }
+    free(files);
+    free(latencies);
+    exit(EXIT_SUCCESS);
+    return 0;			/* suppress no-return-value warnings */
+}
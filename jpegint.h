@@ -50,6 +50,11 @@ struct jpeg_comp_master {
   /* State variables made visible to other modules */
   boolean call_pass_startup;	/* True if pass_startup must be called */
   boolean is_last_pass;		/* True during last pass */
+  /* Restart spacing in MCU rows for this image: the application's
+   * restart_in_rows, or the one jinit_compress_master picks for parallel
+   * entropy coding, which is not written back into cinfo.
+   */
+  int restart_in_rows;
 };
 
 /* Main buffer control (downsampled-data buffer) */
@@ -77,6 +82,8 @@ struct jpeg_c_coef_controller {
   JMETHOD(void, start_pass, (j_compress_ptr cinfo, J_BUF_MODE pass_mode));
   JMETHOD(boolean, compress_data, (j_compress_ptr cinfo,
 				   JSAMPIMAGE input_buf));
+  /* Pointer to array of coefficient virtual arrays, or NULL if none */
+  jvirt_barray_ptr *coef_arrays;
 };
 
 /* Colorspace conversion */
@@ -211,6 +218,16 @@ struct jpeg_entropy_decoder {
   JMETHOD(boolean, decode_mcu, (j_decompress_ptr cinfo,
 				JBLOCKROW *MCU_data));
 
+  /* Entropy index support (jdindex.c): copy the decoder's state at the
+   * start of an MCU to or from an index entry.  save_state returns FALSE
+   * if the state is not worth keeping, having run out of data.  NULL in
+   * decoders without index support.
+   */
+  JMETHOD(boolean, save_state, (j_decompress_ptr cinfo,
+				jpeg_index_entry * entry));
+  JMETHOD(void, restore_state, (j_decompress_ptr cinfo,
+				const jpeg_index_entry * entry));
+
   /* This is here to share code between baseline and progressive decoders; */
   /* other modules probably should not use it */
   boolean insufficient_data;	/* set TRUE after emitting warning */
@@ -311,6 +328,10 @@ EXTERN(void) jinit_forward_dct JPP((j_compress_ptr cinfo));
 EXTERN(void) jinit_huff_encoder JPP((j_compress_ptr cinfo));
 EXTERN(void) jinit_phuff_encoder JPP((j_compress_ptr cinfo));
 EXTERN(void) jinit_marker_writer JPP((j_compress_ptr cinfo));
+/* OpenCL compression pipeline (jcopencl.c) */
+EXTERN(boolean) jopencl_compress_supported JPP((j_compress_ptr cinfo));
+EXTERN(cl_int) jopencl_compress_image JPP((j_compress_ptr cinfo,
+					   JSAMPARRAY image));
 /* Decompression module initialization routines */
 EXTERN(void) jinit_master_decompress JPP((j_decompress_ptr cinfo));
 EXTERN(void) jinit_d_main_controller JPP((j_decompress_ptr cinfo,
@@ -323,6 +344,19 @@ EXTERN(void) jinit_input_controller JPP((j_decompress_ptr cinfo));
 EXTERN(void) jinit_marker_reader JPP((j_decompress_ptr cinfo));
 EXTERN(void) jinit_huff_decoder JPP((j_decompress_ptr cinfo));
 EXTERN(void) jinit_phuff_decoder JPP((j_decompress_ptr cinfo));
+EXTERN(struct jpeg_entropy_decoder *) jcopy_phuff_decoder
+	JPP((j_decompress_ptr cinfo));
+EXTERN(jpeg_entropy_index *) jindex_alloc
+	JPP((j_decompress_ptr cinfo, JDIMENSION interval,
+	     JDIMENSION total_MCUs));
+EXTERN(boolean) jindex_save_entry JPP((j_decompress_ptr cinfo,
+				       const JOCTET * base, const JOCTET * limit,
+				       jpeg_index_entry * entry));
+EXTERN(void) jindex_restore_entry JPP((j_decompress_ptr cinfo,
+				      const JOCTET * base, const JOCTET * limit,
+				      const jpeg_index_entry * entry));
+EXTERN(void) jindex_write JPP((j_decompress_ptr cinfo,
+			      jpeg_entropy_index * index));
 EXTERN(void) jinit_inverse_dct JPP((j_decompress_ptr cinfo));
 EXTERN(void) jinit_upsampler JPP((j_decompress_ptr cinfo));
 EXTERN(void) jinit_color_deconverter JPP((j_decompress_ptr cinfo));
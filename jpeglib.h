@@ -266,6 +266,10 @@ typedef struct jpeg_compress_struct * j_compress_ptr;
 typedef struct jpeg_decompress_struct * j_decompress_ptr;
 
 
+struct j_opencl_store;
+struct j_opencl_prog_pool;
+struct j_threadpool;
+
 /* Master record for a compression instance */
 
 struct jpeg_compress_struct {
@@ -406,10 +410,135 @@ struct jpeg_compress_struct {
   struct jpeg_entropy_encoder * entropy;
   jpeg_scan_info * script_space; /* workspace for jpeg_simple_progression */
   int script_space_size;
+
+  cl_context current_cl_context;
+  cl_command_queue current_cl_queue;
+  cl_device_id current_device_id;
+  struct j_opencl_store * cl_store;
+  struct j_opencl_prog_pool * cl_prog_pool;
+
+  /* OpenCL pipeline.  For RGB input written as YCbCr with the ISLOW DCT
+   * and no smoothing, jpeg_start_compress runs color conversion,
+   * downsampling, DCT and quantization of the whole image on the device
+   * and records that in cl_pipeline; the image is then buffered until its
+   * last scanline arrives.  The application may set cl_disable to keep
+   * the row-by-row CPU path.
+   */
+  boolean cl_disable;
+  boolean cl_pipeline;
+
+  /* Parallel entropy coding.  With entropy_threads other than 1 (0 = one
+   * per core), jpeg_start_compress keeps the coefficients of the whole
+   * image and the Huffman encoder codes the restart intervals of each
+   * sequential scan concurrently, recording the choice in
+   * parallel_entropy.  If neither restart_interval nor restart_in_rows is
+   * set, the library picks a restart spacing that gives each thread several
+   * intervals; cinfo's own fields are left as they were.  As in other multi-pass modes the destination cannot
+   * suspend.  With optimize_coding the statistics are also gathered in
+   * parallel, for progressive scans too (except AC refinement scans);
+   * progressive output is still coded serially.
+   */
+  int entropy_threads;
+  boolean parallel_entropy;
+  struct j_threadpool * cpu_pool;
+
+  /* With optimize_coding, fast_optimize makes a sequential scan's AC
+   * statistics from every fourth MCU row only, in scans of 32 MCU rows or
+   * more.  The tables still code every possible symbol, which costs a few
+   * hundred bytes: 0.1-0.25% of a 1440x954 photo, less for larger ones.
+   */
+  boolean fast_optimize;
 };
 
-struct j_opencl_store;
-struct j_opencl_prog_pool;
+struct j_opencl_scheduler;
+struct j_opencl_prof;
+struct j_threadpool;
+/* Per-stage timing of the decompressor, filled in when cl_profiling is set.
+ * Host times are wall-clock seconds spent in the library for that stage;
+ * the device times come from OpenCL event profiling and are summed over
+ * every command of the stage.
+ */
+
+#define JSTAGE_ENTROPY		0 /* Huffman decoding, host only */
+#define JSTAGE_UPLOAD		1 /* coefficients and tables to the device */
+#define JSTAGE_IDCT		2
+#define JSTAGE_UPSAMPLE		3
+#define JSTAGE_COLOR		4
+#define JSTAGE_READBACK		5 /* final pixels back to the host */
+#define JSTAGE_COUNT		6
+
+typedef struct {
+  double host_seconds;		/* time the host spent in this stage */
+  double queued_seconds;	/* CL_PROFILING_COMMAND_QUEUED -> SUBMIT */
+  double submit_seconds;	/* CL_PROFILING_COMMAND_SUBMIT -> START */
+  double device_seconds;	/* CL_PROFILING_COMMAND_START -> END */
+  long commands;		/* OpenCL commands profiled */
+} jpeg_stage_stats;
+
+typedef struct {
+  jpeg_stage_stats stage[JSTAGE_COUNT];
+} jpeg_decompress_stats;
+
+/* Entropy index of a sequential single-scan image (see jdindex.c): the
+ * Huffman decoder's state at the start of every interval'th MCU, from
+ * which decoding can pick up without going through the MCUs before it.
+ */
+
+typedef struct {
+  long offset;			/* bytes into the entropy-coded data */
+  INT32 get_buffer;		/* bit buffer contents */
+  int bits_left;		/* # of unused bits in it */
+  int unread_marker;		/* marker the bit reader stopped at, or 0 */
+  unsigned int restarts_to_go;	/* MCUs left in this restart interval */
+  int next_restart_num;		/* next restart number expected (0-7) */
+  int last_dc_val[MAX_COMPS_IN_SCAN]; /* DC predictions */
+} jpeg_index_entry;
+
+typedef struct {
+  JDIMENSION interval;		/* MCUs between entries */
+  JDIMENSION total_MCUs;	/* MCUs in the scan */
+  JDIMENSION num_entries;	/* entry i is the state at MCU i * interval */
+  jpeg_index_entry * entries;
+  jpeg_index_entry end;		/* state after the last MCU */
+} jpeg_entropy_index;
+
+/* What jpeg_probe_header finds in the markers of a JPEG file in memory.
+ * Segment payloads are not copied: each is given by its offset into the
+ * caller's buffer, just past the marker length word.
+ */
+
+#define JPEG_PROBE_MAX_SEGMENTS	32 /* APPn/COM segments reported */
+
+typedef struct {
+  int component_id;		/* identifier for this component (0..255) */
+  int h_samp_factor;		/* horizontal sampling factor (1..4) */
+  int v_samp_factor;		/* vertical sampling factor (1..4) */
+  int quant_tbl_no;		/* quantization table selector (0..3) */
+} jpeg_probe_component;
+
+typedef struct {
+  UINT8 marker;			/* marker code: JPEG_COM, or JPEG_APP0+n */
+  size_t offset;		/* first payload byte, from start of buffer */
+  size_t length;		/* # bytes of payload */
+} jpeg_probe_segment;
+
+typedef struct {
+  JDIMENSION image_width;	/* from the SOF marker */
+  JDIMENSION image_height;	/* 0 if given by a DNL marker */
+  int data_precision;		/* bits per sample */
+  int num_components;
+  jpeg_probe_component comp[MAX_COMPONENTS];
+  int sof_marker;		/* SOFn marker code, 0 if none was found */
+  boolean progressive_mode;	/* SOF2, SOF6, SOF10 or SOF14 */
+  boolean arith_code;		/* SOF9 and up */
+  unsigned int restart_interval; /* from a DRI before the first SOS */
+  size_t sos_offset;		/* offset of the first SOS marker, or 0 */
+  int num_segments;		/* # of APPn/COM segments in segment[] */
+  boolean segments_dropped;	/* TRUE if there were more than fit */
+  jpeg_probe_segment segment[JPEG_PROBE_MAX_SEGMENTS];
+} jpeg_probe_info;
+
+
 /* Master record for a decompression instance */
 
 struct jpeg_decompress_struct {
@@ -637,6 +766,64 @@ struct jpeg_decompress_struct {
   cl_device_id current_device_id;
   struct j_opencl_store * cl_store;
   struct j_opencl_prog_pool * cl_prog_pool;
+
+  /* Device copy of the coefficients of a progressive file read in
+   * buffered-image mode, updated by each output pass with the rows the
+   * new scans changed.  Kept for the next image and released with the
+   * OpenCL environment.
+   */
+  cl_mem cl_coef_buffer;
+  size_t cl_coef_size;
+
+  /* Set by the application to spread jpeg_decompress_batch over every
+   * OpenCL device; the scheduler is created on first use.
+   */
+  boolean cl_multi_device;
+  struct j_opencl_scheduler * cl_scheduler;
+
+  /* Set by the application before jpeg_start_decompress to create the
+   * queue with CL_QUEUE_PROFILING_ENABLE and fill in cl_stats.
+   * cl_stats accumulates over images until the application clears it.
+   */
+  boolean cl_profiling;
+  jpeg_decompress_stats cl_stats;
+  struct j_opencl_prof * cl_prof;
+
+  /* Host pipeline.  The application may set cl_disable to decode on the
+   * CPU even when a device exists; jpeg_start_decompress also falls back
+   * to it when no OpenCL device can be brought up, and records the choice
+   * in cpu_pipeline.  IDCT, upsampling and color conversion then run in
+   * iMCU-row bands on up to cpu_threads threads (0 = one per core).
+   * The same pool decodes the scans of a progressive file in parallel,
+   * whichever pipeline does the IDCT.
+   */
+  boolean cl_disable;
+  int cpu_threads;
+  boolean cpu_pipeline;
+  struct j_threadpool * cpu_pool;
+
+  /* Region of interest, in pixels of the scaled image, set with
+   * jpeg_set_region after jpeg_read_header; region_width 0 means the whole
+   * image.  jpeg_calc_output_dimensions crops output_width and output_height
+   * to the region and leaves the uncropped size in full_output_width and
+   * full_output_height.  Only the MCUs under the region, and one MCU around
+   * it for fancy upsampling, are transformed; the rest is entropy decoded
+   * and dropped.
+   */
+  JDIMENSION region_x, region_y, region_width, region_height;
+  JDIMENSION full_output_width, full_output_height;
+
+  /* Entropy index.  jpeg_build_index sets index_interval and index_file to
+   * have one recorded as the scan is decoded and written out at its end;
+   * jpeg_read_index loads one into entropy_index, after which only the
+   * MCUs from the entry before the region (or the first line not skipped)
+   * to the end of it are entropy decoded.  Both need the whole file in
+   * memory, as with jpeg_mem_src or jpeg_mmap_src, and a sequential
+   * single-scan image.
+   */
+  JDIMENSION index_interval;
+  FILE * index_file;
+  jpeg_entropy_index * entropy_index;
 };
 
 
@@ -763,6 +950,42 @@ typedef struct jvirt_sarray_control * jvirt_sarray_ptr;
 typedef struct jvirt_barray_control * jvirt_barray_ptr;
 
 
+/* Allocator the memory manager obtains its pools from.  By default (a NULL
+ * cinfo->mem->allocator) that is jpeg_get_small/jpeg_get_large of the
+ * system-dependent back end (jmemsys.h).  An application may install its
+ * own after creating the JPEG object, eg to place buffers on a NUMA node
+ * or in a per-thread arena; additional private fields may follow the
+ * methods.  Each pool is released through the allocator that obtained it,
+ * so the allocator may be changed at any time, but it must stay valid
+ * until the object is destroyed.  The get methods return NULL on failure.
+ */
+
+struct jpeg_allocator {
+  JMETHOD(void *, get_small, (j_common_ptr cinfo,
+			      struct jpeg_allocator * allocator,
+			      size_t sizeofobject));
+  JMETHOD(void, free_small, (j_common_ptr cinfo,
+			     struct jpeg_allocator * allocator,
+			     void * object, size_t sizeofobject));
+  JMETHOD(void FAR *, get_large, (j_common_ptr cinfo,
+				  struct jpeg_allocator * allocator,
+				  size_t sizeofobject));
+  JMETHOD(void, free_large, (j_common_ptr cinfo,
+			     struct jpeg_allocator * allocator,
+			     void FAR * object, size_t sizeofobject));
+};
+
+/* The bundled huge-page allocator (jmemhuge.c): large objects of at least
+ * threshold bytes are mapped on huge pages, everything else goes to the
+ * default allocator.  threshold must not change while objects are out.
+ */
+
+struct jpeg_huge_allocator {
+  struct jpeg_allocator pub;	/* public fields */
+  size_t threshold;
+};
+
+
 struct jpeg_memory_mgr {
   /* Method pointers */
   JMETHOD(void *, alloc_small, (j_common_ptr cinfo, int pool_id,
@@ -800,6 +1023,10 @@ struct jpeg_memory_mgr {
 					    boolean writable));
   JMETHOD(void, free_pool, (j_common_ptr cinfo, int pool_id));
   JMETHOD(void, self_destruct, (j_common_ptr cinfo));
+  /* Charge an OpenCL buffer about to be created (bytes > 0) or credit one
+   * just released (bytes < 0) to this object; see memory_budget.
+   */
+  JMETHOD(void, account_device_space, (j_common_ptr cinfo, long bytes));
 
   /* Limit on memory allocation for this JPEG object.  (Note that this is
    * merely advisory, not a guaranteed maximum; it only affects the space
@@ -810,6 +1037,35 @@ struct jpeg_memory_mgr {
 
   /* Maximum allocation request accepted by alloc_large. */
   long max_alloc_chunk;
+
+  /* Space in bytes of the IMAGE pools freed at the end of an image that is
+   * kept for reuse by the next image on this object, instead of going back
+   * to the system.  0 (the default) keeps nothing.  May be changed by outer
+   * application at any time; takes effect when the next image ends.
+   */
+  long max_memory_to_retain;
+
+  /* Where new pools come from; NULL for jpeg_get_small/jpeg_get_large. */
+  struct jpeg_allocator * allocator;
+
+  /* Hard limit on the bytes held for this object on the host and on the
+   * OpenCL device together, kept pools included; 0 (the default) means
+   * none.  jpeg_start_decompress falls back to the host pipeline when the
+   * device one would not fit, progressive coefficients go to virtual
+   * arrays (and so to backing store) when they would not fit in memory,
+   * and any allocation that still breaks the limit fails with
+   * JERR_MEMORY_BUDGET.  May be changed by outer application at any time.
+   */
+  long memory_budget;
+
+  /* Accounting kept by the library for the application to read: bytes now
+   * held in pools and in device buffers, and the highest their sum has
+   * reached.  The application may reset peak_space_allocated to measure
+   * a single image.
+   */
+  long host_space_allocated;
+  long device_space_allocated;
+  long peak_space_allocated;
 };
 
 
@@ -844,6 +1100,10 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 EXTERN(struct jpeg_error_mgr *) jpeg_std_error
 	JPP((struct jpeg_error_mgr * err));
 
+/* Huge-page allocator setup; install the result in cinfo->mem->allocator */
+EXTERN(struct jpeg_allocator *) jpeg_huge_allocator
+	JPP((struct jpeg_huge_allocator * alloc, size_t threshold));
+
 /* Initialization of JPEG compression objects.
  * jpeg_create_compress() and jpeg_create_decompress() are the exported
  * names that applications should call.  These expand to calls on
@@ -870,6 +1130,23 @@ EXTERN(void) jpeg_destroy_decompress JPP((j_decompress_ptr cinfo));
 EXTERN(void) jpeg_stdio_dest JPP((j_compress_ptr cinfo, FILE * outfile));
 EXTERN(void) jpeg_stdio_src JPP((j_decompress_ptr cinfo, FILE * infile));
 EXTERN(void) jpeg_mem_src JPP((j_decompress_ptr cinfo, void * aMem,size_t aSize));
+/* Whole-file memory mapping of an open descriptor (POSIX, jmmapsrc.c).
+ * FALSE if the file cannot be mapped; the mapping is released by
+ * jpeg_mmap_src_close, which must precede jpeg_destroy_decompress.
+ */
+EXTERN(boolean) jpeg_mmap_src JPP((j_decompress_ptr cinfo, int fd));
+EXTERN(void) jpeg_mmap_src_close JPP((j_decompress_ptr cinfo));
+/* Suspending source fed piecewise by the application (jfeedsrc.c).
+ * Call jpeg_feed_bytes whenever data arrives, jpeg_feed_end at its end.
+ */
+EXTERN(void) jpeg_feed_src JPP((j_decompress_ptr cinfo));
+EXTERN(void) jpeg_feed_bytes JPP((j_decompress_ptr cinfo,
+				 const JOCTET * data, size_t size));
+EXTERN(void) jpeg_feed_end JPP((j_decompress_ptr cinfo));
+
+/* Header probe of a JPEG file in memory, needing no JPEG object (jdprobe.c) */
+EXTERN(boolean) jpeg_probe_header JPP((const JOCTET * data, size_t size,
+				       jpeg_probe_info * info));
 
 /* Default parameter setup for compression */
 EXTERN(void) jpeg_set_defaults JPP((j_compress_ptr cinfo));
@@ -938,6 +1215,9 @@ EXTERN(JDIMENSION) jpeg_read_scanlines JPP((j_decompress_ptr cinfo,
 					    JSAMPARRAY scanlines,
 					    JDIMENSION max_lines));
 EXTERN(boolean) jpeg_finish_decompress JPP((j_decompress_ptr cinfo));
+/* Skip lines before the first jpeg_read_scanlines call, without IDCT. */
+EXTERN(JDIMENSION) jpeg_skip_scanlines JPP((j_decompress_ptr cinfo,
+					    JDIMENSION num_lines));
 
 /* Replaces jpeg_read_scanlines when reading raw downsampled data. */
 EXTERN(JDIMENSION) jpeg_read_raw_data JPP((j_decompress_ptr cinfo,
@@ -959,8 +1239,41 @@ EXTERN(int) jpeg_consume_input JPP((j_decompress_ptr cinfo));
 #define JPEG_ROW_COMPLETED	3 /* Completed one iMCU row */
 #define JPEG_SCAN_COMPLETED	4 /* Completed last iMCU row of a scan */
 
+/* Batched decompression of many small images sharing one geometry. */
+typedef struct {
+  const JOCTET * data;		/* compressed image, supplied by caller */
+  size_t data_size;
+  JSAMPLE * pixels;		/* decoded pixels, output_components per pixel;
+				 * freed by jpeg_abort_decompress */
+  JDIMENSION output_width;	/* set for images decoded successfully */
+  JDIMENSION output_height;
+  int output_components;
+  int status;			/* one of the codes below */
+} jpeg_batch_image;
+
+#define JBATCH_OK		0 /* decoded, pixels valid */
+#define JBATCH_CORRUPT		1 /* image could not be read */
+#define JBATCH_INCOMPATIBLE	2 /* readable, but not like the rest of the batch */
+
+EXTERN(int) jpeg_decompress_batch JPP((j_decompress_ptr cinfo,
+				       jpeg_batch_image * images,
+				       int num_images, int num_threads));
+
+/* Per-device work and busy time of cl_multi_device batches. */
+EXTERN(void) jpeg_opencl_report_devices JPP((j_decompress_ptr cinfo,
+					     FILE * outfile));
+
 /* Precalculate output dimensions for current decompression parameters. */
 EXTERN(void) jpeg_calc_output_dimensions JPP((j_decompress_ptr cinfo));
+/* Decode only a rectangle of the image; call before start_decompress. */
+EXTERN(void) jpeg_set_region JPP((j_decompress_ptr cinfo,
+				 JDIMENSION x, JDIMENSION y,
+				 JDIMENSION width, JDIMENSION height));
+
+/* Record an entropy index while decoding, or use a recorded one. */
+EXTERN(void) jpeg_build_index JPP((j_decompress_ptr cinfo,
+				  JDIMENSION interval, FILE * outfile));
+EXTERN(boolean) jpeg_read_index JPP((j_decompress_ptr cinfo, FILE * infile));
 
 /* Control saving of COM and APPn markers into marker_list. */
 EXTERN(void) jpeg_save_markers
@@ -0,0 +1,76 @@
+/*
+ * jsimd.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains the run-time CPU feature probe for the SIMD routines.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+#include <cpuid.h>
+#endif
+
+#ifndef NO_GETENV
+#ifndef HAVE_STDLIB_H		/* <stdlib.h> should declare getenv() */
+extern char * getenv JPP((const char * name));
+#endif
+#endif
+
+
+/*
+ * Return the JSIMD_xxx features this CPU and OS can run.
+ * The probe is cheap but is done only once; every thread computes the
+ * same value, so the unsynchronized cache is harmless.
+ */
+
+GLOBAL(int)
+jsimd_cpu_features (void)
+{
+#ifdef JSIMD_X86
+  static int features = -1;
+  unsigned int eax, ebx, ecx, edx;
+  unsigned int xcr0_lo, xcr0_hi;
+  int found = 0;
+
+  if (features >= 0)
+    return features;
+
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    if (edx & bit_SSE2)
+      found |= JSIMD_SSE2;
+    /* AVX2 also needs the OS to save the YMM registers on a task switch */
+    if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX) &&
+	__get_cpuid_max(0, NULL) >= 7) {
+      __asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+      __cpuid_count(7, 0, eax, ebx, ecx, edx);
+      if ((xcr0_lo & 6) == 6 && (ebx & bit_AVX2))
+	found |= JSIMD_AVX2;
+    }
+  }
+
+  /* JPEGSIMD=none or JPEGSIMD=sse2 caps the choice, for testing */
+#ifndef NO_GETENV
+  { char * simdenv;
+
+    if ((simdenv = getenv("JPEGSIMD")) != NULL) {
+      if (strcmp(simdenv, "none") == 0)
+	found = 0;
+      else if (strcmp(simdenv, "sse2") == 0)
+	found &= JSIMD_SSE2;
+    }
+  }
+#endif
+
+  features = found;
+  return features;
+#else
+  return 0;
+#endif
+}
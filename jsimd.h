@@ -0,0 +1,150 @@
+/*
+ * jsimd.h
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file declares the run-time CPU probe that picks SSE2 or AVX2
+ * versions of the host-side routines, and the SIMD row helpers for color
+ * conversion and up- and downsampling.  The SIMD DCTs and quantizers are declared
+ * next to their scalar counterparts (see jdct.h).
+ */
+
+/* The SIMD routines use SSE2/AVX2 intrinsics with per-function target
+ * attributes, so no special compiler switches are needed; they do need a
+ * GCC-compatible compiler on x86.  They also assume the jmorecfg.h
+ * defaults MULTIPLIER = int and FAST_FLOAT = float, and 8-bit samples.
+ */
+
+#if defined(SIMD_SUPPORTED) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__)) && \
+    BITS_IN_JSAMPLE == 8 && DCTSIZE == 8
+#define JSIMD_X86
+#endif
+
+/* The color conversion helpers also need the standard R,G,B pixel layout */
+
+#if defined(JSIMD_X86) && \
+    RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2 && RGB_PIXELSIZE == 3
+#define JSIMD_X86_RGB
+#endif
+
+/* Feature bits returned by jsimd_cpu_features */
+
+#define JSIMD_SSE2	0x01
+#define JSIMD_AVX2	0x02
+
+#ifdef NEED_SHORT_EXTERNAL_NAMES
+#define jsimd_cpu_features	jSCpuFeatures
+#define jsimd_ycc_rgb_row_sse2	jSYccRgbS2
+#define jsimd_ycc_rgb_row_avx2	jSYccRgbA2
+#define jsimd_merged_row_sse2	jSMergedS2
+#define jsimd_merged_row_avx2	jSMergedA2
+#define jsimd_h2v1_fancy_sse2	jSh2v1FS2
+#define jsimd_h2v1_fancy_avx2	jSh2v1FA2
+#define jsimd_h2v2_fancy_sse2	jSh2v2FS2
+#define jsimd_h2v2_fancy_avx2	jSh2v2FA2
+#define jsimd_rgb_ycc_row_sse2	jSRgbYccS2
+#define jsimd_rgb_ycc_row_avx2	jSRgbYccA2
+#define jsimd_h2v1_downsample_sse2	jSh2v1DS2
+#define jsimd_h2v1_downsample_avx2	jSh2v1DA2
+#define jsimd_h2v2_downsample_sse2	jSh2v2DS2
+#define jsimd_h2v2_downsample_avx2	jSh2v2DA2
+#define jsimd_h2v2_smooth_sse2	jSh2v2SS2
+#define jsimd_h2v2_smooth_avx2	jSh2v2SA2
+#endif
+
+EXTERN(int) jsimd_cpu_features JPP((void));
+
+/* The row helpers below do the bulk of a row in vector-sized steps and
+ * return how many columns they handled; the caller finishes the rest with
+ * its scalar loop.  Each gives exactly the scalar results.
+ */
+
+/* YCbCr->RGB of num_cols pixels (jdcolor.c); returns pixels done */
+typedef JMETHOD(JDIMENSION, jsimd_ycc_rgb_row_ptr,
+		(JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		 JSAMPROW outptr, JDIMENSION num_cols));
+/* Merged 2h upsampling and YCbCr->RGB of num_cols pixels (jdmerge.c).
+ * inptr01/outptr1 are the second luma/output row for 2v, else NULL.
+ * Returns pixels done, always even.
+ */
+typedef JMETHOD(JDIMENSION, jsimd_merged_row_ptr,
+		(JSAMPROW inptr00, JSAMPROW inptr01,
+		 JSAMPROW inptr1, JSAMPROW inptr2,
+		 JSAMPROW outptr0, JSAMPROW outptr1, JDIMENSION num_cols));
+/* Fancy upsampling of the num_cols interior columns (jdsample.c).
+ * The input pointers address column 1, the output pointer column 2;
+ * the neighbors on either side are read.  Returns input columns done.
+ */
+typedef JMETHOD(JDIMENSION, jsimd_h2v1_fancy_ptr,
+		(JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+typedef JMETHOD(JDIMENSION, jsimd_h2v2_fancy_ptr,
+		(JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+		 JDIMENSION num_cols));
+/* RGB->YCbCr of num_cols pixels (jccolor.c); returns pixels done */
+typedef JMETHOD(JDIMENSION, jsimd_rgb_ycc_row_ptr,
+		(JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+		 JSAMPROW outptr2, JDIMENSION num_cols));
+/* 2:1 downsampling into output_cols samples (jcsample.c); returns
+ * output samples done, always even.  The smoothing version does the
+ * interior columns: its pointers address input column 2, and it reads
+ * one column on either side.
+ */
+typedef JMETHOD(JDIMENSION, jsimd_h2v1_downsample_ptr,
+		(JSAMPROW inptr, JSAMPROW outptr, JDIMENSION output_cols));
+typedef JMETHOD(JDIMENSION, jsimd_h2v2_downsample_ptr,
+		(JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+		 JDIMENSION output_cols));
+typedef JMETHOD(JDIMENSION, jsimd_h2v2_smooth_ptr,
+		(JSAMPROW above_ptr, JSAMPROW inptr0, JSAMPROW inptr1,
+		 JSAMPROW below_ptr, JSAMPROW outptr, JDIMENSION output_cols,
+		 int memberscale, int neighscale));
+
+EXTERN(JDIMENSION) jsimd_ycc_rgb_row_sse2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_ycc_rgb_row_avx2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_merged_row_sse2
+    JPP((JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr0, JSAMPROW outptr1, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_merged_row_avx2
+    JPP((JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr0, JSAMPROW outptr1, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_h2v1_fancy_sse2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_h2v1_fancy_avx2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_h2v2_fancy_sse2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_h2v2_fancy_avx2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_rgb_ycc_row_sse2
+    JPP((JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JSAMPROW outptr2, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_rgb_ycc_row_avx2
+    JPP((JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JSAMPROW outptr2, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_h2v1_downsample_sse2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION output_cols));
+EXTERN(JDIMENSION) jsimd_h2v1_downsample_avx2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION output_cols));
+EXTERN(JDIMENSION) jsimd_h2v2_downsample_sse2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION output_cols));
+EXTERN(JDIMENSION) jsimd_h2v2_downsample_avx2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION output_cols));
+EXTERN(JDIMENSION) jsimd_h2v2_smooth_sse2
+    JPP((JSAMPROW above_ptr, JSAMPROW inptr0, JSAMPROW inptr1,
+	 JSAMPROW below_ptr, JSAMPROW outptr, JDIMENSION output_cols,
+	 int memberscale, int neighscale));
+EXTERN(JDIMENSION) jsimd_h2v2_smooth_avx2
+    JPP((JSAMPROW above_ptr, JSAMPROW inptr0, JSAMPROW inptr1,
+	 JSAMPROW below_ptr, JSAMPROW outptr, JDIMENSION output_cols,
+	 int memberscale, int neighscale));
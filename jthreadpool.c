@@ -0,0 +1,327 @@
+#include "jthreadpool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_WORKER_COUNT (256)
+
+struct j_threadpool_range
+{
+    pthread_mutex_t lock;
+    int begin;
+    int end;
+};
+
+struct j_threadpool
+{
+    int worker_count;
+    pthread_t * threads;
+    struct j_threadpool_range * ranges;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    unsigned int generation;    // bumped once per job
+    int workers_busy;           // workers that have not finished the job
+    int shutting_down;
+
+    pfn_threadpool_task task;
+    void * arg;
+};
+
+struct j_threadpool_worker_arg
+{
+    struct j_threadpool * pool;
+    int worker;
+};
+
+// take the next index of our own range
+static int take_own(struct j_threadpool_range * range,int * index)
+{
+    int found;
+
+    pthread_mutex_lock(&range->lock);
+    found = range->begin < range->end;
+    if(found)
+    {
+        *index = range->begin ++;
+    }
+    pthread_mutex_unlock(&range->lock);
+    return found;
+}
+
+// move the upper half of the fullest other range into our own range
+static int steal(struct j_threadpool * pool,int worker)
+{
+    struct j_threadpool_range * own;
+    struct j_threadpool_range * range;
+    int victim;
+    int best_victim;
+    int best_left;
+    int left;
+    int begin;
+    int end;
+
+    best_victim = -1;
+    best_left = 0;
+    for(victim = 0 ; victim < pool->worker_count ; ++victim)
+    {
+        if(victim == worker)
+        {
+            continue;
+        }
+        range = &pool->ranges[victim];
+        pthread_mutex_lock(&range->lock);
+        left = range->end - range->begin;
+        pthread_mutex_unlock(&range->lock);
+        if(left > best_left)
+        {
+            best_left = left;
+            best_victim = victim;
+        }
+    }
+    if(best_victim < 0)
+    {
+        return 0;
+    }
+
+    // never hold two range locks at once, two thieves may pick each other
+    range = &pool->ranges[best_victim];
+    pthread_mutex_lock(&range->lock);
+    left = range->end - range->begin;
+    if(left <= 0)
+    {
+        pthread_mutex_unlock(&range->lock);
+        // someone else got there first, look again
+        return 1;
+    }
+    end = range->end;
+    begin = range->begin + left / 2;
+    range->end = begin;
+    pthread_mutex_unlock(&range->lock);
+
+    // our range is empty, so nobody steals from it in between
+    own = &pool->ranges[worker];
+    pthread_mutex_lock(&own->lock);
+    own->begin = begin;
+    own->end = end;
+    pthread_mutex_unlock(&own->lock);
+    return 1;
+}
+
+static void run_share(struct j_threadpool * pool,int worker)
+{
+    int index;
+
+    for(;;)
+    {
+        while(take_own(&pool->ranges[worker],&index))
+        {
+            pool->task(pool->arg,index,worker);
+        }
+        if(!steal(pool,worker))
+        {
+            break;
+        }
+    }
+}
+
+static void * worker_main(void * param)
+{
+    struct j_threadpool_worker_arg * worker_arg;
+    struct j_threadpool * pool;
+    int worker;
+    unsigned int seen_generation;
+
+    worker_arg = (struct j_threadpool_worker_arg *)param;
+    pool = worker_arg->pool;
+    worker = worker_arg->worker;
+    free(worker_arg);
+
+    // the pool was created at generation 0; a job may already have been
+    // posted before this thread got to run, so don't read the counter here
+    seen_generation = 0;
+    pthread_mutex_lock(&pool->lock);
+    for(;;)
+    {
+        while(seen_generation == pool->generation && !pool->shutting_down)
+        {
+            pthread_cond_wait(&pool->job_ready,&pool->lock);
+        }
+        if(pool->shutting_down)
+        {
+            break;
+        }
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_share(pool,worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->workers_busy == 0)
+        {
+            pthread_cond_signal(&pool->job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct j_threadpool * j_threadpool_create(int num_workers)
+{
+    struct j_threadpool * pool;
+    int i;
+
+    if(num_workers <= 0)
+    {
+        num_workers = j_threadpool_default_worker_count();
+    }
+    if(num_workers > MAX_WORKER_COUNT)
+    {
+        num_workers = MAX_WORKER_COUNT;
+    }
+    pool = (struct j_threadpool *)malloc(sizeof(struct j_threadpool));
+    if(!pool)
+    {
+        return NULL;
+    }
+    memset(pool,0,sizeof(struct j_threadpool));
+    pool->worker_count = num_workers;
+    pool->ranges = (struct j_threadpool_range *)malloc(sizeof(struct j_threadpool_range) * num_workers);
+    pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * num_workers);
+    if(!pool->ranges || !pool->threads)
+    {
+        free(pool->ranges);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    for(i = 0 ; i < num_workers ; ++i)
+    {
+        pthread_mutex_init(&pool->ranges[i].lock,NULL);
+        pool->ranges[i].begin = 0;
+        pool->ranges[i].end = 0;
+    }
+    pthread_mutex_init(&pool->lock,NULL);
+    pthread_cond_init(&pool->job_ready,NULL);
+    pthread_cond_init(&pool->job_done,NULL);
+
+    // worker 0 is whoever calls j_threadpool_run
+    for(i = 1 ; i < num_workers ; ++i)
+    {
+        struct j_threadpool_worker_arg * worker_arg;
+
+        worker_arg = (struct j_threadpool_worker_arg *)malloc(sizeof(struct j_threadpool_worker_arg));
+        if(worker_arg)
+        {
+            worker_arg->pool = pool;
+            worker_arg->worker = i;
+        }
+        if(!worker_arg || pthread_create(&pool->threads[i],NULL,worker_main,worker_arg))
+        {
+            free(worker_arg);
+            // run with the threads we managed to start
+            pool->worker_count = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+void j_threadpool_destroy(struct j_threadpool * pool)
+{
+    int i;
+
+    if(!pool)
+    {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for(i = 1 ; i < pool->worker_count ; ++i)
+    {
+        pthread_join(pool->threads[i],NULL);
+    }
+    for(i = 0 ; i < pool->worker_count ; ++i)
+    {
+        pthread_mutex_destroy(&pool->ranges[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_cond_destroy(&pool->job_done);
+    free(pool->ranges);
+    free(pool->threads);
+    free(pool);
+}
+
+int j_threadpool_get_worker_count(struct j_threadpool * pool)
+{
+    return pool ? pool->worker_count : 1;
+}
+
+int j_threadpool_run(struct j_threadpool * pool,int count,pfn_threadpool_task task,void * arg)
+{
+    int i;
+    int share;
+    int begin;
+
+    if(count <= 0)
+    {
+        return 0;
+    }
+    if(!pool || pool->worker_count <= 1 || count == 1)
+    {
+        for(i = 0 ; i < count ; ++i)
+        {
+            task(arg,i,0);
+        }
+        return 0;
+    }
+
+    pool->task = task;
+    pool->arg = arg;
+    share = count / pool->worker_count;
+    for(i = 0 , begin = 0 ; i < pool->worker_count ; ++i)
+    {
+        int size = share + (i < count % pool->worker_count ? 1 : 0);
+
+        pool->ranges[i].begin = begin;
+        pool->ranges[i].end = begin + size;
+        begin += size;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->workers_busy = pool->worker_count - 1;
+    pool->generation ++;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_share(pool,0);
+
+    pthread_mutex_lock(&pool->lock);
+    while(pool->workers_busy > 0)
+    {
+        pthread_cond_wait(&pool->job_done,&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+int j_threadpool_default_worker_count(void)
+{
+    long count;
+
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+    if(count < 1)
+    {
+        return 1;
+    }
+    if(count > MAX_WORKER_COUNT)
+    {
+        return MAX_WORKER_COUNT;
+    }
+    return (int)count;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// A small fixed-size pool of worker threads running "parallel for" jobs.
+// Every job is a range of task indices [0,count).  The range is split
+// evenly between the workers up front; a worker that runs dry steals the
+// upper half of the largest range still pending, so uneven tasks (bands
+// with more nonzero coefficients, images of different sizes) balance out.
+// The calling thread takes part in the job as worker 0.
+
+typedef void (* pfn_threadpool_task)(void * arg,int index,int worker);
+struct j_threadpool;
+
+struct j_threadpool * j_threadpool_create(int num_workers);
+
+void j_threadpool_destroy(struct j_threadpool * pool);
+
+int j_threadpool_get_worker_count(struct j_threadpool * pool);
+
+int j_threadpool_run(struct j_threadpool * pool,int count,pfn_threadpool_task task,void * arg);
+
+int j_threadpool_default_worker_count(void);
@@ -0,0 +1,54 @@
+#define CENTERJSAMPLE	128
+typedef unsigned char JSAMPLE;
+typedef int INT32;
+#define GETJSAMPLE(value)  ((int) (value) & 0xFF)
+#define SCALEBITS	16	/* speediest right-shift on some machines */
+#define CBCR_OFFSET	((INT32) CENTERJSAMPLE << SCALEBITS)
+#define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
+// FIX() of the constants in jccolor.c, for SCALEBITS = 16
+#define FIX_0_29900	19595
+#define FIX_0_58700	38470
+#define FIX_0_11400	7471
+#define FIX_0_16874	11059
+#define FIX_0_33126	21709
+#define FIX_0_50000	32768
+#define FIX_0_41869	27439
+#define FIX_0_08131	5329
+
+// RGB -> YCbCr for the compressor, the same integer sums as the rgb_ycc_tab
+// of jccolor.c.  Global (rows, cols) covers the padded planes; pixels past
+// the right and bottom edges repeat the last column and row, as the
+// preprocessor's edge expansion does.  The three planes are stored one
+// after the other, each get_global_size(0) * get_global_size(1) samples.
+__kernel
+void convert(
+                __global JSAMPLE * input_buf,
+                unsigned int image_width,
+                unsigned int image_height,
+                __global JSAMPLE * output_buf)
+{
+  int r,g,b;
+  __global JSAMPLE * inptr;
+  __global JSAMPLE * outptr;
+  int yoffset = get_global_id(0);
+  int col = get_global_id(1);
+  int width = get_global_size(1);
+  int height = get_global_size(0);
+  int component_image_size = width * height;
+
+  inptr = input_buf + (min(yoffset,(int) image_height - 1) * image_width
+                       + min(col,(int) image_width - 1)) * 3;
+  r = GETJSAMPLE(inptr[0]);
+  g = GETJSAMPLE(inptr[1]);
+  b = GETJSAMPLE(inptr[2]);
+  outptr = output_buf + yoffset * width + col;
+  outptr[0] = (JSAMPLE)
+    ((FIX_0_29900 * r + FIX_0_58700 * g + FIX_0_11400 * b + ONE_HALF)
+     >> SCALEBITS);
+  outptr[component_image_size] = (JSAMPLE)
+    ((- FIX_0_16874 * r - FIX_0_33126 * g + FIX_0_50000 * b
+      + CBCR_OFFSET + ONE_HALF-1) >> SCALEBITS);
+  outptr[component_image_size * 2] = (JSAMPLE)
+    ((FIX_0_50000 * r - FIX_0_41869 * g - FIX_0_08131 * b
+      + CBCR_OFFSET + ONE_HALF-1) >> SCALEBITS);
+}
@@ -0,0 +1,274 @@
+/*
+ * testenc.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains a check of the compressor against the IJG reference
+ * images.  It compresses testimg.ppm as cjpeg would and compares the
+ * result with testimg.jpg (cjpeg testimg.ppm) and testimgp.jpg (cjpeg
+ * -progressive -optimize testimg.ppm), with the Huffman statistics
+ * gathered on one thread and on several.  Sequential output with restart
+ * intervals, coded on one thread and on several, must also be the same,
+ * and a threaded image must leave no restart intervals behind in the
+ * compression object for the next one.
+ * The references were made with the slow integer DCT, so this program is
+ * linked with a build of the library that has it.
+ *
+ * The three files may be named in any order, since the build tool does not
+ * keep the order of a test's input files: the PPM is told by its name and
+ * the progressive reference by its SOF2 marker.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpeglib.h"
+
+
+static JSAMPLE * image;		/* the test image, as read from the PPM */
+static JDIMENSION image_width, image_height;
+static int failures = 0;
+
+
+/* A compressed image in memory */
+
+typedef struct {
+  unsigned char * data;
+  long size;
+} jpeg_image;
+
+
+/* Read a file into memory. */
+
+static jpeg_image
+read_file (const char * name)
+{
+  FILE * file;
+  jpeg_image result;
+
+  if ((file = fopen(name, "rb")) == NULL ||
+      fseek(file, 0L, SEEK_END) != 0 ||
+      (result.size = ftell(file)) <= 0 ||
+      (result.data = (unsigned char *) malloc((size_t) result.size)) == NULL) {
+    fprintf(stderr, "testenc: can't read %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+  rewind(file);
+  if (fread(result.data, 1, (size_t) result.size, file) !=
+      (size_t) result.size) {
+    fprintf(stderr, "testenc: can't read %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+  fclose(file);
+  return result;
+}
+
+
+/* Does the compressed image have a progressive frame header? */
+
+static int
+is_progressive (jpeg_image file)
+{
+  long pos = 2;			/* just past SOI */
+
+  while (pos + 4 <= file.size && file.data[pos] == 0xFF) {
+    switch (file.data[pos + 1]) {
+    case 0xC2:			/* SOF2 */
+      return 1;
+    case 0xC0: case 0xC1: case 0xDA: /* SOF0, SOF1, SOS */
+      return 0;
+    }
+    pos += 2 + ((long) file.data[pos + 2] << 8) + file.data[pos + 3];
+  }
+  return 0;
+}
+
+
+/* Read the raw RGB PPM (P6, maxval 255) to compress. */
+
+static void
+read_ppm (const char * name)
+{
+  FILE * file;
+  unsigned int width, height, maxval;
+  size_t size;
+
+  if ((file = fopen(name, "rb")) == NULL ||
+      fscanf(file, "P6 %u %u %u", &width, &height, &maxval) != 3 ||
+      maxval != 255 || getc(file) == EOF) {
+    fprintf(stderr, "testenc: %s is not a raw 8-bit PPM\n", name);
+    exit(EXIT_FAILURE);
+  }
+  image_width = (JDIMENSION) width;
+  image_height = (JDIMENSION) height;
+  size = (size_t) width * height * 3;
+  if ((image = (JSAMPLE *) malloc(size)) == NULL ||
+      fread(image, 1, size, file) != size) {
+    fprintf(stderr, "testenc: can't read %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+  fclose(file);
+}
+
+
+/*
+ * Compress the test image with the slow integer DCT at the default
+ * quality, as cjpeg does, plus the given options, using an existing
+ * compression object.
+ */
+
+static jpeg_image
+compress_with (j_compress_ptr cinfo, boolean progressive, boolean optimize,
+	       int threads, int restart_in_rows)
+{
+  FILE * outfile;
+  JSAMPROW row;
+  jpeg_image result;
+
+  if ((outfile = tmpfile()) == NULL) {
+    fprintf(stderr, "testenc: can't create output file\n");
+    exit(EXIT_FAILURE);
+  }
+  jpeg_stdio_dest(cinfo, outfile);
+  cinfo->image_width = image_width;
+  cinfo->image_height = image_height;
+  cinfo->input_components = 3;
+  cinfo->in_color_space = JCS_RGB;
+  jpeg_set_defaults(cinfo);
+  cinfo->dct_method = JDCT_ISLOW;
+  cinfo->cl_disable = TRUE;
+  if (progressive)
+    jpeg_simple_progression(cinfo);
+  cinfo->optimize_coding = optimize;
+  cinfo->entropy_threads = threads;
+  cinfo->restart_in_rows = restart_in_rows;
+
+  jpeg_start_compress(cinfo, TRUE);
+  while (cinfo->next_scanline < cinfo->image_height) {
+    row = image + (size_t) cinfo->next_scanline * image_width * 3;
+    (void) jpeg_write_scanlines(cinfo, &row, 1);
+  }
+  jpeg_finish_compress(cinfo);
+
+  result.size = ftell(outfile);
+  result.data = (unsigned char *) malloc((size_t) result.size);
+  rewind(outfile);
+  if (result.data == NULL ||
+      fread(result.data, 1, (size_t) result.size, outfile) !=
+      (size_t) result.size) {
+    fprintf(stderr, "testenc: can't read back output file\n");
+    exit(EXIT_FAILURE);
+  }
+  fclose(outfile);
+  return result;
+}
+
+
+/* The same with a compression object of its own. */
+
+static jpeg_image
+compress_image (boolean progressive, boolean optimize, int threads,
+		int restart_in_rows)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  jpeg_image result;
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  result = compress_with(&cinfo, progressive, optimize, threads,
+			 restart_in_rows);
+  jpeg_destroy_compress(&cinfo);
+  return result;
+}
+
+
+/* Count a failure unless the two images are the same byte for byte. */
+
+static void
+check_same (jpeg_image output, jpeg_image expected, const char * what)
+{
+  if (output.size != expected.size ||
+      memcmp(output.data, expected.data, (size_t) output.size) != 0) {
+    fprintf(stderr, "testenc: %s: output differs "
+	    "(%ld bytes, expected %ld)\n", what, output.size, expected.size);
+    failures++;
+  }
+  free(output.data);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  jpeg_image reference, progressive_reference, one_thread, file;
+  const char * suffix;
+  int i, ppm_read = 0, references = 0;
+
+  if (argc != 4) {
+    fprintf(stderr, "usage: testenc testimg.jpg testimg.ppm testimgp.jpg\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 1; i < argc; i++) {
+    suffix = strrchr(argv[i], '.');
+    if (suffix != NULL && strcmp(suffix, ".ppm") == 0) {
+      read_ppm(argv[i]);
+      ppm_read++;
+      continue;
+    }
+    file = read_file(argv[i]);
+    if (is_progressive(file)) {
+      progressive_reference = file;
+      references |= 2;
+    } else {
+      reference = file;
+      references |= 1;
+    }
+  }
+  if (ppm_read != 1 || references != 3) {
+    fprintf(stderr, "testenc: need a PPM, a sequential JPEG "
+	    "and a progressive JPEG\n");
+    exit(EXIT_FAILURE);
+  }
+
+  check_same(compress_image(FALSE, FALSE, 1, 0), reference,
+	     "sequential");
+  check_same(compress_image(TRUE, TRUE, 1, 0), progressive_reference,
+	     "progressive");
+  check_same(compress_image(TRUE, TRUE, 4, 0), progressive_reference,
+	     "progressive, 4 threads");
+
+  one_thread = compress_image(FALSE, FALSE, 1, 1);
+  check_same(compress_image(FALSE, FALSE, 4, 1), one_thread,
+	     "sequential with restarts, 4 threads");
+  free(one_thread.data);
+  one_thread = compress_image(FALSE, TRUE, 1, 1);
+  check_same(compress_image(FALSE, TRUE, 4, 1), one_thread,
+	     "optimized with restarts, 4 threads");
+  free(one_thread.data);
+
+  /* The restart spacing chosen for a threaded image must not stay behind
+   * in the object, where it would apply to the next image compressed
+   * without another jpeg_set_defaults.
+   */
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  free(compress_with(&cinfo, FALSE, FALSE, 4, 0).data);
+  if (cinfo.restart_in_rows != 0 || cinfo.restart_interval != 0) {
+    fprintf(stderr, "testenc: threaded image left restart_in_rows %d, "
+	    "restart_interval %u\n", cinfo.restart_in_rows,
+	    cinfo.restart_interval);
+    failures++;
+  }
+  jpeg_destroy_compress(&cinfo);
+
+  free(progressive_reference.data);
+  free(reference.data);
+  free(image);
+  exit(failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  return 0;			/* suppress no-return-value warnings */
+}
@@ -0,0 +1,166 @@
+/*
+ * testindex.c
+ *
+ * This file is part of the OpenCL port of the Independent JPEG Group's
+ * software.  For conditions of distribution and use, see the accompanying
+ * README file.
+ *
+ * This file contains a check of jpeg_read_index against stale indexes.
+ * It builds an entropy index for the baseline image named on the command
+ * line, then offers that index back with the image itself, which must be
+ * accepted, and with two altered copies that stand for another encode of
+ * an image of the same size: one with a different quantization table and
+ * one with shorter entropy-coded data.  Both must be refused.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpeglib.h"
+
+
+static unsigned char * image;	/* the test image, read into memory */
+static size_t image_size;
+
+
+/* Decode a whole image from memory, optionally building an index. */
+
+static void
+decode_image (unsigned char * data, size_t size, FILE * index_file)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  JSAMPARRAY rows;
+  JDIMENSION row;
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  cinfo.cl_disable = TRUE;
+  jpeg_mem_src(&cinfo, data, size);
+  (void) jpeg_read_header(&cinfo, TRUE);
+  cinfo.dct_method = JDCT_FLOAT;
+  if (index_file != NULL)
+    jpeg_build_index(&cinfo, 1, index_file);
+  (void) jpeg_start_decompress(&cinfo);
+  rows = (*cinfo.mem->alloc_sarray)
+    ((j_common_ptr) &cinfo, JPOOL_IMAGE,
+     cinfo.output_width * cinfo.output_components, cinfo.output_height);
+  for (row = 0; row < cinfo.output_height; ) {
+    JDIMENSION n = jpeg_read_scanlines(&cinfo, rows + row,
+				       cinfo.output_height - row);
+    if (n == 0) {
+      fprintf(stderr, "testindex: image ends early\n");
+      exit(EXIT_FAILURE);
+    }
+    row += n;
+  }
+  (void) jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+}
+
+
+/* Offer an index for an image in memory; returns jpeg_read_index's answer. */
+
+static boolean
+index_accepted (unsigned char * data, size_t size, FILE * index_file)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  boolean accepted;
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  cinfo.cl_disable = TRUE;
+  jpeg_mem_src(&cinfo, data, size);
+  (void) jpeg_read_header(&cinfo, TRUE);
+  cinfo.dct_method = JDCT_FLOAT;
+  rewind(index_file);
+  accepted = jpeg_read_index(&cinfo, index_file);
+  jpeg_destroy_decompress(&cinfo);
+  return accepted;
+}
+
+
+/* Find a marker in the image; returns the offset of its 0xFF byte. */
+
+static size_t
+find_marker (int code)
+{
+  size_t pos;
+
+  for (pos = 0; pos + 1 < image_size; pos++) {
+    if (image[pos] == 0xFF && image[pos + 1] == code)
+      return pos;
+  }
+  fprintf(stderr, "testindex: marker 0x%02X not found\n", code);
+  exit(EXIT_FAILURE);
+  return 0;
+}
+
+
+int
+main (int argc, char **argv)
+{
+  FILE * input_file;
+  FILE * index_file;
+  unsigned char * stale;
+  size_t pos, eoi;
+  long length;
+  int failures = 0;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: testindex baseline.jpg\n");
+    exit(EXIT_FAILURE);
+  }
+  if ((input_file = fopen(argv[1], "rb")) == NULL ||
+      fseek(input_file, 0L, SEEK_END) != 0 ||
+      (length = ftell(input_file)) <= 0) {
+    fprintf(stderr, "testindex: can't read %s\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+  image_size = (size_t) length;
+  image = (unsigned char *) malloc(image_size);
+  stale = (unsigned char *) malloc(image_size);
+  rewind(input_file);
+  if (image == NULL || stale == NULL ||
+      fread(image, 1, image_size, input_file) != image_size) {
+    fprintf(stderr, "testindex: can't read %s\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+  fclose(input_file);
+  if ((index_file = tmpfile()) == NULL) {
+    fprintf(stderr, "testindex: can't create index file\n");
+    exit(EXIT_FAILURE);
+  }
+
+  decode_image(image, image_size, index_file);
+
+  if (! index_accepted(image, image_size, index_file)) {
+    fprintf(stderr, "testindex: index refused for its own image\n");
+    failures++;
+  }
+
+  /* Same image with one quantization table entry changed. */
+  memcpy(stale, image, image_size);
+  pos = find_marker(0xDB) + 5;	/* first entry of the first DQT table */
+  stale[pos] = (unsigned char) (stale[pos] == 1 ? 2 : stale[pos] - 1);
+  if (index_accepted(stale, image_size, index_file)) {
+    fprintf(stderr, "testindex: index accepted with other tables\n");
+    failures++;
+  }
+
+  /* Same image with a few bytes cut from the end of the entropy data. */
+  eoi = find_marker(0xD9);
+  memcpy(stale, image, eoi - 4);
+  memcpy(stale + eoi - 4, image + eoi, image_size - eoi);
+  if (index_accepted(stale, image_size - 4, index_file)) {
+    fprintf(stderr, "testindex: index accepted with shorter scan\n");
+    failures++;
+  }
+
+  fclose(index_file);
+  free(stale);
+  free(image);
+  exit(failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  return 0;			/* suppress no-return-value warnings */
+}
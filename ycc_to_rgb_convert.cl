@@ -11,11 +11,19 @@ struct ConverterInfo
 };
 #define RIGHT_SHIFT(x,shft)	((x) >> (shft))
 #define SCALEBITS	16	/* speediest right-shift on some machines */
+// Global (output_height, output_width): the rows and columns wanted, which
+// are the region of interest when one is set.  The input planes are the
+// whole upsampled image, in_pitch wide and plane_size apart; (x0, y0) is the
+// region's corner in them.
 __kernel
 void convert(
                 __global struct ConverterInfo * convInfo,
                 __global JSAMPLE * input_buf,
-                __global JSAMPLE * output_buf)
+                __global JSAMPLE * output_buf,
+                unsigned int in_pitch,
+                unsigned int plane_size,
+                unsigned int x0,
+                unsigned int y0)
 {
   int y,cb,cr;
   __global JSAMPLE * inptr0;
@@ -30,16 +38,14 @@ void convert(
   int yoffset = get_global_id(0);
   int col = get_global_id(1);
   int width = get_global_size(1);
-  int height = get_global_size(0);
-  int component_image_size = width * height;
   float3 outputv1 = (float3)(1.0f,0.0f,1.40200f);
   float3 outputv2 = (float3)(1.0f,-0.34414,-0.71414);
   float3 outputv3 = (float3)(1.0f,1.77200f,0.0f);
   float3 components;
 
-  inptr0 = input_buf + yoffset * width + col;
-  inptr1 = inptr0 + component_image_size;
-  inptr2 = inptr1 + component_image_size;
+  inptr0 = input_buf + (yoffset + y0) * in_pitch + col + x0;
+  inptr1 = inptr0 + plane_size;
+  inptr2 = inptr1 + plane_size;
   
   components.x  = convert_float((inptr0[0]) & 0xff);
   components.y = convert_float(((inptr1[0]) & 0xff) - CENTERJSAMPLE);
@@ -49,3 +55,40 @@ void convert(
   outptr[1] = range_limit[convert_int(dot(components,outputv2))];
   outptr[2] = range_limit[convert_int(dot(components,outputv3))] ;
 }
+
+// Batched variant: global (output_height, output_width, images).
+// Uses the same integer tables as the CPU converter in jdcolor.c.
+// Cb and Cr planes of one image are adjacent, c_plane_size apart.
+__kernel
+void convert_batch(
+                __global struct ConverterInfo * convInfo,
+                __global JSAMPLE * y_buf,
+                unsigned int y_offset,
+                unsigned int y_pitch,
+                unsigned int y_image_stride,
+                __global JSAMPLE * c_buf,
+                unsigned int c_offset,
+                unsigned int c_pitch,
+                unsigned int c_plane_size,
+                unsigned int c_image_stride,
+                __global JSAMPLE * output_buf,
+                unsigned int out_image_stride)
+{
+  int y,cb,cr;
+  __global JSAMPLE * cbptr;
+  __global JSAMPLE * outptr;
+  __global JSAMPLE * range_limit = convInfo->sample_range_limit + (MAXJSAMPLE+1);
+  int yoffset = get_global_id(0);
+  int col = get_global_id(1);
+  int width = get_global_size(1);
+  int image = get_global_id(2);
+
+  y = y_buf[y_offset + image * y_image_stride + yoffset * y_pitch + col] & 0xff;
+  cbptr = c_buf + c_offset + image * c_image_stride + yoffset * c_pitch + col;
+  cb = cbptr[0] & 0xff;
+  cr = cbptr[c_plane_size] & 0xff;
+  outptr = output_buf + image * out_image_stride + (yoffset * width + col) * 3;
+  outptr[0] = range_limit[y + convInfo->Cr_r_tab[cr]];
+  outptr[1] = range_limit[y + RIGHT_SHIFT(convInfo->Cb_g_tab[cb] + convInfo->Cr_g_tab[cr], SCALEBITS)];
+  outptr[2] = range_limit[y + convInfo->Cb_b_tab[cb]];
+}